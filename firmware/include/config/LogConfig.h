@@ -0,0 +1,81 @@
+#ifndef LOG_CONFIG_H
+#define LOG_CONFIG_H
+
+// Log levels (a message is compiled in if its level <= the module's level)
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+// Default for every module; override per module with e.g. -DLOG_LEVEL_SCHEDULE_STORE=LOG_LEVEL_DEBUG
+#ifndef LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_DEFAULT LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_LEVEL_MAIN
+#define LOG_LEVEL_MAIN LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_WIFI_MANAGER
+#define LOG_LEVEL_WIFI_MANAGER LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_WEB_SERVER
+#define LOG_LEVEL_WEB_SERVER LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_API_ROUTER
+#define LOG_LEVEL_API_ROUTER LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_RESPONSE_CACHE
+#define LOG_LEVEL_RESPONSE_CACHE LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_STORAGE_WORKER
+#define LOG_LEVEL_STORAGE_WORKER LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_MDNS
+#define LOG_LEVEL_MDNS LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_WEBSOCKET
+#define LOG_LEVEL_WEBSOCKET LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_TELEMETRY
+#define LOG_LEVEL_TELEMETRY LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_DOSE_WORKER_POOL
+#define LOG_LEVEL_DOSE_WORKER_POOL LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_SCHEDULER_TASK
+#define LOG_LEVEL_SCHEDULER_TASK LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_SCHEDULE_MANAGER
+#define LOG_LEVEL_SCHEDULE_MANAGER LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_SCHEDULE_STORE
+#define LOG_LEVEL_SCHEDULE_STORE LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_CONFIG_TRANSACTION
+#define LOG_LEVEL_CONFIG_TRANSACTION LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_DOSING_LOG
+#define LOG_LEVEL_DOSING_LOG LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_FLASH_WRITER
+#define LOG_LEVEL_FLASH_WRITER LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_POWER_MANAGER
+#define LOG_LEVEL_POWER_MANAGER LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_METRICS
+#define LOG_LEVEL_METRICS LOG_LEVEL_DEFAULT
+#endif
+
+// Ring buffer
+#define LOG_RING_SLOTS 64        // Pending messages (power of 2); further messages are dropped
+#define LOG_MAX_ARGS 6           // Format arguments per message (extra arguments are ignored)
+#define LOG_STRING_SPACE 96      // Bytes for copies of %s arguments per message (longer ones are truncated and counted)
+#define LOG_LINE_SIZE 192        // Longest formatted line
+
+// Drain task
+#define LOG_TASK_STACK_SIZE 3072
+#define LOG_TASK_PRIORITY 1      // Lowest application priority: logging never delays real work
+
+#endif // LOG_CONFIG_H
@@ -5,10 +5,16 @@
 #include <WiFi.h>
 
 // WiFi STA Mode Configuration
-#define WIFI_STA_TIMEOUT_MS 20000
+#define WIFI_STA_TIMEOUT_MS 20000         // Joining from AP mode or boot falls back to AP after this
 #define WIFI_STA_RETRY_INTERVAL_MS 60000
-#define WIFI_STA_FAIL_THRESHOLD_MS 60000
-#define WIFI_CHECK_INTERVAL_MS 10000
+#define WIFI_STA_FAIL_THRESHOLD_MS 60000  // A lost link that stays down this long falls back to AP
+#define WIFI_CHECK_INTERVAL_MS 10000      // Status log and backstop check (events drive everything else)
+#define WIFI_SWITCH_DELAY_MS 500          // Requested mode changes wait this long so the HTTP response is sent first
+#define WIFI_ATTEMPT_TIMEOUT_MS 10000     // A join attempt with no result after this counts as failed
+#define WIFI_BACKOFF_INITIAL_MS 500       // Delay before the second reconnect attempt (the first is immediate)
+#define WIFI_BACKOFF_MAX_MS 16000         // Backoff doubles per failed attempt up to this
+#define WIFI_EVENT_QUEUE_DEPTH 8          // WiFi driver events and mode requests waiting for the WiFi task
+#define WIFI_AP_HANDOFF_MS 30000          // Joining from AP mode keeps the AP up until STA has been connected this long
 
 // WiFi AP Mode Configuration
 #define AP_SSID_PREFIX "SquareDose-"
@@ -21,10 +27,91 @@
 #define NVS_NAMESPACE "wifi_config"
 #define NVS_SSID_KEY "ssid"
 #define NVS_PASSWORD_KEY "password"
+#define NVS_LINK_CACHE_KEY "linkcache"   // BSSID, channel and lease of the last good connection
+
+// Fast reconnect: join the cached BSSID on its channel (no scan), full scan if that fails
+#define WIFI_LINK_CACHE_VERSION 1
+#define WIFI_STATIC_IP_FROM_CACHE 0      // 1 = also reuse the cached lease as a static IP (skips DHCP;
+                                         // only safe if the router reserves that address)
+
+// Power profiles (0 performance, 1 balanced, 2 low-power; selected with POST /api/power, stored in NVS)
+#define POWER_DEFAULT_PROFILE 1
+#define POWER_NVS_NAMESPACE "power"
+#define POWER_NVS_PROFILE_KEY "profile"
+
+// Per profile: STA modem sleep, listen interval (beacons, WIFI_PS_MAX_MODEM only; 0 = driver default),
+// CPU frequency bounds for DFS, automatic light sleep, and the board current used for the estimate
+// (idle = no PM lock held, active = dosing or serving a request; motor current not included)
+#define POWER_PERFORMANCE_PS WIFI_PS_NONE
+#define POWER_PERFORMANCE_LISTEN_INTERVAL 0
+#define POWER_PERFORMANCE_MAX_MHZ 240
+#define POWER_PERFORMANCE_MIN_MHZ 240
+#define POWER_PERFORMANCE_LIGHT_SLEEP false
+#define POWER_PERFORMANCE_IDLE_MA 95
+#define POWER_PERFORMANCE_ACTIVE_MA 120
+
+#define POWER_BALANCED_PS WIFI_PS_MIN_MODEM
+#define POWER_BALANCED_LISTEN_INTERVAL 0
+#define POWER_BALANCED_MAX_MHZ 240
+#define POWER_BALANCED_MIN_MHZ 80
+#define POWER_BALANCED_LIGHT_SLEEP false
+#define POWER_BALANCED_IDLE_MA 35
+#define POWER_BALANCED_ACTIVE_MA 110
+
+#define POWER_LOW_POWER_PS WIFI_PS_MAX_MODEM
+#define POWER_LOW_POWER_LISTEN_INTERVAL 10
+#define POWER_LOW_POWER_MAX_MHZ 160
+#define POWER_LOW_POWER_MIN_MHZ 40
+#define POWER_LOW_POWER_LIGHT_SLEEP true   // Needs a core built with CONFIG_PM_ENABLE and tickless idle
+#define POWER_LOW_POWER_IDLE_MA 8
+#define POWER_LOW_POWER_ACTIVE_MA 90
+
+// mDNS / DNS-SD advertisement (_squaredose._tcp)
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "1.0.0"       // Advertised in the fw TXT record (override with -DFIRMWARE_VERSION)
+#endif
+#define MDNS_SERVICE "squaredose"
+#define MDNS_PROTOCOL "tcp"
+#define MDNS_HOSTNAME_PREFIX "squaredose-"  // + device ID, e.g. squaredose-a1b2.local
+#define MDNS_INSTANCE_PREFIX "SquareDose "  // + device ID, shown by DNS-SD browsers
+#define MDNS_TXT_MIN_INTERVAL_MS 1000       // Status TXT changes are announced at most this often
+
+// Web Server Request Limits
+#define WEB_MAX_REQUEST_BODY_SIZE 2048   // Larger POST bodies are rejected with 413 (sized for /api/batch)
+#define WEB_JSON_ARENA_SIZE 8192         // Per-request ArduinoJson arena (request + response documents)
+#define WEB_BODY_BUFFER_COUNT 4          // POST bodies that can be reassembled at the same time
+#define WEB_BATCH_MAX_OPERATIONS 16      // Operations accepted by one POST /api/batch
+#define WEB_BATCH_OP_SIZE 16             // Longest operation name plus terminator
+
+// HTTP caching
+#define WEB_ETAG_SIZE 64                                  // Quoted ETag, e.g. "logs-1a2b3c4d-7-67890000-678a0e0f"
+#define WEB_CACHE_CONTROL_VERSIONED "no-cache"            // ETag resources: clients may keep them but must revalidate
+#define WEB_CACHE_CONTROL_DYNAMIC "no-store"              // Everything else changes on every request
+
+// Storage worker (requests that read or write NVS run on this task; AsyncTCP sends the result)
+#define WEB_STORAGE_QUEUE_DEPTH 4        // Requests waiting for the worker; further ones get 503
+#define WEB_STORAGE_RESPONSE_SLOTS 6     // HTTP results being built or sent; further requests get 503
+#define WEB_RPC_ID_SIZE 32               // Longest WebSocket RPC id (as JSON) carried to the worker
+
+// WebSocket Telemetry
+#define WS_TELEMETRY_WINDOW_MS 100       // Changes inside one window are pushed as a single message
+#define WS_PROGRESS_INTERVAL_MS 500      // Minimum time between dose progress updates per head
+#define WS_TELEMETRY_ARENA_SIZE 4096     // ArduinoJson arena for snapshot/state messages
+
+// WebSocket Sessions (per-client send queue bound is WS_MAX_QUEUED_MESSAGES in platformio.ini)
+#define WS_MAX_CLIENTS 4                 // Further connections are closed with 1013 (try again later)
+#define WS_PING_INTERVAL_MS 15000        // Ping clients that have been quiet this long
+#define WS_CLIENT_TIMEOUT_MS 45000       // Close clients with no pong or data for this long
+#define WS_MAINTENANCE_INTERVAL_MS 1000  // How often ping/timeout/cleanupClients run
 
 // FreeRTOS Task Configuration
 #define WIFI_TASK_STACK_SIZE 5000
 #define WIFI_TASK_PRIORITY 1
 #define WIFI_TASK_CORE CONFIG_ARDUINO_RUNNING_CORE
+#define WS_TELEMETRY_STACK_SIZE 4096
+#define WS_TELEMETRY_PRIORITY 1
+#define WEB_STORAGE_STACK_SIZE 10240     // Hourly log queries keep up to 336 rows on the stack
+#define WEB_STORAGE_ARENA_SIZE 36864     // Worker ArduinoJson arena: 336 hourly log rows at ~96 bytes each, plus pool overhead
+#define WEB_STORAGE_PRIORITY 2           // Below AsyncTCP (3), above the housekeeping tasks
 
 #endif
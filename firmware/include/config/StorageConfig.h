@@ -0,0 +1,22 @@
+#ifndef STORAGE_CONFIG_H
+#define STORAGE_CONFIG_H
+
+// Flash commit queue (one entry per distinct pending key; rewrites of a pending key replace it)
+#define FLASH_QUEUE_SLOTS 24           // Pending writes, removes and clears (a full batch is 10)
+#define FLASH_LARGE_SLOTS 2            // Of which can hold a value up to FLASH_LARGE_VALUE_SIZE
+#define FLASH_VALUE_SIZE 96            // Schedules, calibration blobs, log entries, WiFi strings
+#define FLASH_LARGE_VALUE_SIZE 768     // Configuration journal
+#define FLASH_QUEUE_FULL_WAIT_MS 200   // A writer waits this long for a free slot before failing
+
+// A failed commit stays queued and is retried after FLASH_RETRY_DELAY_MS, doubling each time
+#define FLASH_COMMIT_ATTEMPTS 5
+#define FLASH_RETRY_DELAY_MS 100
+
+// Commits are held back while a motor runs (flash erase stalls both cores), but never longer than this
+#define FLASH_MAX_HOLD_MS 30000
+
+// Writer task
+#define FLASH_WRITER_STACK_SIZE 4096
+#define FLASH_WRITER_PRIORITY 1        // Lowest application priority: callers never wait for flash
+
+#endif // STORAGE_CONFIG_H
@@ -0,0 +1,213 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "config/LogConfig.h"
+
+/**
+ * @brief Declare the tag and compile-time level of the logging module in a .cpp file
+ * e.g. LOG_MODULE("ScheduleStore", LOG_LEVEL_SCHEDULE_STORE);
+ */
+#define LOG_MODULE(tag, level) \
+    static const char* const LOG_MODULE_TAG = tag; \
+    static const uint8_t LOG_MODULE_LEVEL = level
+
+// The level test is a compile-time constant, so filtered messages (including
+// their arguments) are removed by the compiler
+#define LOG_AT(level, format, ...) \
+    do { \
+        if ((level) <= LOG_MODULE_LEVEL) { \
+            Log::write((level), LOG_MODULE_TAG, format, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_ERROR(format, ...) LOG_AT(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...)  LOG_AT(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...)  LOG_AT(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG_AT(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+
+/**
+ * @brief One message waiting to be formatted
+ *
+ * Holds the format string pointer (must be a literal) and the raw argument
+ * values. %s arguments are copied into strings[], so temporaries such as
+ * String::c_str() may be logged. The copies share LOG_STRING_SPACE bytes;
+ * one that does not fit is truncated and counted (squaredose_log_truncated_total).
+ */
+struct LogRecord {
+    enum ArgType : uint8_t {
+        SIGNED32,
+        SIGNED64,
+        UNSIGNED32,
+        UNSIGNED64,
+        DOUBLE,
+        STRING  // value.u is the offset into strings[]
+    };
+
+    union ArgValue {
+        int64_t i;
+        uint64_t u;
+        double f;
+    };
+
+    const char* tag;
+    const char* format;
+    uint8_t level;
+    uint8_t argCount;
+    uint8_t stringUsed;
+    uint8_t argTypes[LOG_MAX_ARGS];
+    ArgValue args[LOG_MAX_ARGS];
+    char strings[LOG_STRING_SPACE];
+
+    void begin(uint8_t messageLevel, const char* messageTag, const char* messageFormat) {
+        tag = messageTag;
+        format = messageFormat;
+        level = messageLevel;
+        argCount = 0;
+        stringUsed = 0;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type add(T value) {
+        typedef typename std::conditional<std::is_enum<T>::value, int, T>::type Integer;
+        if (argCount >= LOG_MAX_ARGS) {
+            return;
+        }
+        if (std::is_signed<Integer>::value) {
+            argTypes[argCount] = (sizeof(Integer) > 4) ? SIGNED64 : SIGNED32;
+            args[argCount++].i = static_cast<int64_t>(value);
+        } else {
+            argTypes[argCount] = (sizeof(Integer) > 4) ? UNSIGNED64 : UNSIGNED32;
+            args[argCount++].u = static_cast<uint64_t>(value);
+        }
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type add(T value) {
+        if (argCount < LOG_MAX_ARGS) {
+            argTypes[argCount] = DOUBLE;
+            args[argCount++].f = static_cast<double>(value);
+        }
+    }
+
+    template <typename T>
+    void add(const T* pointer) {
+        if (argCount < LOG_MAX_ARGS) {
+            argTypes[argCount] = (sizeof(uintptr_t) > 4) ? UNSIGNED64 : UNSIGNED32;
+            args[argCount++].u = reinterpret_cast<uintptr_t>(pointer);
+        }
+    }
+
+    void add(const char* text);
+    void add(const String& text) { add(text.c_str()); }
+};
+
+/**
+ * @brief Asynchronous, lock-free logging
+ *
+ * LOG_* calls never touch the UART: they store the format pointer and
+ * arguments in a fixed ring of records (a bounded multi-producer queue with
+ * per-slot sequence numbers, no locks) and return. A low-priority drain task
+ * formats the records and writes them to Serial, so only the drain task ever
+ * blocks on a slow console. When the ring is full the message is dropped and
+ * counted; the drain task reports how many were lost.
+ *
+ * Messages are printed as "[Tag] message" in the order they were queued.
+ *
+ * Thread-safety: write() may be called from any task (not from ISRs).
+ */
+class Log {
+public:
+    /**
+     * @brief Start the drain task (messages logged before this are kept until it runs)
+     * @return true if the task started
+     */
+    static bool begin();
+
+    /**
+     * @brief Queue a message (use the LOG_* macros)
+     * @param level LOG_LEVEL_*
+     * @param tag Module tag
+     * @param format printf-style format string literal
+     * @param args Integers, enums, floats, pointers, C strings or Strings
+     */
+    template <typename... Args>
+    static void write(uint8_t level, const char* tag, const char* format, const Args&... args) {
+        LogRecord record;
+        record.begin(level, tag, format);
+        int expand[] = {0, (record.add(args), 0)...};
+        (void)expand;
+        push(record);
+    }
+
+    /**
+     * @brief Wait until every queued message has been written (e.g. before a restart)
+     * @param timeoutMs Maximum time to wait
+     * @return true if the ring drained in time
+     */
+    static bool flush(uint32_t timeoutMs);
+
+    /**
+     * @brief Get number of messages dropped because the ring was full
+     * @return Drop count
+     */
+    static uint32_t getDroppedCount();
+
+    /**
+     * @brief Get number of %s arguments cut short because LOG_STRING_SPACE ran out
+     * @return Truncation count
+     */
+    static uint32_t getTruncatedCount();
+
+private:
+    friend struct LogRecord;
+
+    struct Slot {
+        // Sequence number minus the slot index, so the zero-initialized ring is
+        // valid before begin(): equals position - index when the slot is free
+        // for that position, position - index + 1 once it has been filled
+        std::atomic<uint32_t> sequence;
+        LogRecord record;
+    };
+
+    static Slot ring[LOG_RING_SLOTS];
+    static std::atomic<uint32_t> enqueuePos;
+    static std::atomic<uint32_t> dequeuePos;
+    static std::atomic<uint32_t> droppedCount;
+    static std::atomic<uint32_t> truncatedCount;
+    static std::atomic<TaskHandle_t> drainTask;
+
+    // Drain task storage and line buffer
+    static StackType_t taskStack[LOG_TASK_STACK_SIZE];
+    static StaticTask_t taskBuffer;
+    static char line[LOG_LINE_SIZE];
+
+    /**
+     * @brief Copy a record into the next free slot
+     * @param record Record to queue
+     */
+    static void push(const LogRecord& record);
+
+    /**
+     * @brief Format and write one queued record (drain task only)
+     * @return false if the ring is empty
+     */
+    static bool drainOne();
+
+    /**
+     * @brief Expand a record's format string with its stored arguments
+     * @param record Record
+     * @param out Output buffer
+     * @param size Output buffer size
+     * @return Length of the formatted line
+     */
+    static size_t format(const LogRecord& record, char* out, size_t size);
+
+    static void taskFunction(void* parameters);
+};
+
+#endif // LOG_H
@@ -0,0 +1,136 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "config/HardwareConfig.h"
+
+#define METRICS_MAX_TASKS 12  // Tasks whose stack high-water mark is reported
+
+/**
+ * @brief NVS users counted separately in squaredose_flash_writes_total
+ */
+enum class FlashSubsystem : uint8_t {
+    SCHEDULES,
+    LOGS,
+    CALIBRATION,
+    WIFI,
+    JOURNAL,
+    POWER,
+    COUNT
+};
+
+/**
+ * @brief Firmware-wide counters for GET /metrics
+ *
+ * Counters are plain atomics updated on the hot paths (one relaxed
+ * fetch_add, no locks), so recording is safe from any task. write() renders
+ * them together with sampled gauges (heap, task stacks, NVS usage) in the
+ * Prometheus text format. Counters reset on reboot; Prometheus treats that as
+ * a counter reset.
+ *
+ * Thread-safety: All methods may be called from any task.
+ */
+class Metrics {
+public:
+    /**
+     * @brief Count one NVS write, remove or clear
+     * @param subsystem Owner of the namespace
+     */
+    static void recordFlashWrite(FlashSubsystem subsystem);
+
+    /**
+     * @brief Count a finished dose
+     * @param head Dosing head index
+     * @param adhoc true for REST/WebSocket doses, false for scheduled ones
+     * @param success Whether the dose completed
+     * @param volumeMl Estimated volume dispensed
+     */
+    static void recordDose(uint8_t head, bool adhoc, bool success, float volumeMl);
+
+    /**
+     * @brief Count a lost STA connection
+     * @param reason Disconnect reason reported by the WiFi driver
+     */
+    static void recordWifiDisconnect(uint8_t reason);
+
+    /**
+     * @brief Count a successful STA reconnection
+     * @param durationMs Time from losing the link to getting an IP again
+     */
+    static void recordWifiReconnect(uint32_t durationMs);
+
+    /**
+     * @brief Count a STA connection made from AP mode or at boot
+     * @param durationMs Time from starting to join to getting an IP
+     */
+    static void recordWifiConnect(uint32_t durationMs);
+
+    /**
+     * @brief Count one WiFi.begin() attempt
+     * @param cached true if it used the cached BSSID/channel, false for a full scan
+     */
+    static void recordWifiConnectAttempt(bool cached);
+
+    /**
+     * @brief Record when the device first became reachable (STA got an IP or AP started)
+     * @param uptimeMs millis() at that point; later calls are ignored
+     */
+    static void recordWifiReachable(uint32_t uptimeMs);
+
+    /**
+     * @brief Report a task's stack high-water mark (call once, after creating it)
+     * @param task Task handle (ignored if nullptr or the table is full)
+     */
+    static void registerTask(TaskHandle_t task);
+
+    /**
+     * @brief Stop reporting a task (call before deleting it); its slot is reused
+     * @param task Task handle
+     */
+    static void unregisterTask(TaskHandle_t task);
+
+    /**
+     * @brief Write all firmware metrics in Prometheus text format
+     * @param out Destination (e.g. an AsyncResponseStream)
+     */
+    static void write(Print& out);
+
+    /**
+     * @brief Write the # HELP and # TYPE lines of a metric
+     * @param out Destination
+     * @param name Metric name
+     * @param type "counter", "gauge" or "summary"
+     * @param help Description
+     */
+    static void writeHeader(Print& out, const char* name, const char* type, const char* help);
+
+    /**
+     * @brief Write a metric with a single unlabelled sample
+     */
+    static void writeMetric(Print& out, const char* name, const char* type, const char* help, uint32_t value);
+    static void writeMetric(Print& out, const char* name, const char* type, const char* help, int32_t value);
+
+private:
+    static std::atomic<uint32_t> flashWrites[static_cast<uint8_t>(FlashSubsystem::COUNT)];
+    static std::atomic<uint32_t> doses[NUM_MOTORS][2];          // [head][adhoc]
+    static std::atomic<uint32_t> doseFailures[NUM_MOTORS][2];
+    static std::atomic<uint32_t> dosedMicroliters[NUM_MOTORS][2];
+    static std::atomic<uint32_t> wifiDisconnects;
+    static std::atomic<uint32_t> wifiReconnects;
+    static std::atomic<uint32_t> wifiReconnectTimeMs;     // Sum
+    static std::atomic<uint32_t> wifiMaxReconnectTimeMs;
+    static std::atomic<uint32_t> wifiConnects;
+    static std::atomic<uint32_t> wifiConnectTimeMs;       // Sum
+    static std::atomic<uint32_t> wifiMaxConnectTimeMs;
+    static std::atomic<uint32_t> wifiConnectAttempts[2];      // [cached]
+    static std::atomic<uint32_t> wifiBootToReachableMs;       // 0 until reachable
+    static std::atomic<uint8_t> wifiLastDisconnectReason;
+
+    // nullptr marks a free slot; registerTask() claims one with compare_exchange
+    static std::atomic<TaskHandle_t> tasks[METRICS_MAX_TASKS];
+};
+
+#endif // METRICS_H
@@ -2,26 +2,65 @@
 #define DOSING_HEAD_H
 
 #include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "hal/MotorDriver.h"
 
+#define MAX_CALIBRATION_POINTS 8
+
+/**
+ * @brief One calibration measurement: motor ran for runtimeMs and dispensed volumeMl
+ */
+struct CalibrationPoint {
+    uint32_t runtimeMs;
+    float volumeMl;
+};
+
 /**
  * @brief Calibration data for a dosing head
+ *
+ * Volume model: volume = offsetMl + mlPerSecond * seconds
+ * A negative offset is the spin-up/spin-down dead volume of the pump
  */
 struct CalibrationData {
     float mlPerSecond;                  // Milliliters dispensed per second at full speed
+    float offsetMl;                     // Volume intercept of the fit (0 for single-point calibration)
+    uint8_t pointCount;                 // Number of points used in the last fit
     bool isCalibrated;                  // Whether this head has been calibrated
     unsigned long lastCalibrationTime;  // Timestamp of last calibration
 };
 
+/**
+ * @brief A complete calibration state, computed but not yet applied
+ * Lets callers validate several calibrations before committing any of them
+ */
+struct CalibrationUpdate {
+    CalibrationData data;
+    CalibrationPoint points[MAX_CALIBRATION_POINTS];
+};
+
+/**
+ * @brief Progress of a run in progress
+ */
+struct DoseProgress {
+    bool active;            // true while the motor is running for a dose
+    uint32_t elapsedMs;     // Time since the motor started
+    uint32_t targetMs;      // Planned runtime
+    float estimatedVolume;  // Volume pumped so far (mL)
+};
+
 /**
  * @brief Dosing operation result
  */
 struct DosingResult {
     bool success;
-    uint32_t actualRuntime;   // Actual motor runtime in milliseconds
+    uint32_t actualRuntime;   // Actual motor runtime in milliseconds (on-time up to the stop)
     float targetVolume;       // Target volume in mL
     float estimatedVolume;    // Estimated volume dispensed based on calibration
     String errorMessage;
+    bool cancelled;           // Stopped early by stopDispensing()/cancelDispensing()
+    uint32_t cancelLatencyUs; // Time from cancel request until the dose returned (0 if not cancelled)
 };
 
 /**
@@ -32,7 +71,9 @@ struct DosingResult {
  * - Calibration procedure and storage
  * - Dose tracking and statistics
  *
- * Thread-safety: Not thread-safe. Use mutexes if calling from multiple FreeRTOS tasks.
+ * Thread-safety: dispense()/runForDuration() must only run on one task at a time
+ * (DoseWorkerPool guarantees this). stopDispensing()/cancelDispensing() may be
+ * called from any task to interrupt an in-flight dose.
  */
 class DosingHead {
 public:
@@ -52,17 +93,36 @@ public:
 
     /**
      * @brief Dispense a specific volume of liquid
-     * Blocks until dispensing is complete
+     * Blocks until dispensing is complete or cancelled
      * @param volumeMl Volume to dispense in milliliters
-     * @return DosingResult with operation details
+     * @param stopEpoch Optional counter bumped by an emergency stop (DoseWorkerPool's epoch)
+     * @param jobEpoch Value of stopEpoch the dose was accepted under; if it has
+     *        changed by the time the motor is about to start, or right after
+     *        it started, the dose is cancelled
+     * @return DosingResult with operation details (partial volume if cancelled)
      */
-    DosingResult dispense(float volumeMl);
+    DosingResult dispense(float volumeMl, const std::atomic<uint32_t>* stopEpoch = nullptr, uint32_t jobEpoch = 0);
 
     /**
      * @brief Stop dispensing immediately
+     * Stops the motor, then wakes the dispensing task so it reports the partial volume
      */
     void stopDispensing();
 
+    /**
+     * @brief Wake an in-flight dose whose motor was already stopped elsewhere
+     * Used after MotorDriver::emergencyStopAll(); the on-time recorded by the
+     * motor driver at the moment of the stop is used for the partial volume
+     * @return true if a dose was in flight
+     */
+    bool cancelDispensing();
+
+    /**
+     * @brief Get the cancellation latency of the last cancelled dose
+     * @return Microseconds from cancel request until dispense() returned, or 0
+     */
+    uint32_t getLastCancelLatencyUs() const;
+
     /**
      * @brief Calibrate the dosing head
      * System doses 4mL (using current calibration), user measures actual volume
@@ -72,12 +132,46 @@ public:
      */
     bool calibrate(float actualVolumeMl);
 
+    /**
+     * @brief Calibrate the dosing head from several measured runs
+     * Fits volume = offset + rate * time by least squares, so short doses
+     * account for pump spin-up/spin-down dead volume
+     * @param points Measured (runtime, volume) pairs, at least 2 distinct runtimes
+     * @param count Number of points (max MAX_CALIBRATION_POINTS)
+     * @return true if calibration successful
+     */
+    bool calibrate(const CalibrationPoint* points, uint8_t count);
+
+    /**
+     * @brief Compute a single-point calibration without applying it
+     * @param actualVolumeMl Volume measured after the standard calibration dose
+     * @param update Output calibration state
+     * @return true if the resulting calibration is plausible
+     */
+    bool computeCalibration(float actualVolumeMl, CalibrationUpdate& update) const;
+
+    /**
+     * @brief Compute a multi-point calibration without applying it
+     * @param points Measured (runtime, volume) pairs, at least 2 distinct runtimes
+     * @param count Number of points (max MAX_CALIBRATION_POINTS)
+     * @param update Output calibration state
+     * @return true if the fit is plausible
+     */
+    bool computeCalibration(const CalibrationPoint* points, uint8_t count, CalibrationUpdate& update) const;
+
+    /**
+     * @brief Apply a computed calibration and persist it
+     * @param update Calibration state from computeCalibration()
+     * @return true if applied and saved
+     */
+    bool applyCalibration(const CalibrationUpdate& update);
+
     /**
      * @brief Run motor for a specific duration (for manual calibration)
      * Use this to run a calibration dose, then measure the actual volume
      * and call calibrate() with the measured volume
      * @param durationMs How long to run the motor in milliseconds
-     * @return Actual runtime in milliseconds
+     * @return Actual runtime in milliseconds (shorter if cancelled)
      */
     uint32_t runForDuration(uint32_t durationMs);
 
@@ -87,6 +181,12 @@ public:
      */
     bool isDispensing() const;
 
+    /**
+     * @brief Get progress of the run in progress (dose or timed run)
+     * @return Progress snapshot; active is false when idle
+     */
+    DoseProgress getDoseProgress() const;
+
     /**
      * @brief Get calibration data for this head
      * @return CalibrationData structure
@@ -99,6 +199,12 @@ public:
      */
     bool isCalibrated() const;
 
+    /**
+     * @brief Get a counter that increases whenever calibration data changes
+     * @return Calibration version
+     */
+    uint32_t getCalibrationVersion() const;
+
     /**
      * @brief Get the head index
      * @return Head index (0-3)
@@ -137,17 +243,78 @@ public:
     float estimateVolume(uint32_t runtimeMs) const;
 
 private:
+    /**
+     * @brief Calibration model precomputed for the dosing hot path
+     * Rebuilt whenever calibration changes so calculateRuntime/estimateVolume
+     * are a single multiply-add with no division
+     */
+    struct CalibrationCurve {
+        float msPerMl;     // 1000 / mlPerSecond
+        float deadTimeMs;  // Runtime that dispenses zero volume (-offsetMl * msPerMl)
+        float mlPerMs;     // mlPerSecond / 1000
+        float offsetMl;
+        bool valid;
+    };
+
     uint8_t headIndex;
     MotorDriver* motor;
     CalibrationData calibration;
+    CalibrationPoint calibrationPoints[MAX_CALIBRATION_POINTS];
+    CalibrationCurve curve;
+    std::atomic<uint32_t> calibrationVersion;  // Bumped by rebuildCurve()
     bool initialized;
 
+    // Cancellation of in-flight doses
+    SemaphoreHandle_t cancelSignal;
+    StaticSemaphore_t cancelSignalBuffer;
+    std::atomic<bool> dispensing;
+    std::atomic<uint32_t> cancelRequestedUs;
+    std::atomic<uint32_t> lastCancelLatencyUs;
+
+    // Progress of the run in progress (read by telemetry)
+    std::atomic<uint32_t> runStartMs;
+    std::atomic<uint32_t> runTargetMs;
+
     // Volume and runtime limits
     static constexpr float MIN_VOLUME_ML = 0.1;      // Minimum volume: 0.1 mL
     static constexpr float MAX_VOLUME_ML = 1000.0;   // Maximum volume: 1 liter
     static constexpr uint32_t MIN_RUNTIME_MS = 100;  // Minimum runtime: 100ms
     static constexpr uint32_t MAX_RUNTIME_MS = 300000; // Maximum runtime: 5 minutes
 
+    // Calibration fit sanity limits
+    static constexpr float MAX_ML_PER_SECOND = 100.0f;
+    static constexpr float MAX_OFFSET_ML = 5.0f;     // Largest plausible dead volume
+
+    /**
+     * @brief Run the motor for a duration, waking early on cancellation
+     * @param durationMs Requested runtime
+     * @param cancelled Output: true if the run was cancelled
+     * @param cancelLatencyUs Output: cancel-to-wake latency if cancelled
+     * @param stopEpoch Optional emergency stop counter (see dispense())
+     * @param jobEpoch Expected value of stopEpoch
+     * @return Motor on-time in milliseconds as recorded at the moment of stop, or 0 if the motor failed to
+     *         start or the run was stopped before it started
+     */
+    uint32_t runMotor(uint32_t durationMs, bool& cancelled, uint32_t& cancelLatencyUs,
+                      const std::atomic<uint32_t>* stopEpoch = nullptr, uint32_t jobEpoch = 0);
+
+    /**
+     * @brief Recompute the hot-path curve from calibration data
+     */
+    void rebuildCurve();
+
+    /**
+     * @brief Validate a fitted rate/offset and package it as an update
+     * @param mlPerSecond Fitted rate
+     * @param offsetMl Fitted offset
+     * @param points Points used for the fit
+     * @param count Number of points
+     * @param update Output calibration state
+     * @return true if the fit is plausible
+     */
+    bool buildCalibrationUpdate(float mlPerSecond, float offsetMl, const CalibrationPoint* points,
+                                uint8_t count, CalibrationUpdate& update) const;
+
     /**
      * @brief Get NVS namespace for dosing head calibration
      * @return NVS namespace string
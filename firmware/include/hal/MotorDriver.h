@@ -2,6 +2,7 @@
 #define MOTOR_DRIVER_H
 
 #include <Arduino.h>
+#include <atomic>
 #include "config/HardwareConfig.h"
 
 /**
@@ -24,6 +25,19 @@ struct MotorState {
     unsigned long runDuration;
 };
 
+#ifdef SQUAREDOSE_DIAGNOSTICS
+/**
+ * @brief Result of a stop-latency benchmark run
+ * Compares stopping all motors through per-pin digitalWrite calls
+ * against the single masked register write used by emergencyStopAll()
+ */
+struct StopLatencyResult {
+    uint32_t iterations;     // Number of samples averaged
+    uint32_t digitalWriteNs; // Average time to stop all motors via digitalWrite
+    uint32_t registerNs;     // Average time to stop all motors via GPIO mask write
+};
+#endif
+
 /**
  * @brief TB6612 Motor Driver Abstraction
  *
@@ -31,7 +45,11 @@ struct MotorState {
  * Motors run at full speed (digital HIGH) when enabled.
  * Both drivers share a common STBY pin.
  *
- * Thread-safety: Not thread-safe. Use mutexes if calling from multiple FreeRTOS tasks.
+ * Thread-safety: Safe to call from multiple FreeRTOS tasks (SchedulerTask, dose tasks,
+ * AsyncTCP). Each motor's pin writes and state updates run inside its own spinlock
+ * critical section; multi-motor operations take the locks in ascending index order.
+ * Status reads (isMotorRunning, getMotorState, getMotorRuntime) are lock-free and use a
+ * per-motor sequence counter to return a consistent snapshot.
  */
 class MotorDriver {
 public:
@@ -69,11 +87,46 @@ public:
      */
     bool brakeMotor(uint8_t motorIndex);
 
+    /**
+     * @brief Start several motors simultaneously in the same direction
+     * All selected motors (and STBY, if needed) switch in a single register write
+     * @param motorMask Bitmask of motors to start (bit 0 = motor 0)
+     * @param direction Motor direction (FORWARD or REVERSE)
+     * @return true if motors started successfully
+     */
+    bool startMotors(uint8_t motorMask, MotorDirection direction = MotorDirection::FORWARD);
+
+    /**
+     * @brief Stop several motors simultaneously (coast to stop)
+     * @param motorMask Bitmask of motors to stop (bit 0 = motor 0)
+     * @return true if motors stopped successfully
+     */
+    bool stopMotors(uint8_t motorMask);
+
     /**
      * @brief Emergency stop all motors immediately
+     * Brakes every motor and drops STBY in one GPIO set/clear register write
      */
     void emergencyStopAll();
 
+    /**
+     * @brief Get the GPIO write time of the last emergency stop
+     * @return Time in nanoseconds between first and last register write, or 0 if never stopped
+     */
+    uint32_t getLastEmergencyStopLatencyNs() const;
+
+#ifdef SQUAREDOSE_DIAGNOSTICS
+    /**
+     * @brief Measure stop latency of the digitalWrite path vs the register path
+     * Only runs while all motors are idle (writes STOP levels to already stopped pins).
+     * Diagnostics builds only.
+     * @param iterations Number of samples to average
+     * @param result Output benchmark result
+     * @return true if benchmark ran, false if a motor is running or not initialized
+     */
+    bool benchmarkStopLatency(uint16_t iterations, StopLatencyResult& result);
+#endif
+
     /**
      * @brief Check if a motor is currently running
      * @param motorIndex Motor index (0-3)
@@ -111,7 +164,90 @@ public:
      */
     bool isStandbyEnabled() const;
 
+    /**
+     * @brief Get a counter that increases whenever any motor's state changes
+     * Lets readers detect changes without reading every motor state
+     * @return State version
+     */
+    uint32_t getStateVersion() const;
+
 private:
+    /**
+     * @brief GPIO output mask split across the two ESP32-S3 output banks
+     */
+    struct GpioMask {
+        uint32_t low;   // GPIO 0-31 (GPIO.out_w1ts / out_w1tc)
+        uint32_t high;  // GPIO 32-48 (GPIO.out1_w1ts / out1_w1tc)
+    };
+
+    /**
+     * @brief Add a pin to a GPIO mask
+     * @param mask Mask to update
+     * @param pin GPIO number
+     */
+    static void addPinToMask(GpioMask& mask, uint8_t pin);
+
+    /**
+     * @brief Compute set/clear masks that put a motor into a given direction
+     * @param motorIndex Motor index (0-3)
+     * @param direction Motor direction
+     * @param setMask Mask accumulating pins to drive HIGH
+     * @param clearMask Mask accumulating pins to drive LOW
+     */
+    void addDirectionMasks(uint8_t motorIndex, MotorDirection direction,
+                           GpioMask& setMask, GpioMask& clearMask) const;
+
+    /**
+     * @brief Apply set/clear masks to the GPIO output registers
+     * Every pin in the masks changes within the same few bus cycles
+     * @param setMask Pins to drive HIGH
+     * @param clearMask Pins to drive LOW
+     */
+    static void writeMasks(const GpioMask& setMask, const GpioMask& clearMask);
+
+    /**
+     * @brief Record a motor as stopped/braked in the state table
+     * Caller must hold the motor's lock
+     * @param motorIndex Motor index (0-3)
+     * @param direction STOP or BRAKE
+     * @param now Current millis() timestamp
+     */
+    void markStopped(uint8_t motorIndex, MotorDirection direction, unsigned long now);
+
+    /**
+     * @brief Enter the critical sections of every motor in a mask (ascending order)
+     * @param motorMask Bitmask of motors to lock
+     */
+    void lockMotors(uint8_t motorMask);
+
+    /**
+     * @brief Exit the critical sections of every motor in a mask (descending order)
+     * @param motorMask Bitmask of motors to unlock
+     */
+    void unlockMotors(uint8_t motorMask);
+
+    /**
+     * @brief Mark a motor's state as being modified (sequence becomes odd)
+     * Caller must hold the motor's lock
+     * @param motorIndex Motor index (0-3)
+     */
+    void beginStateWrite(uint8_t motorIndex);
+
+    /**
+     * @brief Publish a motor's modified state (sequence becomes even)
+     * Caller must hold the motor's lock
+     * @param motorIndex Motor index (0-3)
+     */
+    void endStateWrite(uint8_t motorIndex);
+
+    /**
+     * @brief Lock-free consistent snapshot of a motor's state
+     * Retries while a writer is mid-update
+     * @param motorIndex Motor index (0-3)
+     * @return Copy of the motor state
+     */
+    MotorState readState(uint8_t motorIndex) const;
+
     /**
      * @brief Set motor direction and speed pins
      * @param motorIndex Motor index (0-3)
@@ -133,10 +269,18 @@ private:
         uint8_t pwm;  // Used as digital HIGH/LOW for full speed
     };
 
+    static constexpr uint8_t ALL_MOTORS_MASK = (1 << NUM_MOTORS) - 1;
+
     MotorPins motorPins[NUM_MOTORS];
-    MotorState motorStates[NUM_MOTORS];
+    MotorState motorStates[NUM_MOTORS];             // Written under motorLocks, read via stateSequence
+    portMUX_TYPE motorLocks[NUM_MOTORS];            // Per-motor spinlocks
+    std::atomic<uint32_t> stateSequence[NUM_MOTORS]; // Seqlock counters (odd = write in progress)
+    std::atomic<uint32_t> stateVersion;             // Bumped after every state write
+    GpioMask allMotorPinsMask;  // Every IN1/IN2/PWM pin, precomputed for emergency stop
+    GpioMask standbyMask;       // Shared STBY pin
+    std::atomic<uint32_t> lastEmergencyStopNs;
     bool initialized;
-    bool standbyEnabled;
+    std::atomic<bool> standbyEnabled;
 };
 
 #endif // MOTOR_DRIVER_H
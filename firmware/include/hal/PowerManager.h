@@ -0,0 +1,212 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_pm.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config/NetworkConfig.h"
+
+/**
+ * @brief Power profiles, in the order of POWER_DEFAULT_PROFILE
+ */
+enum class PowerProfile : uint8_t {
+    PERFORMANCE,  // No modem sleep, CPU fixed at maximum
+    BALANCED,     // Modem sleep per DTIM, CPU scales down when idle
+    LOW_POWER,    // Long listen interval, lower CPU bounds, automatic light sleep
+    COUNT
+};
+
+/**
+ * @brief Work that keeps the CPU at full speed and out of light sleep
+ */
+enum class PowerLock : uint8_t {
+    DOSE,     // A motor is running
+    REQUEST,  // An HTTP request or storage job is being served
+    COUNT
+};
+
+/**
+ * @brief What a profile configures (values from NetworkConfig.h)
+ */
+struct PowerProfileSettings {
+    const char* name;
+    wifi_ps_type_t powerSave;   // STA modem sleep
+    uint16_t listenInterval;    // Beacons between wake-ups in WIFI_PS_MAX_MODEM (0 = driver default)
+    uint16_t maxMhz;            // DFS bounds
+    uint16_t minMhz;
+    bool lightSleep;
+    uint16_t idleMa;            // Estimate with no PowerLock held
+    uint16_t activeMa;          // Estimate while a PowerLock is held
+};
+
+/**
+ * @brief Applies the power profile and keeps the CPU awake while work runs
+ *
+ * A profile sets the STA modem sleep mode and listen interval, the DFS
+ * CPU frequency bounds and automatic light sleep (see NetworkConfig.h). The
+ * selected profile is stored in NVS and applied at boot.
+ *
+ * DFS and light sleep need a core built with CONFIG_PM_ENABLE (light sleep
+ * also CONFIG_FREERTOS_USE_TICKLESS_IDLE). Without it esp_pm_configure() fails,
+ * the CPU stays at its boot frequency and only modem sleep changes; this is
+ * logged and reported as squaredose_power_management_enabled 0. Modem sleep
+ * only applies to the station: the AP never sleeps.
+ *
+ * While a PowerLock is held the CPU runs at its maximum frequency and the
+ * chip does not enter light sleep. Locks are counted, so they nest and may be
+ * held by several tasks at once.
+ *
+ * For each profile the time spent in it, the time any lock was held and
+ * the handler time of HTTP requests are recorded. The estimated current
+ * blends the profile's idle and active figures by the share of time a lock
+ * was held; it is a model, not a measurement, and excludes the motors.
+ *
+ * Thread-safety: All methods may be called from any task (not from ISRs).
+ */
+class PowerManager {
+public:
+    /**
+     * @brief Create the PM locks and apply the stored profile
+     * @return true if the profile was applied (modem sleep at least)
+     */
+    static bool begin();
+
+    /**
+     * @brief Apply a profile and store it in NVS
+     * @param profile Profile
+     * @return false if the profile is invalid or could not be stored
+     */
+    static bool setProfile(PowerProfile profile);
+
+    /**
+     * @brief Get the active profile
+     */
+    static PowerProfile getProfile();
+
+    /**
+     * @brief Get what a profile configures
+     * @param profile Profile (must be valid)
+     */
+    static const PowerProfileSettings& getSettings(PowerProfile profile);
+
+    /**
+     * @brief Check if DFS and light sleep are available (esp_pm_configure succeeded)
+     */
+    static bool isPowerManagementEnabled();
+
+    /**
+     * @brief Get a profile's name ("performance", "balanced", "low-power")
+     */
+    static const char* getProfileName(PowerProfile profile);
+
+    /**
+     * @brief Look up a profile by name
+     * @param name Profile name
+     * @param profile Output
+     * @return false if the name is unknown
+     */
+    static bool parseProfile(const char* name, PowerProfile& profile);
+
+    /**
+     * @brief Apply the profile's modem sleep and listen interval to the station
+     * Called by the WiFi manager after each association.
+     */
+    static void applyStationPowerSave();
+
+    /**
+     * @brief Keep the CPU at full speed and out of light sleep until release()
+     */
+    static void acquire(PowerLock lock);
+
+    /**
+     * @brief End an acquire()
+     */
+    static void release(PowerLock lock);
+
+    /**
+     * @brief Record HTTP handler time under the active profile
+     *
+     * Only the handler's own run time is counted: radio wake-up from modem
+     * sleep and network transfer happen before the handler is called.
+     * @param durationUs Time spent in one handler call
+     * @param complete true for the call that finishes the request (counts the request)
+     */
+    static void recordHandlerTime(uint32_t durationUs, bool complete);
+
+    /**
+     * @brief Estimated average board current while a profile was active
+     * @param profile Profile
+     * @return mA (the idle figure if the profile has not run yet)
+     */
+    static uint32_t getEstimatedCurrentMa(PowerProfile profile);
+
+    /**
+     * @brief Average handler time of HTTP requests served under a profile
+     * @return Microseconds (0 if none)
+     */
+    static uint32_t getAverageHandlerUs(PowerProfile profile);
+
+    /**
+     * @brief Write profile, lock and per-profile latency/current metrics in Prometheus text format
+     * @param out Destination
+     */
+    static void writeMetrics(Print& out);
+
+private:
+    static const PowerProfileSettings profiles[static_cast<uint8_t>(PowerProfile::COUNT)];
+
+    static std::atomic<uint8_t> profile;
+    static std::atomic<bool> pmEnabled;
+    static esp_pm_lock_handle_t locks[static_cast<uint8_t>(PowerLock::COUNT)];
+
+    // Time accounting (protected by mutex)
+    static SemaphoreHandle_t mutex;
+    static StaticSemaphore_t mutexBuffer;
+    static uint8_t holders;                    // Locks currently held, all types
+    static int64_t busySinceUs;                // When holders went from 0 to 1
+    static int64_t profileSinceUs;             // When the active profile was applied
+    static uint64_t profileTimeUs[static_cast<uint8_t>(PowerProfile::COUNT)];
+    static uint64_t busyTimeUs[static_cast<uint8_t>(PowerProfile::COUNT)];
+
+    // Statistics
+    static std::atomic<uint32_t> lockAcquires[static_cast<uint8_t>(PowerLock::COUNT)];
+    static std::atomic<uint32_t> requests[static_cast<uint8_t>(PowerProfile::COUNT)];
+    static std::atomic<uint32_t> handlerTimeUs[static_cast<uint8_t>(PowerProfile::COUNT)];
+    static std::atomic<uint32_t> maxHandlerUs[static_cast<uint8_t>(PowerProfile::COUNT)];
+
+    /**
+     * @brief Configure DFS and light sleep for a profile
+     * @return true if esp_pm_configure() accepted it
+     */
+    static bool applyProfile(PowerProfile profile);
+
+    /**
+     * @brief Blend a profile's idle and active current by the share of busy time
+     * @return mA (the idle figure if totalUs is 0)
+     */
+    static uint32_t estimateCurrentMa(uint8_t index, uint64_t totalUs, uint64_t busyUs);
+
+    /**
+     * @brief Credit the time since the last call to the active profile (mutex must be held)
+     */
+    static void accountTime(int64_t nowUs);
+};
+
+/**
+ * @brief Holds a PowerLock for the lifetime of the scope
+ */
+class PowerLockScope {
+public:
+    explicit PowerLockScope(PowerLock lock) : lock(lock) { PowerManager::acquire(lock); }
+    ~PowerLockScope() { PowerManager::release(lock); }
+
+    PowerLockScope(const PowerLockScope&) = delete;
+    PowerLockScope& operator=(const PowerLockScope&) = delete;
+
+private:
+    PowerLock lock;
+};
+
+#endif // POWER_MANAGER_H
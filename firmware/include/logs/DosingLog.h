@@ -7,6 +7,7 @@
 #define NUM_DOSING_HEADS 4
 #define LOG_RETENTION_HOURS 336  // 14 days × 24 hours
 #define MAX_LOG_ENTRIES (LOG_RETENTION_HOURS * NUM_DOSING_HEADS)  // 1344 entries
+#define LOG_BASE_TIME 1735689600  // Jan 1, 2025 UTC: log keys count hours from here
 
 /**
  * @brief Hourly dosing log entry
@@ -2,6 +2,7 @@
 #define DOSING_LOG_MANAGER_H
 
 #include <Arduino.h>
+#include <atomic>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include "logs/DosingLog.h"
@@ -105,10 +106,17 @@ public:
      */
     bool clearAll();
 
+    /**
+     * @brief Get a counter that increases whenever stored logs change
+     * @return Log version
+     */
+    uint32_t getVersion() const;
+
 private:
     DosingLogStore store;
     SemaphoreHandle_t mutex;
     bool initialized;
+    std::atomic<uint32_t> version;  // Bumped on log, prune and clear
 
     /**
      * @brief Round timestamp to hour boundary
@@ -2,12 +2,16 @@
 #define DOSING_LOG_STORE_H
 
 #include <Arduino.h>
-#include <Preferences.h>
 #include "logs/DosingLog.h"
 
 #define LOG_NVS_NAMESPACE "dosinglogs"
 #define LOG_INDEX_KEY "log_index"  // Rolling index for circular buffer
 #define LOG_COUNT_KEY "log_count"  // Total number of logs stored
+#define LOG_OLDEST_KEY "log_oldest"  // Hour timestamp no stored log is older than
+
+// Pruning never looks further back than this past the cutoff (also used for
+// logs stored before LOG_OLDEST_KEY existed)
+#define LOG_PRUNE_LOOKBACK_HOURS (30 * 24)
 
 /**
  * @brief NVS storage manager for hourly dosing logs
@@ -16,11 +20,11 @@
  * Uses circular buffer approach with rolling index
  * Each log entry is ~13 bytes (4 + 1 + 4 + 4 = 13 bytes)
  * Total: ~17KB storage
+ * Writes are committed by FlashWriter; reads see queued writes
  */
 class DosingLogStore {
 public:
     DosingLogStore();
-    ~DosingLogStore();
 
     /**
      * @brief Initialize the dosing log store
@@ -32,7 +36,7 @@ public:
      * @brief Save or update a log entry for a specific hour and head
      * If entry exists for this hour+head, updates it (adds to volumes)
      * Otherwise creates new entry
-     * @param log Log entry to save
+     * @param log Log entry to save (hours before LOG_BASE_TIME are refused)
      * @return true if save successful
      */
     bool saveLog(const HourlyDoseLog& log);
@@ -67,6 +71,9 @@ public:
 
     /**
      * @brief Delete old logs beyond retention period
+     * Only hours from the oldest stored log up to the cutoff are checked, and
+     * their keys are removed in batches (one flash queue entry per batch).
+     * Does nothing until currentTime is a synchronized time past the retention period.
      * @param currentTime Current Unix epoch time
      * @return Number of logs deleted
      */
@@ -85,8 +92,8 @@ public:
     uint16_t getLogCount();
 
 private:
-    Preferences preferences;
     bool initialized;
+    uint32_t oldestHour;  // LOG_OLDEST_KEY, cached; 0 if not stored
 
     /**
      * @brief Get NVS key for log entry
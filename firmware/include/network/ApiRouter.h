@@ -0,0 +1,162 @@
+#ifndef API_ROUTER_H
+#define API_ROUTER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include <ESPAsyncWebServer.h>
+
+#define ROUTER_MAX_ROUTES 32     // Routes in the table
+#define ROUTER_MAX_SEGMENTS 6    // Path segments per route
+#define ROUTER_MAX_PARAMS 3      // Path parameters per route
+
+/**
+ * @brief Type of a path parameter, e.g. {head:u8}
+ */
+enum class RouteParamType : uint8_t {
+    LITERAL,  // Not a parameter: segment must match exactly
+    U8,
+    U16,
+    U32
+};
+
+/**
+ * @brief Path parameter values of a matched route, in pattern order
+ */
+struct RouteParams {
+    uint8_t count;
+    uint32_t values[ROUTER_MAX_PARAMS];
+};
+
+typedef std::function<void(AsyncWebServerRequest* request, const RouteParams& params)> RouteRequestHandler;
+typedef std::function<void(AsyncWebServerRequest* request, const RouteParams& params,
+                           uint8_t* data, size_t len, size_t index, size_t total)> RouteBodyHandler;
+
+/**
+ * @brief Routing table for the REST API
+ *
+ * Patterns are split into segments once, at registration. Literal segments
+ * must match exactly; {name:u8|u16|u32} segments must be a decimal number
+ * that fits the type, and are passed to the handler in RouteParams. Matching
+ * walks the request path once per candidate route and never allocates.
+ * Unlike AsyncWebServer::on(), matching is exact, so "/api/schedules" does not
+ * also catch "/api/schedules/0" or "/api/schedules/", and registration order
+ * does not matter. Patterns must not end in '/'.
+ *
+ * Pattern strings are not copied and must outlive the router (use literals).
+ *
+ * Each route counts its requests and the time spent in its handlers
+ * (lock-free), reported by writeMetrics().
+ *
+ * Thread-safety: Register routes before the server starts. Matching runs on
+ * the AsyncTCP task only.
+ */
+class ApiRouter : public AsyncWebHandler {
+public:
+    ApiRouter();
+
+    /**
+     * @brief Register a route without a request body
+     * @param method HTTP method(s)
+     * @param pattern Path pattern, e.g. "/api/schedules/{head:u8}"
+     * @param onRequest Called once the request has arrived
+     * @return true if registered (false if the table is full or the pattern is invalid)
+     */
+    bool on(WebRequestMethodComposite method, const char* pattern, RouteRequestHandler onRequest);
+
+    /**
+     * @brief Register a route with a request body
+     * @param method HTTP method(s)
+     * @param pattern Path pattern
+     * @param onBody Called for each body chunk (and once with no data for an empty body)
+     * @return true if registered
+     */
+    bool on(WebRequestMethodComposite method, const char* pattern, RouteBodyHandler onBody);
+
+    /**
+     * @brief Get number of registered routes
+     * @return Route count
+     */
+    uint8_t getRouteCount() const;
+
+    /**
+     * @brief Write per-route request counts and handler latency in Prometheus text format
+     * @param out Destination
+     */
+    void writeMetrics(Print& out) const;
+
+    // AsyncWebHandler interface
+    bool canHandle(AsyncWebServerRequest* request) override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+    void handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) override;
+    bool isRequestHandlerTrivial() override;
+
+private:
+    struct Segment {
+        const char* text;     // Points into the pattern (literal segments)
+        uint8_t length;
+        RouteParamType type;
+    };
+
+    struct Route {
+        WebRequestMethodComposite method;
+        const char* pattern;
+        Segment segments[ROUTER_MAX_SEGMENTS];
+        uint8_t segmentCount;
+        RouteRequestHandler onRequest;
+        RouteBodyHandler onBody;
+        std::atomic<uint32_t> requestCount;
+        std::atomic<uint32_t> handlerTimeUs;  // Wraps after ~71 min of handler time (a counter reset)
+    };
+
+    Route routes[ROUTER_MAX_ROUTES];
+    uint8_t routeCount;
+
+    /**
+     * @brief Split a pattern into segments
+     * @param pattern Path pattern
+     * @param route Route to fill in
+     * @return true if the pattern is valid
+     */
+    static bool compile(const char* pattern, Route& route);
+
+    /**
+     * @brief Find the route for a request
+     * @param request Request
+     * @param params Output path parameters
+     * @return Matching route, or nullptr
+     */
+    Route* match(AsyncWebServerRequest* request, RouteParams& params);
+
+    /**
+     * @brief Match a path against one route
+     * @param route Route
+     * @param path Request path (no query string)
+     * @param params Output path parameters
+     * @return true if the path matches
+     */
+    static bool matchPath(const Route& route, const char* path, RouteParams& params);
+
+    /**
+     * @brief Parse a decimal path parameter
+     * @param text Segment text
+     * @param length Segment length
+     * @param type Parameter type (sets the upper bound)
+     * @param value Output value
+     * @return true if the segment is a number that fits the type
+     */
+    static bool parseParam(const char* text, size_t length, RouteParamType type, uint32_t& value);
+
+    /**
+     * @brief Fill in a newly compiled route and add it to the table
+     */
+    void addRoute(WebRequestMethodComposite method, const char* pattern, RouteRequestHandler onRequest,
+                  RouteBodyHandler onBody);
+
+    /**
+     * @brief Get the name of a route's first HTTP method (for metric labels)
+     */
+    static const char* methodName(WebRequestMethodComposite method);
+};
+
+#endif // API_ROUTER_H
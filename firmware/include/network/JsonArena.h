@@ -0,0 +1,81 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+/**
+ * @brief Bump allocator for ArduinoJson documents built while handling one request
+ *
+ * Hands out memory from a fixed caller-owned buffer and never touches the heap.
+ * Individual frees are ignored except for the most recent block, so a document
+ * that grows or shrinks its last pool does so in place. Everything is released
+ * at once by reset(), normally through a JsonArenaScope at the top of a handler.
+ * When the buffer is exhausted allocate() returns nullptr, which ArduinoJson
+ * reports as NoMemory (parsing) or overflowed() (building).
+ *
+ * Thread-safety: Not thread-safe. Use from a single task (the AsyncTCP task).
+ */
+class JsonArena : public Allocator {
+public:
+    /**
+     * @brief Construct an arena over a buffer
+     * @param buffer Backing storage (8-byte aligned)
+     * @param capacity Buffer size in bytes
+     */
+    JsonArena(uint8_t* buffer, size_t capacity);
+
+    void* allocate(size_t size) override;
+    void deallocate(void* pointer) override;
+    void* reallocate(void* pointer, size_t newSize) override;
+
+    /**
+     * @brief Release every allocation
+     */
+    void reset();
+
+    /**
+     * @brief Get the highest number of bytes in use since boot
+     * @return High-water mark in bytes
+     */
+    size_t getHighWater() const;
+
+    /**
+     * @brief Get the number of allocations refused because the arena was full
+     * @return Failure count
+     */
+    uint32_t getFailures() const;
+
+private:
+    static constexpr size_t ALIGNMENT = 8;
+    static constexpr size_t HEADER_SIZE = ALIGNMENT;  // Block size, padded to keep payloads aligned
+
+    uint8_t* buffer;
+    size_t capacity;
+    size_t offset;      // Next free byte
+    uint8_t* lastBlock; // Payload of the most recent allocation (grows/frees in place)
+    size_t highWater;
+    uint32_t failures;
+
+    static size_t alignSize(size_t size);
+    static size_t blockSize(const uint8_t* payload);
+};
+
+/**
+ * @brief Resets an arena when it goes out of scope
+ * Declare before any JsonDocument that uses the arena so the documents are
+ * destroyed first.
+ */
+class JsonArenaScope {
+public:
+    explicit JsonArenaScope(JsonArena& arena) : arena(arena) {}
+    ~JsonArenaScope() { arena.reset(); }
+
+    JsonArenaScope(const JsonArenaScope&) = delete;
+    JsonArenaScope& operator=(const JsonArenaScope&) = delete;
+
+private:
+    JsonArena& arena;
+};
+
+#endif // JSON_ARENA_H
@@ -0,0 +1,73 @@
+#ifndef MDNS_ADVERTISER_H
+#define MDNS_ADVERTISER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config/NetworkConfig.h"
+
+/**
+ * @brief Returns a value that changes whenever the device status does
+ */
+typedef uint32_t (*StatusHashFunction)(void* context);
+
+/**
+ * @brief Advertises the device as _squaredose._tcp over mDNS/DNS-SD
+ *
+ * Apps find every device with one DNS-SD query instead of probing the
+ * subnet over HTTP. The service instance carries TXT records:
+ * - id: device ID (the AP SSID suffix, e.g. "A1B2")
+ * - fw: FIRMWARE_VERSION
+ * - heads: number of dosing heads
+ * - st: status hash (8 hex digits), the same value as "statusHash" in
+ *   GET /api/status; a client that saw this value already can skip the request
+ *
+ * The host name is MDNS_HOSTNAME_PREFIX + id (lowercase) and answers on both
+ * the station and the AP interface.
+ *
+ * maintain() republishes st when the hash changes. Each change is multicast as
+ * an announcement, so updates are at least MDNS_TXT_MIN_INTERVAL_MS apart;
+ * changes in between are folded into the next update.
+ *
+ * Thread-safety: begin() once during setup; maintain() from one task (the
+ * telemetry publisher). getTxtUpdates() may be called from any task.
+ */
+class MdnsAdvertiser {
+public:
+    MdnsAdvertiser();
+
+    /**
+     * @brief Start the responder and register the service
+     * @param deviceId Device ID (AP SSID suffix)
+     * @param port HTTP port
+     * @param numHeads Number of dosing heads
+     * @param statusHash Status hash source (called from maintain())
+     * @param context Passed to statusHash
+     * @return true if advertising
+     */
+    bool begin(const String& deviceId, uint16_t port, uint8_t numHeads, StatusHashFunction statusHash, void* context);
+
+    /**
+     * @brief Republish the status hash if it changed (rate limited)
+     */
+    void maintain();
+
+    /**
+     * @brief Get number of status TXT updates published
+     */
+    uint32_t getTxtUpdates() const;
+
+private:
+    StatusHashFunction statusHash;
+    void* context;
+    bool running;
+    uint32_t publishedHash;
+    uint32_t lastUpdateMs;
+    std::atomic<uint32_t> txtUpdates;
+
+    /**
+     * @brief Set the st TXT record
+     */
+    bool publishHash(uint32_t hash);
+};
+
+#endif // MDNS_ADVERTISER_H
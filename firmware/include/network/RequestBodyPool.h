@@ -0,0 +1,100 @@
+#ifndef REQUEST_BODY_POOL_H
+#define REQUEST_BODY_POOL_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config/NetworkConfig.h"
+
+/**
+ * @brief Outcome of feeding one body chunk to the pool
+ */
+enum class BodyChunkResult {
+    INCOMPLETE,  // More chunks expected
+    COMPLETE,    // Whole body available
+    NO_BUFFER,   // Every buffer was in use when the body started
+    OUT_OF_ORDER // Chunk did not continue the body (buffer released)
+};
+
+/**
+ * @brief Outcome of feeding one body chunk to parseJsonBody()
+ */
+enum class JsonBodyResult {
+    INCOMPLETE,    // More chunks expected, nothing to answer yet
+    PARSED,        // doc holds the body
+    TOO_LARGE,     // Body exceeds WEB_MAX_REQUEST_BODY_SIZE (first chunk only)
+    NO_BUFFER,     // Every buffer was in use when the body started (first chunk only)
+    OUT_OF_ORDER,  // Chunk did not continue the body (buffer released)
+    INVALID_JSON,  // Body complete but did not parse (see error)
+    IGNORED        // Later chunk of a body that was already answered
+};
+
+/**
+ * @brief Fixed pool of buffers that reassemble POST bodies split across TCP segments
+ *
+ * A buffer is attached to a per-request slot (request->_tempObject, or a
+ * WebSocket client's for an RPC frame) on the first chunk and detached again
+ * once the body has been consumed or the client disconnects. AsyncWebServerRequest free()s a non-null _tempObject in its
+ * destructor, so a pooled buffer must never be left attached. The pool never
+ * sees the request itself; the caller owns the slot and the disconnect hook.
+ *
+ * Thread-safety: Not thread-safe. Use from the AsyncTCP task only.
+ */
+class RequestBodyPool {
+public:
+    RequestBodyPool();
+
+    /**
+     * @brief Reassemble a JSON body and parse it once it is complete
+     * A body that arrives in one chunk is parsed in place, with no copy.
+     * @param slot Request's buffer slot (nullptr before the first chunk)
+     * @param data Chunk data
+     * @param len Chunk length
+     * @param index Offset of the chunk in the body
+     * @param total Total body length
+     * @param doc Output document when PARSED
+     * @param error Output parse error when INVALID_JSON
+     * @return Chunk outcome; the slot is empty again unless INCOMPLETE
+     */
+    JsonBodyResult parseJsonBody(void*& slot, const uint8_t* data, size_t len, size_t index, size_t total,
+                                 JsonDocument& doc, DeserializationError& error);
+
+    /**
+     * @brief Copy a chunk into the request's buffer
+     * @param slot Request's buffer slot (nullptr before the first chunk)
+     * @param data Chunk data
+     * @param len Chunk length
+     * @param index Offset of the chunk in the body
+     * @param total Total body length (at most WEB_MAX_REQUEST_BODY_SIZE)
+     * @param body Output: whole body when COMPLETE
+     * @param length Output: body length when COMPLETE
+     * @return Chunk outcome
+     */
+    BodyChunkResult append(void*& slot, const uint8_t* data, size_t len,
+                           size_t index, size_t total, uint8_t*& body, size_t& length);
+
+    /**
+     * @brief Detach and free the request's buffer (no-op if it has none)
+     * @param slot Request's buffer slot
+     */
+    void release(void*& slot);
+
+    /**
+     * @brief Get the number of bodies refused because every buffer was in use
+     * @return Refusal count
+     */
+    uint32_t getExhaustedCount() const;
+
+private:
+    struct BodyBuffer {
+        uint8_t data[WEB_MAX_REQUEST_BODY_SIZE];
+        size_t received;
+        bool inUse;
+    };
+
+    BodyBuffer buffers[WEB_BODY_BUFFER_COUNT];
+    uint32_t exhaustedCount;
+
+    BodyBuffer* acquire();
+};
+
+#endif // REQUEST_BODY_POOL_H
@@ -0,0 +1,80 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+/**
+ * @brief Fills a document with the response for a cached endpoint
+ */
+typedef void (*ResponseBuildFunction)(JsonDocument& doc, void* context);
+
+/**
+ * @brief Serialized response body cached against a version key
+ *
+ * The key is the sum of the version counters the response depends on. Every
+ * counter only ever increases, so any change to the underlying state produces
+ * a new key. A rebuild happens under the cache mutex, so concurrent requests
+ * for a stale entry wait for the first rebuild and then serve its result.
+ *
+ * Thread-safety: get() may be called from any task.
+ */
+class ResponseCache {
+public:
+    ResponseCache();
+    ~ResponseCache();
+
+    /**
+     * @brief Create the cache mutex
+     * @return true if successful
+     */
+    bool begin();
+
+    /**
+     * @brief Write the body for a version, rebuilding it if the cached copy is stale
+     * Read the version counters BEFORE calling so a change during the rebuild
+     * leaves the entry stale rather than caching old data under a new key.
+     * The body is copied straight into out (e.g. an AsyncResponseStream) with
+     * no intermediate String.
+     * @param version Current version key
+     * @param build Builds the response document on a miss
+     * @param context Passed through to build
+     * @param out Destination for the serialized body
+     * @param skip Number of leading body bytes to leave out
+     * @param allocator Allocator for the rebuild document (nullptr = heap)
+     * @return true if the body was written; on false nothing was written
+     *         (the rebuild overflowed its allocator)
+     */
+    bool write(uint32_t version, ResponseBuildFunction build, void* context, Print& out,
+               size_t skip = 0, Allocator* allocator = nullptr);
+
+    /**
+     * @brief Get the length of the last cached body (buffer sizing hint)
+     * @return Length in bytes, 0 before the first build
+     */
+    size_t getLength() const;
+
+    uint32_t getHits() const;
+    uint32_t getMisses() const;
+
+private:
+    SemaphoreHandle_t mutex;
+    StaticSemaphore_t mutexBuffer;
+    String cachedBody;      // Protected by mutex; capacity is reused across rebuilds
+    uint32_t cachedVersion; // Protected by mutex
+    bool valid;             // Protected by mutex
+    std::atomic<size_t> cachedLength;
+    std::atomic<uint32_t> hits;
+    std::atomic<uint32_t> misses;
+
+    /**
+     * @brief Build and serialize a new body (caller holds mutex)
+     * @return false if the document overflowed (entry left invalid)
+     */
+    bool rebuild(JsonDocument& doc, uint32_t version, ResponseBuildFunction build, void* context);
+};
+
+#endif // RESPONSE_CACHE_H
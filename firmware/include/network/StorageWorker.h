@@ -0,0 +1,221 @@
+#ifndef STORAGE_WORKER_H
+#define STORAGE_WORKER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <ESPAsyncWebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <ArduinoJson.h>
+#include "config/NetworkConfig.h"
+#include "scheduling/Schedule.h"
+
+#define STORAGE_NO_SLOT 0xFF  // Job answers a WebSocket client, not an HTTP request
+
+/**
+ * @brief Request handled by the storage worker
+ */
+enum class StorageOperation : uint8_t {
+    DASHBOARD,        // GET /api/logs/dashboard
+    HOURLY_LOGS,      // GET /api/logs/hourly, RPC getLogs
+    DELETE_LOGS,      // DELETE /api/logs
+    SET_SCHEDULE,     // POST /api/schedules, RPC setSchedule
+    DELETE_SCHEDULE,  // DELETE /api/schedules/{head}
+    BATCH             // POST /api/batch (staged by WebServer, one at a time)
+};
+
+/**
+ * @brief One queued storage request
+ * Request bodies are parsed and validated on the AsyncTCP task; the job
+ * carries only the values the NVS work needs.
+ */
+struct StorageJob {
+    StorageOperation operation;
+    uint8_t slot;        // Response slot of the HTTP request, or STORAGE_NO_SLOT for WebSocket
+    uint32_t clientId;   // WebSocket client to reply to
+    char rpcId[WEB_RPC_ID_SIZE];  // WebSocket RPC id, serialized JSON
+
+    // HOURLY_LOGS
+    uint32_t hours;
+    uint32_t start;
+    uint32_t end;
+
+    // SET_SCHEDULE (validated), DELETE_SCHEDULE (head only)
+    Schedule schedule;
+};
+
+/**
+ * @brief Function that performs a job (runs on the worker task)
+ * HTTP jobs hand their result to StorageWorker::complete(); WebSocket jobs reply themselves.
+ */
+typedef void (*StorageJobFunction)(const StorageJob& job, void* context);
+
+class StorageResponse;
+
+/**
+ * @brief Runs NVS-backed requests on their own task
+ *
+ * Reading a week of hourly logs or committing a schedule can take tens of
+ * milliseconds of flash access. Done inside an AsyncTCP callback, that stalls
+ * every other connection and the WebSocket and can trip the async_tcp
+ * watchdog. Handlers instead submit a StorageJob and return.
+ *
+ * ESPAsyncWebServer requests may only be used on the AsyncTCP task, so the
+ * worker never touches one. submit() answers the request at once with a
+ * StorageResponse that holds a response slot. The worker serializes the
+ * result into the slot's body buffer and marks it ready with complete().
+ * AsyncTCP polls the response (on each connection poll) and sends the body
+ * once it is ready. The slot's state is an atomic handoff between the two
+ * tasks: if the client disconnects first, the response is deleted and marks
+ * the slot abandoned, and whichever side finishes last frees it. Neither task
+ * ever waits for the other.
+ *
+ * WebSocket replies go through AsyncWebSocket::text(clientId, ...), which
+ * ignores clients that have gone.
+ *
+ * Jobs run one at a time in submission order. When WEB_STORAGE_QUEUE_DEPTH
+ * jobs are waiting, or every response slot is in use, submit() fails and the
+ * caller answers 503.
+ *
+ * Thread-safety: submit() is called from the AsyncTCP task, complete() from
+ * the job function. Counters may be read from any task.
+ */
+class StorageWorker {
+public:
+    StorageWorker();
+
+    /**
+     * @brief Create the queue
+     * @param run Function that performs each job
+     * @param context Passed to run
+     * @return true if initialization successful
+     */
+    bool begin(StorageJobFunction run, void* context);
+
+    /**
+     * @brief Start the worker task
+     * @return true if the task started
+     */
+    bool start();
+
+    /**
+     * @brief Queue a job that answers an HTTP request
+     * On success the request has been answered with a response that is sent
+     * once the job completes.
+     * @param job Job (slot is filled in)
+     * @param request Request to answer; must not be answered by the caller if this succeeds
+     * @return false if the queue or the response slots are full
+     */
+    bool submit(StorageJob& job, AsyncWebServerRequest* request);
+
+    /**
+     * @brief Queue a job that answers a WebSocket client (job.clientId)
+     * @param job Job
+     * @return false if the queue is full
+     */
+    bool submit(StorageJob& job);
+
+    /**
+     * @brief Hand an HTTP job's result to AsyncTCP for sending
+     * Skips serializing if the client has already gone
+     * @param job Job being run
+     * @param code HTTP status code
+     * @param doc Response body
+     * @param etag ETag header for a 200 response, or nullptr
+     */
+    void complete(const StorageJob& job, int code, const JsonDocument& doc, const char* etag);
+
+    /**
+     * @brief Get number of jobs run
+     * @return Job count
+     */
+    uint32_t getCompletedCount() const;
+
+    /**
+     * @brief Get number of jobs refused because the queue was full
+     * @return Rejection count
+     */
+    uint32_t getRejectedCount() const;
+
+    /**
+     * @brief Get number of HTTP responses not sent because the client disconnected first
+     * @return Abandoned count
+     */
+    uint32_t getAbandonedCount() const;
+
+    /**
+     * @brief Get number of jobs waiting to run
+     * @return Queue depth
+     */
+    uint8_t getQueueDepth() const;
+
+private:
+    friend class StorageResponse;
+
+    enum SlotState : uint8_t {
+        SLOT_FREE,
+        SLOT_QUEUED,     // Job queued or running
+        SLOT_READY,      // Result stored; owned by the StorageResponse until it is deleted
+        SLOT_ABANDONED   // Response deleted before the result was ready; the worker frees it
+    };
+
+    struct ResponseSlot {
+        std::atomic<uint8_t> state;  // SlotState
+        int code;
+        char etag[WEB_ETAG_SIZE];    // Empty if none
+        char* body;                  // Heap, or nullptr for the out-of-memory body
+        size_t length;
+    };
+
+    StorageJobFunction run;
+    void* context;
+    bool running;
+
+    ResponseSlot slots[WEB_STORAGE_RESPONSE_SLOTS];
+
+    QueueHandle_t queue;
+    StaticQueue_t queueBuffer;
+    uint8_t queueStorage[WEB_STORAGE_QUEUE_DEPTH * sizeof(StorageJob)];
+
+    std::atomic<uint32_t> completedCount;
+    std::atomic<uint32_t> rejectedCount;
+    std::atomic<uint32_t> abandonedCount;
+
+    // Static task storage
+    StackType_t taskStack[WEB_STORAGE_STACK_SIZE];
+    StaticTask_t taskBuffer;
+    TaskHandle_t taskHandle;
+
+    bool answered;  // complete() called for the job being run (worker task only)
+
+    /**
+     * @brief Store a result in a slot and mark it ready (worker task)
+     * @param slot Slot index
+     * @param code HTTP status code
+     * @param body Heap body (taken over), or nullptr for an out-of-memory 500
+     * @param length Body length
+     * @param etag ETag header for a 200 response, or nullptr
+     */
+    void publish(uint8_t slot, int code, char* body, size_t length, const char* etag);
+
+    /**
+     * @brief Give up a slot from the response side (AsyncTCP task, response deleted)
+     * @param slot Slot index
+     * @param sent true if the response was sent
+     */
+    void release(uint8_t slot, bool sent);
+
+    /**
+     * @brief Free a slot's body and mark it free
+     * @param slot Slot index
+     */
+    void freeSlot(uint8_t slot);
+
+    /**
+     * @brief FreeRTOS task function (static wrapper)
+     */
+    static void taskFunction(void* parameters);
+};
+
+#endif // STORAGE_WORKER_H
@@ -0,0 +1,180 @@
+#ifndef TELEMETRY_PUBLISHER_H
+#define TELEMETRY_PUBLISHER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "config/HardwareConfig.h"
+#include "config/NetworkConfig.h"
+#include "hal/DosingHead.h"
+#include "hal/MotorDriver.h"
+#include "network/wifi_manager.h"
+#include "network/JsonArena.h"
+#include "network/MdnsAdvertiser.h"
+#include "network/WebSocketSessions.h"
+#include "scheduling/ScheduleManager.h"
+#include "scheduling/DoseWorkerPool.h"
+
+// Forward declaration to avoid circular dependency
+class DosingLogManager;
+
+/**
+ * @brief Pushes device state to WebSocket clients
+ *
+ * A client that needs a resync (new connection, changed subscriptions or
+ * dropped diffs) is sent a "snapshot" of its topics. Otherwise clients receive
+ * "state" messages holding only what changed, one message per topic:
+ * - doses: dose progress (at most once per WS_PROGRESS_INTERVAL_MS per head)
+ * - motors: motor start/stop and queue depths
+ * - config: schedules and calibration
+ * - wifi: WiFi mode and connectivity
+ * - logs: log version (clients refetch logs when it changes)
+ * Changes are detected from the subsystems' version counters once per
+ * WS_TELEMETRY_WINDOW_MS, so a burst of events becomes a single message.
+ * The publisher task also runs WebSocketSessions::maintain() and, if set,
+ * MdnsAdvertiser::maintain().
+ *
+ * Thread-safety: Everything runs on the publisher task; getMessagesSent() may
+ * be called from any task.
+ */
+class TelemetryPublisher {
+public:
+    TelemetryPublisher();
+
+    /**
+     * @brief Initialize the publisher
+     * @param ws WebSocket to publish on
+     * @param sessions Client sessions (subscriptions and send queues)
+     * @param dosingHeads Array of dosing head pointers
+     * @param numHeads Number of dosing heads (max NUM_MOTORS)
+     * @param motorDriver Motor driver
+     * @param wifiMgr WiFi manager
+     * @param schedMgr Schedule manager (optional)
+     * @param logMgr Dosing log manager (optional)
+     * @param dosePool Dose worker pool (optional)
+     * @return true if initialization successful
+     */
+    bool begin(AsyncWebSocket* ws, WebSocketSessions* sessions, DosingHead** dosingHeads, uint8_t numHeads,
+               MotorDriver* motorDriver, WiFiManager* wifiMgr, ScheduleManager* schedMgr,
+               DosingLogManager* logMgr, DoseWorkerPool* dosePool);
+
+    /**
+     * @brief Set the mDNS advertiser whose status hash the task keeps current (call before start())
+     * @param mdns Advertiser
+     */
+    void setAdvertiser(MdnsAdvertiser* mdns);
+
+    /**
+     * @brief Start the publisher task
+     * @return true if the task started
+     */
+    bool start();
+
+    /**
+     * @brief Get number of WebSocket messages published
+     * @return Message count (snapshots and state diffs)
+     */
+    uint32_t getMessagesSent() const;
+
+private:
+    /**
+     * @brief Last published state of one head (the diff baseline)
+     */
+    struct HeadState {
+        bool running;
+        uint8_t queuedDoses;
+        uint32_t calibrationVersion;
+        bool hasSchedule;
+        Schedule schedule;
+        uint32_t lastProgressMs;
+    };
+
+    AsyncWebSocket* ws;
+    WebSocketSessions* sessions;
+    DosingHead** dosingHeads;
+    uint8_t numHeads;
+    MotorDriver* motorDriver;
+    WiFiManager* wifiManager;
+    ScheduleManager* scheduleManager;
+    DosingLogManager* logManager;
+    DoseWorkerPool* doseWorkerPool;
+    MdnsAdvertiser* advertiser;
+    bool initialized;
+    bool running;
+
+    // Diff baseline, only touched by the publisher task
+    HeadState published[NUM_MOTORS];
+    uint32_t motorVersion;
+    uint32_t poolVersion;
+    uint32_t scheduleVersion;
+    uint32_t wifiVersion;
+    uint32_t logVersion;
+
+    std::atomic<uint32_t> messagesSent;
+
+    // Backing memory for the publisher's JSON documents
+    alignas(8) uint8_t arenaBuffer[WS_TELEMETRY_ARENA_SIZE];
+    JsonArena arena;
+
+    // Static task storage
+    StackType_t taskStack[WS_TELEMETRY_STACK_SIZE];
+    StaticTask_t taskBuffer;
+    TaskHandle_t taskHandle;
+
+    /**
+     * @brief FreeRTOS task function (static wrapper)
+     */
+    static void taskFunction(void* parameters);
+
+    /**
+     * @brief Publisher loop: session maintenance, diffs, then pending snapshots
+     */
+    void run();
+
+    /**
+     * @brief Diff current state against the baseline and publish each changed topic
+     * The baseline is kept current even with no subscribers
+     */
+    void publishChanges();
+
+    /**
+     * @brief Send a snapshot of the given topics to one client
+     * @param clientId Client to send to
+     * @param topics WsTopic bit mask
+     */
+    void sendSnapshot(uint32_t clientId, uint8_t topics);
+
+    /**
+     * @brief Add the sections of one topic to a message
+     * @param doc Message being built
+     * @param topic Single WsTopic bit
+     * @param full true for a snapshot (every entry, baseline untouched),
+     *             false for a diff (changed entries only, baseline updated)
+     * @param now Current millis()
+     * @return true if anything was added
+     */
+    bool appendTopic(JsonDocument& doc, uint8_t topic, bool full, uint32_t now);
+
+    bool appendHeads(JsonDocument& doc, bool full);
+    bool appendProgress(JsonDocument& doc, bool full, uint32_t now);
+    bool appendSchedules(JsonDocument& doc, bool full);
+    bool appendCalibration(JsonDocument& doc, bool full);
+    bool appendWifi(JsonDocument& doc, bool full);
+    bool appendLogs(JsonDocument& doc, bool full);
+
+    /**
+     * @brief Serialize a message into a WebSocket buffer and send it
+     * @param doc Message
+     * @param topic WsTopic to publish to subscribers of, or 0 to send to clientId only
+     * @param clientId Client to send to when topic is 0
+     * @return true if sent
+     */
+    bool send(const JsonDocument& doc, uint8_t topic, uint32_t clientId);
+
+    static bool sameSchedule(const Schedule& a, const Schedule& b);
+};
+
+#endif // TELEMETRY_PUBLISHER_H
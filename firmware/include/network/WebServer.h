@@ -6,7 +6,17 @@
 #include "hal/DosingHead.h"
 #include "hal/MotorDriver.h"
 #include "network/wifi_manager.h"
+#include "network/ResponseCache.h"
+#include "network/JsonArena.h"
+#include "network/RequestBodyPool.h"
+#include "network/TelemetryPublisher.h"
+#include "network/ApiRouter.h"
+#include "network/StorageWorker.h"
+#include "network/MdnsAdvertiser.h"
+#include "config/NetworkConfig.h"
 #include "scheduling/ScheduleManager.h"
+#include "scheduling/DoseWorkerPool.h"
+#include "scheduling/ConfigTransaction.h"
 
 // Forward declaration to avoid circular dependency
 class DosingLogManager;
@@ -22,7 +32,13 @@ class DosingLogManager;
  * - WiFi management
  * - Schedule management (CRUD operations)
  *
- * WebSocket for real-time updates of dosing progress
+ * WebSocket for real-time updates: a state snapshot on connect, then
+ * coalesced diffs from TelemetryPublisher, plus dose and emergency stop events,
+ * filtered by each client's topic subscriptions (WebSocketSessions)
+ *
+ * Requests that read or write NVS (logs, schedule changes, batches) are validated on
+ * the AsyncTCP task and answered from the StorageWorker task, so slow flash
+ * never stalls other connections.
  *
  * Thread-safety: AsyncWebServer is thread-safe, but shared resources (DosingHead, MotorDriver)
  * should be accessed with appropriate synchronization if used from multiple tasks
@@ -43,9 +59,10 @@ public:
      * @param wifiMgr Pointer to WiFiManager instance
      * @param schedMgr Pointer to ScheduleManager instance (optional)
      * @param logMgr Pointer to DosingLogManager instance (optional)
+     * @param dosePool Pointer to DoseWorkerPool instance that runs ad-hoc doses (optional)
      * @return true if initialization successful
      */
-    bool begin(DosingHead** dosingHeads, uint8_t numHeads, MotorDriver* motorDriver, WiFiManager* wifiMgr, ScheduleManager* schedMgr = nullptr, DosingLogManager* logMgr = nullptr);
+    bool begin(DosingHead** dosingHeads, uint8_t numHeads, MotorDriver* motorDriver, WiFiManager* wifiMgr, ScheduleManager* schedMgr = nullptr, DosingLogManager* logMgr = nullptr, DoseWorkerPool* dosePool = nullptr);
 
     /**
      * @brief Stop the web server
@@ -53,10 +70,13 @@ public:
     void stop();
 
     /**
-     * @brief Send a message to all connected WebSocket clients
-     * @param message JSON message to send
+     * @brief Serialize an event straight into a WebSocket buffer and send it to subscribed clients
+     * With WsSendPolicy::DROP, clients whose send queue is full miss the event (counted as a drop)
+     * @param doc JSON document to send
+     * @param topics WsTopic bit mask; clients subscribed to any of them receive it
+     * @param policy WsSendPolicy::CRITICAL sends to every client and closes full ones
      */
-    void broadcastWebSocket(const String& message);
+    void broadcastWebSocket(const JsonDocument& doc, uint8_t topics, WsSendPolicy policy = WsSendPolicy::DROP);
 
     /**
      * @brief Check if server is running
@@ -73,44 +93,220 @@ private:
     WiFiManager* wifiManager;
     ScheduleManager* scheduleManager;
     DosingLogManager* logManager;
+    DoseWorkerPool* doseWorkerPool;
     bool running;
+    uint32_t bootId;  // Random per boot, so ETags never repeat across restarts
+
+    // Backing memory for every JsonDocument built by a request handler; reset
+    // at the end of each handler (all handlers run on the AsyncTCP task)
+    alignas(8) uint8_t requestArenaBuffer[WEB_JSON_ARENA_SIZE];
+    JsonArena requestArena;
+
+    // Same for documents built on the storage worker task, sized for the largest hourly logs reply
+    alignas(8) uint8_t storageArenaBuffer[WEB_STORAGE_ARENA_SIZE];
+    JsonArena storageArena;
+
+    // Reassembly buffers for POST bodies and WebSocket RPC frames split across TCP segments
+    RequestBodyPool bodyPool;
+
+    // Serialized bodies of the polled read endpoints, keyed on subsystem versions
+    ResponseCache statusCache;
+    ResponseCache calibrationCache;
+    ResponseCache schedulesCache;
+
+    // WebSocket client subscriptions, liveness and send-queue limits
+    WebSocketSessions wsSessions;
+
+    // Pushes state snapshots and diffs to WebSocket clients
+    TelemetryPublisher telemetry;
+
+    // REST routes (registered with the server as a single handler)
+    ApiRouter router;
+
+    // Runs NVS-backed requests off the AsyncTCP task
+    StorageWorker storageWorker;
+
+    /**
+     * @brief A validated /api/batch, staged on AsyncTCP and committed on the storage worker
+     * Reserving flash queue room can wait for a running dose to end, which the
+     * AsyncTCP task must never do.
+     */
+    struct PendingBatch {
+        ConfigTransaction transaction;
+        DoseJob doses[WEB_BATCH_MAX_OPERATIONS];
+        int8_t doseIndex[WEB_BATCH_MAX_OPERATIONS];  // Position in doses[] per operation, -1 if not a dose
+        char ops[WEB_BATCH_MAX_OPERATIONS][WEB_BATCH_OP_SIZE];
+        uint8_t opCount;
+    };
+    PendingBatch batch;
+    std::atomic<bool> batchPending;  // Set by AsyncTCP when it submits batch, cleared by the worker
+
+    // _squaredose._tcp service with the status hash in its TXT record
+    MdnsAdvertiser mdns;
+    uint16_t port;
 
     // REST API Handlers
     void handleGetStatus(AsyncWebServerRequest* request);
     void handlePostDose(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+    void handlePostDoseCancel(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
     void handlePostCalibrate(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
     void handleGetCalibration(AsyncWebServerRequest* request);
+    void handleGetHeadCalibration(AsyncWebServerRequest* request, uint8_t head);
     void handlePostEmergencyStop(AsyncWebServerRequest* request);
     void handleGetWifiStatus(AsyncWebServerRequest* request);
     void handlePostWifiConfigure(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
     void handlePostWifiReset(AsyncWebServerRequest* request);
+    void handlePostBatch(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
 
     // Schedule API Handlers
     void handleGetAllSchedules(AsyncWebServerRequest* request);
-    void handleGetSchedule(AsyncWebServerRequest* request);
+    void handleGetSchedule(AsyncWebServerRequest* request, uint8_t head);
     void handlePostSchedule(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
-    void handleDeleteSchedule(AsyncWebServerRequest* request);
+    void handleDeleteSchedule(AsyncWebServerRequest* request, uint8_t head);
 
     // Dosing Log API Handlers
     void handleGetDashboard(AsyncWebServerRequest* request);
     void handleGetHourlyLogs(AsyncWebServerRequest* request);
     void handleDeleteLogs(AsyncWebServerRequest* request);
 
+    // Prometheus metrics
+    void handleGetMetrics(AsyncWebServerRequest* request);
+
     // Time Sync API Handlers
     void handleGetTime(AsyncWebServerRequest* request);
     void handlePostTime(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
 
+    // Power profile API Handlers
+    void handleGetPower(AsyncWebServerRequest* request);
+    void handlePostPower(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+
     // WebSocket Handlers
     void handleWebSocketEvent(AsyncWebSocket* server, AsyncWebSocketClient* client,
                              AwsEventType type, void* arg, uint8_t* data, size_t len);
 
+    /**
+     * @brief Dispatch a WebSocket RPC request and reply to the sender
+     * Request: {"id": any, "method": "dose"|"cancel"|"setSchedule"|"getLogs"|"subscribe", "params": {...}}
+     * Reply: {"type": "response", "id": same, "status": HTTP code, "result": REST response body}
+     * Error replies echo the id too, including for oversized or fragmented messages
+     */
+    void handleWebSocketRpc(AsyncWebSocketClient* client, AwsFrameInfo* info, uint8_t* data, size_t len);
+
+    // Operations shared by the REST routes and WebSocket RPC; each fills in the
+    // response body and returns the HTTP status code
+    int executeDose(JsonVariantConst params, JsonObject response);
+    int executeDoseCancel(JsonVariantConst params, JsonObject response);
+    int executeSubscribe(uint32_t clientId, JsonVariantConst params, JsonObject response);
+
+    /**
+     * @brief Validate a setSchedule/getLogs RPC and queue it for the storage worker
+     * @return 0 once queued (the worker sends the reply), otherwise the error status
+     */
+    int submitRpcStorageJob(uint32_t clientId, JsonVariantConst id, JsonVariantConst params,
+                            bool getLogs, JsonObject response);
+
+    // Storage operations (storage worker task only)
+    int executeSaveSchedule(Schedule& sched, JsonObject response);
+    int executeDeleteSchedule(uint8_t head, JsonObject response);
+    int executeGetDashboard(JsonObject response);
+    int executeGetHourlyLogs(uint32_t hours, uint32_t start, uint32_t end, JsonObject response);
+    int executeDeleteLogs(JsonObject response);
+    int executeBatch(JsonObject response);
+
+    /**
+     * @brief Queue a storage job for an HTTP request, or answer 503 if the worker is busy
+     * @param request Request (answered by the worker on success)
+     * @param job Job to queue
+     */
+    void submitStorageJob(AsyncWebServerRequest* request, StorageJob& job);
+
+    /**
+     * @brief Run a storage job and send its HTTP response or WebSocket reply
+     * @param job Job
+     */
+    void runStorageJob(const StorageJob& job);
+
     // Helper methods
     void setupRoutes();
-    void sendJsonResponse(AsyncWebServerRequest* request, int code, const JsonDocument& doc);
+    void sendJsonResponse(AsyncWebServerRequest* request, int code, const JsonDocument& doc, const char* etag = nullptr);
+    void sendCachedResponse(AsyncWebServerRequest* request, ResponseCache& cache, uint32_t version,
+                            ResponseBuildFunction build, const char* etag);
     void sendErrorResponse(AsyncWebServerRequest* request, int code, const String& message);
-    bool validateDosingRequest(const JsonDocument& doc, uint8_t& head, float& volume, String& error);
-    bool validateCalibrationRequest(const JsonDocument& doc, uint8_t& head, float& actualVolume, String& error);
-    bool validateScheduleRequest(const JsonDocument& doc, Schedule& sched, String& error);
+    void sendWebSocket(uint32_t clientId, const JsonDocument& doc);
+    static int errorResult(JsonObject response, int code, const String& message);
+    void sendParseError(AsyncWebServerRequest* request, const DeserializationError& error);
+    bool parseJsonBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total, JsonDocument& doc);
+    bool validateDosingRequest(JsonVariantConst doc, uint8_t& head, float& volume, String& error);
+    bool validateCalibrationRequest(JsonVariantConst doc, uint8_t& head, float& actualVolume, String& error);
+    bool validateCalibrationPointsRequest(JsonVariantConst doc, uint8_t& head, CalibrationPoint* points, uint8_t& count, String& error);
+    bool validateScheduleRequest(JsonVariantConst doc, Schedule& sched, String& error);
+
+    /**
+     * @brief Validate one /api/batch operation and stage it
+     * Schedule and calibration changes go into the transaction; doses are
+     * appended to doses[] for submission after the commit
+     * @return true if the operation is valid
+     */
+    bool stageBatchOperation(JsonVariantConst op, ConfigTransaction& transaction,
+                             DoseJob* doses, uint8_t& doseCount, String& error);
+
+    /**
+     * @brief Format a strong ETag from the version counters a response depends on
+     * @param etag Output buffer
+     * @param resource Resource name (keeps ETags of different endpoints apart)
+     * @param version Version key of the resource
+     * @param rangeStart Start of the requested range (0 if none)
+     * @param rangeEnd End of the requested range (0 if none)
+     */
+    void formatETag(char (&etag)[WEB_ETAG_SIZE], const char* resource, uint32_t version,
+                    uint32_t rangeStart = 0, uint32_t rangeEnd = 0) const;
+
+    /**
+     * @brief Answer 304 Not Modified if the client already has this version
+     * Called before the response is built, so a match costs no JSON work
+     * @param request Request (If-None-Match is checked)
+     * @param etag Current ETag of the resource
+     * @return true if the 304 was sent
+     */
+    bool sendIfNotModified(AsyncWebServerRequest* request, const char* etag);
+
+    /**
+     * @brief Resolve the time range of an hourly log query
+     * A relative range ("last N hours") is aligned to hour boundaries, so the
+     * response only changes when the hour rolls over or logs change
+     * @param hours Hours to cover (0 = 24, capped at 336)
+     * @param start Explicit start time (0 = relative range)
+     * @param end Explicit end time (0 = relative range)
+     * @param startTime Output start time
+     * @param endTime Output end time
+     * @return false if the clock is not synchronized
+     */
+    static bool resolveLogRange(uint32_t hours, uint32_t start, uint32_t end, uint32_t& startTime, uint32_t& endTime);
+
+    // Response cache keys (sums of the versions each response depends on)
+    uint32_t getStatusVersion();
+    uint32_t getCalibrationVersion() const;
+
+    /**
+     * @brief Status hash for /api/status and the mDNS st record
+     * @param version getStatusVersion()
+     * @return Value that differs for every status version and boot
+     */
+    uint32_t getStatusHash(uint32_t version) const;
+
+    // MdnsAdvertiser status hash source (context is the WebServer)
+    static uint32_t computeStatusHash(void* context);
+
+    // Response cache builders (context is the WebServer)
+    static void buildStatusResponse(JsonDocument& doc, void* context);
+    static void buildCalibrationResponse(JsonDocument& doc, void* context);
+    static void buildSchedulesResponse(JsonDocument& doc, void* context);
+
+    // Storage worker job function (context is the WebServer)
+    static void onStorageJob(const StorageJob& job, void* context);
+
+    // Dose worker pool completion callback for ad-hoc doses
+    static void onAdhocDoseComplete(const DoseJob& job, const DosingResult& result, void* context);
 
     // WebSocket event handler wrapper (for C-style callback)
     static void onWebSocketEventStatic(AsyncWebSocket* server, AsyncWebSocketClient* client,
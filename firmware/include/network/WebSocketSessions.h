@@ -0,0 +1,201 @@
+#ifndef WEBSOCKET_SESSIONS_H
+#define WEBSOCKET_SESSIONS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <ESPAsyncWebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config/NetworkConfig.h"
+
+/**
+ * @brief WebSocket topics a client can subscribe to (bit mask)
+ */
+enum WsTopic : uint8_t {
+    WS_TOPIC_DOSES  = 0x01,  // Dose events and dose progress
+    WS_TOPIC_MOTORS = 0x02,  // Motor running state and queue depths
+    WS_TOPIC_CONFIG = 0x04,  // Schedule and calibration changes
+    WS_TOPIC_WIFI   = 0x08,  // WiFi mode and connectivity
+    WS_TOPIC_LOGS   = 0x10,  // Dosing log changes
+    WS_TOPIC_ALL    = 0x1F
+};
+
+/**
+ * @brief What to do when a client's send queue is full
+ */
+enum class WsSendPolicy : uint8_t {
+    DROP,      // Skip the message for that client (events)
+    COALESCE,  // Skip it and resend a full snapshot once the queue drains (state diffs)
+    CRITICAL   // Send to every client regardless of topics; close a full client (safety events)
+};
+
+/**
+ * @brief Per-client state for /ws connections
+ *
+ * Tracks each connected client's topic subscriptions and liveness. Messages
+ * are sent to each subscribed client individually. A client whose send queue
+ * is full is skipped, so a slow client never holds up the others. The queue
+ * bound is the library's WS_MAX_QUEUED_MESSAGES (set in platformio.ini).
+ * Skipped state diffs are coalesced: the client is marked for a resync and
+ * gets one fresh snapshot when it catches up. Critical messages are never
+ * skipped: a client that cannot take one is closed, so it reconnects and
+ * starts over from a snapshot instead of silently missing it.
+ *
+ * maintain() pings idle clients, closes clients that stop answering and
+ * calls cleanupClients() to free disconnected ones.
+ *
+ * Thread-safety: All public methods are mutex protected and may be called
+ * from any task.
+ */
+class WebSocketSessions {
+public:
+    WebSocketSessions();
+    ~WebSocketSessions();
+
+    /**
+     * @brief Initialize session tracking
+     * @param ws WebSocket the sessions belong to
+     * @return true if initialization successful
+     */
+    bool begin(AsyncWebSocket* ws);
+
+    /**
+     * @brief Register a newly connected client (subscribed to all topics)
+     * The client is marked for a resync so it receives a snapshot
+     * @param client Connected client
+     * @return false if all WS_MAX_CLIENTS slots are taken (client is closed)
+     */
+    bool onConnect(AsyncWebSocketClient* client);
+
+    /**
+     * @brief Forget a disconnected client
+     * @param clientId Client ID
+     */
+    void onDisconnect(uint32_t clientId);
+
+    /**
+     * @brief Record that a client is alive (pong or data received)
+     * @param clientId Client ID
+     */
+    void onActivity(uint32_t clientId);
+
+    /**
+     * @brief Replace a client's subscriptions and queue a snapshot of the new topics
+     * @param clientId Client ID
+     * @param topics WsTopic bit mask
+     * @return true if the client has a session
+     */
+    bool setTopics(uint32_t clientId, uint8_t topics);
+
+    /**
+     * @brief Send a message to every client subscribed to a topic
+     * @param topic WsTopic bit the message belongs to (ignored for WsSendPolicy::CRITICAL)
+     * @param buffer Serialized message (shared between clients)
+     * @param policy What to do for clients whose queue is full
+     * @return Number of clients the message was queued for
+     */
+    uint8_t publish(uint8_t topic, AsyncWebSocketMessageBuffer* buffer, WsSendPolicy policy);
+
+    /**
+     * @brief Check if any client is subscribed to a topic
+     * @param topic WsTopic bit mask
+     * @return true if at least one client would receive it
+     */
+    bool hasSubscribers(uint8_t topic);
+
+    /**
+     * @brief Take the next client that needs a snapshot and has room to receive it
+     * @param clientId Output client ID
+     * @param topics Output subscriptions of that client
+     * @return true if a client was returned
+     */
+    bool takeResync(uint32_t& clientId, uint8_t& topics);
+
+    /**
+     * @brief Ping, time out and clean up clients
+     * Cheap to call often; does work at most every WS_MAINTENANCE_INTERVAL_MS
+     */
+    void maintain();
+
+    /**
+     * @brief Get number of tracked clients
+     * @return Client count
+     */
+    uint8_t getClientCount();
+
+    /**
+     * @brief Get number of event messages dropped for full client queues
+     * @return Drop count
+     */
+    uint32_t getDroppedCount() const;
+
+    /**
+     * @brief Get number of state diffs replaced by a resync snapshot
+     * @return Coalesced message count
+     */
+    uint32_t getCoalescedCount() const;
+
+    /**
+     * @brief Get number of clients closed because a critical message found their queue full
+     * @return Eviction count
+     */
+    uint32_t getEvictedCount() const;
+
+    /**
+     * @brief Get number of clients closed for not answering pings
+     * @return Timeout count
+     */
+    uint32_t getTimeoutCount() const;
+
+    /**
+     * @brief Map a topic name ("doses", "motors", "config", "wifi", "logs") to its bit
+     * @param name Topic name
+     * @return WsTopic bit, or 0 if unknown
+     */
+    static uint8_t parseTopic(const char* name);
+
+    /**
+     * @brief Get the name of a single topic bit
+     * @param topic WsTopic bit
+     * @return Topic name, or nullptr if not a single known topic
+     */
+    static const char* topicName(uint8_t topic);
+
+private:
+    struct Session {
+        bool active;
+        uint32_t clientId;
+        uint8_t topics;
+        bool needsResync;     // Send a snapshot before further diffs
+        uint32_t lastSeenMs;  // Last pong or data from the client
+        uint32_t lastPingMs;
+    };
+
+    AsyncWebSocket* ws;
+    SemaphoreHandle_t mutex;
+    StaticSemaphore_t mutexBuffer;
+    Session sessions[WS_MAX_CLIENTS];
+    uint32_t lastMaintenanceMs;
+
+    std::atomic<uint32_t> droppedCount;
+    std::atomic<uint32_t> coalescedCount;
+    std::atomic<uint32_t> evictedCount;
+    std::atomic<uint32_t> timeoutCount;
+
+    /**
+     * @brief Find the session of a client (mutex must be held)
+     * @param clientId Client ID
+     * @return Session, or nullptr if not tracked
+     */
+    Session* findSession(uint32_t clientId);
+
+    /**
+     * @brief Look up a session's client if it can take another message (mutex must be held)
+     * @param session Session
+     * @param full Output: true if the client is connected but its queue is full
+     * @return Client, or nullptr if gone or full
+     */
+    AsyncWebSocketClient* sendableClient(const Session& session, bool& full);
+};
+
+#endif // WEBSOCKET_SESSIONS_H
@@ -2,8 +2,11 @@
 #define WIFI_MANAGER_H
 
 #include <Arduino.h>
+#include <atomic>
 #include <WiFi.h>
-#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include "config/NetworkConfig.h"
 
 enum WifiManagerMode {
@@ -12,6 +15,63 @@ enum WifiManagerMode {
     WIFIMANAGER_MODE_TRANSITIONING
 };
 
+/**
+ * @brief Published WiFi state, copied out by readers
+ */
+struct WiFiStatus {
+    WifiManagerMode mode;
+    bool connected;        // STA: associated; AP: at least one client
+    char ipAddress[16];    // "No IP" while not reachable
+    char ssid[33];         // STA network (empty in AP mode)
+    bool apActive;         // Provisioning AP is up (also while STA joins or settles)
+};
+
+/**
+ * @brief Owns the WiFi mode (AP or STA) and the stored credentials
+ *
+ * Mode changes and connection attempts are made by one state machine that
+ * runs on the keep-alive task (and on the caller of begin() during boot).
+ * It sleeps on an event queue fed by WiFi.onEvent (got IP, disconnected with
+ * the driver's reason code, AP clients joining/leaving) and by mode requests,
+ * waking early only for its own deadlines:
+ *
+ *   AP -> CONNECTING             credentials stored, WIFI_STA_RETRY_INTERVAL_MS after the last try
+ *   CONNECTING -> CONNECTED      got IP
+ *   CONNECTING -> AP             credentials rejected, or WIFI_STA_TIMEOUT_MS without an IP
+ *   CONNECTED -> RECONNECTING    disconnected (the first retry is immediate)
+ *   CONNECTING/RECONNECTING -> BACKOFF   attempt failed; waits WIFI_BACKOFF_INITIAL_MS,
+ *                                doubling per failure up to WIFI_BACKOFF_MAX_MS
+ *   BACKOFF -> CONNECTING/RECONNECTING   backoff elapsed
+ *   RECONNECTING/BACKOFF -> AP   link down for WIFI_STA_FAIL_THRESHOLD_MS
+ *
+ * No transition turns the radio off. Joining from AP mode runs in WIFI_AP_STA:
+ * the AP stays up (and is still reported as AP mode) while STA connects, and
+ * is only torn down once STA has stayed connected for WIFI_AP_HANDOFF_MS.
+ * Falling back to AP brings the AP up before the station is dropped. While
+ * both run, the AP follows the station's channel, so AP clients may have to
+ * re-associate once when the station joins.
+ *
+ * Fast reconnect: after every successful connection the AP's BSSID and
+ * channel and the DHCP lease are cached in NVS (written only when they
+ * change). The next attempt joins that BSSID on its channel without a scan,
+ * optionally reusing the lease as a static IP (WIFI_STATIC_IP_FROM_CACHE).
+ * If a cached attempt fails, the next attempt is a full scan with DHCP.
+ *
+ * Connect (boot or AP to IP) and reconnect (link lost to IP) durations are
+ * reported to Metrics. A WIFI_CHECK_INTERVAL_MS backstop check catches link
+ * changes whose events were dropped.
+ *
+ * Connecting takes seconds, so nothing is locked while it runs: the state
+ * machine publishes a WiFiStatus snapshot after every change and readers copy
+ * the latest one without taking a lock.
+ *
+ * Other tasks ask for a mode change with requestSTAMode()/requestAPMode(),
+ * which return immediately; the state machine applies the request
+ * WIFI_SWITCH_DELAY_MS later so an HTTP response can leave first.
+ *
+ * Thread-safety: All public methods may be called from any task.
+ * Credentials are protected by a mutex that is never held across WiFi calls.
+ */
 class WiFiManager {
 public:
     WiFiManager();
@@ -19,6 +79,10 @@ public:
 
     void initMutex();
 
+    /**
+     * @brief Load credentials and bring up STA (falling back to AP) before returning
+     * @return true
+     */
     bool begin();
 
     bool setCredentials(const char* ssid, const char* password);
@@ -27,36 +91,206 @@ public:
 
     bool clearCredentials();
 
-    bool switchToSTAMode();
+    /**
+     * @brief Ask the state machine to connect as a station with the stored credentials
+     */
+    void requestSTAMode();
+
+    /**
+     * @brief Ask the state machine to switch to access point mode
+     */
+    void requestAPMode();
+
+    /**
+     * @brief Copy the latest published state (lock-free)
+     * @param status Output
+     */
+    void getStatus(WiFiStatus& status) const;
 
-    bool switchToAPMode();
+    WifiManagerMode getCurrentMode() const;
 
-    WifiManagerMode getCurrentMode();
+    bool isConnected() const;
 
-    bool isConnected();
+    String getLocalIP() const;
 
-    String getLocalIP();
+    String getAPSSID() const;
 
-    String getAPSSID();
+    // Counter that increases on every mode or connectivity change
+    uint32_t getStateVersion() const;
 
     static void keepAliveTask(void* parameters);
 
 private:
-    // Thread-safe mutex for shared state protection
-    SemaphoreHandle_t stateMutex;
+    enum LinkState : uint8_t {
+        LINK_AP,
+        LINK_CONNECTING,    // Joining from AP or boot; falls back to AP on failure
+        LINK_CONNECTED,
+        LINK_RECONNECTING,  // Link lost, attempt in progress
+        LINK_BACKOFF        // Link lost, waiting before the next attempt
+    };
+
+    enum EventType : uint8_t {
+        EVENT_STA_GOT_IP,
+        EVENT_STA_DISCONNECTED,
+        EVENT_AP_CLIENTS_CHANGED,
+        EVENT_REQUEST_STA,
+        EVENT_REQUEST_AP
+    };
+
+    struct LinkCache {
+        uint8_t version;
+        uint8_t channel;
+        uint8_t bssid[6];
+        uint32_t ip;            // Lease (IPAddress as uint32_t)
+        uint32_t gateway;
+        uint32_t subnet;
+        uint32_t dns;
+        char ssid[33];          // Network the cache belongs to
+    };
+
+    struct LinkEvent {
+        EventType type;
+        uint8_t reason;         // EVENT_STA_DISCONNECTED: driver reason code
+        unsigned long timeMs;   // When it happened (stale events are ignored)
+    };
 
-    // Shared state (protected by mutex)
-    Preferences preferences;
+    // Credentials (protected by stateMutex)
+    SemaphoreHandle_t stateMutex;
     String currentSSID;
     String currentPassword;
     bool credentialsLoaded;
-    WifiManagerMode currentMode;
+
+    // Set once in begin()
     String apSSID;
-    unsigned long staFailedTime;
+
+    // State machine (owned by the task running step())
+    LinkState linkState;
+    String connectingSSID;
+    unsigned long joinStartTime;      // CONNECTING: when joining began
+    unsigned long connectedTime;      // CONNECTED: when the IP was obtained (AP handoff)
+    unsigned long attemptStartTime;   // Current WiFi.begin() attempt
+    unsigned long staFailedTime;      // RECONNECTING/BACKOFF: when the link was lost
+    LinkState resumeState;            // BACKOFF: LINK_CONNECTING or LINK_RECONNECTING
+    unsigned long backoffStartTime;
+    uint32_t backoffMs;
+    uint8_t failedAttempts;
+    LinkCache linkCache;
+    bool linkCacheValid;
+    bool cachedAttempt;               // Current attempt used the cache
+    bool skipCache;                   // Cached attempt failed: scan until connected again
+    bool staticIPApplied;
+    bool reachable;                   // Boot-to-reachable recorded
+    bool apActive;                    // AP interface is up
     unsigned long lastSTAAttemptTime;
+    unsigned long lastCheckTime;
+    bool requestPending;
+    EventType pendingRequest;         // EVENT_REQUEST_STA or EVENT_REQUEST_AP
+    unsigned long requestTime;
+
+    // Events from the WiFi driver callback and other tasks
+    QueueHandle_t eventQueue;
+    StaticQueue_t eventQueueBuffer;
+    uint8_t eventQueueStorage[WIFI_EVENT_QUEUE_DEPTH * sizeof(LinkEvent)];
+
+    // Published state: the writer fills the slot readers are not using, then
+    // bumps publishCount; readers retry if it moved while they copied
+    WiFiStatus snapshots[2];
+    std::atomic<uint32_t> publishCount;
+
+    /**
+     * @brief Wait for the next event or deadline and advance the state machine (single task at a time)
+     */
+    void step();
+
+    /**
+     * @brief React to one event
+     */
+    void handleEvent(const LinkEvent& event);
+
+    /**
+     * @brief Act on deadlines that have passed (requests, timeouts, backoff, AP retry)
+     */
+    void handleTimers();
+
+    /**
+     * @brief Time until the next deadline
+     * @return Milliseconds (at most WIFI_CHECK_INTERVAL_MS)
+     */
+    uint32_t msUntilNextDeadline() const;
+
+    /**
+     * @brief A join attempt failed: back off, retry or fall back to AP
+     * @param reason Driver reason code (0 for a timeout)
+     */
+    void handleAttemptFailed(uint8_t reason);
+
+    /**
+     * @brief Got an IP while joining or reconnecting
+     */
+    void handleGotIP();
+
+    /**
+     * @brief The connected link went down: start reconnecting immediately
+     * @param reason Driver reason code (0 if found by the backstop check)
+     */
+    void handleLinkLost(uint8_t reason);
+
+    /**
+     * @brief Check if a join or reconnect session has run out of time
+     * @param session LINK_CONNECTING or LINK_RECONNECTING
+     */
+    bool hasGivenUp(LinkState session) const;
+
+    /**
+     * @brief Queue an event for the state machine (never blocks)
+     */
+    bool postEvent(EventType type, uint8_t reason);
+
+    /**
+     * @brief WiFi.onEvent handler (runs on the Arduino event task)
+     */
+    static void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info);
+
+    /**
+     * @brief Leave the current mode and start joining the stored network (returns immediately)
+     * @return false if there are no credentials
+     */
+    bool startJoin();
+
+    /**
+     * @brief Make one WiFi.begin() attempt with the stored credentials
+     * @param state LINK_CONNECTING or LINK_RECONNECTING
+     * @return false if there are no credentials
+     */
+    bool beginAttempt(LinkState state);
+
+    /**
+     * @brief Load the link cache from NVS
+     */
+    void loadLinkCache();
+
+    /**
+     * @brief Cache the current BSSID, channel and lease (NVS write only if they changed)
+     */
+    void updateLinkCache();
+
+    /**
+     * @brief Check if a disconnect reason means the credentials were rejected
+     */
+    static bool isAuthFailure(uint8_t reason);
+
+    /**
+     * @brief Switch to AP mode (the AP comes up before the station is dropped)
+     */
+    void enterAPMode();
+
+    /**
+     * @brief Publish the current state if it differs from the last snapshot
+     */
+    void publishStatus();
 
     // Helper: Check if duration has elapsed (handles millis overflow)
-    bool hasElapsed(unsigned long startTime, unsigned long duration);
+    bool hasElapsed(unsigned long startTime, unsigned long duration) const;
 
     bool loadCredentialsFromNVS();
 
@@ -64,11 +298,16 @@ private:
 
     bool clearCredentialsFromNVS();
 
-    bool connectToSTA();
-
+    /**
+     * @brief Bring up the AP interface, next to the station if one is running
+     * @return true if the AP is up
+     */
     bool startAPMode();
 
-    void stopCurrentMode();
+    /**
+     * @brief Take down the AP interface, leaving the station connected
+     */
+    void stopAPMode();
 
     void generateAPSSID();
 };
@@ -0,0 +1,133 @@
+#ifndef CONFIG_TRANSACTION_H
+#define CONFIG_TRANSACTION_H
+
+#include <Arduino.h>
+#include "config/HardwareConfig.h"
+#include "hal/DosingHead.h"
+#include "scheduling/ScheduleManager.h"
+
+#define CONFIG_JOURNAL_NVS_NAMESPACE "cfgjournal"
+#define CONFIG_JOURNAL_NVS_KEY "pending"
+#define CONFIG_JOURNAL_VERSION 2
+
+/**
+ * @brief Stages schedule and calibration changes and commits them atomically
+ *
+ * Changes are staged per head (a later change to the same head replaces an
+ * earlier one). commit() first writes the whole set as a single NVS blob (the
+ * journal). NVS blob writes are atomic, so once the journal reaches flash the
+ * set is durable. It then applies the changes to their normal keys and removes
+ * the journal. All three steps go through FlashWriter, separated by barriers,
+ * so they reach flash in that order. Queue entries for every write are
+ * reserved first, so a full queue fails the commit before anything is written.
+ * The journal removal is skipped if the writer drops any write queued before
+ * it. If power is lost while the changes are applied, or a write is dropped,
+ * recover() replays the journal at the next boot, so either every change
+ * lands or none does.
+ *
+ * Schedules and calibrations keep their per-head keys: the scheduler rewrites
+ * a head's schedule after every dose, so folding all heads into one blob would
+ * rewrite every head on each dose. The journal therefore costs two writes on
+ * top of one per changed head, and only staged records are written to it. A
+ * single change is already atomic and skips the journal.
+ *
+ * Thread-safety: Not thread-safe. Stage and commit from one task at a time;
+ * commit() may wait for a running dose, so never call it on the AsyncTCP task.
+ */
+class ConfigTransaction {
+public:
+    ConfigTransaction();
+
+    /**
+     * @brief Stage a schedule save
+     * @param sched Schedule (sched.head selects the slot)
+     * @return true if staged
+     */
+    bool setSchedule(const Schedule& sched);
+
+    /**
+     * @brief Stage a schedule delete
+     * @param head Head index
+     * @return true if staged
+     */
+    bool deleteSchedule(uint8_t head);
+
+    /**
+     * @brief Stage a calibration computed with DosingHead::computeCalibration()
+     * @param head Head index
+     * @param update Calibration state
+     * @return true if staged
+     */
+    bool setCalibration(uint8_t head, const CalibrationUpdate& update);
+
+    /**
+     * @brief Check if anything is staged
+     * @return true if no changes are staged
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief Journal the staged changes, apply them, then clear the journal
+     * A transaction with a single change is applied without a journal. The
+     * changes are in effect (and read back) when this returns, but reach flash
+     * in the background; it does not wait for FlashWriter.
+     * @param scheduleManager Schedule manager to apply schedule changes to
+     * @param dosingHeads Dosing heads to apply calibrations to
+     * @param numHeads Number of dosing heads
+     * @return true if every change was applied and its writes queued
+     */
+    bool commit(ScheduleManager* scheduleManager, DosingHead** dosingHeads, uint8_t numHeads);
+
+    /**
+     * @brief Replay a journal left behind by an interrupted commit
+     * Call at boot after the schedule manager and dosing heads are initialized
+     * @param scheduleManager Schedule manager
+     * @param dosingHeads Dosing heads
+     * @param numHeads Number of dosing heads
+     * @return true if there was nothing to recover or the replay succeeded
+     */
+    static bool recover(ScheduleManager* scheduleManager, DosingHead** dosingHeads, uint8_t numHeads);
+
+private:
+    enum RecordKind : uint8_t {
+        SCHEDULE,
+        CALIBRATION
+    };
+
+    /**
+     * @brief One staged change
+     */
+    struct Record {
+        RecordKind kind;
+        uint8_t head;
+        union {
+            ScheduleChange schedule;        // kind == SCHEDULE
+            CalibrationUpdate calibration;  // kind == CALIBRATION
+        };
+    };
+
+    /**
+     * @brief Persisted form of a transaction (written as one blob, up to records[count])
+     */
+    struct Journal {
+        uint8_t version;
+        uint8_t count;  // Records in use
+        Record records[NUM_SCHEDULE_HEADS + NUM_MOTORS];
+    };
+
+    Journal journal;
+
+    /**
+     * @brief Find the staged record for a head, or add an empty one
+     */
+    Record& stage(RecordKind kind, uint8_t head);
+
+    static size_t journalSize(uint8_t count);
+    static bool apply(const Journal& journal, ScheduleManager* scheduleManager,
+                      DosingHead** dosingHeads, uint8_t numHeads);
+    static bool writeJournal(const Journal& journal);
+    static bool readJournal(Journal& journal);
+    static void clearJournal();
+};
+
+#endif // CONFIG_TRANSACTION_H
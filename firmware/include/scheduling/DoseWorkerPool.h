@@ -0,0 +1,178 @@
+#ifndef DOSE_WORKER_POOL_H
+#define DOSE_WORKER_POOL_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include "config/HardwareConfig.h"
+#include "hal/DosingHead.h"
+
+#define DOSE_WORKER_STACK_SIZE 4096       // Stack size per worker (bytes)
+#define DOSE_WORKER_PRIORITY 2            // Same priority as SchedulerTask
+#define DOSE_ADHOC_QUEUE_DEPTH 4          // Pending ad-hoc doses per head
+#define DOSE_SCHEDULED_QUEUE_DEPTH 2      // Pending scheduled doses per head
+
+/**
+ * @brief Origin of a dose job (determines queue priority)
+ */
+enum class DoseSource : uint8_t {
+    SCHEDULED,  // Lowest priority - from ScheduleManager
+    ADHOC       // Manual dose from the REST API
+};
+
+/**
+ * @brief Outcome of submitting a dose job
+ */
+enum class DoseSubmitResult {
+    ACCEPTED,      // Job queued for its head's worker
+    QUEUE_FULL,    // Head's queue for this source is at capacity (backpressure)
+    INVALID_HEAD,  // Head index out of range
+    NOT_RUNNING    // Pool not started
+};
+
+struct DoseJob;
+
+/**
+ * @brief Called on the worker task when a job finishes, fails or is cancelled
+ */
+typedef void (*DoseCompletionCallback)(const DoseJob& job, const DosingResult& result, void* context);
+
+/**
+ * @brief A single queued dose
+ */
+struct DoseJob {
+    uint8_t head;                    // Dosing head index (0-3)
+    float volume;                    // Target volume in mL
+    DoseSource source;               // Scheduled or ad-hoc
+    uint32_t requestedAt;            // Caller-defined timestamp (e.g. schedule check time)
+    DoseCompletionCallback onComplete;  // Optional completion callback
+    void* context;                   // Passed through to onComplete
+    uint32_t epoch;                  // Set by the pool; jobs from before cancelAll() are dropped
+};
+
+/**
+ * @brief Fixed pool of dose workers, one per dosing head
+ *
+ * Each head has a statically allocated worker task fed by two bounded queues.
+ * Ad-hoc jobs are always taken before scheduled jobs, and cancelAll() (used by
+ * emergency stop) discards everything pending. Because a head only ever has one
+ * worker, a motor can never be driven by two dose tasks at the same time.
+ *
+ * Thread-safety: submit(), cancelAll() and the getters may be called from any task.
+ */
+class DoseWorkerPool {
+public:
+    DoseWorkerPool();
+
+    /**
+     * @brief Initialize the pool and create the per-head queues
+     * @param heads Array of dosing head pointers
+     * @param numHeads Number of dosing heads (max NUM_MOTORS)
+     * @return true if initialization successful
+     */
+    bool begin(DosingHead** heads, uint8_t numHeads);
+
+    /**
+     * @brief Start the worker tasks
+     * @return true if all workers started
+     */
+    bool start();
+
+    /**
+     * @brief Queue a dose for its head's worker
+     * Never blocks: returns QUEUE_FULL when the head is at capacity
+     * @param job Job to queue (epoch is filled in by the pool)
+     * @return Submit outcome
+     */
+    DoseSubmitResult submit(const DoseJob& job);
+
+    /**
+     * @brief Discard every pending job on every head
+     * Each discarded job's callback is invoked with a cancelled result. A job a
+     * worker has already taken is stopped by its head before or right after the
+     * motor starts; a motor that is already running needs cancelDispensing().
+     * @return Number of jobs discarded
+     */
+    uint16_t cancelAll();
+
+    /**
+     * @brief Get number of jobs waiting for a head (excluding the running one)
+     * @param head Head index
+     * @return Pending job count
+     */
+    uint8_t getQueueDepth(uint8_t head) const;
+
+    /**
+     * @brief Check if a head's worker is currently executing a job
+     * @param head Head index
+     * @return true if busy
+     */
+    bool isBusy(uint8_t head) const;
+
+    /**
+     * @brief Check if workers are running
+     * @return true if running
+     */
+    bool isRunning() const;
+
+    /**
+     * @brief Get a counter that increases whenever a queue depth or busy flag changes
+     * @return Pool version
+     */
+    uint32_t getVersion() const;
+
+private:
+    struct Worker {
+        DoseWorkerPool* pool;
+        uint8_t head;
+        TaskHandle_t task;
+        QueueHandle_t adhocQueue;
+        QueueHandle_t scheduledQueue;
+        std::atomic<bool> busy;
+    };
+
+    DosingHead** dosingHeads;
+    uint8_t numHeads;
+    bool initialized;
+    bool running;
+    std::atomic<uint32_t> epoch;  // Incremented by cancelAll(); a running job's head checks it as its motor starts
+    std::atomic<uint32_t> version;  // Incremented on queue/busy changes
+
+    Worker workers[NUM_MOTORS];
+
+    // Static storage so bursts of requests never touch the heap
+    StackType_t workerStacks[NUM_MOTORS][DOSE_WORKER_STACK_SIZE];
+    StaticTask_t workerTaskBuffers[NUM_MOTORS];
+    uint8_t adhocQueueStorage[NUM_MOTORS][DOSE_ADHOC_QUEUE_DEPTH * sizeof(DoseJob)];
+    uint8_t scheduledQueueStorage[NUM_MOTORS][DOSE_SCHEDULED_QUEUE_DEPTH * sizeof(DoseJob)];
+    StaticQueue_t adhocQueueBuffers[NUM_MOTORS];
+    StaticQueue_t scheduledQueueBuffers[NUM_MOTORS];
+
+    /**
+     * @brief FreeRTOS task function (static wrapper)
+     */
+    static void workerTaskFunction(void* parameters);
+
+    /**
+     * @brief Worker loop for one head
+     */
+    void runWorker(Worker& worker);
+
+    /**
+     * @brief Take the next job for a worker, ad-hoc before scheduled
+     * @param worker Worker to receive for
+     * @param job Output job
+     * @return true if a job was received
+     */
+    bool receiveNext(Worker& worker, DoseJob& job);
+
+    /**
+     * @brief Invoke a job's callback with a cancelled result
+     * @param job Cancelled job
+     */
+    static void completeCancelled(const DoseJob& job);
+};
+
+#endif // DOSE_WORKER_POOL_H
@@ -2,9 +2,11 @@
 #define SCHEDULE_MANAGER_H
 
 #include <Arduino.h>
+#include <atomic>
 #include "scheduling/Schedule.h"
 #include "scheduling/ScheduleStore.h"
 #include "hal/DosingHead.h"
+#include "scheduling/DoseWorkerPool.h"
 
 // Forward declaration to avoid circular dependency
 class DosingLogManager;
@@ -54,6 +56,14 @@ public:
      */
     bool deleteSchedule(uint8_t head);
 
+    /**
+     * @brief Save/delete several schedules in one store write
+     * @param changes Changes indexed by head (size NUM_SCHEDULE_HEADS)
+     * @param headMask Bit n set = apply changes[n]
+     * @return true if every change was written
+     */
+    bool applyChanges(const ScheduleChange* changes, uint8_t headMask);
+
     /**
      * @brief Get all active schedules
      * @param schedules Output array (must be at least NUM_SCHEDULE_HEADS size)
@@ -82,16 +92,36 @@ public:
      */
     void setLogManager(DosingLogManager* logManager);
 
+    /**
+     * @brief Set the dose worker pool used to execute scheduled doses
+     * When set, due schedules are queued instead of dispensed on the scheduler task
+     * @param pool Pointer to DoseWorkerPool instance (optional)
+     */
+    void setWorkerPool(DoseWorkerPool* pool);
+
+    /**
+     * @brief Get a counter that increases whenever any schedule changes
+     * Includes execution bookkeeping (lastExecutionTime, executionCount)
+     * @return Schedule version
+     */
+    uint32_t getVersion() const;
+
 private:
     ScheduleStore store;
     SemaphoreHandle_t mutex;
     bool initialized;
     DosingLogManager* logManager;  // Pointer to log manager for scheduled doses
+    DoseWorkerPool* workerPool;    // Pointer to dose worker pool (optional)
+
+    // Heads with a scheduled dose queued or running (protected by mutex)
+    bool dosePending[NUM_SCHEDULE_HEADS];
 
     // In-memory cache of schedules for fast access
     Schedule scheduleCache[NUM_SCHEDULE_HEADS];
     bool cacheValid[NUM_SCHEDULE_HEADS];
 
+    std::atomic<uint32_t> version;  // Bumped after every cache change (under mutex)
+
     /**
      * @brief Reload schedule cache from NVS
      */
@@ -104,6 +134,27 @@ private:
      * @param currentTime Current time (same as used for shouldExecute check)
      */
     void executeSchedule(Schedule& sched, DosingHead** dosingHeads, uint32_t currentTime);
+
+    /**
+     * @brief Queue a scheduled dose on the worker pool
+     * Caller must hold mutex
+     * @param sched Schedule to execute
+     * @param currentTime Current time (same as used for shouldExecute check)
+     */
+    void submitSchedule(const Schedule& sched, uint32_t currentTime);
+
+    /**
+     * @brief Record the outcome of a scheduled dose (log + last execution)
+     * @param head Head index
+     * @param result Dosing result
+     * @param currentTime Time used for the shouldExecute check
+     */
+    void completeSchedule(uint8_t head, const DosingResult& result, uint32_t currentTime);
+
+    /**
+     * @brief Worker pool completion callback for scheduled doses
+     */
+    static void onScheduledDoseComplete(const DoseJob& job, const DosingResult& result, void* context);
 };
 
 #endif // SCHEDULE_MANAGER_H
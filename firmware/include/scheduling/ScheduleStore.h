@@ -2,22 +2,29 @@
 #define SCHEDULE_STORE_H
 
 #include <Arduino.h>
-#include <Preferences.h>
 #include "scheduling/Schedule.h"
 
 #define NUM_SCHEDULE_HEADS 4
 #define SCHEDULE_NVS_NAMESPACE "schedules"
 
+/**
+ * @brief A staged change to one head's schedule
+ */
+struct ScheduleChange {
+    bool remove;        // true = delete the head's schedule, false = save schedule
+    Schedule schedule;  // Schedule to save (schedule.head identifies the slot)
+};
+
 /**
  * @brief NVS storage manager for schedules
  *
  * Stores exactly 4 schedules (one per dosing head)
  * Head index (0-3) is used as the schedule identifier
+ * Writes are committed by FlashWriter; reads see queued writes
  */
 class ScheduleStore {
 public:
     ScheduleStore();
-    ~ScheduleStore();
 
     /**
      * @brief Initialize the schedule store
@@ -47,6 +54,14 @@ public:
      */
     bool deleteSchedule(uint8_t head);
 
+    /**
+     * @brief Save/delete several schedules in one go
+     * @param changes Changes indexed by head (size NUM_SCHEDULE_HEADS)
+     * @param headMask Bit n set = apply changes[n]
+     * @return true if every change was queued
+     */
+    bool applyChanges(const ScheduleChange* changes, uint8_t headMask);
+
     /**
      * @brief Load all schedules from NVS
      * @param schedules Output array (must be at least NUM_SCHEDULE_HEADS size)
@@ -68,7 +83,6 @@ public:
     bool hasSchedule(uint8_t head);
 
 private:
-    Preferences preferences;
     bool initialized;
 
     /**
@@ -8,6 +8,8 @@
 #include "hal/DosingHead.h"
 #include <time.h>
 
+class DosingLogManager;
+
 #define SCHEDULER_CHECK_INTERVAL_MS 1000  // Check schedules every 1 second
 
 /**
@@ -15,6 +17,7 @@
  *
  * Runs every second, checking if any schedules are due for execution
  * Coordinates with ScheduleManager for thread-safe schedule access
+ * Once an hour it also prunes dosing logs past their retention period
  */
 class SchedulerTask {
 public:
@@ -30,6 +33,12 @@ public:
      */
     bool begin(ScheduleManager* manager, DosingHead** heads, uint8_t numHeads);
 
+    /**
+     * @brief Set the log manager whose old logs are pruned hourly (optional)
+     * @param logManager Pointer to DosingLogManager instance
+     */
+    void setLogManager(DosingLogManager* logManager);
+
     /**
      * @brief Start the FreeRTOS scheduler task
      * @return true if task started successfully
@@ -58,6 +67,8 @@ private:
     uint8_t numHeads;
     TaskHandle_t taskHandle;
     bool running;
+    DosingLogManager* logManager;
+    uint32_t lastPruneHour;  // Hour (currentTime / 3600) of the last prune
 
     /**
      * @brief Get current Unix epoch time
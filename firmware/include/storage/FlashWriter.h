@@ -0,0 +1,329 @@
+#ifndef FLASH_WRITER_H
+#define FLASH_WRITER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "config/StorageConfig.h"
+#include "diagnostics/Metrics.h"
+
+#define FLASH_NAME_SIZE 16  // NVS namespace and key names are at most 15 characters
+
+/**
+ * @brief Single writer for all NVS persistence
+ *
+ * Every flash erase/write disables the flash cache on both cores, so a write
+ * made directly from a dose worker, the scheduler or the AsyncTCP task stalls
+ * whatever else is running. Instead, writes are queued here and committed by
+ * one low-priority task; callers only copy their value into the queue.
+ *
+ * - Bounded: FLASH_QUEUE_SLOTS pending entries. When every slot is in use a
+ *   write waits up to FLASH_QUEUE_FULL_WAIT_MS, then fails.
+ * - Reservations: reserve() sets entries aside for one task's group of writes
+ *   (see FlashReservation), so a multi-key update either gets room for every
+ *   write or fails before queueing any of them.
+ * - Coalescing: rewriting a key that is still pending replaces its value
+ *   (last write wins) and keeps its place in the queue. clear() drops the
+ *   namespace's pending writes.
+ * - Ordering: entries are committed in queue order. barrier() starts a new
+ *   epoch: nothing queued after it is merged into an entry queued before it,
+ *   so e.g. a journal is committed before the writes it covers.
+ * - Reads (readBytes, readUShort, readString, hasKey) see pending values
+ *   first, so a value reads back as written before it reaches flash.
+ * - flush() waits until everything queued before the call is in flash.
+ * - Commits are held while a motor runs (holdCommits/releaseCommits), up to
+ *   FLASH_MAX_HOLD_MS.
+ *
+ * A write returning true means the value was queued. A commit that fails
+ * stays at the head of the queue (later entries wait behind it) and is retried
+ * up to FLASH_COMMIT_ATTEMPTS times with a doubling delay; only then is it
+ * logged, counted (squaredose_flash_commit_failures_total) and dropped, along
+ * with any removeIfCommitted() queued behind it.
+ *
+ * Thread-safety: All methods may be called from any task (not from ISRs).
+ * flush() must not be called before begin().
+ */
+class FlashWriter {
+public:
+    /**
+     * @brief Start the writer task (writes queued before this are committed once it runs)
+     * @return true if the task started
+     */
+    static bool begin();
+
+    /**
+     * @brief Queue a blob write
+     * @param ns NVS namespace
+     * @param key Key
+     * @param data Value
+     * @param size Value size (at most FLASH_LARGE_VALUE_SIZE)
+     * @param subsystem Owner, for squaredose_flash_writes_total
+     * @return true if queued
+     */
+    static bool putBytes(const char* ns, const char* key, const void* data, size_t size, FlashSubsystem subsystem);
+
+    /**
+     * @brief Queue a uint16_t write (Preferences::putUShort)
+     */
+    static bool putUShort(const char* ns, const char* key, uint16_t value, FlashSubsystem subsystem);
+
+    /**
+     * @brief Queue a string write (Preferences::putString)
+     */
+    static bool putString(const char* ns, const char* key, const char* value, FlashSubsystem subsystem);
+
+    /**
+     * @brief Queue removal of a key (no-op at commit time if it does not exist)
+     */
+    static bool remove(const char* ns, const char* key, FlashSubsystem subsystem);
+
+    /**
+     * @brief Queue removal of a key that only happens if every write queued before it commits
+     * If an earlier write is dropped, so is the removal and the key stays in
+     * flash, e.g. a journal is kept for replay until every write it covers is in.
+     */
+    static bool removeIfCommitted(const char* ns, const char* key, FlashSubsystem subsystem);
+
+    /**
+     * @brief Queue erasing a whole namespace
+     */
+    static bool clear(const char* ns, FlashSubsystem subsystem);
+
+    /**
+     * @brief Queue removal of several keys as one entry (committed with one namespace open)
+     * Acts as a barrier on both sides. Absent keys are skipped at commit time.
+     * @param ns NVS namespace
+     * @param keys NUL-terminated keys, back to back
+     * @param size Total size of keys, terminators included (at most FLASH_LARGE_VALUE_SIZE)
+     * @param subsystem Owner, for squaredose_flash_writes_total
+     * @return true if queued
+     */
+    static bool removeKeys(const char* ns, const char* keys, size_t size, FlashSubsystem subsystem);
+
+    /**
+     * @brief Set entries aside for the calling task's next writes
+     * Other tasks cannot take reserved entries; the caller's writes use them up.
+     * Waits up to FLASH_QUEUE_FULL_WAIT_MS for room, longer while commits are
+     * held (nothing leaves the queue until the motor stops), but never more
+     * than FLASH_MAX_HOLD_MS + FLASH_QUEUE_FULL_WAIT_MS. One reservation at a time.
+     * @param count Entries for values up to FLASH_VALUE_SIZE
+     * @param largeCount Entries for values up to FLASH_LARGE_VALUE_SIZE
+     * @return true if reserved (end it with unreserve())
+     */
+    static bool reserve(uint8_t count, uint8_t largeCount);
+
+    /**
+     * @brief Return what is left of the calling task's reservation
+     */
+    static void unreserve();
+
+    /**
+     * @brief Order everything queued so far before anything queued afterwards
+     * Does not wait for flash.
+     */
+    static void barrier();
+
+    /**
+     * @brief Wait until every write queued before this call has been committed
+     * @param timeoutMs Maximum time to wait
+     * @return true if committed in time (false on timeout or on the writer task itself)
+     */
+    static bool flush(uint32_t timeoutMs);
+
+    /**
+     * @brief Read a blob, pending value first
+     * @param ns NVS namespace
+     * @param key Key
+     * @param data Output buffer
+     * @param size Buffer size
+     * @return Bytes read (0 if the key does not exist)
+     */
+    static size_t readBytes(const char* ns, const char* key, void* data, size_t size);
+
+    /**
+     * @brief Read a uint16_t, pending value first
+     * @return Value, or defaultValue if the key does not exist
+     */
+    static uint16_t readUShort(const char* ns, const char* key, uint16_t defaultValue);
+
+    /**
+     * @brief Read a string, pending value first
+     * @return Value, or defaultValue if the key does not exist
+     */
+    static String readString(const char* ns, const char* key, const char* defaultValue);
+
+    /**
+     * @brief Check if a key exists, counting pending writes and removals
+     */
+    static bool hasKey(const char* ns, const char* key);
+
+    /**
+     * @brief Count the keys of a list that exist, like hasKey() with one namespace open
+     * @param ns NVS namespace
+     * @param keys NUL-terminated keys, back to back (as for removeKeys())
+     * @param size Total size of keys
+     * @return Number of keys that exist
+     */
+    static uint16_t countKeys(const char* ns, const char* keys, size_t size);
+
+    /**
+     * @brief Defer commits while timing-critical work runs (nestable)
+     */
+    static void holdCommits();
+
+    /**
+     * @brief End a holdCommits()
+     */
+    static void releaseCommits();
+
+    /**
+     * @brief Write queue and commit statistics in Prometheus text format
+     * @param out Destination
+     */
+    static void writeMetrics(Print& out);
+
+private:
+    enum EntryType : uint8_t {
+        BLOB,
+        USHORT,
+        STRING,
+        REMOVE,
+        CLEAR,       // key is empty
+        REMOVE_KEYS  // key is empty; value lists the keys
+    };
+
+    enum EntryState : uint8_t {
+        FREE,
+        PENDING,
+        COMMITTING  // Copied out by the writer; still visible to readers until done
+    };
+
+    struct Entry {
+        EntryState state;
+        EntryType type;
+        FlashSubsystem subsystem;
+        uint16_t size;
+        uint16_t capacity;
+        uint32_t order;      // Queue position (commit order)
+        uint32_t epoch;      // barrier() epoch it was queued in
+        uint32_t since;      // Write sequence number when it became pending (for flush)
+        uint32_t queuedUs;   // Time of the oldest write it holds (commit latency)
+        uint32_t retryAtMs;  // Earliest retry after a failed commit
+        uint8_t attempts;    // Failed commits so far
+        bool conditional;    // Dropped if an earlier entry is (removeIfCommitted)
+        char ns[FLASH_NAME_SIZE];
+        char key[FLASH_NAME_SIZE];
+        uint8_t* value;      // Points into smallValues or largeValues
+    };
+
+    static Entry entries[FLASH_QUEUE_SLOTS];
+    static uint8_t smallValues[FLASH_QUEUE_SLOTS - FLASH_LARGE_SLOTS][FLASH_VALUE_SIZE];
+    static uint8_t largeValues[FLASH_LARGE_SLOTS][FLASH_LARGE_VALUE_SIZE];
+    static uint32_t nextOrder;
+    static uint32_t epoch;
+    static uint32_t writeSequence;
+
+    static SemaphoreHandle_t mutex;
+    static StaticSemaphore_t mutexBuffer;
+    static std::atomic<TaskHandle_t> writerTask;
+    static StackType_t taskStack[FLASH_WRITER_STACK_SIZE];
+    static StaticTask_t taskBuffer;
+
+    static std::atomic<uint32_t> holdCount;
+
+    // Current reservation (mutex must be held)
+    static TaskHandle_t reservationOwner;
+    static uint8_t reservedEntries;
+    static uint8_t reservedLargeEntries;
+
+    // Statistics
+    static std::atomic<uint8_t> depth;
+    static std::atomic<uint8_t> maxDepth;
+    static std::atomic<uint32_t> commits;
+    static std::atomic<uint32_t> coalesced;
+    static std::atomic<uint32_t> failures;
+    static std::atomic<uint32_t> retries;
+    static std::atomic<uint32_t> rejected;
+    static std::atomic<uint32_t> commitTimeUs;     // Sum of time spent in NVS
+    static std::atomic<uint32_t> maxCommitTimeUs;
+    static std::atomic<uint32_t> latencyMs;        // Sum of queued-to-committed time
+    static std::atomic<uint32_t> maxLatencyMs;
+
+    /**
+     * @brief Queue an entry, replacing a pending entry for the same key in this epoch
+     * @param conditional true to drop the entry if one queued before it is dropped
+     * @return true if queued
+     */
+    static bool enqueue(EntryType type, const char* ns, const char* key, const void* data, size_t size,
+                        FlashSubsystem subsystem, bool conditional = false);
+
+    /**
+     * @brief Drop every pending removeIfCommitted() after a failed entry was dropped (mutex must be held)
+     */
+    static void dropConditional();
+
+    /**
+     * @brief Find the newest entry that decides the value of a key (mutex must be held)
+     * @return Entry (a CLEAR of the namespace, or a write/remove of the key), or nullptr
+     */
+    static Entry* findLatest(const char* ns, const char* key);
+
+    /**
+     * @brief Check if an entry writes or removes a key (mutex must be held)
+     */
+    static bool coversKey(const Entry& entry, const char* key);
+
+    /**
+     * @brief Claim a free entry that can hold size bytes (mutex must be held)
+     * @param size Value size
+     * @param reserved true if the caller owns the reservation
+     * @return Entry, or nullptr if none is free outside the reservation
+     */
+    static Entry* allocate(size_t size, bool reserved);
+
+    /**
+     * @brief First free entry in [first, last) if more than keep are free (mutex must be held)
+     */
+    static Entry* findFree(uint8_t first, uint8_t last, uint8_t keep);
+
+    /**
+     * @brief Assign the value storage of every entry (first call only)
+     */
+    static void init();
+
+    /**
+     * @brief Write one entry to NVS (writer task only)
+     * @return true on success
+     */
+    static bool commit(const Entry& entry, const uint8_t* value);
+
+    static void taskFunction(void* parameters);
+};
+
+/**
+ * @brief Holds a FlashWriter reservation for the lifetime of the scope
+ */
+class FlashReservation {
+public:
+    FlashReservation(uint8_t count, uint8_t largeCount) : reserved(FlashWriter::reserve(count, largeCount)) {}
+    ~FlashReservation() {
+        if (reserved) {
+            FlashWriter::unreserve();
+        }
+    }
+
+    /**
+     * @brief Check if the entries were reserved
+     */
+    bool isReserved() const { return reserved; }
+
+    FlashReservation(const FlashReservation&) = delete;
+    FlashReservation& operator=(const FlashReservation&) = delete;
+
+private:
+    bool reserved;
+};
+
+#endif // FLASH_WRITER_H
@@ -0,0 +1,268 @@
+#include "diagnostics/Log.h"
+
+static const uint32_t RING_MASK = LOG_RING_SLOTS - 1;
+static_assert((LOG_RING_SLOTS & RING_MASK) == 0, "LOG_RING_SLOTS must be a power of 2");
+static_assert(LOG_STRING_SPACE <= 255, "String offsets are stored as uint8_t");
+
+// Static storage is zero-initialized, which is a valid empty ring
+Log::Slot Log::ring[LOG_RING_SLOTS];
+std::atomic<uint32_t> Log::enqueuePos;
+std::atomic<uint32_t> Log::dequeuePos;
+std::atomic<uint32_t> Log::droppedCount;
+std::atomic<uint32_t> Log::truncatedCount;
+std::atomic<TaskHandle_t> Log::drainTask;
+StackType_t Log::taskStack[LOG_TASK_STACK_SIZE];
+StaticTask_t Log::taskBuffer;
+char Log::line[LOG_LINE_SIZE];
+
+void LogRecord::add(const char* text) {
+    if (argCount >= LOG_MAX_ARGS) {
+        return;
+    }
+
+    if (text == nullptr) {
+        text = "(null)";
+    }
+
+    // Copy as much as fits; the last string may be truncated (or empty when full), which is counted
+    size_t offset = stringUsed;
+    size_t room = LOG_STRING_SPACE - offset;
+    size_t length = strnlen(text, room > 0 ? room - 1 : 0);
+    if (text[length] != '\0') {
+        Log::truncatedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (room > 0) {
+        memcpy(&strings[offset], text, length);
+        strings[offset + length] = '\0';
+        stringUsed = offset + length + 1;
+    } else {
+        offset = LOG_STRING_SPACE - 1;  // Always the terminator of the last copy
+    }
+
+    argTypes[argCount] = STRING;
+    args[argCount++].u = offset;
+}
+
+bool Log::begin() {
+    if (drainTask.load() != nullptr) {
+        return true;
+    }
+
+    TaskHandle_t task = xTaskCreateStatic(
+        taskFunction,           // Task function
+        "Log",                  // Task name
+        LOG_TASK_STACK_SIZE,    // Stack size (bytes)
+        nullptr,                // Parameters
+        LOG_TASK_PRIORITY,      // Priority
+        taskStack,              // Static stack
+        &taskBuffer             // Static TCB
+    );
+
+    if (task == nullptr) {
+        Serial.println("[Log] Failed to create drain task");
+        return false;
+    }
+
+    drainTask.store(task);
+    return true;
+}
+
+void Log::push(const LogRecord& record) {
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+
+    for (;;) {
+        slot = &ring[pos & RING_MASK];
+        uint32_t sequence = slot->sequence.load(std::memory_order_acquire) + (pos & RING_MASK);
+        int32_t diff = static_cast<int32_t>(sequence - pos);
+
+        if (diff == 0) {
+            // Slot is free for this position; claim it
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Slot still holds the message from one lap ago: ring full, never wait
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            // Another task claimed this position first
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Copy only the used part of the string area
+    LogRecord& target = slot->record;
+    memcpy(&target, &record, offsetof(LogRecord, strings));
+    memcpy(target.strings, record.strings, record.stringUsed);
+    slot->sequence.store(pos + 1 - (pos & RING_MASK), std::memory_order_release);
+
+    TaskHandle_t task = drainTask.load(std::memory_order_relaxed);
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
+}
+
+bool Log::drainOne() {
+    uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Slot& slot = ring[pos & RING_MASK];
+
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire) + (pos & RING_MASK);
+    if (sequence != pos + 1) {
+        return false;  // Empty, or the producer is still copying
+    }
+
+    size_t length = format(slot.record, line, sizeof(line) - 1);
+
+    // Free the slot for the next lap before the slow write
+    slot.sequence.store(pos + LOG_RING_SLOTS - (pos & RING_MASK), std::memory_order_release);
+    dequeuePos.store(pos + 1, std::memory_order_release);
+
+    line[length++] = '\n';
+    Serial.write(reinterpret_cast<const uint8_t*>(line), length);
+    return true;
+}
+
+bool Log::flush(uint32_t timeoutMs) {
+    uint32_t start = millis();
+    while (dequeuePos.load() != enqueuePos.load()) {
+        if (drainTask.load() == nullptr || millis() - start >= timeoutMs) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return true;
+}
+
+uint32_t Log::getDroppedCount() {
+    return droppedCount.load(std::memory_order_relaxed);
+}
+
+uint32_t Log::getTruncatedCount() {
+    return truncatedCount.load(std::memory_order_relaxed);
+}
+
+void Log::taskFunction(void* parameters) {
+    uint32_t reportedDrops = 0;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+
+        while (drainOne()) {
+        }
+
+        uint32_t drops = droppedCount.load(std::memory_order_relaxed);
+        if (drops != reportedDrops) {
+            Serial.printf("[Log] %lu messages dropped (ring full)\n", (unsigned long)(drops - reportedDrops));
+            reportedDrops = drops;
+        }
+    }
+}
+
+size_t Log::format(const LogRecord& record, char* out, size_t size) {
+    int prefix = snprintf(out, size, "[%s] ", record.tag);
+    size_t length = (prefix > 0) ? min(static_cast<size_t>(prefix), size - 1) : 0;
+    const char* cursor = record.format;
+    uint8_t argIndex = 0;
+
+    while (*cursor != '\0' && length + 1 < size) {
+        if (*cursor != '%') {
+            out[length++] = *cursor++;
+            continue;
+        }
+        if (cursor[1] == '%') {
+            out[length++] = '%';
+            cursor += 2;
+            continue;
+        }
+
+        // Keep "%[flags][width][.precision]", drop the length modifier: the
+        // stored value's real type decides how it is passed to snprintf
+        char spec[16];
+        size_t specLength = 0;
+        spec[specLength++] = *cursor++;
+        while (*cursor != '\0' && strchr("-+ #0123456789.", *cursor) != nullptr && specLength < sizeof(spec) - 4) {
+            spec[specLength++] = *cursor++;
+        }
+        while (*cursor != '\0' && strchr("hlLqjzt", *cursor) != nullptr) {
+            cursor++;
+        }
+
+        char conversion = *cursor;
+        if (conversion == '\0') {
+            break;
+        }
+        cursor++;
+
+        if (argIndex >= record.argCount) {
+            continue;  // More conversions than arguments
+        }
+
+        uint8_t type = record.argTypes[argIndex];
+        const LogRecord::ArgValue& value = record.args[argIndex++];
+        char* dest = out + length;
+        size_t room = size - length;
+        int written = 0;
+
+        // Integers converted the way printf would have seen them
+        int64_t asSigned = (type == LogRecord::DOUBLE) ? static_cast<int64_t>(value.f) : value.i;
+        uint64_t asUnsigned = (type == LogRecord::DOUBLE) ? static_cast<uint64_t>(value.f) : value.u;
+        if (type == LogRecord::SIGNED32 || type == LogRecord::UNSIGNED32) {
+            asUnsigned &= 0xFFFFFFFFull;
+        }
+
+        switch (conversion) {
+            case 'd':
+            case 'i':
+                memcpy(&spec[specLength], "lld", 4);
+                written = snprintf(dest, room, spec, static_cast<long long>(asSigned));
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                spec[specLength] = 'l';
+                spec[specLength + 1] = 'l';
+                spec[specLength + 2] = conversion;
+                spec[specLength + 3] = '\0';
+                written = snprintf(dest, room, spec, static_cast<unsigned long long>(asUnsigned));
+                break;
+            case 'c':
+                memcpy(&spec[specLength], "c", 2);
+                written = snprintf(dest, room, spec, static_cast<int>(asSigned));
+                break;
+            case 'p':
+                memcpy(&spec[specLength], "p", 2);
+                written = snprintf(dest, room, spec, reinterpret_cast<void*>(static_cast<uintptr_t>(asUnsigned)));
+                break;
+            case 's':
+                memcpy(&spec[specLength], "s", 2);
+                written = snprintf(dest, room, spec,
+                                   (type == LogRecord::STRING) ? &record.strings[value.u] : "?");
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G': {
+                double number = (type == LogRecord::DOUBLE) ? value.f :
+                                (type == LogRecord::SIGNED32 || type == LogRecord::SIGNED64) ?
+                                static_cast<double>(value.i) : static_cast<double>(value.u);
+                spec[specLength] = conversion;
+                spec[specLength + 1] = '\0';
+                written = snprintf(dest, room, spec, number);
+                break;
+            }
+            default:
+                break;
+        }
+
+        if (written > 0) {
+            length += min(static_cast<size_t>(written), room - 1);
+        }
+    }
+
+    out[length] = '\0';
+    return length;
+}
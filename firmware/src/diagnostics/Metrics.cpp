@@ -0,0 +1,237 @@
+#include "diagnostics/Metrics.h"
+#include "diagnostics/Log.h"
+#include "storage/FlashWriter.h"
+#include "hal/PowerManager.h"
+#include <nvs.h>
+
+LOG_MODULE("Metrics", LOG_LEVEL_METRICS);
+
+static const char* const FLASH_SUBSYSTEM_NAMES[] = {"schedules", "logs", "calibration", "wifi", "journal", "power"};
+static const char* const DOSE_SOURCE_NAMES[] = {"scheduled", "adhoc"};
+
+// Static storage is zero-initialized, so every counter starts at 0
+std::atomic<uint32_t> Metrics::flashWrites[static_cast<uint8_t>(FlashSubsystem::COUNT)];
+std::atomic<uint32_t> Metrics::doses[NUM_MOTORS][2];
+std::atomic<uint32_t> Metrics::doseFailures[NUM_MOTORS][2];
+std::atomic<uint32_t> Metrics::dosedMicroliters[NUM_MOTORS][2];
+std::atomic<uint32_t> Metrics::wifiDisconnects;
+std::atomic<uint32_t> Metrics::wifiReconnects;
+std::atomic<uint32_t> Metrics::wifiReconnectTimeMs;
+std::atomic<uint32_t> Metrics::wifiMaxReconnectTimeMs;
+std::atomic<uint32_t> Metrics::wifiConnects;
+std::atomic<uint32_t> Metrics::wifiConnectTimeMs;
+std::atomic<uint32_t> Metrics::wifiMaxConnectTimeMs;
+std::atomic<uint32_t> Metrics::wifiConnectAttempts[2];
+std::atomic<uint32_t> Metrics::wifiBootToReachableMs;
+std::atomic<uint8_t> Metrics::wifiLastDisconnectReason;
+std::atomic<TaskHandle_t> Metrics::tasks[METRICS_MAX_TASKS];
+
+void Metrics::recordFlashWrite(FlashSubsystem subsystem) {
+    if (subsystem < FlashSubsystem::COUNT) {
+        flashWrites[static_cast<uint8_t>(subsystem)].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::recordDose(uint8_t head, bool adhoc, bool success, float volumeMl) {
+    if (head >= NUM_MOTORS) {
+        return;
+    }
+
+    uint8_t source = adhoc ? 1 : 0;
+    if (success) {
+        doses[head][source].fetch_add(1, std::memory_order_relaxed);
+    } else {
+        doseFailures[head][source].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Cancelled and failed doses can still have pumped something
+    if (volumeMl > 0.0f) {
+        dosedMicroliters[head][source].fetch_add(static_cast<uint32_t>(volumeMl * 1000.0f + 0.5f),
+                                                 std::memory_order_relaxed);
+    }
+}
+
+void Metrics::recordWifiDisconnect(uint8_t reason) {
+    wifiDisconnects.fetch_add(1, std::memory_order_relaxed);
+    wifiLastDisconnectReason.store(reason, std::memory_order_relaxed);
+}
+
+void Metrics::recordWifiReconnect(uint32_t durationMs) {
+    wifiReconnects.fetch_add(1, std::memory_order_relaxed);
+    wifiReconnectTimeMs.fetch_add(durationMs, std::memory_order_relaxed);
+
+    // Only the WiFi task records transitions, so load/store is enough for the max
+    if (durationMs > wifiMaxReconnectTimeMs.load(std::memory_order_relaxed)) {
+        wifiMaxReconnectTimeMs.store(durationMs, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::recordWifiConnect(uint32_t durationMs) {
+    wifiConnects.fetch_add(1, std::memory_order_relaxed);
+    wifiConnectTimeMs.fetch_add(durationMs, std::memory_order_relaxed);
+
+    if (durationMs > wifiMaxConnectTimeMs.load(std::memory_order_relaxed)) {
+        wifiMaxConnectTimeMs.store(durationMs, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::recordWifiConnectAttempt(bool cached) {
+    wifiConnectAttempts[cached ? 1 : 0].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::recordWifiReachable(uint32_t uptimeMs) {
+    uint32_t expected = 0;
+    wifiBootToReachableMs.compare_exchange_strong(expected, uptimeMs > 0 ? uptimeMs : 1, std::memory_order_relaxed);
+}
+
+void Metrics::registerTask(TaskHandle_t task) {
+    if (task == nullptr) {
+        return;
+    }
+
+    // A stopped task frees its slot (e.g. SchedulerTask::stop()), so a restart reuses it
+    for (uint8_t i = 0; i < METRICS_MAX_TASKS; i++) {
+        TaskHandle_t expected = nullptr;
+        if (tasks[i].compare_exchange_strong(expected, task)) {
+            return;
+        }
+    }
+    LOG_WARN("Task table full - stack not reported");
+}
+
+void Metrics::unregisterTask(TaskHandle_t task) {
+    for (uint8_t i = 0; i < METRICS_MAX_TASKS; i++) {
+        TaskHandle_t expected = task;
+        if (tasks[i].compare_exchange_strong(expected, nullptr)) {
+            return;
+        }
+    }
+}
+
+void Metrics::writeHeader(Print& out, const char* name, const char* type, const char* help) {
+    out.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void Metrics::writeMetric(Print& out, const char* name, const char* type, const char* help, uint32_t value) {
+    writeHeader(out, name, type, help);
+    out.printf("%s %lu\n", name, (unsigned long)value);
+}
+
+void Metrics::writeMetric(Print& out, const char* name, const char* type, const char* help, int32_t value) {
+    writeHeader(out, name, type, help);
+    out.printf("%s %ld\n", name, (long)value);
+}
+
+void Metrics::write(Print& out) {
+    writeMetric(out, "squaredose_uptime_seconds", "gauge", "Time since boot",
+                static_cast<uint32_t>(millis() / 1000));
+
+    // Heap
+    writeMetric(out, "squaredose_heap_free_bytes", "gauge", "Free heap",
+                static_cast<uint32_t>(ESP.getFreeHeap()));
+    writeMetric(out, "squaredose_heap_min_free_bytes", "gauge", "Lowest free heap since boot",
+                static_cast<uint32_t>(ESP.getMinFreeHeap()));
+    writeMetric(out, "squaredose_heap_largest_block_bytes", "gauge", "Largest allocatable heap block",
+                static_cast<uint32_t>(ESP.getMaxAllocHeap()));
+
+    // Task stacks (ESP-IDF reports the high-water mark in bytes)
+    writeHeader(out, "squaredose_task_stack_free_min_bytes", "gauge", "Lowest unused stack since the task started");
+    for (uint8_t i = 0; i < METRICS_MAX_TASKS; i++) {
+        TaskHandle_t task = tasks[i].load();
+        if (task != nullptr) {
+            out.printf("squaredose_task_stack_free_min_bytes{task=\"%s\"} %lu\n", pcTaskGetName(task),
+                       (unsigned long)uxTaskGetStackHighWaterMark(task));
+        }
+    }
+
+    // NVS
+    nvs_stats_t stats;
+    if (nvs_get_stats(nullptr, &stats) == ESP_OK) {
+        writeMetric(out, "squaredose_nvs_used_entries", "gauge", "Used NVS entries",
+                    static_cast<uint32_t>(stats.used_entries));
+        writeMetric(out, "squaredose_nvs_free_entries", "gauge", "Free NVS entries",
+                    static_cast<uint32_t>(stats.free_entries));
+        writeMetric(out, "squaredose_nvs_namespaces", "gauge", "NVS namespaces",
+                    static_cast<uint32_t>(stats.namespace_count));
+    }
+
+    writeHeader(out, "squaredose_flash_writes_total", "counter", "NVS writes, removes and clears");
+    for (uint8_t i = 0; i < static_cast<uint8_t>(FlashSubsystem::COUNT); i++) {
+        out.printf("squaredose_flash_writes_total{subsystem=\"%s\"} %lu\n", FLASH_SUBSYSTEM_NAMES[i],
+                   (unsigned long)flashWrites[i].load(std::memory_order_relaxed));
+    }
+
+    // Doses
+    writeHeader(out, "squaredose_doses_total", "counter", "Completed doses");
+    for (uint8_t head = 0; head < NUM_MOTORS; head++) {
+        for (uint8_t source = 0; source < 2; source++) {
+            out.printf("squaredose_doses_total{head=\"%u\",source=\"%s\"} %lu\n", head, DOSE_SOURCE_NAMES[source],
+                       (unsigned long)doses[head][source].load(std::memory_order_relaxed));
+        }
+    }
+
+    writeHeader(out, "squaredose_dose_failures_total", "counter", "Doses that failed or were cancelled");
+    for (uint8_t head = 0; head < NUM_MOTORS; head++) {
+        for (uint8_t source = 0; source < 2; source++) {
+            out.printf("squaredose_dose_failures_total{head=\"%u\",source=\"%s\"} %lu\n", head,
+                       DOSE_SOURCE_NAMES[source],
+                       (unsigned long)doseFailures[head][source].load(std::memory_order_relaxed));
+        }
+    }
+
+    writeHeader(out, "squaredose_dosed_volume_ml_total", "counter", "Estimated volume dispensed");
+    for (uint8_t head = 0; head < NUM_MOTORS; head++) {
+        for (uint8_t source = 0; source < 2; source++) {
+            out.printf("squaredose_dosed_volume_ml_total{head=\"%u\",source=\"%s\"} %.3f\n", head,
+                       DOSE_SOURCE_NAMES[source],
+                       dosedMicroliters[head][source].load(std::memory_order_relaxed) / 1000.0);
+        }
+    }
+
+    // WiFi connection events (RSSI is sampled by the caller, which owns the WiFi state)
+    writeMetric(out, "squaredose_wifi_disconnects_total", "counter", "STA connections lost",
+                wifiDisconnects.load(std::memory_order_relaxed));
+    writeMetric(out, "squaredose_wifi_reconnects_total", "counter", "STA reconnections",
+                wifiReconnects.load(std::memory_order_relaxed));
+    writeHeader(out, "squaredose_wifi_connect_attempts_total", "counter", "STA join attempts");
+    out.printf("squaredose_wifi_connect_attempts_total{method=\"scan\"} %lu\n",
+               (unsigned long)wifiConnectAttempts[0].load(std::memory_order_relaxed));
+    out.printf("squaredose_wifi_connect_attempts_total{method=\"cached\"} %lu\n",
+               (unsigned long)wifiConnectAttempts[1].load(std::memory_order_relaxed));
+    writeMetric(out, "squaredose_wifi_last_disconnect_reason", "gauge", "WiFi driver reason code of the last lost connection",
+                static_cast<uint32_t>(wifiLastDisconnectReason.load(std::memory_order_relaxed)));
+
+    writeHeader(out, "squaredose_wifi_reconnect_duration_seconds", "summary", "Time from losing the link to having an IP again");
+    out.printf("squaredose_wifi_reconnect_duration_seconds_sum %.3f\n",
+               wifiReconnectTimeMs.load(std::memory_order_relaxed) / 1000.0);
+    out.printf("squaredose_wifi_reconnect_duration_seconds_count %lu\n",
+               (unsigned long)wifiReconnects.load(std::memory_order_relaxed));
+    writeHeader(out, "squaredose_wifi_reconnect_duration_max_seconds", "gauge", "Longest reconnection");
+    out.printf("squaredose_wifi_reconnect_duration_max_seconds %.3f\n",
+               wifiMaxReconnectTimeMs.load(std::memory_order_relaxed) / 1000.0);
+
+    uint32_t reachableMs = wifiBootToReachableMs.load(std::memory_order_relaxed);
+    if (reachableMs > 0) {
+        writeHeader(out, "squaredose_wifi_boot_to_reachable_seconds", "gauge",
+                    "Time from boot until STA had an IP or the AP was up");
+        out.printf("squaredose_wifi_boot_to_reachable_seconds %.3f\n", reachableMs / 1000.0);
+    }
+
+    writeHeader(out, "squaredose_wifi_connect_duration_seconds", "summary", "Time from starting to join (boot or AP mode) to having an IP");
+    out.printf("squaredose_wifi_connect_duration_seconds_sum %.3f\n",
+               wifiConnectTimeMs.load(std::memory_order_relaxed) / 1000.0);
+    out.printf("squaredose_wifi_connect_duration_seconds_count %lu\n",
+               (unsigned long)wifiConnects.load(std::memory_order_relaxed));
+    writeHeader(out, "squaredose_wifi_connect_duration_max_seconds", "gauge", "Longest connection from boot or AP mode");
+    out.printf("squaredose_wifi_connect_duration_max_seconds %.3f\n",
+               wifiMaxConnectTimeMs.load(std::memory_order_relaxed) / 1000.0);
+
+    writeMetric(out, "squaredose_log_dropped_total", "counter", "Log messages dropped because the ring was full",
+                Log::getDroppedCount());
+    writeMetric(out, "squaredose_log_truncated_total", "counter",
+                "Log string arguments cut short because the message ran out of string space",
+                Log::getTruncatedCount());
+
+    FlashWriter::writeMetrics(out);
+    PowerManager::writeMetrics(out);
+}
@@ -1,4 +1,6 @@
 #include "hal/DosingHead.h"
+#include "hal/PowerManager.h"
+#include "storage/FlashWriter.h"
 #include <Preferences.h>
 
 // Default calibration value (mL per second) - will be refined through calibration
@@ -6,14 +8,35 @@
 static constexpr float DEFAULT_ML_PER_SECOND = 1.0f;  // 1 mL/s initial estimate
 static constexpr float CALIBRATION_VOLUME_ML = 4.0f;   // Standard calibration dose
 
+// Calibration is persisted as a single versioned blob per head
+static constexpr uint8_t CALIBRATION_BLOB_VERSION = 1;
+static constexpr const char* CALIBRATION_BLOB_KEY = "calBlob";
+
+struct CalibrationBlob {
+    uint8_t version;
+    uint8_t pointCount;
+    bool isCalibrated;
+    float mlPerSecond;
+    float offsetMl;
+    uint32_t lastCalibrationTime;
+    CalibrationPoint points[MAX_CALIBRATION_POINTS];
+};
+
+static_assert(sizeof(CalibrationBlob) <= FLASH_VALUE_SIZE, "CalibrationBlob must fit a flash queue entry");
+
 DosingHead::DosingHead(uint8_t headIndex, MotorDriver* motorDriver)
-    : headIndex(headIndex), motor(motorDriver), initialized(false) {
+    : headIndex(headIndex), motor(motorDriver), calibrationVersion(0), initialized(false), cancelSignal(nullptr),
+      dispensing(false), cancelRequestedUs(0), lastCancelLatencyUs(0), runStartMs(0), runTargetMs(0) {
     // Initialize calibration data with default values
     calibration = {
         DEFAULT_ML_PER_SECOND,  // mlPerSecond - default estimate
+        0.0f,                   // offsetMl - no dead volume assumed
+        0,                      // pointCount
         false,                  // isCalibrated - not yet calibrated
         0                       // lastCalibrationTime
     };
+    memset(calibrationPoints, 0, sizeof(calibrationPoints));
+    rebuildCurve();
 }
 
 bool DosingHead::begin() {
@@ -25,6 +48,12 @@ bool DosingHead::begin() {
         return false;
     }
 
+    // Statically allocated so begin() never fails on a fragmented heap
+    cancelSignal = xSemaphoreCreateBinaryStatic(&cancelSignalBuffer);
+    if (cancelSignal == nullptr) {
+        return false;
+    }
+
     // Load calibration data from NVS (or use defaults if not found)
     loadCalibration();
 
@@ -32,8 +61,8 @@ bool DosingHead::begin() {
     return true;
 }
 
-DosingResult DosingHead::dispense(float volumeMl) {
-    DosingResult result = {false, 0, volumeMl, 0.0f, ""};
+DosingResult DosingHead::dispense(float volumeMl, const std::atomic<uint32_t>* stopEpoch, uint32_t jobEpoch) {
+    DosingResult result = {false, 0, volumeMl, 0.0f, "", false, 0};
 
     // Validate initialization
     if (!initialized) {
@@ -55,24 +84,26 @@ DosingResult DosingHead::dispense(float volumeMl) {
         return result;
     }
 
-    // Start the motor
-    if (!motor->startMotor(headIndex, MotorDirection::FORWARD)) {
+    // Run for calculated duration (blocking until done or cancelled)
+    // Note: In production, this will be called from a FreeRTOS task so it won't block the whole system
+    bool cancelled = false;
+    uint32_t actualRuntime = runMotor(runtimeMs, cancelled, result.cancelLatencyUs, stopEpoch, jobEpoch);
+
+    if (actualRuntime == 0 && !cancelled) {
         result.errorMessage = "Failed to start motor";
         return result;
     }
 
-    // Run for calculated duration (blocking)
-    // Note: In production, this will be called from a FreeRTOS task so it won't block the whole system
-    unsigned long startTime = millis();
-    delay(runtimeMs);
-
-    // Stop the motor
-    motor->stopMotor(headIndex);
+    // Volume is based on the real on-time, so a cancelled dose reports what was actually pumped
+    // (nothing if an emergency stop came before the motor started)
+    result.actualRuntime = actualRuntime;
+    result.estimatedVolume = (actualRuntime > 0) ? estimateVolume(actualRuntime) : 0.0f;
+    result.cancelled = cancelled;
+    result.success = !cancelled;
 
-    // Calculate actual runtime
-    result.actualRuntime = millis() - startTime;
-    result.estimatedVolume = estimateVolume(result.actualRuntime);
-    result.success = true;
+    if (cancelled) {
+        result.errorMessage = "Dose cancelled after " + String(actualRuntime) + " ms";
+    }
 
     return result;
 }
@@ -80,10 +111,87 @@ DosingResult DosingHead::dispense(float volumeMl) {
 void DosingHead::stopDispensing() {
     if (initialized && motor != nullptr) {
         motor->stopMotor(headIndex);
+        cancelDispensing();
+    }
+}
+
+bool DosingHead::cancelDispensing() {
+    if (!initialized || !dispensing.load()) {
+        return false;
     }
+
+    cancelRequestedUs.store(micros());
+    xSemaphoreGive(cancelSignal);
+    return true;
+}
+
+uint32_t DosingHead::getLastCancelLatencyUs() const {
+    return lastCancelLatencyUs.load();
+}
+
+uint32_t DosingHead::runMotor(uint32_t durationMs, bool& cancelled, uint32_t& cancelLatencyUs,
+                              const std::atomic<uint32_t>* stopEpoch, uint32_t jobEpoch) {
+    cancelled = false;
+    cancelLatencyUs = 0;
+
+    // Full CPU speed and no light sleep while the motor runs (run timing and cancel latency)
+    PowerLockScope powerLock(PowerLock::DOSE);
+
+    // Discard a cancel that raced with the end of the previous dose
+    xSemaphoreTake(cancelSignal, 0);
+    runStartMs.store(millis());
+    runTargetMs.store(durationMs);
+    dispensing.store(true);
+
+    // An emergency stop bumps the epoch before it brakes and signals. Once
+    // dispensing is set its signal is no longer lost, so a stop that came
+    // earlier is caught here, and one that lands during startMotor() below
+    // is caught by the second check (its brake may have run before our start).
+    if (stopEpoch != nullptr && stopEpoch->load() != jobEpoch) {
+        dispensing.store(false);
+        cancelled = true;
+        return 0;
+    }
+
+    // Start the motor
+    if (!motor->startMotor(headIndex, MotorDirection::FORWARD)) {
+        dispensing.store(false);
+        return 0;
+    }
+
+    if (stopEpoch != nullptr && stopEpoch->load() != jobEpoch) {
+        motor->stopMotor(headIndex);
+        dispensing.store(false);
+        cancelled = true;
+        return motor->getMotorState(headIndex).runDuration;
+    }
+
+    // Block on the cancel signal instead of delay() so a stop wakes us immediately
+    if (xSemaphoreTake(cancelSignal, pdMS_TO_TICKS(durationMs)) == pdTRUE) {
+        cancelled = true;
+        cancelLatencyUs = micros() - cancelRequestedUs.load();
+        lastCancelLatencyUs.store(cancelLatencyUs);
+    }
+
+    // Stop the motor (no-op if the canceller already stopped it)
+    motor->stopMotor(headIndex);
+    dispensing.store(false);
+
+    // The driver records the on-time when the pins were actually switched off
+    return motor->getMotorState(headIndex).runDuration;
 }
 
 bool DosingHead::calibrate(float actualVolumeMl) {
+    CalibrationUpdate update;
+    return computeCalibration(actualVolumeMl, update) && applyCalibration(update);
+}
+
+bool DosingHead::calibrate(const CalibrationPoint* points, uint8_t count) {
+    CalibrationUpdate update;
+    return computeCalibration(points, count, update) && applyCalibration(update);
+}
+
+bool DosingHead::computeCalibration(float actualVolumeMl, CalibrationUpdate& update) const {
     if (!initialized) {
         return false;
     }
@@ -101,22 +209,88 @@ bool DosingHead::calibrate(float actualVolumeMl) {
         return false;
     }
 
-    // Calculate new mL/second rate based on actual measurement
+    // Calculate new mL/second rate based on actual measurement, keeping any
+    // dead-volume offset from a previous multi-point calibration
     // Example: System dosed for 4000ms (thought it was 4mL at 1.0 mL/s)
     //          User measured 3.8mL actually dispensed
     //          New rate = 3.8 mL / 4.0 seconds = 0.95 mL/s
     float seconds = durationMs / 1000.0f;
-    float newMlPerSecond = actualVolumeMl / seconds;
+    float newMlPerSecond = (actualVolumeMl - calibration.offsetMl) / seconds;
+
+    CalibrationPoint point = {durationMs, actualVolumeMl};
+    return buildCalibrationUpdate(newMlPerSecond, calibration.offsetMl, &point, 1, update);
+}
+
+bool DosingHead::computeCalibration(const CalibrationPoint* points, uint8_t count, CalibrationUpdate& update) const {
+    if (!initialized || points == nullptr || count < 2 || count > MAX_CALIBRATION_POINTS) {
+        return false;
+    }
+
+    // Least-squares fit of volume = offset + rate * seconds
+    // Centered on the means to keep float precision over long runtimes
+    float meanSeconds = 0.0f;
+    float meanVolume = 0.0f;
+    for (uint8_t i = 0; i < count; i++) {
+        if (!isValidRuntime(points[i].runtimeMs) || points[i].volumeMl <= 0.0f) {
+            return false;
+        }
+        meanSeconds += points[i].runtimeMs / 1000.0f;
+        meanVolume += points[i].volumeMl;
+    }
+    meanSeconds /= count;
+    meanVolume /= count;
+
+    float sxx = 0.0f;
+    float sxy = 0.0f;
+    for (uint8_t i = 0; i < count; i++) {
+        float dx = points[i].runtimeMs / 1000.0f - meanSeconds;
+        sxx += dx * dx;
+        sxy += dx * (points[i].volumeMl - meanVolume);
+    }
 
-    // Validate the calculated rate is reasonable
-    if (newMlPerSecond <= 0.0f || newMlPerSecond > 100.0f) {  // Max 100 mL/s sanity check
+    // Need at least two distinct runtimes to separate offset from rate
+    if (sxx <= 0.0f) {
+        return false;
+    }
+
+    float newMlPerSecond = sxy / sxx;
+    float newOffsetMl = meanVolume - newMlPerSecond * meanSeconds;
+
+    return buildCalibrationUpdate(newMlPerSecond, newOffsetMl, points, count, update);
+}
+
+bool DosingHead::buildCalibrationUpdate(float mlPerSecond, float offsetMl, const CalibrationPoint* points,
+                                        uint8_t count, CalibrationUpdate& update) const {
+    // Validate the fitted model is reasonable
+    if (mlPerSecond <= 0.0f || mlPerSecond > MAX_ML_PER_SECOND) {
+        return false;
+    }
+
+    if (offsetMl < -MAX_OFFSET_ML || offsetMl > MAX_OFFSET_ML) {
+        return false;
+    }
+
+    update.data.mlPerSecond = mlPerSecond;
+    update.data.offsetMl = offsetMl;
+    update.data.pointCount = count;
+    update.data.isCalibrated = true;
+    update.data.lastCalibrationTime = millis();
+
+    memset(update.points, 0, sizeof(update.points));
+    memcpy(update.points, points, count * sizeof(CalibrationPoint));
+    return true;
+}
+
+bool DosingHead::applyCalibration(const CalibrationUpdate& update) {
+    if (!initialized || update.data.pointCount > MAX_CALIBRATION_POINTS) {
         return false;
     }
 
     // Update calibration
-    calibration.mlPerSecond = newMlPerSecond;
-    calibration.isCalibrated = true;
-    calibration.lastCalibrationTime = millis();
+    calibration = update.data;
+    memcpy(calibrationPoints, update.points, sizeof(calibrationPoints));
+
+    rebuildCurve();
 
     // Save to NVS
     return saveCalibration();
@@ -127,20 +301,10 @@ uint32_t DosingHead::runForDuration(uint32_t durationMs) {
         return 0;
     }
 
-    // Start the motor
-    if (!motor->startMotor(headIndex, MotorDirection::FORWARD)) {
-        return 0;
-    }
-
-    // Run for specified duration (blocking)
-    unsigned long startTime = millis();
-    delay(durationMs);
-
-    // Stop the motor
-    motor->stopMotor(headIndex);
-
-    // Return actual runtime
-    return millis() - startTime;
+    // Run for specified duration (blocking until done or cancelled)
+    bool cancelled = false;
+    uint32_t cancelLatencyUs = 0;
+    return runMotor(durationMs, cancelled, cancelLatencyUs);
 }
 
 bool DosingHead::isDispensing() const {
@@ -150,6 +314,21 @@ bool DosingHead::isDispensing() const {
     return motor->isMotorRunning(headIndex);
 }
 
+DoseProgress DosingHead::getDoseProgress() const {
+    DoseProgress progress = {false, 0, 0, 0.0f};
+
+    if (!dispensing.load()) {
+        return progress;
+    }
+
+    progress.active = true;
+    progress.targetMs = runTargetMs.load();
+    uint32_t elapsedMs = millis() - runStartMs.load();
+    progress.elapsedMs = (elapsedMs < progress.targetMs) ? elapsedMs : progress.targetMs;
+    progress.estimatedVolume = estimateVolume(progress.elapsedMs);
+    return progress;
+}
+
 CalibrationData DosingHead::getCalibrationData() const {
     return calibration;
 }
@@ -158,73 +337,123 @@ bool DosingHead::isCalibrated() const {
     return calibration.isCalibrated;
 }
 
+uint32_t DosingHead::getCalibrationVersion() const {
+    return calibrationVersion.load();
+}
+
 uint8_t DosingHead::getHeadIndex() const {
     return headIndex;
 }
 
 void DosingHead::resetCalibration() {
     calibration.mlPerSecond = DEFAULT_ML_PER_SECOND;
+    calibration.offsetMl = 0.0f;
+    calibration.pointCount = 0;
     calibration.isCalibrated = false;
     calibration.lastCalibrationTime = 0;
+    memset(calibrationPoints, 0, sizeof(calibrationPoints));
 
+    rebuildCurve();
     saveCalibration();
 }
 
 bool DosingHead::loadCalibration() {
-    Preferences prefs;
     String ns = getNVSNamespace();
 
-    if (!prefs.begin(ns.c_str(), true)) {  // true = read-only
-        // If NVS not available, keep default values
-        return false;
+    CalibrationBlob blob;
+    size_t read = FlashWriter::readBytes(ns.c_str(), CALIBRATION_BLOB_KEY, &blob, sizeof(CalibrationBlob));
+
+    if (read == sizeof(CalibrationBlob) && blob.version == CALIBRATION_BLOB_VERSION &&
+        blob.pointCount <= MAX_CALIBRATION_POINTS) {
+        calibration.mlPerSecond = blob.mlPerSecond;
+        calibration.offsetMl = blob.offsetMl;
+        calibration.pointCount = blob.pointCount;
+        calibration.isCalibrated = blob.isCalibrated;
+        calibration.lastCalibrationTime = blob.lastCalibrationTime;
+        memcpy(calibrationPoints, blob.points, sizeof(calibrationPoints));
+
+        // Drop the legacy per-field keys once the blob exists
+        if (FlashWriter::hasKey(ns.c_str(), "mlPerSec")) {
+            FlashWriter::remove(ns.c_str(), "mlPerSec", FlashSubsystem::CALIBRATION);
+            FlashWriter::remove(ns.c_str(), "calibrated", FlashSubsystem::CALIBRATION);
+            FlashWriter::remove(ns.c_str(), "lastCalTime", FlashSubsystem::CALIBRATION);
+        }
+    } else {
+        // Pre-blob firmware stored separate keys with a rate-only model (never written any more)
+        Preferences prefs;
+        if (!prefs.begin(ns.c_str(), true)) {  // true = read-only
+            // If NVS not available, keep default values
+            return false;
+        }
+
+        calibration.mlPerSecond = prefs.getFloat("mlPerSec", DEFAULT_ML_PER_SECOND);
+        calibration.offsetMl = 0.0f;
+        calibration.pointCount = 0;
+        calibration.isCalibrated = prefs.getBool("calibrated", false);
+        calibration.lastCalibrationTime = prefs.getULong("lastCalTime", 0);
+
+        prefs.end();
     }
 
-    // Load calibration data (use current values as defaults if not found)
-    calibration.mlPerSecond = prefs.getFloat("mlPerSec", DEFAULT_ML_PER_SECOND);
-    calibration.isCalibrated = prefs.getBool("calibrated", false);
-    calibration.lastCalibrationTime = prefs.getULong("lastCalTime", 0);
-
-    prefs.end();
+    rebuildCurve();
     return true;
 }
 
 bool DosingHead::saveCalibration() {
-    Preferences prefs;
     String ns = getNVSNamespace();
 
-    if (!prefs.begin(ns.c_str(), false)) {  // false = read-write
-        return false;
-    }
-
-    // Save calibration data
-    prefs.putFloat("mlPerSec", calibration.mlPerSecond);
-    prefs.putBool("calibrated", calibration.isCalibrated);
-    prefs.putULong("lastCalTime", calibration.lastCalibrationTime);
-
-    prefs.end();
-    return true;
+    // Save calibration data as one blob so the model is committed atomically
+    CalibrationBlob blob;
+    memset(&blob, 0, sizeof(CalibrationBlob));
+    blob.version = CALIBRATION_BLOB_VERSION;
+    blob.pointCount = calibration.pointCount;
+    blob.isCalibrated = calibration.isCalibrated;
+    blob.mlPerSecond = calibration.mlPerSecond;
+    blob.offsetMl = calibration.offsetMl;
+    blob.lastCalibrationTime = calibration.lastCalibrationTime;
+    memcpy(blob.points, calibrationPoints, sizeof(blob.points));
+
+    // One write per save: ConfigTransaction reserves exactly that
+    return FlashWriter::putBytes(ns.c_str(), CALIBRATION_BLOB_KEY, &blob, sizeof(CalibrationBlob),
+                                 FlashSubsystem::CALIBRATION);
 }
 
 uint32_t DosingHead::calculateRuntime(float volumeMl) const {
-    if (calibration.mlPerSecond <= 0.0f) {
+    if (!curve.valid) {
         return 0;
     }
 
     // Calculate runtime in milliseconds
-    // Example: Want 4 mL at 1.0 mL/s = 4 seconds = 4000 ms
-    float seconds = volumeMl / calibration.mlPerSecond;
-    uint32_t runtimeMs = static_cast<uint32_t>(seconds * 1000.0f);
+    // Example: Want 4 mL at 1.0 mL/s with 0.2 mL dead volume = 200 + 4 * 1000 = 4200 ms
+    float runtimeMs = curve.deadTimeMs + volumeMl * curve.msPerMl;
+    if (runtimeMs <= 0.0f) {
+        return 0;
+    }
 
-    return runtimeMs;
+    return static_cast<uint32_t>(runtimeMs);
 }
 
 float DosingHead::estimateVolume(uint32_t runtimeMs) const {
     // Calculate volume in milliliters
     // Example: Ran for 4000ms at 1.0 mL/s = 4.0 seconds * 1.0 mL/s = 4.0 mL
-    float seconds = runtimeMs / 1000.0f;
-    float volumeMl = calibration.mlPerSecond * seconds;
+    float volumeMl = curve.offsetMl + runtimeMs * curve.mlPerMs;
+
+    return volumeMl > 0.0f ? volumeMl : 0.0f;
+}
+
+void DosingHead::rebuildCurve() {
+    if (calibration.mlPerSecond <= 0.0f) {
+        curve = {0.0f, 0.0f, 0.0f, 0.0f, false};
+    } else {
+        curve.msPerMl = 1000.0f / calibration.mlPerSecond;
+        curve.deadTimeMs = -calibration.offsetMl * curve.msPerMl;
+        curve.mlPerMs = calibration.mlPerSecond / 1000.0f;
+        curve.offsetMl = calibration.offsetMl;
+        curve.valid = true;
+    }
 
-    return volumeMl;
+    // Every calibration change passes through here; bump after the data is written
+    calibrationVersion.fetch_add(1);
 }
 
 String DosingHead::getNVSNamespace() const {
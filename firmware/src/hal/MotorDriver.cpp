@@ -1,16 +1,30 @@
 #include "hal/MotorDriver.h"
+#include <soc/gpio_struct.h>
 
-MotorDriver::MotorDriver() : initialized(false), standbyEnabled(false) {
+MotorDriver::MotorDriver()
+    : allMotorPinsMask{0, 0}, standbyMask{0, 0}, lastEmergencyStopNs(0),
+      initialized(false), standbyEnabled(false) {
     // Initialize motor pin configurations
     motorPins[0] = {MOTOR1_IN1_PIN, MOTOR1_IN2_PIN, MOTOR1_PWM_PIN};
     motorPins[1] = {MOTOR2_IN1_PIN, MOTOR2_IN2_PIN, MOTOR2_PWM_PIN};
     motorPins[2] = {MOTOR3_IN1_PIN, MOTOR3_IN2_PIN, MOTOR3_PWM_PIN};
     motorPins[3] = {MOTOR4_IN1_PIN, MOTOR4_IN2_PIN, MOTOR4_PWM_PIN};
 
-    // Initialize motor states
+    // Initialize motor states and their locks
     for (uint8_t i = 0; i < NUM_MOTORS; i++) {
         motorStates[i] = {false, MotorDirection::STOP, 0, 0};
+        portMUX_INITIALIZE(&motorLocks[i]);
+        stateSequence[i].store(0, std::memory_order_relaxed);
     }
+    stateVersion.store(0, std::memory_order_relaxed);
+
+    // Precompute register masks so the emergency stop path does no per-pin work
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        addPinToMask(allMotorPinsMask, motorPins[i].in1);
+        addPinToMask(allMotorPinsMask, motorPins[i].in2);
+        addPinToMask(allMotorPinsMask, motorPins[i].pwm);
+    }
+    addPinToMask(standbyMask, MOTOR_STBY_PIN);
 }
 
 bool MotorDriver::begin() {
@@ -39,7 +53,21 @@ bool MotorDriver::begin() {
 }
 
 bool MotorDriver::startMotor(uint8_t motorIndex, MotorDirection direction) {
-    if (!initialized || !isValidMotorIndex(motorIndex)) {
+    if (!isValidMotorIndex(motorIndex)) {
+        return false;
+    }
+    return startMotors(1 << motorIndex, direction);
+}
+
+bool MotorDriver::stopMotor(uint8_t motorIndex) {
+    if (!isValidMotorIndex(motorIndex)) {
+        return false;
+    }
+    return stopMotors(1 << motorIndex);
+}
+
+bool MotorDriver::startMotors(uint8_t motorMask, MotorDirection direction) {
+    if (!initialized || motorMask == 0 || (motorMask >> NUM_MOTORS) != 0) {
         return false;
     }
 
@@ -48,36 +76,73 @@ bool MotorDriver::startMotor(uint8_t motorIndex, MotorDirection direction) {
         return false;
     }
 
-    // Enable standby if not already enabled
-    if (!standbyEnabled) {
-        enableStandby();
+    GpioMask setMask = {0, 0};
+    GpioMask clearMask = {0, 0};
+
+    // Always include STBY in the set mask: it is idempotent and avoids racing
+    // a concurrent emergency stop on the standbyEnabled flag
+    setMask.low |= standbyMask.low;
+    setMask.high |= standbyMask.high;
+
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        if (motorMask & (1 << i)) {
+            addDirectionMasks(i, direction, setMask, clearMask);
+        }
     }
 
-    // Set direction and enable motor at full speed
-    setMotorPins(motorIndex, direction);
+    unsigned long now = millis();
+
+    lockMotors(motorMask);
+
+    // Set direction and enable all selected motors at full speed
+    writeMasks(setMask, clearMask);
+    standbyEnabled.store(true);
 
     // Update state
-    motorStates[motorIndex].isRunning = true;
-    motorStates[motorIndex].direction = direction;
-    motorStates[motorIndex].startTime = millis();
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        if (motorMask & (1 << i)) {
+            beginStateWrite(i);
+            motorStates[i].isRunning = true;
+            motorStates[i].direction = direction;
+            motorStates[i].startTime = now;
+            endStateWrite(i);
+        }
+    }
+
+    unlockMotors(motorMask);
 
     return true;
 }
 
-bool MotorDriver::stopMotor(uint8_t motorIndex) {
-    if (!initialized || !isValidMotorIndex(motorIndex)) {
+bool MotorDriver::stopMotors(uint8_t motorMask) {
+    if (!initialized || motorMask == 0 || (motorMask >> NUM_MOTORS) != 0) {
         return false;
     }
 
-    // Coast to stop (IN1=LOW, IN2=LOW, PWM=LOW)
-    setMotorPins(motorIndex, MotorDirection::STOP);
+    GpioMask setMask = {0, 0};
+    GpioMask clearMask = {0, 0};
+
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        if (motorMask & (1 << i)) {
+            addDirectionMasks(i, MotorDirection::STOP, setMask, clearMask);
+        }
+    }
+
+    unsigned long now = millis();
+
+    lockMotors(motorMask);
+
+    // Coast to stop (IN1=LOW, IN2=LOW, PWM=LOW) on all selected motors at once
+    writeMasks(setMask, clearMask);
 
     // Update state
-    if (motorStates[motorIndex].isRunning) {
-        motorStates[motorIndex].runDuration = millis() - motorStates[motorIndex].startTime;
-        motorStates[motorIndex].isRunning = false;
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        if (motorMask & (1 << i)) {
+            markStopped(i, MotorDirection::STOP, now);
+        }
     }
-    motorStates[motorIndex].direction = MotorDirection::STOP;
+
+    unlockMotors(motorMask);
 
     return true;
 }
@@ -87,41 +152,129 @@ bool MotorDriver::brakeMotor(uint8_t motorIndex) {
         return false;
     }
 
+    unsigned long now = millis();
+    uint8_t motorMask = 1 << motorIndex;
+
+    lockMotors(motorMask);
+
     // Short brake (IN1=HIGH, IN2=HIGH, PWM=HIGH)
     setMotorPins(motorIndex, MotorDirection::BRAKE);
 
     // Update state
-    if (motorStates[motorIndex].isRunning) {
-        motorStates[motorIndex].runDuration = millis() - motorStates[motorIndex].startTime;
-        motorStates[motorIndex].isRunning = false;
-    }
-    motorStates[motorIndex].direction = MotorDirection::BRAKE;
+    markStopped(motorIndex, MotorDirection::BRAKE, now);
+
+    unlockMotors(motorMask);
 
     return true;
 }
 
 void MotorDriver::emergencyStopAll() {
-    // Immediately stop all motors using brake
+    if (!initialized) {
+        return;
+    }
+
+    unsigned long now = millis();
+
+    lockMotors(ALL_MOTORS_MASK);
+
+    // Brake every motor and drop STBY in a single set/clear register write
+    uint32_t startCycles = ESP.getCycleCount();
+    writeMasks(allMotorPinsMask, standbyMask);
+    uint32_t elapsedCycles = ESP.getCycleCount() - startCycles;
+
+    standbyEnabled.store(false);
+
+    // Update state
     for (uint8_t i = 0; i < NUM_MOTORS; i++) {
-        brakeMotor(i);
+        markStopped(i, MotorDirection::BRAKE, now);
     }
 
-    // Disable standby for safety
-    disableStandby();
+    unlockMotors(ALL_MOTORS_MASK);
+
+    lastEmergencyStopNs.store((elapsedCycles * 1000UL) / ESP.getCpuFreqMHz());
 }
 
+uint32_t MotorDriver::getLastEmergencyStopLatencyNs() const {
+    return lastEmergencyStopNs.load();
+}
+
+#ifdef SQUAREDOSE_DIAGNOSTICS
+bool MotorDriver::benchmarkStopLatency(uint16_t iterations, StopLatencyResult& result) {
+    result = {0, 0, 0};
+
+    if (!initialized || iterations == 0) {
+        return false;
+    }
+
+    GpioMask setMask = {0, 0};
+    GpioMask clearMask = {0, 0};
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        addDirectionMasks(i, MotorDirection::STOP, setMask, clearMask);
+    }
+
+    uint64_t digitalWriteCycles = 0;
+    uint64_t registerCycles = 0;
+
+    // Motors are locked so no task can start one mid-measurement, and never
+    // benchmarked while dosing: writing STOP levels would halt the dose
+    for (uint16_t n = 0; n < iterations; n++) {
+        // Legacy path: three digitalWrite calls per motor. Each motor is locked
+        // only for its own writes, so a sample never holds every lock for long
+        for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+            lockMotors(1 << i);
+            if (motorStates[i].isRunning) {
+                unlockMotors(1 << i);
+                return false;
+            }
+
+            uint32_t start = ESP.getCycleCount();
+            digitalWrite(motorPins[i].in1, LOW);
+            digitalWrite(motorPins[i].in2, LOW);
+            digitalWrite(motorPins[i].pwm, LOW);
+            digitalWriteCycles += ESP.getCycleCount() - start;
+
+            unlockMotors(1 << i);
+        }
+
+        // Register path: one clear write per bank, locked like stopMotors()
+        lockMotors(ALL_MOTORS_MASK);
+        bool anyRunning = false;
+        for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+            anyRunning = anyRunning || motorStates[i].isRunning;
+        }
+        if (anyRunning) {
+            unlockMotors(ALL_MOTORS_MASK);
+            return false;
+        }
+
+        uint32_t start = ESP.getCycleCount();
+        writeMasks(setMask, clearMask);
+        registerCycles += ESP.getCycleCount() - start;
+
+        unlockMotors(ALL_MOTORS_MASK);
+    }
+
+    uint32_t cpuMHz = ESP.getCpuFreqMHz();
+    result.iterations = iterations;
+    result.digitalWriteNs = (digitalWriteCycles * 1000ULL) / (static_cast<uint64_t>(cpuMHz) * iterations);
+    result.registerNs = (registerCycles * 1000ULL) / (static_cast<uint64_t>(cpuMHz) * iterations);
+
+    return true;
+}
+#endif // SQUAREDOSE_DIAGNOSTICS
+
 bool MotorDriver::isMotorRunning(uint8_t motorIndex) const {
     if (!isValidMotorIndex(motorIndex)) {
         return false;
     }
-    return motorStates[motorIndex].isRunning;
+    return readState(motorIndex).isRunning;
 }
 
 MotorState MotorDriver::getMotorState(uint8_t motorIndex) const {
     if (!isValidMotorIndex(motorIndex)) {
         return {false, MotorDirection::STOP, 0, 0};
     }
-    return motorStates[motorIndex];
+    return readState(motorIndex);
 }
 
 unsigned long MotorDriver::getMotorRuntime(uint8_t motorIndex) const {
@@ -129,78 +282,170 @@ unsigned long MotorDriver::getMotorRuntime(uint8_t motorIndex) const {
         return 0;
     }
 
-    if (motorStates[motorIndex].isRunning) {
-        return millis() - motorStates[motorIndex].startTime;
+    MotorState state = readState(motorIndex);
+    if (state.isRunning) {
+        return millis() - state.startTime;
     }
 
-    return motorStates[motorIndex].runDuration;
+    return state.runDuration;
 }
 
 void MotorDriver::enableStandby() {
     if (initialized) {
         digitalWrite(MOTOR_STBY_PIN, HIGH);
-        standbyEnabled = true;
+        standbyEnabled.store(true);
     }
 }
 
 void MotorDriver::disableStandby() {
     if (initialized) {
-        digitalWrite(MOTOR_STBY_PIN, LOW);
-        standbyEnabled = false;
+        unsigned long now = millis();
+
+        lockMotors(ALL_MOTORS_MASK);
+
+        writeMasks({0, 0}, standbyMask);
+        standbyEnabled.store(false);
 
         // Mark all motors as stopped since standby disables them
         for (uint8_t i = 0; i < NUM_MOTORS; i++) {
             if (motorStates[i].isRunning) {
-                motorStates[i].runDuration = millis() - motorStates[i].startTime;
+                beginStateWrite(i);
+                motorStates[i].runDuration = now - motorStates[i].startTime;
                 motorStates[i].isRunning = false;
+                endStateWrite(i);
             }
         }
+
+        unlockMotors(ALL_MOTORS_MASK);
     }
 }
 
 bool MotorDriver::isStandbyEnabled() const {
-    return standbyEnabled;
+    return standbyEnabled.load();
 }
 
-void MotorDriver::setMotorPins(uint8_t motorIndex, MotorDirection direction) {
-    if (!isValidMotorIndex(motorIndex)) {
-        return;
+void MotorDriver::addPinToMask(GpioMask& mask, uint8_t pin) {
+    if (pin < 32) {
+        mask.low |= (1UL << pin);
+    } else {
+        mask.high |= (1UL << (pin - 32));
     }
+}
 
+void MotorDriver::addDirectionMasks(uint8_t motorIndex, MotorDirection direction,
+                                    GpioMask& setMask, GpioMask& clearMask) const {
     const MotorPins& pins = motorPins[motorIndex];
 
     switch (direction) {
         case MotorDirection::FORWARD:
             // IN1=HIGH, IN2=LOW, PWM=HIGH (full speed forward)
-            digitalWrite(pins.in1, HIGH);
-            digitalWrite(pins.in2, LOW);
-            digitalWrite(pins.pwm, HIGH);
+            addPinToMask(setMask, pins.in1);
+            addPinToMask(clearMask, pins.in2);
+            addPinToMask(setMask, pins.pwm);
             break;
 
         case MotorDirection::REVERSE:
             // IN1=LOW, IN2=HIGH, PWM=HIGH (full speed reverse)
-            digitalWrite(pins.in1, LOW);
-            digitalWrite(pins.in2, HIGH);
-            digitalWrite(pins.pwm, HIGH);
+            addPinToMask(clearMask, pins.in1);
+            addPinToMask(setMask, pins.in2);
+            addPinToMask(setMask, pins.pwm);
             break;
 
         case MotorDirection::BRAKE:
             // IN1=HIGH, IN2=HIGH, PWM=HIGH (short brake)
-            digitalWrite(pins.in1, HIGH);
-            digitalWrite(pins.in2, HIGH);
-            digitalWrite(pins.pwm, HIGH);
+            addPinToMask(setMask, pins.in1);
+            addPinToMask(setMask, pins.in2);
+            addPinToMask(setMask, pins.pwm);
             break;
 
         case MotorDirection::STOP:
         default:
             // IN1=LOW, IN2=LOW, PWM=LOW (coast to stop)
-            digitalWrite(pins.in1, LOW);
-            digitalWrite(pins.in2, LOW);
-            digitalWrite(pins.pwm, LOW);
+            addPinToMask(clearMask, pins.in1);
+            addPinToMask(clearMask, pins.in2);
+            addPinToMask(clearMask, pins.pwm);
             break;
     }
 }
 
+void IRAM_ATTR MotorDriver::writeMasks(const GpioMask& setMask, const GpioMask& clearMask) {
+    // W1TS/W1TC registers only touch the bits that are set, so pins outside
+    // the masks (and other tasks' GPIOs) are never disturbed
+    GPIO.out_w1ts = setMask.low;
+    GPIO.out_w1tc = clearMask.low;
+    GPIO.out1_w1ts.val = setMask.high;
+    GPIO.out1_w1tc.val = clearMask.high;
+}
+
+void MotorDriver::markStopped(uint8_t motorIndex, MotorDirection direction, unsigned long now) {
+    beginStateWrite(motorIndex);
+    if (motorStates[motorIndex].isRunning) {
+        motorStates[motorIndex].runDuration = now - motorStates[motorIndex].startTime;
+        motorStates[motorIndex].isRunning = false;
+    }
+    motorStates[motorIndex].direction = direction;
+    endStateWrite(motorIndex);
+}
+
+void MotorDriver::lockMotors(uint8_t motorMask) {
+    // Fixed ascending order prevents deadlock between overlapping group operations
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        if (motorMask & (1 << i)) {
+            portENTER_CRITICAL(&motorLocks[i]);
+        }
+    }
+}
+
+void MotorDriver::unlockMotors(uint8_t motorMask) {
+    for (int8_t i = NUM_MOTORS - 1; i >= 0; i--) {
+        if (motorMask & (1 << i)) {
+            portEXIT_CRITICAL(&motorLocks[i]);
+        }
+    }
+}
+
+uint32_t MotorDriver::getStateVersion() const {
+    return stateVersion.load(std::memory_order_acquire);
+}
+
+void MotorDriver::beginStateWrite(uint8_t motorIndex) {
+    stateSequence[motorIndex].fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void MotorDriver::endStateWrite(uint8_t motorIndex) {
+    stateSequence[motorIndex].fetch_add(1, std::memory_order_release);
+    stateVersion.fetch_add(1, std::memory_order_release);
+}
+
+MotorState MotorDriver::readState(uint8_t motorIndex) const {
+    MotorState snapshot;
+    uint32_t before;
+    uint32_t after;
+
+    // Writers only hold the sequence odd for a few instructions inside a
+    // critical section, so this loop almost never retries
+    do {
+        before = stateSequence[motorIndex].load(std::memory_order_acquire);
+        snapshot = motorStates[motorIndex];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = stateSequence[motorIndex].load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+
+    return snapshot;
+}
+
+void MotorDriver::setMotorPins(uint8_t motorIndex, MotorDirection direction) {
+    if (!isValidMotorIndex(motorIndex)) {
+        return;
+    }
+
+    GpioMask setMask = {0, 0};
+    GpioMask clearMask = {0, 0};
+    addDirectionMasks(motorIndex, direction, setMask, clearMask);
+    writeMasks(setMask, clearMask);
+}
+
 bool MotorDriver::isValidMotorIndex(uint8_t motorIndex) const {
     return motorIndex < NUM_MOTORS;
 }
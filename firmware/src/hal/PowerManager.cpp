@@ -0,0 +1,335 @@
+#include "hal/PowerManager.h"
+#include "diagnostics/Log.h"
+#include "diagnostics/Metrics.h"
+#include "storage/FlashWriter.h"
+#include <WiFi.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+
+LOG_MODULE("PowerManager", LOG_LEVEL_POWER_MANAGER);
+
+static constexpr uint8_t PROFILE_COUNT = static_cast<uint8_t>(PowerProfile::COUNT);
+static constexpr uint8_t LOCK_COUNT = static_cast<uint8_t>(PowerLock::COUNT);
+
+static const char* const POWER_LOCK_NAMES[] = {"dose", "request"};
+
+const PowerProfileSettings PowerManager::profiles[PROFILE_COUNT] = {
+    {"performance", POWER_PERFORMANCE_PS, POWER_PERFORMANCE_LISTEN_INTERVAL, POWER_PERFORMANCE_MAX_MHZ,
+     POWER_PERFORMANCE_MIN_MHZ, POWER_PERFORMANCE_LIGHT_SLEEP, POWER_PERFORMANCE_IDLE_MA, POWER_PERFORMANCE_ACTIVE_MA},
+    {"balanced", POWER_BALANCED_PS, POWER_BALANCED_LISTEN_INTERVAL, POWER_BALANCED_MAX_MHZ,
+     POWER_BALANCED_MIN_MHZ, POWER_BALANCED_LIGHT_SLEEP, POWER_BALANCED_IDLE_MA, POWER_BALANCED_ACTIVE_MA},
+    {"low-power", POWER_LOW_POWER_PS, POWER_LOW_POWER_LISTEN_INTERVAL, POWER_LOW_POWER_MAX_MHZ,
+     POWER_LOW_POWER_MIN_MHZ, POWER_LOW_POWER_LIGHT_SLEEP, POWER_LOW_POWER_IDLE_MA, POWER_LOW_POWER_ACTIVE_MA},
+};
+
+// Static storage is zero-initialized, so every counter starts at 0
+std::atomic<uint8_t> PowerManager::profile(POWER_DEFAULT_PROFILE);
+std::atomic<bool> PowerManager::pmEnabled(false);
+esp_pm_lock_handle_t PowerManager::locks[LOCK_COUNT];
+SemaphoreHandle_t PowerManager::mutex;
+StaticSemaphore_t PowerManager::mutexBuffer;
+uint8_t PowerManager::holders;
+int64_t PowerManager::busySinceUs;
+int64_t PowerManager::profileSinceUs;
+uint64_t PowerManager::profileTimeUs[PROFILE_COUNT];
+uint64_t PowerManager::busyTimeUs[PROFILE_COUNT];
+std::atomic<uint32_t> PowerManager::lockAcquires[LOCK_COUNT];
+std::atomic<uint32_t> PowerManager::requests[PROFILE_COUNT];
+std::atomic<uint32_t> PowerManager::handlerTimeUs[PROFILE_COUNT];
+std::atomic<uint32_t> PowerManager::maxHandlerUs[PROFILE_COUNT];
+
+bool PowerManager::begin() {
+    if (mutex == nullptr) {
+        mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+        if (mutex == nullptr) {
+            LOG_ERROR("CRITICAL: Failed to create mutex!");
+            return false;
+        }
+    }
+
+    // One CPU_FREQ_MAX lock per kind of work; it also keeps the chip out of light sleep
+    for (uint8_t i = 0; i < LOCK_COUNT; i++) {
+        if (locks[i] == nullptr && esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, POWER_LOCK_NAMES[i], &locks[i]) != ESP_OK) {
+            locks[i] = nullptr;  // Core built without CONFIG_PM_ENABLE: nothing to hold
+        }
+    }
+
+    uint16_t stored = FlashWriter::readUShort(POWER_NVS_NAMESPACE, POWER_NVS_PROFILE_KEY, POWER_DEFAULT_PROFILE);
+    if (stored >= PROFILE_COUNT) {
+        LOG_WARN("Stored profile %u is invalid, using the default", stored);
+        stored = POWER_DEFAULT_PROFILE;
+    }
+
+    profileSinceUs = esp_timer_get_time();
+    profile.store(static_cast<uint8_t>(stored));
+
+    applyProfile(static_cast<PowerProfile>(stored));
+    applyStationPowerSave();
+    LOG_INFO("Power profile: %s", profiles[stored].name);
+    return true;
+}
+
+bool PowerManager::setProfile(PowerProfile newProfile) {
+    uint8_t index = static_cast<uint8_t>(newProfile);
+    if (index >= PROFILE_COUNT) {
+        return false;
+    }
+
+    if (!FlashWriter::putUShort(POWER_NVS_NAMESPACE, POWER_NVS_PROFILE_KEY, index, FlashSubsystem::POWER)) {
+        LOG_ERROR("Failed to store profile");
+        return false;
+    }
+
+    // Time so far belongs to the previous profile
+    if (mutex != nullptr && xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
+        accountTime(esp_timer_get_time());
+        profile.store(index);
+        xSemaphoreGive(mutex);
+    } else {
+        profile.store(index);
+    }
+
+    applyProfile(newProfile);
+    applyStationPowerSave();
+    LOG_INFO("Power profile: %s", profiles[index].name);
+    return true;
+}
+
+PowerProfile PowerManager::getProfile() {
+    return static_cast<PowerProfile>(profile.load());
+}
+
+const PowerProfileSettings& PowerManager::getSettings(PowerProfile profile) {
+    return profiles[static_cast<uint8_t>(profile)];
+}
+
+bool PowerManager::isPowerManagementEnabled() {
+    return pmEnabled.load();
+}
+
+const char* PowerManager::getProfileName(PowerProfile profile) {
+    uint8_t index = static_cast<uint8_t>(profile);
+    return (index < PROFILE_COUNT) ? profiles[index].name : "unknown";
+}
+
+bool PowerManager::parseProfile(const char* name, PowerProfile& profile) {
+    if (name == nullptr) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+        if (strcmp(name, profiles[i].name) == 0) {
+            profile = static_cast<PowerProfile>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PowerManager::applyProfile(PowerProfile profile) {
+    const PowerProfileSettings& settings = getSettings(profile);
+
+    esp_pm_config_esp32s3_t config;
+    config.max_freq_mhz = settings.maxMhz;
+    config.min_freq_mhz = settings.minMhz;
+    config.light_sleep_enable = settings.lightSleep;
+
+    esp_err_t err = esp_pm_configure(&config);
+    pmEnabled.store(err == ESP_OK);
+    if (err != ESP_OK) {
+        LOG_WARN("DFS and light sleep unavailable (esp_pm_configure: %d), modem sleep only", err);
+        return false;
+    }
+
+    LOG_INFO("CPU %u-%u MHz, light sleep %s", settings.minMhz, settings.maxMhz, settings.lightSleep ? "on" : "off");
+    return true;
+}
+
+void PowerManager::applyStationPowerSave() {
+    const PowerProfileSettings& settings = profiles[profile.load()];
+
+    // The WiFi library keeps this and reapplies it whenever the station starts
+    WiFi.setSleep(settings.powerSave);
+
+    // WiFi.begin() writes its own station config (listen interval 0 = 3 beacons),
+    // so the interval is set again after each association
+    if (settings.listenInterval == 0 || WiFi.status() != WL_CONNECTED) {
+        return;
+    }
+
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK || config.sta.listen_interval == settings.listenInterval) {
+        return;
+    }
+
+    config.sta.listen_interval = settings.listenInterval;
+    if (esp_wifi_set_config(WIFI_IF_STA, &config) != ESP_OK) {
+        LOG_WARN("Failed to set listen interval %u", settings.listenInterval);
+    }
+}
+
+void PowerManager::acquire(PowerLock lock) {
+    uint8_t index = static_cast<uint8_t>(lock);
+    if (index >= LOCK_COUNT) {
+        return;
+    }
+
+    if (locks[index] != nullptr) {
+        esp_pm_lock_acquire(locks[index]);
+    }
+    lockAcquires[index].fetch_add(1, std::memory_order_relaxed);
+
+    if (mutex != nullptr && xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
+        if (holders++ == 0) {
+            busySinceUs = esp_timer_get_time();
+        }
+        xSemaphoreGive(mutex);
+    }
+}
+
+void PowerManager::release(PowerLock lock) {
+    uint8_t index = static_cast<uint8_t>(lock);
+    if (index >= LOCK_COUNT) {
+        return;
+    }
+
+    if (mutex != nullptr && xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
+        // Ignores a release whose acquire came before begin()
+        if (holders > 0) {
+            if (holders == 1) {
+                accountTime(esp_timer_get_time());
+            }
+            holders--;
+        }
+        xSemaphoreGive(mutex);
+    }
+
+    if (locks[index] != nullptr) {
+        esp_pm_lock_release(locks[index]);
+    }
+}
+
+void PowerManager::accountTime(int64_t nowUs) {
+    uint8_t current = profile.load();
+
+    profileTimeUs[current] += nowUs - profileSinceUs;
+    profileSinceUs = nowUs;
+
+    if (holders > 0) {
+        busyTimeUs[current] += nowUs - busySinceUs;
+        busySinceUs = nowUs;
+    }
+}
+
+void PowerManager::recordHandlerTime(uint32_t durationUs, bool complete) {
+    uint8_t current = profile.load();
+    if (complete) {
+        requests[current].fetch_add(1, std::memory_order_relaxed);
+    }
+    handlerTimeUs[current].fetch_add(durationUs, std::memory_order_relaxed);
+
+    // Handlers run on the AsyncTCP task only, so load/store is enough for the max
+    if (durationUs > maxHandlerUs[current].load(std::memory_order_relaxed)) {
+        maxHandlerUs[current].store(durationUs, std::memory_order_relaxed);
+    }
+}
+
+uint32_t PowerManager::getAverageHandlerUs(PowerProfile profile) {
+    uint8_t index = static_cast<uint8_t>(profile);
+    if (index >= PROFILE_COUNT) {
+        return 0;
+    }
+
+    uint32_t count = requests[index].load(std::memory_order_relaxed);
+    return (count > 0) ? handlerTimeUs[index].load(std::memory_order_relaxed) / count : 0;
+}
+
+uint32_t PowerManager::getEstimatedCurrentMa(PowerProfile profile) {
+    uint8_t index = static_cast<uint8_t>(profile);
+    if (index >= PROFILE_COUNT) {
+        return 0;
+    }
+
+    uint64_t totalUs = 0;
+    uint64_t busyUs = 0;
+    if (mutex != nullptr && xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
+        accountTime(esp_timer_get_time());
+        totalUs = profileTimeUs[index];
+        busyUs = busyTimeUs[index];
+        xSemaphoreGive(mutex);
+    }
+
+    return estimateCurrentMa(index, totalUs, busyUs);
+}
+
+uint32_t PowerManager::estimateCurrentMa(uint8_t index, uint64_t totalUs, uint64_t busyUs) {
+    const PowerProfileSettings& settings = profiles[index];
+    if (totalUs == 0) {
+        return settings.idleMa;
+    }
+
+    // Time-weighted mix of the idle and active figures
+    return static_cast<uint32_t>((settings.idleMa * (totalUs - busyUs) + settings.activeMa * busyUs) / totalUs);
+}
+
+void PowerManager::writeMetrics(Print& out) {
+    uint8_t current = profile.load();
+
+    Metrics::writeHeader(out, "squaredose_power_profile", "gauge", "1 for the active power profile");
+    for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+        out.printf("squaredose_power_profile{profile=\"%s\"} %u\n", profiles[i].name, i == current ? 1 : 0);
+    }
+    Metrics::writeMetric(out, "squaredose_power_management_enabled", "gauge", "1 if DFS and light sleep are available",
+                         static_cast<uint32_t>(pmEnabled.load() ? 1 : 0));
+
+    Metrics::writeHeader(out, "squaredose_power_lock_acquires_total", "counter", "Times work held the CPU awake");
+    for (uint8_t i = 0; i < LOCK_COUNT; i++) {
+        out.printf("squaredose_power_lock_acquires_total{lock=\"%s\"} %lu\n", POWER_LOCK_NAMES[i],
+                   (unsigned long)lockAcquires[i].load(std::memory_order_relaxed));
+    }
+
+    // Snapshot the time accounting, then print without the lock
+    uint64_t totalUs[PROFILE_COUNT] = {0};
+    uint64_t busyUs[PROFILE_COUNT] = {0};
+    if (mutex != nullptr && xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
+        accountTime(esp_timer_get_time());
+        memcpy(totalUs, profileTimeUs, sizeof(totalUs));
+        memcpy(busyUs, busyTimeUs, sizeof(busyUs));
+        xSemaphoreGive(mutex);
+    }
+
+    Metrics::writeHeader(out, "squaredose_power_profile_seconds_total", "counter", "Time spent in each profile");
+    for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+        out.printf("squaredose_power_profile_seconds_total{profile=\"%s\"} %.3f\n", profiles[i].name,
+                   totalUs[i] / 1000000.0);
+    }
+    Metrics::writeHeader(out, "squaredose_power_busy_seconds_total", "counter", "Time a power lock was held, per profile");
+    for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+        out.printf("squaredose_power_busy_seconds_total{profile=\"%s\"} %.3f\n", profiles[i].name,
+                   busyUs[i] / 1000000.0);
+    }
+
+    Metrics::writeHeader(out, "squaredose_power_estimated_current_ma", "gauge",
+                         "Modelled average board current per profile (excludes motors)");
+    for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+        if (totalUs[i] > 0) {
+            out.printf("squaredose_power_estimated_current_ma{profile=\"%s\"} %lu\n", profiles[i].name,
+                       (unsigned long)estimateCurrentMa(i, totalUs[i], busyUs[i]));
+        }
+    }
+
+    Metrics::writeHeader(out, "squaredose_power_handler_duration_seconds", "summary",
+                         "HTTP handler time per power profile (excludes radio wake-up)");
+    for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+        out.printf("squaredose_power_handler_duration_seconds_sum{profile=\"%s\"} %.6f\n", profiles[i].name,
+                   handlerTimeUs[i].load(std::memory_order_relaxed) / 1000000.0);
+        out.printf("squaredose_power_handler_duration_seconds_count{profile=\"%s\"} %lu\n", profiles[i].name,
+                   (unsigned long)requests[i].load(std::memory_order_relaxed));
+    }
+    Metrics::writeHeader(out, "squaredose_power_handler_duration_max_seconds", "gauge",
+                         "Longest HTTP handler call per power profile");
+    for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+        out.printf("squaredose_power_handler_duration_max_seconds{profile=\"%s\"} %.6f\n", profiles[i].name,
+                   maxHandlerUs[i].load(std::memory_order_relaxed) / 1000000.0);
+    }
+}
@@ -1,6 +1,9 @@
 #include "logs/DosingLogManager.h"
+#include "diagnostics/Log.h"
 
-DosingLogManager::DosingLogManager() : mutex(nullptr), initialized(false) {
+LOG_MODULE("DosingLogManager", LOG_LEVEL_DOSING_LOG);
+
+DosingLogManager::DosingLogManager() : mutex(nullptr), initialized(false), version(0) {
 }
 
 DosingLogManager::~DosingLogManager() {
@@ -12,7 +15,7 @@ DosingLogManager::~DosingLogManager() {
 void DosingLogManager::initMutex() {
     mutex = xSemaphoreCreateMutex();
     if (mutex == nullptr) {
-        Serial.println("[DosingLogManager] CRITICAL: Failed to create mutex!");
+        LOG_ERROR("CRITICAL: Failed to create mutex!");
     }
 }
 
@@ -22,18 +25,18 @@ bool DosingLogManager::begin() {
     }
 
     if (mutex == nullptr) {
-        Serial.println("[DosingLogManager] Error: Mutex not initialized. Call initMutex() first.");
+        LOG_ERROR("Error: Mutex not initialized. Call initMutex() first.");
         return false;
     }
 
     // Initialize the storage layer
     if (!store.begin()) {
-        Serial.println("[DosingLogManager] Failed to initialize DosingLogStore");
+        LOG_ERROR("Failed to initialize DosingLogStore");
         return false;
     }
 
     initialized = true;
-    Serial.println("[DosingLogManager] Initialized successfully");
+    LOG_INFO("Initialized successfully");
     return true;
 }
 
@@ -53,14 +56,14 @@ bool DosingLogManager::logDoseInternal(uint8_t head, float scheduledVolume, floa
     // Internal method - caller must hold mutex
 
     if (head >= NUM_DOSING_HEADS) {
-        Serial.printf("[DosingLogManager] Invalid head index: %d\n", head);
+        LOG_WARN("Invalid head index: %d", head);
         return false;
     }
 
     // Skip logging if time is invalid (before year 2020)
     // This allows schedules to work without NTP, but logs only when time is valid
     if (timestamp < 1577836800) {  // Jan 1, 2020
-        Serial.println("[DosingLogManager] Skipping log - time not synced (NTP or manual sync required)");
+        LOG_WARN("Skipping log - time not synced (NTP or manual sync required)");
         return false;  // Not an error, just skipping
     }
 
@@ -78,10 +81,10 @@ bool DosingLogManager::logDoseInternal(uint8_t head, float scheduledVolume, floa
     bool success = store.saveLog(log);
 
     if (success) {
-        Serial.printf("[DosingLogManager] Logged dose: head=%d, scheduled=%.2f mL, adhoc=%.2f mL, hour=%lu\n",
-                     head, scheduledVolume, adhocVolume, hourTimestamp);
+        version.fetch_add(1);
+        LOG_DEBUG("Logged dose: head=%d, scheduled=%.2f mL, adhoc=%.2f mL, hour=%lu", head, scheduledVolume, adhocVolume, hourTimestamp);
     } else {
-        Serial.printf("[DosingLogManager] Failed to log dose for head %d\n", head);
+        LOG_ERROR("Failed to log dose for head %d", head);
     }
 
     return success;
@@ -89,7 +92,7 @@ bool DosingLogManager::logDoseInternal(uint8_t head, float scheduledVolume, floa
 
 bool DosingLogManager::logScheduledDose(uint8_t head, float volume, uint32_t timestamp) {
     if (!initialized) {
-        Serial.println("[DosingLogManager] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
@@ -100,13 +103,13 @@ bool DosingLogManager::logScheduledDose(uint8_t head, float volume, uint32_t tim
         return success;
     }
 
-    Serial.println("[DosingLogManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return false;
 }
 
 bool DosingLogManager::logAdhocDose(uint8_t head, float volume, uint32_t timestamp) {
     if (!initialized) {
-        Serial.println("[DosingLogManager] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
@@ -117,19 +120,19 @@ bool DosingLogManager::logAdhocDose(uint8_t head, float volume, uint32_t timesta
         return success;
     }
 
-    Serial.println("[DosingLogManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return false;
 }
 
 bool DosingLogManager::getDailySummary(uint8_t head, uint32_t currentTime, float dailyTarget,
                                        uint16_t dosesPerDay, float perDoseVolume, DailySummary& summary) {
     if (!initialized) {
-        Serial.println("[DosingLogManager] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     if (head >= NUM_DOSING_HEADS) {
-        Serial.printf("[DosingLogManager] Invalid head index: %d\n", head);
+        LOG_WARN("Invalid head index: %d", head);
         return false;
     }
 
@@ -161,18 +164,17 @@ bool DosingLogManager::getDailySummary(uint8_t head, uint32_t currentTime, float
 
         xSemaphoreGive(mutex);
 
-        Serial.printf("[DosingLogManager] Daily summary for head %d: scheduled=%.2f/%.2f mL, adhoc=%.2f mL\n",
-                     head, summary.scheduledActual, summary.dailyTarget, summary.adhocTotal);
+        LOG_INFO("Daily summary for head %d: scheduled=%.2f/%.2f mL, adhoc=%.2f mL", head, summary.scheduledActual, summary.dailyTarget, summary.adhocTotal);
         return true;
     }
 
-    Serial.println("[DosingLogManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return false;
 }
 
 uint8_t DosingLogManager::getAllDailySummaries(uint32_t currentTime, Schedule* schedules, DailySummary* summaries) {
     if (!initialized || summaries == nullptr) {
-        Serial.println("[DosingLogManager] Not initialized or null summaries array");
+        LOG_WARN("Not initialized or null summaries array");
         return 0;
     }
 
@@ -200,13 +202,13 @@ uint8_t DosingLogManager::getAllDailySummaries(uint32_t currentTime, Schedule* s
         }
     }
 
-    Serial.printf("[DosingLogManager] Generated %d daily summaries\n", count);
+    LOG_DEBUG("Generated %d daily summaries", count);
     return count;
 }
 
 uint16_t DosingLogManager::getHourlyLogs(uint32_t startTime, uint32_t endTime, HourlyDoseLog* logs, uint16_t maxLogs) {
     if (!initialized || logs == nullptr) {
-        Serial.println("[DosingLogManager] Not initialized or null logs array");
+        LOG_WARN("Not initialized or null logs array");
         return 0;
     }
 
@@ -215,30 +217,33 @@ uint16_t DosingLogManager::getHourlyLogs(uint32_t startTime, uint32_t endTime, H
         uint16_t count = store.loadLogsInRange(startTime, endTime, logs, maxLogs);
         xSemaphoreGive(mutex);
 
-        Serial.printf("[DosingLogManager] Retrieved %d hourly logs\n", count);
+        LOG_DEBUG("Retrieved %d hourly logs", count);
         return count;
     }
 
-    Serial.println("[DosingLogManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return 0;
 }
 
 uint16_t DosingLogManager::pruneOldLogs(uint32_t currentTime) {
     if (!initialized) {
-        Serial.println("[DosingLogManager] Not initialized");
+        LOG_WARN("Not initialized");
         return 0;
     }
 
     // Thread-safe: Lock before pruning
     if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
         uint16_t count = store.pruneOldLogs(currentTime);
+        if (count > 0) {
+            version.fetch_add(1);
+        }
         xSemaphoreGive(mutex);
 
-        Serial.printf("[DosingLogManager] Pruned %d old logs\n", count);
+        LOG_DEBUG("Pruned %d old logs", count);
         return count;
     }
 
-    Serial.println("[DosingLogManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return 0;
 }
 
@@ -259,17 +264,22 @@ uint16_t DosingLogManager::getLogCount() {
 
 bool DosingLogManager::clearAll() {
     if (!initialized) {
-        Serial.println("[DosingLogManager] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     // Thread-safe: Lock before clearing
     if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
         bool success = store.clearAll();
+        version.fetch_add(1);  // Even a failed clear may have removed some logs
         xSemaphoreGive(mutex);
         return success;
     }
 
-    Serial.println("[DosingLogManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return false;
 }
+
+uint32_t DosingLogManager::getVersion() const {
+    return version.load();
+}
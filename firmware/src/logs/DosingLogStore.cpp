@@ -1,12 +1,13 @@
 #include "logs/DosingLogStore.h"
+#include "storage/FlashWriter.h"
+#include "diagnostics/Log.h"
+#include <string.h>
 
-DosingLogStore::DosingLogStore() : initialized(false) {
-}
+LOG_MODULE("DosingLogStore", LOG_LEVEL_DOSING_LOG);
 
-DosingLogStore::~DosingLogStore() {
-    if (initialized) {
-        preferences.end();
-    }
+static_assert(sizeof(HourlyDoseLog) <= FLASH_VALUE_SIZE, "HourlyDoseLog must fit a flash queue entry");
+
+DosingLogStore::DosingLogStore() : initialized(false), oldestHour(0) {
 }
 
 bool DosingLogStore::begin() {
@@ -14,8 +15,12 @@ bool DosingLogStore::begin() {
         return true;
     }
 
+    if (FlashWriter::readBytes(LOG_NVS_NAMESPACE, LOG_OLDEST_KEY, &oldestHour, sizeof(oldestHour)) != sizeof(oldestHour)) {
+        oldestHour = 0;
+    }
+
     initialized = true;
-    Serial.println("[DosingLogStore] Initialized");
+    LOG_INFO("Initialized");
     return true;
 }
 
@@ -31,34 +36,33 @@ String DosingLogStore::getLogKey(uint32_t hourTimestamp, uint8_t head) {
     // Format: "h<offset>_<head>" where offset is in hours
     // Example: "h12345_0" for head 0
 
-    const uint32_t BASE_TIME = 1735689600;  // Jan 1, 2025
-    uint32_t hourOffset = (hourTimestamp - BASE_TIME) / 3600;
+    uint32_t hourOffset = (hourTimestamp - LOG_BASE_TIME) / 3600;
 
     return "h" + String(hourOffset) + "_" + String(head);
 }
 
 bool DosingLogStore::saveLog(const HourlyDoseLog& log) {
     if (!initialized) {
-        Serial.println("[DosingLogStore] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     if (!log.isValid()) {
-        Serial.println("[DosingLogStore] Invalid log entry");
+        LOG_WARN("Invalid log entry");
         return false;
     }
 
-    // Open NVS for writing
-    if (!preferences.begin(LOG_NVS_NAMESPACE, false)) {
-        Serial.println("[DosingLogStore] Failed to open NVS for writing");
+    // Keys count hours from LOG_BASE_TIME; an earlier hour would also drag the oldest hour back
+    if (log.hourTimestamp < LOG_BASE_TIME) {
+        LOG_WARN("Skipping log for hour %lu - before %lu", log.hourTimestamp, (unsigned long)LOG_BASE_TIME);
         return false;
     }
 
     String key = getLogKey(log.hourTimestamp, log.head);
 
-    // Check if log already exists for this hour+head
+    // Check if log already exists for this hour+head (including a queued write)
     HourlyDoseLog existingLog;
-    size_t read = preferences.getBytes(key.c_str(), &existingLog, sizeof(HourlyDoseLog));
+    size_t read = FlashWriter::readBytes(LOG_NVS_NAMESPACE, key.c_str(), &existingLog, sizeof(HourlyDoseLog));
 
     HourlyDoseLog updatedLog = log;
 
@@ -66,66 +70,55 @@ bool DosingLogStore::saveLog(const HourlyDoseLog& log) {
         // Log exists, add to existing volumes
         updatedLog.scheduledVolume += existingLog.scheduledVolume;
         updatedLog.adhocVolume += existingLog.adhocVolume;
-        Serial.printf("[DosingLogStore] Updating existing log for hour %lu, head %d\n",
-                     log.hourTimestamp, log.head);
+        LOG_DEBUG("Updating existing log for hour %lu, head %d", log.hourTimestamp, log.head);
     } else {
         // New log entry
-        Serial.printf("[DosingLogStore] Creating new log for hour %lu, head %d\n",
-                     log.hourTimestamp, log.head);
+        LOG_DEBUG("Creating new log for hour %lu, head %d", log.hourTimestamp, log.head);
     }
 
-    // Write log as blob
-    size_t written = preferences.putBytes(key.c_str(), &updatedLog, sizeof(HourlyDoseLog));
+    // Queue log as blob; repeated doses within the hour coalesce into one commit
+    bool written = FlashWriter::putBytes(LOG_NVS_NAMESPACE, key.c_str(), &updatedLog, sizeof(HourlyDoseLog),
+                                         FlashSubsystem::LOGS);
 
-    // Update log count if this is a new entry
-    if (read != sizeof(HourlyDoseLog)) {
-        uint16_t count = preferences.getUShort(LOG_COUNT_KEY, 0);
-        preferences.putUShort(LOG_COUNT_KEY, count + 1);
-    }
+    // Update log count and the oldest stored hour if this is a new entry
+    if (written && read != sizeof(HourlyDoseLog)) {
+        uint16_t count = FlashWriter::readUShort(LOG_NVS_NAMESPACE, LOG_COUNT_KEY, 0);
+        FlashWriter::putUShort(LOG_NVS_NAMESPACE, LOG_COUNT_KEY, count + 1, FlashSubsystem::LOGS);
 
-    preferences.end();
+        if ((oldestHour == 0 || log.hourTimestamp < oldestHour) &&
+            FlashWriter::putBytes(LOG_NVS_NAMESPACE, LOG_OLDEST_KEY, &log.hourTimestamp, sizeof(log.hourTimestamp),
+                                  FlashSubsystem::LOGS)) {
+            oldestHour = log.hourTimestamp;
+        }
+    }
 
-    if (written != sizeof(HourlyDoseLog)) {
-        Serial.printf("[DosingLogStore] Failed to write log\n");
+    if (!written) {
+        LOG_ERROR("Failed to write log");
         return false;
     }
 
-    Serial.printf("[DosingLogStore] Saved log: %s\n", updatedLog.toString().c_str());
+    LOG_DEBUG("Saved log: %s", updatedLog.toString().c_str());
     return true;
 }
 
 bool DosingLogStore::loadLog(uint32_t hourTimestamp, uint8_t head, HourlyDoseLog& log) {
     if (!initialized) {
-        Serial.println("[DosingLogStore] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     if (head >= NUM_DOSING_HEADS) {
-        Serial.printf("[DosingLogStore] Invalid head index: %d\n", head);
+        LOG_WARN("Invalid head index: %d", head);
         return false;
     }
 
     // Round timestamp to hour
     uint32_t roundedTime = roundToHour(hourTimestamp);
 
-    // Open NVS for reading
-    if (!preferences.begin(LOG_NVS_NAMESPACE, true)) {
-        Serial.println("[DosingLogStore] Failed to open NVS for reading");
-        return false;
-    }
-
     String key = getLogKey(roundedTime, head);
 
-    // Check if key exists first (avoids error logs)
-    if (!preferences.isKey(key.c_str())) {
-        preferences.end();
-        return false;
-    }
-
-    // Read log as blob
-    size_t read = preferences.getBytes(key.c_str(), &log, sizeof(HourlyDoseLog));
-
-    preferences.end();
+    // Read log as blob (absent keys read as 0 bytes without error logs)
+    size_t read = FlashWriter::readBytes(LOG_NVS_NAMESPACE, key.c_str(), &log, sizeof(HourlyDoseLog));
 
     if (read != sizeof(HourlyDoseLog)) {
         // Read failed
@@ -137,7 +130,7 @@ bool DosingLogStore::loadLog(uint32_t hourTimestamp, uint8_t head, HourlyDoseLog
 
 uint16_t DosingLogStore::loadLogsInRange(uint32_t startTime, uint32_t endTime, HourlyDoseLog* logs, uint16_t maxLogs) {
     if (!initialized || logs == nullptr) {
-        Serial.println("[DosingLogStore] Not initialized or null logs array");
+        LOG_WARN("Not initialized or null logs array");
         return 0;
     }
 
@@ -159,24 +152,18 @@ uint16_t DosingLogStore::loadLogsInRange(uint32_t startTime, uint32_t endTime, H
         }
     }
 
-    Serial.printf("[DosingLogStore] Loaded %d logs in range %lu to %lu\n", count, startTime, endTime);
+    LOG_DEBUG("Loaded %d logs in range %lu to %lu", count, startTime, endTime);
     return count;
 }
 
 uint16_t DosingLogStore::loadLogsForHead(uint8_t head, HourlyDoseLog* logs, uint16_t maxLogs) {
     if (!initialized || logs == nullptr) {
-        Serial.println("[DosingLogStore] Not initialized or null logs array");
+        LOG_WARN("Not initialized or null logs array");
         return 0;
     }
 
     if (head >= NUM_DOSING_HEADS) {
-        Serial.printf("[DosingLogStore] Invalid head index: %d\n", head);
-        return 0;
-    }
-
-    // Open NVS for reading
-    if (!preferences.begin(LOG_NVS_NAMESPACE, true)) {
-        Serial.println("[DosingLogStore] Failed to open NVS for reading");
+        LOG_WARN("Invalid head index: %d", head);
         return 0;
     }
 
@@ -186,15 +173,18 @@ uint16_t DosingLogStore::loadLogsForHead(uint8_t head, HourlyDoseLog* logs, uint
     // In production, you might want to maintain an index of log keys for efficiency
     // For now, we'll rely on the loadLogsInRange method for querying
 
-    preferences.end();
-
-    Serial.printf("[DosingLogStore] loadLogsForHead not fully implemented - use loadLogsInRange instead\n");
+    LOG_WARN("loadLogsForHead not fully implemented - use loadLogsInRange instead");
     return count;
 }
 
 uint16_t DosingLogStore::pruneOldLogs(uint32_t currentTime) {
     if (!initialized) {
-        Serial.println("[DosingLogStore] Not initialized");
+        LOG_WARN("Not initialized");
+        return 0;
+    }
+
+    // Before NTP sync the scheduler's time is uptime, and the cutoff would wrap
+    if (currentTime < LOG_BASE_TIME + LOG_RETENTION_HOURS * 3600) {
         return 0;
     }
 
@@ -202,62 +192,75 @@ uint16_t DosingLogStore::pruneOldLogs(uint32_t currentTime) {
     uint32_t cutoffTime = currentTime - (LOG_RETENTION_HOURS * 3600);
     uint32_t cutoffHour = roundToHour(cutoffTime);
 
-    // Open NVS for writing
-    if (!preferences.begin(LOG_NVS_NAMESPACE, false)) {
-        Serial.println("[DosingLogStore] Failed to open NVS for writing");
+    // Nothing is stored before the oldest logged hour, and the walk stays bounded
+    uint32_t firstHour = cutoffHour - LOG_PRUNE_LOOKBACK_HOURS * 3600;
+    if (firstHour < LOG_BASE_TIME) {
+        firstHour = LOG_BASE_TIME;
+    }
+    if (oldestHour != 0 && oldestHour > firstHour) {
+        firstHour = oldestHour;
+    } else if (oldestHour == 0 && getLogCount() == 0) {
         return 0;
     }
 
     uint16_t deletedCount = 0;
+    bool queued = true;
+    char keys[FLASH_LARGE_VALUE_SIZE];
+
+    // Each batch takes as many whole hours as fit one queue entry, is checked
+    // with one namespace open and removed as one entry
+    for (uint32_t hour = firstHour; hour < cutoffHour && queued;) {
+        size_t used = 0;
+        for (; hour < cutoffHour && used + NUM_DOSING_HEADS * FLASH_NAME_SIZE <= sizeof(keys); hour += 3600) {
+            for (uint8_t head = 0; head < NUM_DOSING_HEADS; head++) {
+                String key = getLogKey(hour, head);
+                memcpy(keys + used, key.c_str(), key.length() + 1);
+                used += key.length() + 1;
+            }
+        }
 
-    // Iterate through potential old logs
-    // We'll check the last 30 days worth of hourly slots to find old entries
-    for (uint32_t hour = cutoffHour - (30 * 24 * 3600); hour < cutoffHour; hour += 3600) {
-        for (uint8_t head = 0; head < NUM_DOSING_HEADS; head++) {
-            String key = getLogKey(hour, head);
-            if (preferences.remove(key.c_str())) {
-                deletedCount++;
+        uint16_t found = FlashWriter::countKeys(LOG_NVS_NAMESPACE, keys, used);
+        if (found > 0) {
+            queued = FlashWriter::removeKeys(LOG_NVS_NAMESPACE, keys, used, FlashSubsystem::LOGS);
+            if (queued) {
+                deletedCount += found;
             }
         }
     }
 
+    // Everything before the cutoff is gone (a failed batch is retried next time)
+    if (queued && firstHour < cutoffHour &&
+        FlashWriter::putBytes(LOG_NVS_NAMESPACE, LOG_OLDEST_KEY, &cutoffHour, sizeof(cutoffHour), FlashSubsystem::LOGS)) {
+        oldestHour = cutoffHour;
+    }
+
     // Update log count
     if (deletedCount > 0) {
-        uint16_t count = preferences.getUShort(LOG_COUNT_KEY, 0);
-        if (count >= deletedCount) {
-            preferences.putUShort(LOG_COUNT_KEY, count - deletedCount);
-        } else {
-            preferences.putUShort(LOG_COUNT_KEY, 0);
-        }
+        uint16_t count = FlashWriter::readUShort(LOG_NVS_NAMESPACE, LOG_COUNT_KEY, 0);
+        FlashWriter::putUShort(LOG_NVS_NAMESPACE, LOG_COUNT_KEY, (count >= deletedCount) ? count - deletedCount : 0,
+                               FlashSubsystem::LOGS);
     }
 
-    preferences.end();
-
-    Serial.printf("[DosingLogStore] Pruned %d old logs (cutoff: %lu)\n", deletedCount, cutoffTime);
+    if (deletedCount > 0) {
+        LOG_INFO("Pruned %d old logs (cutoff: %lu)", deletedCount, cutoffTime);
+    }
     return deletedCount;
 }
 
 bool DosingLogStore::clearAll() {
     if (!initialized) {
-        Serial.println("[DosingLogStore] Not initialized");
-        return false;
-    }
-
-    // Open NVS for writing
-    if (!preferences.begin(LOG_NVS_NAMESPACE, false)) {
-        Serial.println("[DosingLogStore] Failed to open NVS for writing");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     // Clear entire namespace
-    bool success = preferences.clear();
-
-    preferences.end();
+    bool success = FlashWriter::clear(LOG_NVS_NAMESPACE, FlashSubsystem::LOGS);
 
     if (success) {
-        Serial.println("[DosingLogStore] Cleared all logs");
+        oldestHour = 0;
+        LOG_INFO("Cleared all logs");
     } else {
-        Serial.println("[DosingLogStore] Failed to clear logs");
+        LOG_ERROR("Failed to clear logs");
     }
 
     return success;
@@ -268,16 +271,7 @@ uint16_t DosingLogStore::getLogCount() {
         return 0;
     }
 
-    // Open NVS for reading
-    if (!preferences.begin(LOG_NVS_NAMESPACE, true)) {
-        return 0;
-    }
-
-    uint16_t count = preferences.getUShort(LOG_COUNT_KEY, 0);
-
-    preferences.end();
-
-    return count;
+    return FlashWriter::readUShort(LOG_NVS_NAMESPACE, LOG_COUNT_KEY, 0);
 }
 
 uint16_t DosingLogStore::incrementLogIndex() {
@@ -285,16 +279,9 @@ uint16_t DosingLogStore::incrementLogIndex() {
         return 0;
     }
 
-    // Open NVS for writing
-    if (!preferences.begin(LOG_NVS_NAMESPACE, false)) {
-        return 0;
-    }
-
-    uint16_t index = preferences.getUShort(LOG_INDEX_KEY, 0);
+    uint16_t index = FlashWriter::readUShort(LOG_NVS_NAMESPACE, LOG_INDEX_KEY, 0);
     index = (index + 1) % MAX_LOG_ENTRIES;  // Circular buffer
-    preferences.putUShort(LOG_INDEX_KEY, index);
-
-    preferences.end();
+    FlashWriter::putUShort(LOG_NVS_NAMESPACE, LOG_INDEX_KEY, index, FlashSubsystem::LOGS);
 
     return index;
 }
@@ -5,9 +5,17 @@
 #include "hal/DosingHead.h"
 #include "scheduling/ScheduleManager.h"
 #include "scheduling/SchedulerTask.h"
+#include "scheduling/DoseWorkerPool.h"
+#include "scheduling/ConfigTransaction.h"
 #include "logs/DosingLogManager.h"
+#include "diagnostics/Metrics.h"
+#include "diagnostics/Log.h"
+#include "storage/FlashWriter.h"
+#include "hal/PowerManager.h"
 #include <time.h>
 
+LOG_MODULE("Main", LOG_LEVEL_MAIN);
+
 // NTP Configuration for New York (EST/EDT)
 #define NTP_SERVER1 "pool.ntp.org"
 #define NTP_SERVER2 "time.nist.gov"
@@ -35,124 +43,168 @@ DosingLogManager dosingLogManager;
 // Scheduler task instance
 SchedulerTask schedulerTask;
 
+// Dose worker pool (one statically allocated worker per head)
+DoseWorkerPool doseWorkerPool;
+
 // WebServer instance
 WebServer webServer(80);
 
 void setup() {
   Serial.begin(9600);
+  Metrics::registerTask(xTaskGetCurrentTaskHandle());  // Arduino loopTask
+  if (Log::begin()) {
+    Metrics::registerTask(xTaskGetHandle("Log"));
+  }
+  if (!FlashWriter::begin()) {
+    LOG_ERROR("ERROR: Flash writer failed to start - settings will not be saved!");
+  }
+  if (!PowerManager::begin()) {
+    LOG_ERROR("ERROR: Power manager failed to start!");
+  }
   delay(1000);
 
-  Serial.println("[Main] Starting SquareDose Smart Doser...");
+  LOG_INFO("Starting SquareDose Smart Doser...");
 
   // Initialize Motor Driver
-  Serial.println("[Main] Initializing Motor Driver...");
+  LOG_INFO("Initializing Motor Driver...");
   if (motorDriver.begin()) {
-    Serial.println("[Main] Motor Driver initialized successfully");
+    LOG_INFO("Motor Driver initialized successfully");
+
+#ifdef SQUAREDOSE_DIAGNOSTICS
+    StopLatencyResult stopBench;
+    if (motorDriver.benchmarkStopLatency(100, stopBench)) {
+      LOG_INFO("Stop latency (all motors): digitalWrite %lu ns, register %lu ns", stopBench.digitalWriteNs, stopBench.registerNs);
+    }
+#endif
   } else {
-    Serial.println("[Main] ERROR: Motor Driver initialization failed!");
+    LOG_ERROR("ERROR: Motor Driver initialization failed!");
   }
 
   // Initialize all Dosing Heads
-  Serial.println("[Main] Initializing Dosing Heads...");
+  LOG_INFO("Initializing Dosing Heads...");
   for (uint8_t i = 0; i < 4; i++) {
     if (dosingHeads[i]->begin()) {
       CalibrationData cal = dosingHeads[i]->getCalibrationData();
-      Serial.printf("[Main] Dosing Head %d initialized - Calibrated: %s, Rate: %.3f mL/s\n",
-                   i, cal.isCalibrated ? "YES" : "NO", cal.mlPerSecond);
+      LOG_INFO("Dosing Head %d initialized - Calibrated: %s, Rate: %.3f mL/s, Offset: %.3f mL", i, cal.isCalibrated ? "YES" : "NO", cal.mlPerSecond, cal.offsetMl);
     } else {
-      Serial.printf("[Main] ERROR: Dosing Head %d initialization failed!\n", i);
+      LOG_ERROR("ERROR: Dosing Head %d initialization failed!", i);
     }
   }
 
-  Serial.println("[Main] Initializing WiFi Manager...");
+  LOG_INFO("Initializing WiFi Manager...");
 
   // Initialize mutex before using WiFiManager
   wifiManager.initMutex();
   wifiManager.begin();
 
-  Serial.println("[Main] WiFi mode: " + String(wifiManager.getCurrentMode() == WIFIMANAGER_MODE_AP ? "AP" : "STA"));
-  Serial.println("[Main] IP Address: " + wifiManager.getLocalIP());
+  LOG_INFO("WiFi mode: %s", wifiManager.getCurrentMode() == WIFIMANAGER_MODE_AP ? "AP" : "STA");
+  LOG_INFO("IP Address: %s", wifiManager.getLocalIP().c_str());
 
   if (wifiManager.getCurrentMode() == WIFIMANAGER_MODE_AP) {
-    Serial.println("[Main] AP SSID: " + wifiManager.getAPSSID());
-    Serial.println("[Main] AP Password: " + String(AP_PASSWORD));
-    Serial.println("[Main] Connect to AP and configure WiFi via /api/wifi/configure");
+    LOG_INFO("AP SSID: %s", wifiManager.getAPSSID().c_str());
+    LOG_INFO("AP Password: %s", AP_PASSWORD);
+    LOG_INFO("Connect to AP and configure WiFi via /api/wifi/configure");
   }
 
+  TaskHandle_t wifiTaskHandle = NULL;
   xTaskCreatePinnedToCore(
     WiFiManager::keepAliveTask,    // Function that should be called
     "WiFiKeepAliveTask",           // Name of the task (for debugging)
     WIFI_TASK_STACK_SIZE,          // Stack size (bytes)
     NULL,                          // Parameter to pass
     WIFI_TASK_PRIORITY,            // Task priority
-    NULL,                          // Task handle
+    &wifiTaskHandle,               // Task handle
     WIFI_TASK_CORE                 // Core to run the task on (0 or 1)
   );
+  Metrics::registerTask(wifiTaskHandle);
 
   // Configure NTP for New York timezone
-  Serial.println("[Main] Configuring NTP...");
+  LOG_INFO("Configuring NTP...");
   configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER1, NTP_SERVER2);
-  Serial.println("[Main] NTP configured (will sync when connected to WiFi)");
+  LOG_INFO("NTP configured (will sync when connected to WiFi)");
 
   // Initialize Dosing Log Manager
-  Serial.println("[Main] Initializing Dosing Log Manager...");
+  LOG_INFO("Initializing Dosing Log Manager...");
   dosingLogManager.initMutex();
   if (dosingLogManager.begin()) {
-    Serial.println("[Main] Dosing Log Manager initialized successfully");
+    LOG_INFO("Dosing Log Manager initialized successfully");
   } else {
-    Serial.println("[Main] ERROR: Dosing Log Manager initialization failed!");
+    LOG_ERROR("ERROR: Dosing Log Manager initialization failed!");
   }
 
   // Initialize Schedule Manager
-  Serial.println("[Main] Initializing Schedule Manager...");
+  LOG_INFO("Initializing Schedule Manager...");
   scheduleManager.initMutex();
   if (scheduleManager.begin()) {
-    Serial.println("[Main] Schedule Manager initialized successfully");
+    LOG_INFO("Schedule Manager initialized successfully");
   } else {
-    Serial.println("[Main] ERROR: Schedule Manager initialization failed!");
+    LOG_ERROR("ERROR: Schedule Manager initialization failed!");
+  }
+
+  // Finish any batch commit that was interrupted by a reset
+  if (!ConfigTransaction::recover(&scheduleManager, dosingHeads, 4)) {
+    LOG_ERROR("ERROR: Failed to recover interrupted configuration commit!");
   }
 
   // Connect log manager to schedule manager only
   // Note: DosingHead does NOT get log manager - WebServer handles ad-hoc dose logging
-  Serial.println("[Main] Connecting Dosing Log Manager...");
+  LOG_INFO("Connecting Dosing Log Manager...");
   scheduleManager.setLogManager(&dosingLogManager);
-  Serial.println("[Main] Dosing Log Manager connected to ScheduleManager");
+  LOG_INFO("Dosing Log Manager connected to ScheduleManager");
+
+  // Initialize Dose Worker Pool
+  LOG_INFO("Initializing Dose Worker Pool...");
+  if (doseWorkerPool.begin(dosingHeads, 4) && doseWorkerPool.start()) {
+    scheduleManager.setWorkerPool(&doseWorkerPool);
+    LOG_INFO("Dose Worker Pool started successfully");
+  } else {
+    LOG_ERROR("ERROR: Dose Worker Pool failed to start!");
+  }
 
   // Initialize Scheduler Task
-  Serial.println("[Main] Initializing Scheduler Task...");
+  LOG_INFO("Initializing Scheduler Task...");
   if (schedulerTask.begin(&scheduleManager, dosingHeads, 4)) {
+    schedulerTask.setLogManager(&dosingLogManager);
     if (schedulerTask.start()) {
-      Serial.println("[Main] Scheduler Task started successfully");
+      LOG_INFO("Scheduler Task started successfully");
     } else {
-      Serial.println("[Main] ERROR: Scheduler Task failed to start!");
+      LOG_ERROR("ERROR: Scheduler Task failed to start!");
     }
   } else {
-    Serial.println("[Main] ERROR: Scheduler Task initialization failed!");
+    LOG_ERROR("ERROR: Scheduler Task initialization failed!");
   }
 
   // Initialize Web Server
-  Serial.println("[Main] Initializing Web Server...");
-  if (webServer.begin(dosingHeads, 4, &motorDriver, &wifiManager, &scheduleManager, &dosingLogManager)) {
-    Serial.println("[Main] Web Server started successfully");
-    Serial.println("[Main] REST API available at:");
-    Serial.println("[Main]   http://" + wifiManager.getLocalIP() + "/api/status");
-    Serial.println("[Main]   WebSocket: ws://" + wifiManager.getLocalIP() + "/ws");
+  LOG_INFO("Initializing Web Server...");
+  if (webServer.begin(dosingHeads, 4, &motorDriver, &wifiManager, &scheduleManager, &dosingLogManager, &doseWorkerPool)) {
+    LOG_INFO("Web Server started successfully");
+    LOG_INFO("REST API available at:");
+    LOG_INFO("  http://%s/api/status", wifiManager.getLocalIP().c_str());
+    LOG_INFO("  WebSocket: ws://%s/ws", wifiManager.getLocalIP().c_str());
   } else {
-    Serial.println("[Main] ERROR: Web Server initialization failed!");
+    LOG_ERROR("ERROR: Web Server initialization failed!");
   }
 
-  Serial.println("[Main] Setup complete");
+  LOG_INFO("Setup complete");
+
+  // The endpoint list is printed directly; let queued messages go out first
+  Log::flush(1000);
   Serial.println();
   Serial.println("========================================");
   Serial.println("  REST API Endpoints:");
   Serial.println("  GET  /api/status");
   Serial.println("  GET  /api/calibration");
+  Serial.println("  GET  /api/heads/{head}/calibration");
   Serial.println("  GET  /api/wifi/status");
   Serial.println("  POST /api/dose");
+  Serial.println("  POST /api/dose/cancel");
+  Serial.println("  POST /api/batch");
   Serial.println("  POST /api/calibrate");
   Serial.println("  POST /api/emergency-stop");
   Serial.println("  POST /api/wifi/configure");
   Serial.println("  POST /api/wifi/reset");
+  Serial.println("  GET  /api/power");
+  Serial.println("  POST /api/power");
   Serial.println("  GET  /api/schedules");
   Serial.println("  GET  /api/schedules/{head}");
   Serial.println("  POST /api/schedules");
@@ -162,6 +214,7 @@ void setup() {
   Serial.println("  DELETE /api/logs");
   Serial.println("  GET  /api/time");
   Serial.println("  POST /api/time");
+  Serial.println("  GET  /metrics");
   Serial.println("========================================");
 }
 
@@ -0,0 +1,254 @@
+#include "network/ApiRouter.h"
+#include "diagnostics/Log.h"
+#include "hal/PowerManager.h"
+#include <esp_timer.h>
+
+LOG_MODULE("ApiRouter", LOG_LEVEL_API_ROUTER);
+
+ApiRouter::ApiRouter() : routeCount(0) {
+}
+
+bool ApiRouter::on(WebRequestMethodComposite method, const char* pattern, RouteRequestHandler onRequest) {
+    if (routeCount >= ROUTER_MAX_ROUTES || !compile(pattern, routes[routeCount])) {
+        LOG_ERROR("Failed to register %s", pattern);
+        return false;
+    }
+
+    addRoute(method, pattern, onRequest, nullptr);
+    return true;
+}
+
+bool ApiRouter::on(WebRequestMethodComposite method, const char* pattern, RouteBodyHandler onBody) {
+    if (routeCount >= ROUTER_MAX_ROUTES || !compile(pattern, routes[routeCount])) {
+        LOG_ERROR("Failed to register %s", pattern);
+        return false;
+    }
+
+    addRoute(method, pattern, nullptr, onBody);
+    return true;
+}
+
+void ApiRouter::addRoute(WebRequestMethodComposite method, const char* pattern, RouteRequestHandler onRequest,
+                         RouteBodyHandler onBody) {
+    Route& route = routes[routeCount];
+    route.method = method;
+    route.pattern = pattern;
+    route.onRequest = onRequest;
+    route.onBody = onBody;
+    route.requestCount.store(0);
+    route.handlerTimeUs.store(0);
+    routeCount++;
+}
+
+uint8_t ApiRouter::getRouteCount() const {
+    return routeCount;
+}
+
+bool ApiRouter::canHandle(AsyncWebServerRequest* request) {
+    RouteParams params;
+    if (match(request, params) == nullptr) {
+        return false;
+    }
+
+    // The server only keeps the headers a handler asks for (read for ETag validation)
+    request->addInterestingHeader("If-None-Match");
+    return true;
+}
+
+void ApiRouter::handleRequest(AsyncWebServerRequest* request) {
+    RouteParams params;
+    Route* route = match(request, params);
+    if (route == nullptr) {
+        return;
+    }
+
+    PowerLockScope powerLock(PowerLock::REQUEST);
+    int64_t startUs = esp_timer_get_time();
+
+    if (route->onRequest) {
+        route->onRequest(request, params);
+    } else if (request->contentLength() == 0) {
+        // handleBody() is never called without a body; let the handler reject it
+        route->onBody(request, params, nullptr, 0, 0, 0);
+    }
+
+    uint32_t durationUs = static_cast<uint32_t>(esp_timer_get_time() - startUs);
+    route->requestCount.fetch_add(1, std::memory_order_relaxed);
+    route->handlerTimeUs.fetch_add(durationUs, std::memory_order_relaxed);
+    PowerManager::recordHandlerTime(durationUs, true);
+}
+
+void ApiRouter::handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    RouteParams params;
+    Route* route = match(request, params);
+    if (route != nullptr && route->onBody) {
+        // Body routes do their work here; the request is counted in handleRequest()
+        PowerLockScope powerLock(PowerLock::REQUEST);
+        int64_t startUs = esp_timer_get_time();
+        route->onBody(request, params, data, len, index, total);
+
+        uint32_t durationUs = static_cast<uint32_t>(esp_timer_get_time() - startUs);
+        route->handlerTimeUs.fetch_add(durationUs, std::memory_order_relaxed);
+        PowerManager::recordHandlerTime(durationUs, false);
+    }
+}
+
+void ApiRouter::writeMetrics(Print& out) const {
+    out.print("# HELP squaredose_http_request_duration_seconds Time spent in the route handler\n"
+              "# TYPE squaredose_http_request_duration_seconds summary\n");
+
+    for (uint8_t i = 0; i < routeCount; i++) {
+        const Route& route = routes[i];
+        const char* method = methodName(route.method);
+        out.printf("squaredose_http_request_duration_seconds_sum{method=\"%s\",route=\"%s\"} %.6f\n",
+                   method, route.pattern, route.handlerTimeUs.load(std::memory_order_relaxed) / 1000000.0);
+        out.printf("squaredose_http_request_duration_seconds_count{method=\"%s\",route=\"%s\"} %lu\n",
+                   method, route.pattern, (unsigned long)route.requestCount.load(std::memory_order_relaxed));
+    }
+}
+
+const char* ApiRouter::methodName(WebRequestMethodComposite method) {
+    static const struct {
+        WebRequestMethod method;
+        const char* name;
+    } METHODS[] = {
+        {HTTP_GET, "GET"}, {HTTP_POST, "POST"}, {HTTP_DELETE, "DELETE"}, {HTTP_PUT, "PUT"}, {HTTP_PATCH, "PATCH"}
+    };
+
+    for (const auto& entry : METHODS) {
+        if ((method & entry.method) != 0) {
+            return entry.name;
+        }
+    }
+    return "OTHER";
+}
+
+bool ApiRouter::isRequestHandlerTrivial() {
+    // Some routes take a body, so the server must deliver it
+    return false;
+}
+
+bool ApiRouter::compile(const char* pattern, Route& route) {
+    if (pattern == nullptr || pattern[0] != '/') {
+        return false;
+    }
+
+    route.segmentCount = 0;
+    uint8_t paramCount = 0;
+    const char* cursor = pattern + 1;
+
+    while (*cursor != '\0') {
+        const char* end = strchr(cursor, '/');
+        size_t length = (end != nullptr) ? static_cast<size_t>(end - cursor) : strlen(cursor);
+
+        if (length == 0 || length > 255 || route.segmentCount >= ROUTER_MAX_SEGMENTS) {
+            return false;
+        }
+
+        Segment& segment = route.segments[route.segmentCount++];
+        segment.text = cursor;
+        segment.length = length;
+        segment.type = RouteParamType::LITERAL;
+
+        if (cursor[0] == '{') {
+            // {name:type} - only the type matters for matching
+            const char* colon = static_cast<const char*>(memchr(cursor, ':', length));
+            if (cursor[length - 1] != '}' || colon == nullptr || paramCount >= ROUTER_MAX_PARAMS) {
+                return false;
+            }
+
+            size_t typeLength = (cursor + length - 1) - (colon + 1);
+            if (typeLength == 2 && strncmp(colon + 1, "u8", 2) == 0) {
+                segment.type = RouteParamType::U8;
+            } else if (typeLength == 3 && strncmp(colon + 1, "u16", 3) == 0) {
+                segment.type = RouteParamType::U16;
+            } else if (typeLength == 3 && strncmp(colon + 1, "u32", 3) == 0) {
+                segment.type = RouteParamType::U32;
+            } else {
+                return false;
+            }
+            paramCount++;
+        }
+
+        cursor += length;
+        if (*cursor == '/') {
+            cursor++;
+        }
+    }
+
+    // No trailing '/': paths must match exactly, and a bare "/" would have no segments to check
+    return cursor[-1] != '/';
+}
+
+ApiRouter::Route* ApiRouter::match(AsyncWebServerRequest* request, RouteParams& params) {
+    WebRequestMethodComposite method = request->method();
+    const char* path = request->url().c_str();
+
+    for (uint8_t i = 0; i < routeCount; i++) {
+        if ((routes[i].method & method) != 0 && matchPath(routes[i], path, params)) {
+            return &routes[i];
+        }
+    }
+
+    return nullptr;
+}
+
+bool ApiRouter::matchPath(const Route& route, const char* path, RouteParams& params) {
+    if (path[0] != '/') {
+        return false;
+    }
+
+    params.count = 0;
+    const char* cursor = path + 1;
+
+    for (uint8_t i = 0; i < route.segmentCount; i++) {
+        const Segment& segment = route.segments[i];
+
+        const char* end = cursor;
+        while (*end != '\0' && *end != '/') {
+            end++;
+        }
+        size_t length = end - cursor;
+
+        if (segment.type == RouteParamType::LITERAL) {
+            if (length != segment.length || strncmp(cursor, segment.text, length) != 0) {
+                return false;
+            }
+        } else if (!parseParam(cursor, length, segment.type, params.values[params.count++])) {
+            return false;
+        }
+
+        // More pattern segments need a '/', the last one needs the end of the path
+        bool last = (i + 1 == route.segmentCount);
+        if (last ? (*end != '\0') : (*end != '/')) {
+            return false;
+        }
+        cursor = end + 1;
+    }
+
+    return true;
+}
+
+bool ApiRouter::parseParam(const char* text, size_t length, RouteParamType type, uint32_t& value) {
+    // At most 10 digits for a uint32_t; no sign, no leading '+', no empty segment
+    if (length == 0 || length > 10) {
+        return false;
+    }
+
+    uint64_t parsed = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        parsed = parsed * 10 + (text[i] - '0');
+    }
+
+    uint32_t limit = (type == RouteParamType::U8) ? UINT8_MAX :
+                     (type == RouteParamType::U16) ? UINT16_MAX : UINT32_MAX;
+    if (parsed > limit) {
+        return false;
+    }
+
+    value = static_cast<uint32_t>(parsed);
+    return true;
+}
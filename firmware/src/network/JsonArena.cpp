@@ -0,0 +1,92 @@
+#include "network/JsonArena.h"
+
+JsonArena::JsonArena(uint8_t* buffer, size_t capacity)
+    : buffer(buffer), capacity(capacity), offset(0), lastBlock(nullptr), highWater(0), failures(0) {
+}
+
+void* JsonArena::allocate(size_t size) {
+    size_t needed = HEADER_SIZE + alignSize(size);
+
+    if (buffer == nullptr || needed > capacity - offset) {
+        failures++;
+        return nullptr;
+    }
+
+    uint8_t* header = buffer + offset;
+    *reinterpret_cast<size_t*>(header) = size;
+
+    offset += needed;
+    if (offset > highWater) {
+        highWater = offset;
+    }
+
+    lastBlock = header + HEADER_SIZE;
+    return lastBlock;
+}
+
+void JsonArena::deallocate(void* pointer) {
+    // Only the most recent block can be returned; the rest is freed by reset()
+    if (pointer != nullptr && pointer == lastBlock) {
+        offset = static_cast<size_t>(lastBlock - buffer) - HEADER_SIZE;
+        lastBlock = nullptr;
+    }
+}
+
+void* JsonArena::reallocate(void* pointer, size_t newSize) {
+    if (pointer == nullptr) {
+        return allocate(newSize);
+    }
+
+    uint8_t* payload = static_cast<uint8_t*>(pointer);
+    size_t oldSize = blockSize(payload);
+
+    if (payload == lastBlock) {
+        // Grow or shrink in place
+        size_t start = static_cast<size_t>(payload - buffer);
+        size_t needed = alignSize(newSize);
+
+        if (needed > capacity - start) {
+            failures++;
+            return nullptr;
+        }
+
+        *reinterpret_cast<size_t*>(payload - HEADER_SIZE) = newSize;
+        offset = start + needed;
+        if (offset > highWater) {
+            highWater = offset;
+        }
+        return payload;
+    }
+
+    if (newSize <= oldSize) {
+        // Shrinking an older block: keep it, the tail is reclaimed by reset()
+        return payload;
+    }
+
+    void* moved = allocate(newSize);
+    if (moved != nullptr) {
+        memcpy(moved, payload, oldSize);
+    }
+    return moved;
+}
+
+void JsonArena::reset() {
+    offset = 0;
+    lastBlock = nullptr;
+}
+
+size_t JsonArena::getHighWater() const {
+    return highWater;
+}
+
+uint32_t JsonArena::getFailures() const {
+    return failures;
+}
+
+size_t JsonArena::alignSize(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+size_t JsonArena::blockSize(const uint8_t* payload) {
+    return *reinterpret_cast<const size_t*>(payload - HEADER_SIZE);
+}
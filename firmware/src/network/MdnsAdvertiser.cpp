@@ -0,0 +1,82 @@
+#include "network/MdnsAdvertiser.h"
+#include "diagnostics/Log.h"
+#include <ESPmDNS.h>
+
+LOG_MODULE("mDNS", LOG_LEVEL_MDNS);
+
+MdnsAdvertiser::MdnsAdvertiser()
+    : statusHash(nullptr), context(nullptr), running(false), publishedHash(0), lastUpdateMs(0), txtUpdates(0) {
+}
+
+bool MdnsAdvertiser::begin(const String& deviceId, uint16_t port, uint8_t numHeads, StatusHashFunction hashFunction,
+                           void* hashContext) {
+    if (running) {
+        return true;
+    }
+
+    if (hashFunction == nullptr) {
+        LOG_WARN("Invalid parameters");
+        return false;
+    }
+
+    String hostname = String(MDNS_HOSTNAME_PREFIX) + deviceId;
+    hostname.toLowerCase();
+
+    if (!MDNS.begin(hostname.c_str())) {
+        LOG_ERROR("Failed to start responder");
+        return false;
+    }
+    MDNS.setInstanceName(String(MDNS_INSTANCE_PREFIX) + deviceId);
+
+    if (!MDNS.addService(MDNS_SERVICE, MDNS_PROTOCOL, port)) {
+        LOG_ERROR("Failed to register service");
+        return false;
+    }
+
+    statusHash = hashFunction;
+    context = hashContext;
+
+    // Static records first; clients read them from the same response as st
+    MDNS.addServiceTxt(MDNS_SERVICE, MDNS_PROTOCOL, "id", deviceId);
+    MDNS.addServiceTxt(MDNS_SERVICE, MDNS_PROTOCOL, "fw", FIRMWARE_VERSION);
+    MDNS.addServiceTxt(MDNS_SERVICE, MDNS_PROTOCOL, "heads", String(numHeads));
+    publishHash(statusHash(context));
+
+    running = true;
+    LOG_INFO("Advertising _%s._%s as %s.local", MDNS_SERVICE, MDNS_PROTOCOL, hostname.c_str());
+    return true;
+}
+
+void MdnsAdvertiser::maintain() {
+    if (!running) {
+        return;
+    }
+
+    uint32_t hash = statusHash(context);
+    if (hash == publishedHash || millis() - lastUpdateMs < MDNS_TXT_MIN_INTERVAL_MS) {
+        return;
+    }
+
+    publishHash(hash);
+}
+
+uint32_t MdnsAdvertiser::getTxtUpdates() const {
+    return txtUpdates.load();
+}
+
+bool MdnsAdvertiser::publishHash(uint32_t hash) {
+    char value[9];
+    snprintf(value, sizeof(value), "%08lx", (unsigned long)hash);
+
+    // Recorded even on failure so a broken responder is not retried every window
+    publishedHash = hash;
+    lastUpdateMs = millis();
+
+    if (!MDNS.addServiceTxt(MDNS_SERVICE, MDNS_PROTOCOL, "st", value)) {
+        LOG_WARN("Failed to update status TXT record");
+        return false;
+    }
+
+    txtUpdates.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,112 @@
+#include "network/RequestBodyPool.h"
+
+RequestBodyPool::RequestBodyPool() : exhaustedCount(0) {
+    for (uint8_t i = 0; i < WEB_BODY_BUFFER_COUNT; i++) {
+        buffers[i].received = 0;
+        buffers[i].inUse = false;
+    }
+}
+
+JsonBodyResult RequestBodyPool::parseJsonBody(void*& slot, const uint8_t* data, size_t len, size_t index,
+                                              size_t total, JsonDocument& doc, DeserializationError& error) {
+    if (total > WEB_MAX_REQUEST_BODY_SIZE) {
+        // total is known from the first chunk: answer once, then ignore the rest
+        return (index == 0) ? JsonBodyResult::TOO_LARGE : JsonBodyResult::IGNORED;
+    }
+
+    const uint8_t* body = data;
+    size_t length = len;
+
+    // Common case: the body fits in one segment, parse it in place
+    if (index != 0 || len != total) {
+        uint8_t* assembled = nullptr;
+        BodyChunkResult result = append(slot, data, len, index, total, assembled, length);
+
+        if (result == BodyChunkResult::INCOMPLETE) {
+            return JsonBodyResult::INCOMPLETE;
+        }
+
+        if (result == BodyChunkResult::NO_BUFFER) {
+            return (index == 0) ? JsonBodyResult::NO_BUFFER : JsonBodyResult::IGNORED;
+        }
+
+        if (result == BodyChunkResult::OUT_OF_ORDER) {
+            return JsonBodyResult::OUT_OF_ORDER;
+        }
+
+        body = assembled;
+    }
+
+    error = deserializeJson(doc, body, length);
+
+    // The document holds its own copies of the strings, so the buffer can go back now
+    release(slot);
+
+    return error ? JsonBodyResult::INVALID_JSON : JsonBodyResult::PARSED;
+}
+
+BodyChunkResult RequestBodyPool::append(void*& slot, const uint8_t* data, size_t len,
+                                        size_t index, size_t total, uint8_t*& body, size_t& length) {
+    BodyBuffer* buffer = static_cast<BodyBuffer*>(slot);
+
+    if (index == 0) {
+        // A new body on a slot that still holds one restarts it
+        release(slot);
+
+        buffer = acquire();
+        if (buffer == nullptr) {
+            exhaustedCount++;
+            return BodyChunkResult::NO_BUFFER;
+        }
+
+        slot = buffer;
+    }
+
+    if (buffer == nullptr) {
+        // Continuation of a body that was refused on its first chunk
+        return BodyChunkResult::NO_BUFFER;
+    }
+
+    if (index != buffer->received || index + len > total) {
+        // Gap or overlap in the stream
+        release(slot);
+        return BodyChunkResult::OUT_OF_ORDER;
+    }
+
+    memcpy(buffer->data + index, data, len);
+    buffer->received += len;
+
+    if (buffer->received < total) {
+        return BodyChunkResult::INCOMPLETE;
+    }
+
+    body = buffer->data;
+    length = buffer->received;
+    return BodyChunkResult::COMPLETE;
+}
+
+void RequestBodyPool::release(void*& slot) {
+    BodyBuffer* buffer = static_cast<BodyBuffer*>(slot);
+    if (buffer == nullptr) {
+        return;
+    }
+
+    buffer->received = 0;
+    buffer->inUse = false;
+    slot = nullptr;
+}
+
+uint32_t RequestBodyPool::getExhaustedCount() const {
+    return exhaustedCount;
+}
+
+RequestBodyPool::BodyBuffer* RequestBodyPool::acquire() {
+    for (uint8_t i = 0; i < WEB_BODY_BUFFER_COUNT; i++) {
+        if (!buffers[i].inUse) {
+            buffers[i].inUse = true;
+            buffers[i].received = 0;
+            return &buffers[i];
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,100 @@
+#include "network/ResponseCache.h"
+#include "diagnostics/Log.h"
+
+LOG_MODULE("ResponseCache", LOG_LEVEL_RESPONSE_CACHE);
+
+ResponseCache::ResponseCache()
+    : mutex(nullptr), cachedVersion(0), valid(false), cachedLength(0), hits(0), misses(0) {
+}
+
+ResponseCache::~ResponseCache() {
+    if (mutex != nullptr) {
+        vSemaphoreDelete(mutex);
+    }
+}
+
+bool ResponseCache::begin() {
+    if (mutex != nullptr) {
+        return true;
+    }
+
+    mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+    if (mutex == nullptr) {
+        LOG_ERROR("CRITICAL: Failed to create mutex!");
+        return false;
+    }
+
+    return true;
+}
+
+bool ResponseCache::write(uint32_t version, ResponseBuildFunction build, void* context, Print& out,
+                          size_t skip, Allocator* allocator) {
+    if (build == nullptr) {
+        return false;
+    }
+
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+
+    if (valid && cachedVersion == version) {
+        hits.fetch_add(1);
+    } else {
+        misses.fetch_add(1);
+
+        bool built;
+        if (allocator != nullptr) {
+            JsonDocument doc(allocator);
+            built = rebuild(doc, version, build, context);
+        } else {
+            JsonDocument doc;
+            built = rebuild(doc, version, build, context);
+        }
+
+        if (!built) {
+            xSemaphoreGive(mutex);
+            return false;
+        }
+    }
+
+    if (skip < cachedBody.length()) {
+        out.write(reinterpret_cast<const uint8_t*>(cachedBody.c_str()) + skip, cachedBody.length() - skip);
+    }
+
+    xSemaphoreGive(mutex);
+    return true;
+}
+
+bool ResponseCache::rebuild(JsonDocument& doc, uint32_t version, ResponseBuildFunction build, void* context) {
+    build(doc, context);
+
+    if (doc.overflowed()) {
+        // Leave the entry invalid so the next request retries
+        LOG_WARN("Response document overflowed");
+        valid = false;
+        return false;
+    }
+
+    // Size once up front so the body never grows in steps
+    size_t length = measureJson(doc);
+    cachedBody = "";
+    cachedBody.reserve(length);
+    serializeJson(doc, cachedBody);
+
+    cachedVersion = version;
+    cachedLength.store(cachedBody.length());
+    valid = true;
+    return true;
+}
+
+size_t ResponseCache::getLength() const {
+    return cachedLength.load();
+}
+
+uint32_t ResponseCache::getHits() const {
+    return hits.load();
+}
+
+uint32_t ResponseCache::getMisses() const {
+    return misses.load();
+}
@@ -0,0 +1,331 @@
+#include "network/StorageWorker.h"
+#include "diagnostics/Metrics.h"
+#include "diagnostics/Log.h"
+#include "hal/PowerManager.h"
+
+LOG_MODULE("StorageWorker", LOG_LEVEL_STORAGE_WORKER);
+
+static const char OUT_OF_MEMORY_BODY[] = "{\"error\":\"Out of memory\"}";
+
+/**
+ * @brief HTTP response whose body comes from the storage worker
+ *
+ * Sent by the handler like any other response, but it writes nothing until
+ * its slot is ready. AsyncTCP calls _ack() on every poll of the connection,
+ * and the first call that finds the result starts the real response, so the
+ * request is only ever touched on the AsyncTCP task. Deleting the response
+ * (sent, or the client went away) gives the slot back.
+ */
+class StorageResponse : public AsyncAbstractResponse {
+public:
+    StorageResponse(StorageWorker* worker, uint8_t slot)
+        : worker(worker), slot(slot), waiting(true), offset(0) {
+        _code = 200;
+        _contentType = "application/json";
+    }
+
+    ~StorageResponse() {
+        worker->release(slot, !waiting);
+    }
+
+    bool _sourceValid() const override {
+        return true;
+    }
+
+    void _respond(AsyncWebServerRequest* request) override {
+        _ack(request, 0, 0);
+    }
+
+    size_t _ack(AsyncWebServerRequest* request, size_t len, uint32_t time) override {
+        if (!waiting) {
+            return AsyncAbstractResponse::_ack(request, len, time);
+        }
+
+        const StorageWorker::ResponseSlot& result = worker->slots[slot];
+        if (result.state.load(std::memory_order_acquire) != StorageWorker::SLOT_READY) {
+            return 0;  // Polled again until the worker is done
+        }
+
+        waiting = false;
+        _code = result.code;
+        _contentLength = result.length;
+
+        // Only successful responses are validated against an ETag
+        if (result.etag[0] != '\0') {
+            addHeader("ETag", result.etag);
+            addHeader("Cache-Control", WEB_CACHE_CONTROL_VERSIONED);
+        } else {
+            addHeader("Cache-Control", WEB_CACHE_CONTROL_DYNAMIC);
+        }
+
+        // Sends the head and the first part of the body, then continues on acks
+        AsyncAbstractResponse::_respond(request);
+        return 0;
+    }
+
+    size_t _fillBuffer(uint8_t* data, size_t len) override {
+        const StorageWorker::ResponseSlot& result = worker->slots[slot];
+        const char* body = (result.body != nullptr) ? result.body : OUT_OF_MEMORY_BODY;
+
+        size_t count = result.length - offset;
+        if (count > len) {
+            count = len;
+        }
+        memcpy(data, body + offset, count);
+        offset += count;
+        return count;
+    }
+
+private:
+    StorageWorker* worker;
+    uint8_t slot;
+    bool waiting;   // Result not picked up yet
+    size_t offset;  // Body bytes handed to the connection
+};
+
+/**
+ * @brief Copy a fixed body to the heap
+ * @return Body, or nullptr if out of memory
+ */
+static char* copyBody(const char* text, size_t& length) {
+    length = strlen(text);
+    char* body = static_cast<char*>(malloc(length + 1));
+    if (body != nullptr) {
+        memcpy(body, text, length + 1);
+    }
+    return body;
+}
+
+StorageWorker::StorageWorker()
+    : run(nullptr), context(nullptr), running(false), queue(nullptr), completedCount(0), rejectedCount(0),
+      abandonedCount(0), taskHandle(nullptr), answered(false) {
+    for (uint8_t i = 0; i < WEB_STORAGE_RESPONSE_SLOTS; i++) {
+        slots[i].state.store(SLOT_FREE);
+        slots[i].body = nullptr;
+        slots[i].length = 0;
+        slots[i].etag[0] = '\0';
+    }
+}
+
+bool StorageWorker::begin(StorageJobFunction runFunction, void* runContext) {
+    if (runFunction == nullptr) {
+        return false;
+    }
+
+    run = runFunction;
+    context = runContext;
+
+    if (queue == nullptr) {
+        queue = xQueueCreateStatic(WEB_STORAGE_QUEUE_DEPTH, sizeof(StorageJob), queueStorage, &queueBuffer);
+        if (queue == nullptr) {
+            LOG_ERROR("Failed to create queue");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool StorageWorker::start() {
+    if (running) {
+        return true;
+    }
+
+    if (queue == nullptr) {
+        LOG_WARN("Not initialized - call begin() first");
+        return false;
+    }
+
+    taskHandle = xTaskCreateStatic(
+        taskFunction,             // Task function
+        "Storage",                // Task name
+        WEB_STORAGE_STACK_SIZE,   // Stack size (bytes)
+        this,                     // Parameters
+        WEB_STORAGE_PRIORITY,     // Priority
+        taskStack,                // Static stack
+        &taskBuffer               // Static TCB
+    );
+
+    if (taskHandle == nullptr) {
+        LOG_ERROR("Failed to create task");
+        return false;
+    }
+    Metrics::registerTask(taskHandle);
+
+    running = true;
+    return true;
+}
+
+bool StorageWorker::submit(StorageJob& job, AsyncWebServerRequest* request) {
+    if (!running || request == nullptr) {
+        return false;
+    }
+
+    // Claim a response slot; it stays claimed until the response is deleted
+    uint8_t slot = STORAGE_NO_SLOT;
+    for (uint8_t i = 0; i < WEB_STORAGE_RESPONSE_SLOTS; i++) {
+        uint8_t expected = SLOT_FREE;
+        if (slots[i].state.compare_exchange_strong(expected, SLOT_QUEUED, std::memory_order_acq_rel)) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot == STORAGE_NO_SLOT) {
+        rejectedCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    job.slot = slot;
+
+    if (xQueueSend(queue, &job, 0) != pdTRUE) {
+        slots[slot].state.store(SLOT_FREE, std::memory_order_release);
+        rejectedCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Answered now; the response waits for the worker's result
+    request->send(new StorageResponse(this, slot));
+    return true;
+}
+
+bool StorageWorker::submit(StorageJob& job) {
+    if (!running) {
+        return false;
+    }
+
+    job.slot = STORAGE_NO_SLOT;
+
+    if (xQueueSend(queue, &job, 0) != pdTRUE) {
+        rejectedCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+void StorageWorker::complete(const StorageJob& job, int code, const JsonDocument& doc, const char* etag) {
+    if (job.slot >= WEB_STORAGE_RESPONSE_SLOTS) {
+        return;
+    }
+    answered = true;
+
+    // Client gone while the job was queued or running: nothing to build
+    if (slots[job.slot].state.load(std::memory_order_acquire) == SLOT_ABANDONED) {
+        abandonedCount.fetch_add(1, std::memory_order_relaxed);
+        freeSlot(job.slot);
+        return;
+    }
+
+    char* body;
+    size_t length;
+
+    if (doc.overflowed()) {
+        LOG_WARN("Response exceeded its JSON document");
+        code = 500;
+        etag = nullptr;
+        body = copyBody("{\"error\":\"Response too large\"}", length);
+    } else {
+        length = measureJson(doc);
+        body = static_cast<char*>(malloc(length + 1));
+        if (body != nullptr) {
+            serializeJson(doc, body, length + 1);
+        }
+    }
+
+    publish(job.slot, code, body, length, etag);
+}
+
+void StorageWorker::publish(uint8_t slot, int code, char* body, size_t length, const char* etag) {
+    ResponseSlot& result = slots[slot];
+
+    if (body == nullptr) {
+        LOG_ERROR("Out of memory for a %u byte response", (unsigned)length);
+        code = 500;
+        length = sizeof(OUT_OF_MEMORY_BODY) - 1;
+        etag = nullptr;
+    }
+
+    // The response only reads these once it sees SLOT_READY
+    result.code = code;
+    result.body = body;
+    result.length = length;
+    if (etag != nullptr && code == 200) {
+        strncpy(result.etag, etag, sizeof(result.etag) - 1);
+        result.etag[sizeof(result.etag) - 1] = '\0';
+    } else {
+        result.etag[0] = '\0';
+    }
+
+    uint8_t expected = SLOT_QUEUED;
+    if (!result.state.compare_exchange_strong(expected, SLOT_READY, std::memory_order_acq_rel)) {
+        // The response was deleted while the body was built
+        abandonedCount.fetch_add(1, std::memory_order_relaxed);
+        freeSlot(slot);
+    }
+}
+
+void StorageWorker::release(uint8_t slot, bool sent) {
+    // Still being built: the worker frees it when it gets there
+    uint8_t expected = SLOT_QUEUED;
+    if (slots[slot].state.compare_exchange_strong(expected, SLOT_ABANDONED, std::memory_order_acq_rel)) {
+        return;
+    }
+
+    // Ready: the result belongs to the response
+    if (!sent) {
+        abandonedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    freeSlot(slot);
+}
+
+void StorageWorker::freeSlot(uint8_t slot) {
+    free(slots[slot].body);
+    slots[slot].body = nullptr;
+    slots[slot].state.store(SLOT_FREE, std::memory_order_release);
+}
+
+uint32_t StorageWorker::getCompletedCount() const {
+    return completedCount.load(std::memory_order_relaxed);
+}
+
+uint32_t StorageWorker::getRejectedCount() const {
+    return rejectedCount.load(std::memory_order_relaxed);
+}
+
+uint32_t StorageWorker::getAbandonedCount() const {
+    return abandonedCount.load(std::memory_order_relaxed);
+}
+
+uint8_t StorageWorker::getQueueDepth() const {
+    return (queue != nullptr) ? static_cast<uint8_t>(uxQueueMessagesWaiting(queue)) : 0;
+}
+
+void StorageWorker::taskFunction(void* parameters) {
+    StorageWorker* worker = static_cast<StorageWorker*>(parameters);
+    StorageJob job;
+
+    LOG_INFO("Task loop started");
+
+    for (;;) {
+        if (xQueueReceive(worker->queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        worker->answered = false;
+        {
+            PowerLockScope powerLock(PowerLock::REQUEST);
+            worker->run(job, worker->context);
+        }
+
+        // A job that finished without answering must not keep its slot
+        if (job.slot < WEB_STORAGE_RESPONSE_SLOTS && !worker->answered) {
+            LOG_ERROR("Job %d finished without a response", static_cast<int>(job.operation));
+            size_t length;
+            char* body = copyBody("{\"error\":\"Request not answered\"}", length);
+            worker->publish(job.slot, 500, body, length, nullptr);
+        }
+
+        worker->completedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,421 @@
+#include "network/TelemetryPublisher.h"
+#include "logs/DosingLogManager.h"
+#include "diagnostics/Metrics.h"
+#include "diagnostics/Log.h"
+
+LOG_MODULE("Telemetry", LOG_LEVEL_TELEMETRY);
+
+TelemetryPublisher::TelemetryPublisher()
+    : ws(nullptr), sessions(nullptr), dosingHeads(nullptr), numHeads(0), motorDriver(nullptr),
+      wifiManager(nullptr), scheduleManager(nullptr), logManager(nullptr), doseWorkerPool(nullptr),
+      advertiser(nullptr), initialized(false), running(false), motorVersion(0), poolVersion(0), scheduleVersion(0),
+      wifiVersion(0), logVersion(0), messagesSent(0), arena(arenaBuffer, sizeof(arenaBuffer)),
+      taskHandle(nullptr) {
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        published[i] = {};
+    }
+}
+
+bool TelemetryPublisher::begin(AsyncWebSocket* socket, WebSocketSessions* wsSessions, DosingHead** heads,
+                               uint8_t num, MotorDriver* motor, WiFiManager* wifiMgr, ScheduleManager* schedMgr,
+                               DosingLogManager* logMgr, DoseWorkerPool* dosePool) {
+    if (initialized) {
+        return true;
+    }
+
+    if (socket == nullptr || wsSessions == nullptr || heads == nullptr || num == 0 || num > NUM_MOTORS ||
+        motor == nullptr || wifiMgr == nullptr) {
+        LOG_WARN("Invalid parameters");
+        return false;
+    }
+
+    ws = socket;
+    sessions = wsSessions;
+    dosingHeads = heads;
+    numHeads = num;
+    motorDriver = motor;
+    wifiManager = wifiMgr;
+    scheduleManager = schedMgr;
+    logManager = logMgr;
+    doseWorkerPool = dosePool;
+
+    initialized = true;
+    return true;
+}
+
+void TelemetryPublisher::setAdvertiser(MdnsAdvertiser* mdns) {
+    advertiser = mdns;
+}
+
+bool TelemetryPublisher::start() {
+    if (running) {
+        return true;
+    }
+
+    if (!initialized) {
+        LOG_WARN("Not initialized - call begin() first");
+        return false;
+    }
+
+    taskHandle = xTaskCreateStatic(
+        taskFunction,             // Task function
+        "Telemetry",              // Task name
+        WS_TELEMETRY_STACK_SIZE,  // Stack size (bytes)
+        this,                     // Parameters
+        WS_TELEMETRY_PRIORITY,    // Priority
+        taskStack,                // Static stack
+        &taskBuffer               // Static TCB
+    );
+
+    if (taskHandle == nullptr) {
+        LOG_ERROR("Failed to create task");
+        return false;
+    }
+    Metrics::registerTask(taskHandle);
+
+    running = true;
+    return true;
+}
+
+uint32_t TelemetryPublisher::getMessagesSent() const {
+    return messagesSent.load();
+}
+
+void TelemetryPublisher::taskFunction(void* parameters) {
+    TelemetryPublisher* publisher = static_cast<TelemetryPublisher*>(parameters);
+    if (publisher != nullptr) {
+        publisher->run();
+    }
+    vTaskDelete(NULL);
+}
+
+void TelemetryPublisher::run() {
+    LOG_INFO("Publisher started");
+
+    TickType_t lastWake = xTaskGetTickCount();
+
+    for (;;) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(WS_TELEMETRY_WINDOW_MS));
+
+        sessions->maintain();
+        if (advertiser != nullptr) {
+            advertiser->maintain();
+        }
+
+        // Diff first so snapshots sent afterwards match the baseline later diffs build on
+        publishChanges();
+
+        uint32_t clientId;
+        uint8_t topics;
+        while (sessions->takeResync(clientId, topics)) {
+            sendSnapshot(clientId, topics);
+        }
+    }
+}
+
+void TelemetryPublisher::publishChanges() {
+    uint32_t now = millis();
+
+    // One message per topic per window; the baseline is updated even with no subscribers
+    for (uint8_t topic = WS_TOPIC_DOSES; topic <= WS_TOPIC_LOGS; topic <<= 1) {
+        JsonArenaScope arenaScope(arena);
+        JsonDocument doc(&arena);
+
+        doc["type"] = "state";
+        doc["topic"] = WebSocketSessions::topicName(topic);
+
+        if (appendTopic(doc, topic, false, now) && sessions->hasSubscribers(topic)) {
+            send(doc, topic, 0);
+        }
+    }
+}
+
+void TelemetryPublisher::sendSnapshot(uint32_t clientId, uint8_t topics) {
+    JsonArenaScope arenaScope(arena);
+    JsonDocument doc(&arena);
+    uint32_t now = millis();
+
+    doc["type"] = "snapshot";
+    JsonArray topicNames = doc["topics"].to<JsonArray>();
+
+    for (uint8_t topic = WS_TOPIC_DOSES; topic <= WS_TOPIC_LOGS; topic <<= 1) {
+        if ((topics & topic) != 0) {
+            topicNames.add(WebSocketSessions::topicName(topic));
+            appendTopic(doc, topic, true, now);
+        }
+    }
+
+    send(doc, 0, clientId);
+}
+
+bool TelemetryPublisher::appendTopic(JsonDocument& doc, uint8_t topic, bool full, uint32_t now) {
+    switch (topic) {
+        case WS_TOPIC_DOSES:
+            return appendProgress(doc, full, now);
+        case WS_TOPIC_MOTORS:
+            return appendHeads(doc, full);
+        case WS_TOPIC_CONFIG: {
+            bool changed = appendSchedules(doc, full);
+            changed |= appendCalibration(doc, full);
+            return changed;
+        }
+        case WS_TOPIC_WIFI:
+            return appendWifi(doc, full);
+        case WS_TOPIC_LOGS:
+            return appendLogs(doc, full);
+        default:
+            return false;
+    }
+}
+
+bool TelemetryPublisher::appendHeads(JsonDocument& doc, bool full) {
+    uint32_t currentMotorVersion = motorDriver->getStateVersion();
+    uint32_t currentPoolVersion = (doseWorkerPool != nullptr) ? doseWorkerPool->getVersion() : 0;
+
+    if (!full && currentMotorVersion == motorVersion && currentPoolVersion == poolVersion) {
+        return false;
+    }
+
+    JsonArray headsArray;
+    bool added = false;
+
+    for (uint8_t i = 0; i < numHeads; i++) {
+        bool isRunning = motorDriver->isMotorRunning(i);
+        uint8_t queued = (doseWorkerPool != nullptr) ? doseWorkerPool->getQueueDepth(i) : 0;
+
+        if (!full && isRunning == published[i].running && queued == published[i].queuedDoses) {
+            continue;
+        }
+
+        if (!added) {
+            headsArray = doc["heads"].to<JsonArray>();
+            added = true;
+        }
+
+        JsonObject head = headsArray.add<JsonObject>();
+        head["head"] = i;
+        head["running"] = isRunning;
+        head["queuedDoses"] = queued;
+
+        if (!full) {
+            published[i].running = isRunning;
+            published[i].queuedDoses = queued;
+        }
+    }
+
+    if (!full) {
+        motorVersion = currentMotorVersion;
+        poolVersion = currentPoolVersion;
+    }
+
+    return added;
+}
+
+bool TelemetryPublisher::appendProgress(JsonDocument& doc, bool full, uint32_t now) {
+    JsonArray progressArray;
+    bool added = false;
+
+    for (uint8_t i = 0; i < numHeads; i++) {
+        DoseProgress progress = dosingHeads[i]->getDoseProgress();
+        if (!progress.active) {
+            continue;
+        }
+
+        // Rate cap per head; snapshots always carry the current progress
+        if (!full) {
+            if (now - published[i].lastProgressMs < WS_PROGRESS_INTERVAL_MS) {
+                continue;
+            }
+            published[i].lastProgressMs = now;
+        }
+
+        if (!added) {
+            progressArray = doc["progress"].to<JsonArray>();
+            added = true;
+        }
+
+        JsonObject entry = progressArray.add<JsonObject>();
+        entry["head"] = i;
+        entry["elapsedMs"] = progress.elapsedMs;
+        entry["targetMs"] = progress.targetMs;
+        entry["estimatedVolume"] = progress.estimatedVolume;
+    }
+
+    return added;
+}
+
+bool TelemetryPublisher::appendSchedules(JsonDocument& doc, bool full) {
+    if (scheduleManager == nullptr) {
+        return false;
+    }
+
+    uint32_t currentVersion = scheduleManager->getVersion();
+    if (!full && currentVersion == scheduleVersion) {
+        return false;
+    }
+
+    JsonArray schedulesArray;
+    bool added = false;
+
+    for (uint8_t i = 0; i < NUM_SCHEDULE_HEADS; i++) {
+        Schedule sched;
+        bool hasSchedule = scheduleManager->getSchedule(i, sched);
+
+        if (!full) {
+            bool unchanged = (hasSchedule == published[i].hasSchedule) &&
+                             (!hasSchedule || sameSchedule(sched, published[i].schedule));
+            if (unchanged) {
+                continue;
+            }
+
+            published[i].hasSchedule = hasSchedule;
+            if (hasSchedule) {
+                published[i].schedule = sched;
+            }
+        } else if (!hasSchedule) {
+            // Snapshots list existing schedules only
+            continue;
+        }
+
+        if (!added) {
+            schedulesArray = doc["schedules"].to<JsonArray>();
+            added = true;
+        }
+
+        JsonObject schedObj = schedulesArray.add<JsonObject>();
+        schedObj["head"] = i;
+
+        if (!hasSchedule) {
+            schedObj["deleted"] = true;
+            continue;
+        }
+
+        schedObj["name"] = sched.name;
+        schedObj["enabled"] = sched.enabled;
+        schedObj["dailyTargetVolume"] = sched.dailyTargetVolume;
+        schedObj["dosesPerDay"] = sched.dosesPerDay;
+        schedObj["volume"] = sched.volume;
+        schedObj["intervalSeconds"] = sched.intervalSeconds;
+        schedObj["lastExecutionTime"] = sched.lastExecutionTime;
+        schedObj["executionCount"] = sched.executionCount;
+    }
+
+    if (!full) {
+        scheduleVersion = currentVersion;
+    }
+
+    // A snapshot always carries the array, even when empty
+    if (full && !added) {
+        doc["schedules"].to<JsonArray>();
+    }
+
+    return added;
+}
+
+bool TelemetryPublisher::appendCalibration(JsonDocument& doc, bool full) {
+    JsonArray calibrationArray;
+    bool added = false;
+
+    for (uint8_t i = 0; i < numHeads; i++) {
+        uint32_t currentVersion = dosingHeads[i]->getCalibrationVersion();
+        if (!full && currentVersion == published[i].calibrationVersion) {
+            continue;
+        }
+
+        if (!added) {
+            calibrationArray = doc["calibration"].to<JsonArray>();
+            added = true;
+        }
+
+        CalibrationData cal = dosingHeads[i]->getCalibrationData();
+        JsonObject head = calibrationArray.add<JsonObject>();
+        head["head"] = i;
+        head["isCalibrated"] = cal.isCalibrated;
+        head["mlPerSecond"] = cal.mlPerSecond;
+        head["offsetMl"] = cal.offsetMl;
+        head["pointCount"] = cal.pointCount;
+
+        if (!full) {
+            published[i].calibrationVersion = currentVersion;
+        }
+    }
+
+    return added;
+}
+
+bool TelemetryPublisher::appendWifi(JsonDocument& doc, bool full) {
+    uint32_t currentVersion = wifiManager->getStateVersion();
+    if (!full && currentVersion == wifiVersion) {
+        return false;
+    }
+
+    WiFiStatus status;
+    wifiManager->getStatus(status);
+
+    JsonObject wifi = doc["wifi"].to<JsonObject>();
+    wifi["mode"] = (status.mode == WIFIMANAGER_MODE_AP) ? "AP" : "STA";
+    wifi["connected"] = status.connected;
+    wifi["ipAddress"] = status.ipAddress;
+    wifi["apActive"] = status.apActive;
+
+    if (!full) {
+        wifiVersion = currentVersion;
+    }
+
+    return true;
+}
+
+bool TelemetryPublisher::appendLogs(JsonDocument& doc, bool full) {
+    if (logManager == nullptr) {
+        return false;
+    }
+
+    uint32_t currentVersion = logManager->getVersion();
+    if (!full && currentVersion == logVersion) {
+        return false;
+    }
+
+    // Logs are too large to push; clients refetch when the version changes
+    doc["logs"]["version"] = currentVersion;
+
+    if (!full) {
+        logVersion = currentVersion;
+    }
+
+    return true;
+}
+
+bool TelemetryPublisher::send(const JsonDocument& doc, uint8_t topic, uint32_t clientId) {
+    if (doc.overflowed()) {
+        LOG_WARN("Message exceeds WS_TELEMETRY_ARENA_SIZE - dropped");
+        return false;
+    }
+
+    size_t length = measureJson(doc);
+    AsyncWebSocketMessageBuffer* buffer = ws->makeBuffer(length);
+    if (buffer == nullptr) {
+        LOG_ERROR("Failed to allocate WebSocket buffer");
+        return false;
+    }
+
+    serializeJson(doc, reinterpret_cast<char*>(buffer->get()), length + 1);
+
+    if (topic != 0) {
+        sessions->publish(topic, buffer, WsSendPolicy::COALESCE);
+    } else {
+        ws->text(clientId, buffer);
+    }
+
+    messagesSent.fetch_add(1);
+    return true;
+}
+
+bool TelemetryPublisher::sameSchedule(const Schedule& a, const Schedule& b) {
+    return a.enabled == b.enabled &&
+           a.dailyTargetVolume == b.dailyTargetVolume &&
+           a.dosesPerDay == b.dosesPerDay &&
+           a.lastExecutionTime == b.lastExecutionTime &&
+           a.executionCount == b.executionCount &&
+           a.updatedAt == b.updatedAt &&
+           strncmp(a.name, b.name, sizeof(a.name)) == 0;
+}
@@ -1,21 +1,28 @@
 #include "network/WebServer.h"
 #include "logs/DosingLogManager.h"
+#include "diagnostics/Metrics.h"
+#include "diagnostics/Log.h"
+#include "hal/PowerManager.h"
 #include <time.h>
 #include <sys/time.h>
 
+LOG_MODULE("WebServer", LOG_LEVEL_WEB_SERVER);
+
 // Static instance pointer for WebSocket callback
 static WebServer* serverInstance = nullptr;
 
 WebServer::WebServer(uint16_t port)
     : server(nullptr), ws(nullptr), dosingHeads(nullptr), numHeads(0),
       motorDriver(nullptr), wifiManager(nullptr), scheduleManager(nullptr),
-      logManager(nullptr), running(false) {
+      logManager(nullptr), doseWorkerPool(nullptr), running(false), bootId(0),
+      requestArena(requestArenaBuffer, sizeof(requestArenaBuffer)),
+      storageArena(storageArenaBuffer, sizeof(storageArenaBuffer)), batchPending(false), port(port) {
     server = new AsyncWebServer(port);
     ws = new AsyncWebSocket("/ws");
     serverInstance = this;
 }
 
-bool WebServer::begin(DosingHead** heads, uint8_t num, MotorDriver* motor, WiFiManager* wifiMgr, ScheduleManager* schedMgr, DosingLogManager* logMgr) {
+bool WebServer::begin(DosingHead** heads, uint8_t num, MotorDriver* motor, WiFiManager* wifiMgr, ScheduleManager* schedMgr, DosingLogManager* logMgr, DoseWorkerPool* dosePool) {
     if (running) {
         return true;
     }
@@ -30,11 +37,38 @@ bool WebServer::begin(DosingHead** heads, uint8_t num, MotorDriver* motor, WiFiM
     wifiManager = wifiMgr;
     scheduleManager = schedMgr;
     logManager = logMgr;
+    doseWorkerPool = dosePool;
+    bootId = esp_random();
+
+    if (!statusCache.begin() || !calibrationCache.begin() || !schedulesCache.begin()) {
+        return false;
+    }
 
     // Setup WebSocket
     ws->onEvent(onWebSocketEventStatic);
     server->addHandler(ws);
 
+    if (!wsSessions.begin(ws) ||
+        !telemetry.begin(ws, &wsSessions, heads, num, motor, wifiMgr, schedMgr, logMgr, dosePool)) {
+        return false;
+    }
+
+    // Discovery is optional: clients can still find the device by IP
+    String deviceId = wifiMgr->getAPSSID().substring(strlen(AP_SSID_PREFIX));
+    if (mdns.begin(deviceId, port, num, computeStatusHash, this)) {
+        telemetry.setAdvertiser(&mdns);
+    } else {
+        LOG_WARN("mDNS advertisement unavailable");
+    }
+
+    if (!telemetry.start()) {
+        return false;
+    }
+
+    if (!storageWorker.begin(onStorageJob, this) || !storageWorker.start()) {
+        return false;
+    }
+
     // Setup REST API routes
     setupRoutes();
 
@@ -42,6 +76,9 @@ bool WebServer::begin(DosingHead** heads, uint8_t num, MotorDriver* motor, WiFiM
     server->begin();
     running = true;
 
+    // AsyncTCP creates its task on the first begin()
+    Metrics::registerTask(xTaskGetHandle("async_tcp"));
+
     return true;
 }
 
@@ -52,10 +89,59 @@ void WebServer::stop() {
     }
 }
 
-void WebServer::broadcastWebSocket(const String& message) {
-    if (ws) {
-        ws->textAll(message);
+void WebServer::broadcastWebSocket(const JsonDocument& doc, uint8_t topics, WsSendPolicy policy) {
+    if (!ws) {
+        return;
+    }
+
+    // One buffer shared by every client's send queue
+    size_t length = measureJson(doc);
+    AsyncWebSocketMessageBuffer* buffer = ws->makeBuffer(length);
+    if (buffer == nullptr) {
+        LOG_ERROR("Failed to allocate WebSocket buffer");
+        return;
     }
+
+    serializeJson(doc, reinterpret_cast<char*>(buffer->get()), length + 1);
+    wsSessions.publish(topics, buffer, policy);
+}
+
+void WebServer::sendWebSocket(uint32_t clientId, const JsonDocument& doc) {
+    // Sent by client ID, which is a no-op if the client has gone (replies may
+    // come from the storage worker after the client disconnected)
+    if (doc.overflowed()) {
+        LOG_WARN("WebSocket reply exceeded %d byte arena", WEB_JSON_ARENA_SIZE);
+
+        // The id is set before the result, so it survives the overflow and is still echoed
+        static const char prefix[] = "{\"type\":\"response\",\"id\":";
+        static const char suffix[] = ",\"status\":500,\"result\":{\"error\":\"Response too large\"}}";
+        JsonVariantConst id = doc["id"];
+        size_t idLength = measureJson(id);
+
+        AsyncWebSocketMessageBuffer* buffer = ws->makeBuffer(sizeof(prefix) - 1 + idLength + sizeof(suffix) - 1);
+        if (buffer == nullptr) {
+            LOG_ERROR("Failed to allocate WebSocket buffer");
+            return;
+        }
+
+        char* out = reinterpret_cast<char*>(buffer->get());
+        memcpy(out, prefix, sizeof(prefix) - 1);
+        out += sizeof(prefix) - 1;
+        serializeJson(id, out, idLength + 1);
+        memcpy(out + idLength, suffix, sizeof(suffix));
+        ws->text(clientId, buffer);
+        return;
+    }
+
+    size_t length = measureJson(doc);
+    AsyncWebSocketMessageBuffer* buffer = ws->makeBuffer(length);
+    if (buffer == nullptr) {
+        LOG_ERROR("Failed to allocate WebSocket buffer");
+        return;
+    }
+
+    serializeJson(doc, reinterpret_cast<char*>(buffer->get()), length + 1);
+    ws->text(clientId, buffer);
 }
 
 bool WebServer::isRunning() const {
@@ -63,254 +149,357 @@ bool WebServer::isRunning() const {
 }
 
 void WebServer::setupRoutes() {
+    // All REST routes go through one routing table: exact matches with typed
+    // path parameters, so route order does not matter and /api/schedules does
+    // not swallow /api/schedules/{head}
+    auto body = [this](void (WebServer::*handler)(AsyncWebServerRequest*, uint8_t*, size_t, size_t, size_t)) {
+        return RouteBodyHandler([this, handler](AsyncWebServerRequest* request, const RouteParams& params,
+                                                uint8_t* data, size_t len, size_t index, size_t total) {
+            (this->*handler)(request, data, len, index, total);
+        });
+    };
+
+    auto plain = [this](void (WebServer::*handler)(AsyncWebServerRequest*)) {
+        return RouteRequestHandler([this, handler](AsyncWebServerRequest* request, const RouteParams& params) {
+            (this->*handler)(request);
+        });
+    };
+
     // System status
-    server->on("/api/status", HTTP_GET, [this](AsyncWebServerRequest* request) {
-        this->handleGetStatus(request);
-    });
+    router.on(HTTP_GET, "/api/status", plain(&WebServer::handleGetStatus));
 
     // Dosing endpoints
-    server->on("/api/dose", HTTP_POST, [](AsyncWebServerRequest* request) {},
-              nullptr,
-              [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-                  this->handlePostDose(request, data, len, index, total);
-              });
+    router.on(HTTP_POST, "/api/dose", body(&WebServer::handlePostDose));
+    router.on(HTTP_POST, "/api/dose/cancel", body(&WebServer::handlePostDoseCancel));
+
+    // Batch endpoint (schedule/calibration changes committed together, then doses)
+    router.on(HTTP_POST, "/api/batch", body(&WebServer::handlePostBatch));
 
     // Calibration endpoints
-    server->on("/api/calibrate", HTTP_POST, [](AsyncWebServerRequest* request) {},
-              nullptr,
-              [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-                  this->handlePostCalibrate(request, data, len, index, total);
-              });
+    router.on(HTTP_POST, "/api/calibrate", body(&WebServer::handlePostCalibrate));
+    router.on(HTTP_GET, "/api/calibration", plain(&WebServer::handleGetCalibration));
 
-    server->on("/api/calibration", HTTP_GET, [this](AsyncWebServerRequest* request) {
-        this->handleGetCalibration(request);
-    });
+    router.on(HTTP_GET, "/api/heads/{head:u8}/calibration",
+              [this](AsyncWebServerRequest* request, const RouteParams& params) {
+                  this->handleGetHeadCalibration(request, params.values[0]);
+              });
 
     // Emergency stop
-    server->on("/api/emergency-stop", HTTP_POST, [this](AsyncWebServerRequest* request) {
-        this->handlePostEmergencyStop(request);
-    });
+    router.on(HTTP_POST, "/api/emergency-stop", plain(&WebServer::handlePostEmergencyStop));
 
     // WiFi management
-    server->on("/api/wifi/status", HTTP_GET, [this](AsyncWebServerRequest* request) {
-        this->handleGetWifiStatus(request);
-    });
-
-    server->on("/api/wifi/configure", HTTP_POST, [](AsyncWebServerRequest* request) {},
-              nullptr,
-              [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-                  this->handlePostWifiConfigure(request, data, len, index, total);
-              });
-
-    server->on("/api/wifi/reset", HTTP_POST, [this](AsyncWebServerRequest* request) {
-        this->handlePostWifiReset(request);
-    });
+    router.on(HTTP_GET, "/api/wifi/status", plain(&WebServer::handleGetWifiStatus));
+    router.on(HTTP_POST, "/api/wifi/configure", body(&WebServer::handlePostWifiConfigure));
+    router.on(HTTP_POST, "/api/wifi/reset", plain(&WebServer::handlePostWifiReset));
 
     // Schedule management endpoints
-    server->on("/api/schedules", HTTP_GET, [this](AsyncWebServerRequest* request) {
-        this->handleGetAllSchedules(request);
-    });
+    router.on(HTTP_GET, "/api/schedules", plain(&WebServer::handleGetAllSchedules));
+    router.on(HTTP_POST, "/api/schedules", body(&WebServer::handlePostSchedule));
 
-    server->on("/api/schedules", HTTP_POST, [](AsyncWebServerRequest* request) {},
-              nullptr,
-              [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-                  this->handlePostSchedule(request, data, len, index, total);
+    router.on(HTTP_GET, "/api/schedules/{head:u8}",
+              [this](AsyncWebServerRequest* request, const RouteParams& params) {
+                  this->handleGetSchedule(request, params.values[0]);
               });
 
-    // Schedule by head index using AsyncWebHandler (GET /api/schedules/0, DELETE /api/schedules/0)
-    server->on("/api/schedules/0", HTTP_GET, [this](AsyncWebServerRequest* request) { this->handleGetSchedule(request); });
-    server->on("/api/schedules/1", HTTP_GET, [this](AsyncWebServerRequest* request) { this->handleGetSchedule(request); });
-    server->on("/api/schedules/2", HTTP_GET, [this](AsyncWebServerRequest* request) { this->handleGetSchedule(request); });
-    server->on("/api/schedules/3", HTTP_GET, [this](AsyncWebServerRequest* request) { this->handleGetSchedule(request); });
-
-    server->on("/api/schedules/0", HTTP_DELETE, [this](AsyncWebServerRequest* request) { this->handleDeleteSchedule(request); });
-    server->on("/api/schedules/1", HTTP_DELETE, [this](AsyncWebServerRequest* request) { this->handleDeleteSchedule(request); });
-    server->on("/api/schedules/2", HTTP_DELETE, [this](AsyncWebServerRequest* request) { this->handleDeleteSchedule(request); });
-    server->on("/api/schedules/3", HTTP_DELETE, [this](AsyncWebServerRequest* request) { this->handleDeleteSchedule(request); });
+    router.on(HTTP_DELETE, "/api/schedules/{head:u8}",
+              [this](AsyncWebServerRequest* request, const RouteParams& params) {
+                  this->handleDeleteSchedule(request, params.values[0]);
+              });
 
     // Dosing log endpoints
-    server->on("/api/logs/dashboard", HTTP_GET, [this](AsyncWebServerRequest* request) {
-        this->handleGetDashboard(request);
-    });
+    router.on(HTTP_GET, "/api/logs/dashboard", plain(&WebServer::handleGetDashboard));
+    router.on(HTTP_GET, "/api/logs/hourly", plain(&WebServer::handleGetHourlyLogs));
+    router.on(HTTP_DELETE, "/api/logs", plain(&WebServer::handleDeleteLogs));
 
-    server->on("/api/logs/hourly", HTTP_GET, [this](AsyncWebServerRequest* request) {
-        this->handleGetHourlyLogs(request);
-    });
+    // Time sync endpoints
+    router.on(HTTP_GET, "/api/time", plain(&WebServer::handleGetTime));
+    router.on(HTTP_POST, "/api/time", body(&WebServer::handlePostTime));
 
-    server->on("/api/logs", HTTP_DELETE, [this](AsyncWebServerRequest* request) {
-        this->handleDeleteLogs(request);
-    });
+    // Power profile endpoints
+    router.on(HTTP_GET, "/api/power", plain(&WebServer::handleGetPower));
+    router.on(HTTP_POST, "/api/power", body(&WebServer::handlePostPower));
 
-    // Time sync endpoints
-    server->on("/api/time", HTTP_GET, [this](AsyncWebServerRequest* request) {
-        this->handleGetTime(request);
-    });
+    // Prometheus scrape endpoint
+    router.on(HTTP_GET, "/metrics", plain(&WebServer::handleGetMetrics));
 
-    server->on("/api/time", HTTP_POST, [](AsyncWebServerRequest* request) {},
-              nullptr,
-              [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-                  this->handlePostTime(request, data, len, index, total);
-              });
+    server->addHandler(&router);
 
-    // 404 handler
+    // 404 handler (also catches a path parameter that does not parse, e.g. /api/schedules/x)
     server->onNotFound([](AsyncWebServerRequest* request) {
         request->send(404, "application/json", "{\"error\":\"Endpoint not found\"}");
     });
 }
 
 void WebServer::handleGetStatus(AsyncWebServerRequest* request) {
-    JsonDocument doc;
+    JsonArenaScope arenaScope(requestArena);
+
+    uint32_t version = getStatusVersion();
+    AsyncResponseStream* response = request->beginResponseStream("application/json", statusCache.getLength() + 128);
+
+    // Uptime and heap change on every request, so they are written in front of
+    // the cached fields (which always start with '{' and are never empty)
+    response->printf("{\"uptime\":%lu,\"heap\":{\"free\":%lu,\"minFree\":%lu,\"largestBlock\":%lu},"
+                     "\"statusHash\":\"%08lx\",",
+                     millis(), (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap(),
+                     (unsigned long)ESP.getMaxAllocHeap(), (unsigned long)getStatusHash(version));
+    if (!statusCache.write(version, buildStatusResponse, this, *response, 1, &requestArena)) {
+        // Nothing has been sent yet, so the half-written stream can be dropped
+        delete response;
+        request->send(500, "application/json", "{\"error\":\"Response too large\"}");
+        return;
+    }
 
-    doc["uptime"] = millis();
-    doc["wifiMode"] = (wifiManager->getCurrentMode() == WIFIMANAGER_MODE_AP) ? "AP" : "STA";
-    doc["wifiConnected"] = wifiManager->isConnected();
-    doc["ipAddress"] = wifiManager->getLocalIP();
-    doc["apSSID"] = wifiManager->getAPSSID();
+    response->addHeader("Cache-Control", WEB_CACHE_CONTROL_DYNAMIC);
+    request->send(response);
+}
+
+uint32_t WebServer::getStatusVersion() {
+    uint32_t version = wifiManager->getStateVersion() + motorDriver->getStateVersion() + getCalibrationVersion();
+    if (doseWorkerPool != nullptr) {
+        version += doseWorkerPool->getVersion();
+    }
+    return version;
+}
+
+uint32_t WebServer::getStatusHash(uint32_t version) const {
+    // The version sum only grows within a boot; bootId separates boots
+    return bootId ^ (version * 2654435761u);
+}
+
+uint32_t WebServer::computeStatusHash(void* context) {
+    WebServer* self = static_cast<WebServer*>(context);
+    return self->getStatusHash(self->getStatusVersion());
+}
+
+uint32_t WebServer::getCalibrationVersion() const {
+    uint32_t version = 0;
+    for (uint8_t i = 0; i < numHeads; i++) {
+        version += dosingHeads[i]->getCalibrationVersion();
+    }
+    return version;
+}
+
+void WebServer::buildStatusResponse(JsonDocument& doc, void* context) {
+    WebServer* self = static_cast<WebServer*>(context);
+    WiFiStatus wifi;
+    self->wifiManager->getStatus(wifi);
+
+    doc["wifiMode"] = (wifi.mode == WIFIMANAGER_MODE_AP) ? "AP" : "STA";
+    doc["wifiConnected"] = wifi.connected;
+    doc["ipAddress"] = wifi.ipAddress;
+    doc["apSSID"] = self->wifiManager->getAPSSID();
 
     // Add dosing head status
     JsonArray heads = doc["dosingHeads"].to<JsonArray>();
-    for (uint8_t i = 0; i < numHeads; i++) {
+    for (uint8_t i = 0; i < self->numHeads; i++) {
+        DosingHead* dosingHead = self->dosingHeads[i];
         JsonObject head = heads.add<JsonObject>();
         head["index"] = i;
-        head["isDispensing"] = dosingHeads[i]->isDispensing();
-        head["isCalibrated"] = dosingHeads[i]->isCalibrated();
+        head["isDispensing"] = dosingHead->isDispensing();
+        head["isCalibrated"] = dosingHead->isCalibrated();
+        if (self->doseWorkerPool != nullptr) {
+            head["queuedDoses"] = self->doseWorkerPool->getQueueDepth(i);
+        }
+        head["lastCancelLatencyUs"] = dosingHead->getLastCancelLatencyUs();
 
-        CalibrationData cal = dosingHeads[i]->getCalibrationData();
+        CalibrationData cal = dosingHead->getCalibrationData();
         head["mlPerSecond"] = cal.mlPerSecond;
     }
-
-    sendJsonResponse(request, 200, doc);
 }
 
 void WebServer::handlePostDose(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-    // Only process if we have the complete body
-    if (index + len != total) {
-        return;
-    }
-
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, data, len);
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
 
-    if (error) {
-        sendErrorResponse(request, 400, "Invalid JSON: " + String(error.c_str()));
+    // Returns true once, when the whole body has arrived and parsed
+    if (!parseJsonBody(request, data, len, index, total, doc)) {
         return;
     }
 
+    JsonDocument responseDoc(&requestArena);
+    int code = executeDose(doc, responseDoc.to<JsonObject>());
+    sendJsonResponse(request, code, responseDoc);
+}
+
+int WebServer::executeDose(JsonVariantConst params, JsonObject response) {
     uint8_t head;
     float volume;
     String validationError;
 
-    if (!validateDosingRequest(doc, head, volume, validationError)) {
-        sendErrorResponse(request, 400, validationError);
-        return;
+    if (!validateDosingRequest(params, head, volume, validationError)) {
+        return errorResult(response, 400, validationError);
     }
 
-    // Send immediate response acknowledging the dose request
-    JsonDocument responseDoc;
-    responseDoc["success"] = true;
-    responseDoc["head"] = head;
-    responseDoc["targetVolume"] = volume;
-    responseDoc["message"] = "Dose started";
-    responseDoc["note"] = "Dosing operation running in background. Use WebSocket or poll /api/status for completion.";
+    if (doseWorkerPool == nullptr) {
+        return errorResult(response, 503, "Dose worker pool not available");
+    }
 
-    sendJsonResponse(request, 202, responseDoc);  // 202 Accepted
+    // Queue dose on the head's worker to avoid blocking the HTTP response
+    DoseJob job = {};
+    job.head = head;
+    job.volume = volume;
+    job.source = DoseSource::ADHOC;
+    job.requestedAt = millis();
+    job.onComplete = onAdhocDoseComplete;
+    job.context = this;
 
-    // Execute dose in background task to avoid blocking HTTP response
-    struct DoseTaskParams {
-        DosingHead** heads;
-        uint8_t head;
-        float volume;
-        AsyncWebSocket* ws;
-        DosingLogManager* logManager;  // For logging ad-hoc doses
-    };
+    DoseSubmitResult submitResult = doseWorkerPool->submit(job);
 
-    DoseTaskParams* params = new DoseTaskParams{dosingHeads, head, volume, ws, logManager};
+    if (submitResult == DoseSubmitResult::QUEUE_FULL) {
+        return errorResult(response, 429, "Dose queue full for head " + String(head) + ", retry later");
+    }
 
-    xTaskCreate([](void* param) {
-        DoseTaskParams* p = (DoseTaskParams*)param;
+    if (submitResult != DoseSubmitResult::ACCEPTED) {
+        return errorResult(response, 503, "Dose worker pool not running");
+    }
 
-        // Execute dose (blocking within this task)
-        DosingResult result = p->heads[p->head]->dispense(p->volume);
+    // Acknowledge immediately; completion is reported over the WebSocket
+    response["success"] = true;
+    response["head"] = head;
+    response["targetVolume"] = volume;
+    response["queuedDoses"] = doseWorkerPool->getQueueDepth(head);
+    response["message"] = "Dose queued";
+    response["note"] = "Dosing operation running in background. Progress and completion are pushed over the /ws WebSocket.";
 
-        // Log ad-hoc dose if successful and log manager available
-        if (result.success && p->logManager != nullptr) {
-            time_t now;
-            time(&now);
-            uint32_t timestamp = static_cast<uint32_t>(now);
+    return 202;  // 202 Accepted
+}
 
-            // Only log if we have valid time (after year 2000)
-            if (timestamp >= 946684800) {
-                p->logManager->logAdhocDose(p->head, result.estimatedVolume, timestamp);
-            }
-        }
+void WebServer::handlePostDoseCancel(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
 
-        // Broadcast result to WebSocket clients
-        if (result.success) {
-            JsonDocument wsDoc;
-            wsDoc["event"] = "dose_complete";
-            wsDoc["head"] = p->head;
-            wsDoc["targetVolume"] = result.targetVolume;
-            wsDoc["estimatedVolume"] = result.estimatedVolume;
-            wsDoc["runtime"] = result.actualRuntime;
+    // Returns true once, when the whole body has arrived and parsed
+    if (!parseJsonBody(request, data, len, index, total, doc)) {
+        return;
+    }
 
-            String wsMessage;
-            serializeJson(wsDoc, wsMessage);
-            p->ws->textAll(wsMessage);
+    JsonDocument responseDoc(&requestArena);
+    int code = executeDoseCancel(doc, responseDoc.to<JsonObject>());
+    sendJsonResponse(request, code, responseDoc);
+}
 
-            Serial.printf("[WebServer] Ad-hoc dose complete: Head %d, Volume %.2f mL, Runtime %lu ms\n",
-                         p->head, result.estimatedVolume, result.actualRuntime);
-        } else {
-            JsonDocument wsDoc;
-            wsDoc["event"] = "dose_error";
-            wsDoc["head"] = p->head;
-            wsDoc["error"] = result.errorMessage;
+int WebServer::executeDoseCancel(JsonVariantConst params, JsonObject response) {
+    if (!params["head"].is<int>()) {
+        return errorResult(response, 400, "Missing 'head' field");
+    }
 
-            String wsMessage;
-            serializeJson(wsDoc, wsMessage);
-            p->ws->textAll(wsMessage);
+    int head = params["head"];
+    if (head < 0 || head >= numHeads) {
+        return errorResult(response, 400, "Invalid head index (must be 0-" + String(numHeads - 1) + ")");
+    }
 
-            Serial.printf("[WebServer] Dose failed: Head %d, Error: %s\n",
-                         p->head, result.errorMessage.c_str());
-        }
+    // The worker reports the partial volume through its completion callback
+    bool wasDispensing = dosingHeads[head]->isDispensing();
+    dosingHeads[head]->stopDispensing();
+
+    response["success"] = true;
+    response["head"] = head;
+    response["wasDispensing"] = wasDispensing;
+    response["message"] = wasDispensing ? "Dose cancelled" : "No dose in progress";
 
-        delete p;
-        vTaskDelete(NULL);
-    }, "DoseTask", 4096, params, 1, NULL);
+    return 200;
 }
 
-void WebServer::handlePostCalibrate(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-    // Only process if we have the complete body
-    if (index + len != total) {
+void WebServer::onAdhocDoseComplete(const DoseJob& job, const DosingResult& result, void* context) {
+    WebServer* self = static_cast<WebServer*>(context);
+    if (self == nullptr) {
         return;
     }
 
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, data, len);
+    // Log ad-hoc dose if it pumped anything (a cancelled dose logs its partial volume)
+    bool pumped = result.success || (result.cancelled && result.estimatedVolume > 0.0f);
+    if (pumped && self->logManager != nullptr) {
+        time_t now;
+        time(&now);
+        uint32_t timestamp = static_cast<uint32_t>(now);
+
+        // Only log if we have valid time (after year 2000)
+        if (timestamp >= 946684800) {
+            self->logManager->logAdhocDose(job.head, result.estimatedVolume, timestamp);
+        }
+    }
+
+    // Broadcast result to WebSocket clients
+    if (result.success) {
+        JsonDocument wsDoc;
+        wsDoc["event"] = "dose_complete";
+        wsDoc["head"] = job.head;
+        wsDoc["targetVolume"] = result.targetVolume;
+        wsDoc["estimatedVolume"] = result.estimatedVolume;
+        wsDoc["runtime"] = result.actualRuntime;
+
+        self->broadcastWebSocket(wsDoc, WS_TOPIC_DOSES);
+
+        LOG_INFO("Ad-hoc dose complete: Head %d, Volume %.2f mL, Runtime %lu ms", job.head, result.estimatedVolume, result.actualRuntime);
+    } else if (result.cancelled) {
+        JsonDocument wsDoc;
+        wsDoc["event"] = "dose_cancelled";
+        wsDoc["head"] = job.head;
+        wsDoc["targetVolume"] = result.targetVolume;
+        wsDoc["estimatedVolume"] = result.estimatedVolume;
+        wsDoc["runtime"] = result.actualRuntime;
+        wsDoc["cancelLatencyUs"] = result.cancelLatencyUs;
+
+        self->broadcastWebSocket(wsDoc, WS_TOPIC_DOSES);
+
+        LOG_INFO("Ad-hoc dose cancelled: Head %d, Partial %.2f of %.2f mL, Latency %lu us", job.head, result.estimatedVolume, result.targetVolume, result.cancelLatencyUs);
+    } else {
+        JsonDocument wsDoc;
+        wsDoc["event"] = "dose_error";
+        wsDoc["head"] = job.head;
+        wsDoc["error"] = result.errorMessage;
+
+        self->broadcastWebSocket(wsDoc, WS_TOPIC_DOSES);
+
+        LOG_ERROR("Dose failed: Head %d, Error: %s", job.head, result.errorMessage.c_str());
+    }
+}
+
+void WebServer::handlePostCalibrate(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
 
-    if (error) {
-        sendErrorResponse(request, 400, "Invalid JSON: " + String(error.c_str()));
+    // Returns true once, when the whole body has arrived and parsed
+    if (!parseJsonBody(request, data, len, index, total, doc)) {
         return;
     }
 
     uint8_t head;
-    float actualVolume;
     String validationError;
+    bool success;
 
-    if (!validateCalibrationRequest(doc, head, actualVolume, validationError)) {
-        sendErrorResponse(request, 400, validationError);
-        return;
-    }
+    if (doc["points"].is<JsonArrayConst>()) {
+        // Multi-point calibration: fit rate and dead-volume offset
+        CalibrationPoint points[MAX_CALIBRATION_POINTS];
+        uint8_t count;
+
+        if (!validateCalibrationPointsRequest(doc, head, points, count, validationError)) {
+            sendErrorResponse(request, 400, validationError);
+            return;
+        }
+
+        success = dosingHeads[head]->calibrate(points, count);
+    } else {
+        float actualVolume;
+
+        if (!validateCalibrationRequest(doc, head, actualVolume, validationError)) {
+            sendErrorResponse(request, 400, validationError);
+            return;
+        }
 
-    // Perform calibration
-    bool success = dosingHeads[head]->calibrate(actualVolume);
+        // Perform calibration
+        success = dosingHeads[head]->calibrate(actualVolume);
+    }
 
-    JsonDocument responseDoc;
+    JsonDocument responseDoc(&requestArena);
     responseDoc["success"] = success;
     responseDoc["head"] = head;
 
     if (success) {
         CalibrationData cal = dosingHeads[head]->getCalibrationData();
         responseDoc["mlPerSecond"] = cal.mlPerSecond;
+        responseDoc["offsetMl"] = cal.offsetMl;
+        responseDoc["pointCount"] = cal.pointCount;
         responseDoc["isCalibrated"] = cal.isCalibrated;
     } else {
         responseDoc["error"] = "Calibration failed";
@@ -320,64 +509,120 @@ void WebServer::handlePostCalibrate(AsyncWebServerRequest* request, uint8_t* dat
 }
 
 void WebServer::handleGetCalibration(AsyncWebServerRequest* request) {
-    JsonDocument doc;
+    JsonArenaScope arenaScope(requestArena);
+
+    uint32_t version = getCalibrationVersion();
+    char etag[WEB_ETAG_SIZE];
+    formatETag(etag, "calibration", version);
+    if (sendIfNotModified(request, etag)) {
+        return;
+    }
+
+    sendCachedResponse(request, calibrationCache, version, buildCalibrationResponse, etag);
+}
+
+void WebServer::buildCalibrationResponse(JsonDocument& doc, void* context) {
+    WebServer* self = static_cast<WebServer*>(context);
     JsonArray heads = doc["calibrations"].to<JsonArray>();
 
-    for (uint8_t i = 0; i < numHeads; i++) {
+    for (uint8_t i = 0; i < self->numHeads; i++) {
         JsonObject head = heads.add<JsonObject>();
-        CalibrationData cal = dosingHeads[i]->getCalibrationData();
+        CalibrationData cal = self->dosingHeads[i]->getCalibrationData();
 
         head["head"] = i;
         head["isCalibrated"] = cal.isCalibrated;
         head["mlPerSecond"] = cal.mlPerSecond;
+        head["offsetMl"] = cal.offsetMl;
+        head["pointCount"] = cal.pointCount;
         head["lastCalibrationTime"] = cal.lastCalibrationTime;
     }
+}
 
-    sendJsonResponse(request, 200, doc);
+void WebServer::handleGetHeadCalibration(AsyncWebServerRequest* request, uint8_t head) {
+    JsonArenaScope arenaScope(requestArena);
+
+    if (head >= numHeads) {
+        sendErrorResponse(request, 400, "Invalid head index: " + String(head));
+        return;
+    }
+
+    char etag[WEB_ETAG_SIZE];
+    formatETag(etag, "calibration", dosingHeads[head]->getCalibrationVersion());
+    if (sendIfNotModified(request, etag)) {
+        return;
+    }
+
+    CalibrationData cal = dosingHeads[head]->getCalibrationData();
+
+    JsonDocument doc(&requestArena);
+    doc["head"] = head;
+    doc["isCalibrated"] = cal.isCalibrated;
+    doc["mlPerSecond"] = cal.mlPerSecond;
+    doc["offsetMl"] = cal.offsetMl;
+    doc["pointCount"] = cal.pointCount;
+    doc["lastCalibrationTime"] = cal.lastCalibrationTime;
+
+    sendJsonResponse(request, 200, doc, etag);
 }
 
 void WebServer::handlePostEmergencyStop(AsyncWebServerRequest* request) {
+    JsonArenaScope arenaScope(requestArena);
+
+    // Drop queued doses first so no worker starts a motor right after the stop
+    uint16_t cancelled = 0;
+    if (doseWorkerPool != nullptr) {
+        cancelled = doseWorkerPool->cancelAll();
+    }
+
     motorDriver->emergencyStopAll();
 
-    JsonDocument doc;
+    // Wake in-flight doses so they report the volume pumped up to the stop
+    uint8_t interrupted = 0;
+    for (uint8_t i = 0; i < numHeads; i++) {
+        if (dosingHeads[i]->cancelDispensing()) {
+            interrupted++;
+        }
+    }
+
+    JsonDocument doc(&requestArena);
     doc["success"] = true;
     doc["message"] = "Emergency stop executed";
+    doc["stopLatencyNs"] = motorDriver->getLastEmergencyStopLatencyNs();
+    doc["cancelledDoses"] = cancelled;
+    doc["interruptedDoses"] = interrupted;
 
     sendJsonResponse(request, 200, doc);
 
-    // Broadcast to WebSocket clients
+    // Every client must learn of the stop, whatever it subscribed to
     JsonDocument wsDoc;
     wsDoc["event"] = "emergency_stop";
     wsDoc["timestamp"] = millis();
 
-    String wsMessage;
-    serializeJson(wsDoc, wsMessage);
-    broadcastWebSocket(wsMessage);
+    broadcastWebSocket(wsDoc, WS_TOPIC_ALL, WsSendPolicy::CRITICAL);
 }
 
 void WebServer::handleGetWifiStatus(AsyncWebServerRequest* request) {
-    JsonDocument doc;
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
+
+    WiFiStatus wifi;
+    wifiManager->getStatus(wifi);
 
-    WifiManagerMode mode = wifiManager->getCurrentMode();
-    doc["mode"] = (mode == WIFIMANAGER_MODE_AP) ? "AP" : "STA";
-    doc["connected"] = wifiManager->isConnected();
-    doc["ipAddress"] = wifiManager->getLocalIP();
+    doc["mode"] = (wifi.mode == WIFIMANAGER_MODE_AP) ? "AP" : "STA";
+    doc["connected"] = wifi.connected;
+    doc["ipAddress"] = wifi.ipAddress;
     doc["apSSID"] = wifiManager->getAPSSID();
+    doc["apActive"] = wifi.apActive;
 
     sendJsonResponse(request, 200, doc);
 }
 
 void WebServer::handlePostWifiConfigure(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-    // Only process if we have the complete body
-    if (index + len != total) {
-        return;
-    }
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
 
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, data, len);
-
-    if (error) {
-        sendErrorResponse(request, 400, "Invalid JSON: " + String(error.c_str()));
+    // Returns true once, when the whole body has arrived and parsed
+    if (!parseJsonBody(request, data, len, index, total, doc)) {
         return;
     }
 
@@ -392,7 +637,7 @@ void WebServer::handlePostWifiConfigure(AsyncWebServerRequest* request, uint8_t*
     // Save credentials to NVS
     bool success = wifiManager->setCredentials(ssid, password);
 
-    JsonDocument responseDoc;
+    JsonDocument responseDoc(&requestArena);
     responseDoc["success"] = success;
 
     if (success) {
@@ -404,22 +649,16 @@ void WebServer::handlePostWifiConfigure(AsyncWebServerRequest* request, uint8_t*
 
     sendJsonResponse(request, success ? 200 : 500, responseDoc);
 
-    // Switch to STA mode in background (non-blocking)
-    // The keepAliveTask will detect the new credentials and switch automatically
+    // Switch to STA mode in background (non-blocking): the WiFi task applies
+    // the request after WIFI_SWITCH_DELAY_MS, once the response has been sent
     if (success) {
-        // Trigger an immediate switch attempt by calling switchToSTAMode in a non-blocking way
-        // We do this AFTER responding to avoid blocking the HTTP response
-        xTaskCreate([](void* param) {
-            WiFiManager* mgr = (WiFiManager*)param;
-            vTaskDelay(100 / portTICK_PERIOD_MS); // Small delay to ensure HTTP response is sent
-            mgr->switchToSTAMode();
-            vTaskDelete(NULL);
-        }, "WiFiSwitch", 4096, wifiManager, 1, NULL);
+        wifiManager->requestSTAMode();
     }
 }
 
 void WebServer::handlePostWifiReset(AsyncWebServerRequest* request) {
-    JsonDocument doc;
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
     doc["success"] = true;
     doc["message"] = "Clearing WiFi credentials and switching to AP mode...";
     doc["note"] = "Device will reset to AP mode and stay there until reconfigured.";
@@ -427,57 +666,306 @@ void WebServer::handlePostWifiReset(AsyncWebServerRequest* request) {
 
     sendJsonResponse(request, 200, doc);
 
-    // Clear credentials and switch to AP mode in background (non-blocking)
-    // We do this AFTER responding to avoid disconnecting the client mid-response
-    xTaskCreate([](void* param) {
-        WiFiManager* mgr = (WiFiManager*)param;
-        vTaskDelay(500 / portTICK_PERIOD_MS); // Longer delay to ensure HTTP response is fully sent
-
-        // Clear credentials from NVS so device stays in AP mode
-        mgr->clearCredentials();
+    // Clear credentials from NVS so device stays in AP mode
+    wifiManager->clearCredentials();
 
-        // Switch to AP mode
-        mgr->switchToAPMode();
-
-        vTaskDelete(NULL);
-    }, "WiFiReset", 4096, wifiManager, 1, NULL);
+    // Switch to AP mode in background (non-blocking): the WiFi task applies
+    // the request after WIFI_SWITCH_DELAY_MS, so the client is not dropped mid-response
+    wifiManager->requestAPMode();
 }
 
 void WebServer::handleWebSocketEvent(AsyncWebSocket* server, AsyncWebSocketClient* client,
                                     AwsEventType type, void* arg, uint8_t* data, size_t len) {
     switch (type) {
         case WS_EVT_CONNECT:
-            Serial.printf("[WebSocket] Client #%u connected from %s\n",
-                         client->id(), client->remoteIP().toString().c_str());
+            LOG_INFO("WebSocket client #%u connected from %s", client->id(), client->remoteIP().toString().c_str());
+            wsSessions.onConnect(client);
             break;
 
         case WS_EVT_DISCONNECT:
-            Serial.printf("[WebSocket] Client #%u disconnected\n", client->id());
+            LOG_INFO("WebSocket client #%u disconnected", client->id());
+            wsSessions.onDisconnect(client->id());
+            bodyPool.release(client->_tempObject);
             break;
 
         case WS_EVT_DATA:
-            // Handle incoming WebSocket data if needed
+            wsSessions.onActivity(client->id());
+            handleWebSocketRpc(client, static_cast<AwsFrameInfo*>(arg), data, len);
             break;
 
         case WS_EVT_PONG:
+            wsSessions.onActivity(client->id());
+            break;
+
         case WS_EVT_ERROR:
             break;
     }
 }
 
-void WebServer::sendJsonResponse(AsyncWebServerRequest* request, int code, const JsonDocument& doc) {
-    String response;
-    serializeJson(doc, response);
-    request->send(code, "application/json", response);
+void WebServer::handleWebSocketRpc(AsyncWebSocketClient* client, AwsFrameInfo* info, uint8_t* data, size_t len) {
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument message(&requestArena);
+
+    // RPC requests are small: accept only unfragmented text messages. A frame
+    // that arrives in several TCP segments is reassembled like a POST body.
+    bool singleFrame = info != nullptr && info->final && info->num == 0 && info->opcode == WS_TEXT;
+
+    JsonBodyResult body = JsonBodyResult::IGNORED;
+    DeserializationError error = DeserializationError::Ok;
+    if (singleFrame) {
+        body = bodyPool.parseJsonBody(client->_tempObject, data, len, info->index, info->len, message, error);
+        if (body == JsonBodyResult::INCOMPLETE || body == JsonBodyResult::IGNORED) {
+            return;
+        }
+    } else if (info == nullptr || info->num != 0 || info->index != 0) {
+        // A message in several frames is answered once, on its first chunk
+        return;
+    }
+
+    if (body != JsonBodyResult::PARSED && body != JsonBodyResult::INVALID_JSON && info->index == 0) {
+        // Rejected unparsed, but the reply still echoes the id if this chunk holds it.
+        // The filter keeps only the id, so a partial or oversized message costs no arena.
+        JsonDocument filter(&requestArena);
+        filter["id"] = true;
+        deserializeJson(message, reinterpret_cast<const char*>(data), len, DeserializationOption::Filter(filter));
+    }
+
+    const char* method = message["method"];
+    JsonVariantConst params = message["params"];
+
+    JsonDocument reply(&requestArena);
+
+    reply["type"] = "response";
+    reply["id"] = message["id"];
+    JsonObject result = reply["result"].to<JsonObject>();
+    int status;
+
+    if (!singleFrame) {
+        status = errorResult(result, 400, "RPC requests must be a single text frame");
+    } else if (body == JsonBodyResult::TOO_LARGE) {
+        status = errorResult(result, 413, "RPC request over " + String(WEB_MAX_REQUEST_BODY_SIZE) + " bytes");
+    } else if (body == JsonBodyResult::NO_BUFFER) {
+        status = errorResult(result, 503, "Too many requests in progress, retry later");
+    } else if (body == JsonBodyResult::OUT_OF_ORDER) {
+        status = errorResult(result, 400, "Malformed RPC frame");
+    } else if (error) {
+        status = errorResult(result, 400, "Invalid JSON: " + String(error.c_str()));
+    } else if (method == nullptr) {
+        status = errorResult(result, 400, "Missing required field: method");
+    } else if (strcmp(method, "dose") == 0) {
+        status = executeDose(params, result);
+    } else if (strcmp(method, "cancel") == 0) {
+        status = executeDoseCancel(params, result);
+    } else if (strcmp(method, "setSchedule") == 0 || strcmp(method, "getLogs") == 0) {
+        status = submitRpcStorageJob(client->id(), message["id"], params, strcmp(method, "getLogs") == 0, result);
+        if (status == 0) {
+            return;  // Queued: the storage worker replies
+        }
+    } else if (strcmp(method, "subscribe") == 0) {
+        status = executeSubscribe(client->id(), params, result);
+    } else {
+        status = errorResult(result, 404, "Unknown method: " + String(method));
+    }
+
+    reply["status"] = status;
+    sendWebSocket(client->id(), reply);
+}
+
+int WebServer::submitRpcStorageJob(uint32_t clientId, JsonVariantConst id, JsonVariantConst params,
+                                   bool getLogs, JsonObject response) {
+    StorageJob job = {};
+    job.clientId = clientId;
+
+    // The id is echoed back verbatim, so it travels to the worker as JSON text
+    if (measureJson(id) >= sizeof(job.rpcId)) {
+        return errorResult(response, 400, "RPC id over " + String(WEB_RPC_ID_SIZE - 1) + " bytes");
+    }
+    serializeJson(id, job.rpcId, sizeof(job.rpcId));
+
+    if (getLogs) {
+        if (logManager == nullptr) {
+            return errorResult(response, 503, "Dosing log manager not available");
+        }
+
+        // Missing fields read as 0 (use defaults)
+        job.operation = StorageOperation::HOURLY_LOGS;
+        job.hours = params["hours"].as<uint32_t>();
+        job.start = params["start"].as<uint32_t>();
+        job.end = params["end"].as<uint32_t>();
+    } else {
+        if (scheduleManager == nullptr) {
+            return errorResult(response, 503, "Schedule manager not available");
+        }
+
+        String validationError;
+        if (!validateScheduleRequest(params, job.schedule, validationError)) {
+            return errorResult(response, 400, validationError);
+        }
+        job.operation = StorageOperation::SET_SCHEDULE;
+    }
+
+    if (!storageWorker.submit(job)) {
+        return errorResult(response, 503, "Storage busy, retry later");
+    }
+
+    return 0;
+}
+
+bool WebServer::parseJsonBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total, JsonDocument& doc) {
+    bool hadBuffer = request->_tempObject != nullptr;
+    DeserializationError error;
+
+    JsonBodyResult result = bodyPool.parseJsonBody(request->_tempObject, data, len, index, total, doc, error);
+
+    if (!hadBuffer && request->_tempObject != nullptr) {
+        // Detach before the request is destroyed if the client goes away mid-body
+        request->onDisconnect([this, request]() {
+            bodyPool.release(request->_tempObject);
+        });
+    }
+
+    switch (result) {
+        case JsonBodyResult::PARSED:
+            return true;
+
+        case JsonBodyResult::TOO_LARGE:
+            sendErrorResponse(request, 413, "Request body too large (max " + String(WEB_MAX_REQUEST_BODY_SIZE) + " bytes)");
+            return false;
+
+        case JsonBodyResult::NO_BUFFER:
+            sendErrorResponse(request, 503, "Too many requests in progress, retry later");
+            return false;
+
+        case JsonBodyResult::OUT_OF_ORDER:
+            sendErrorResponse(request, 400, "Malformed request body");
+            return false;
+
+        case JsonBodyResult::INVALID_JSON:
+            sendParseError(request, error);
+            return false;
+
+        case JsonBodyResult::INCOMPLETE:
+        case JsonBodyResult::IGNORED:
+        default:
+            return false;
+    }
+}
+
+
+void WebServer::sendJsonResponse(AsyncWebServerRequest* request, int code, const JsonDocument& doc, const char* etag) {
+    if (doc.overflowed()) {
+        LOG_WARN("Response exceeded %d byte arena", WEB_JSON_ARENA_SIZE);
+        request->send(500, "application/json", "{\"error\":\"Response too large\"}");
+        return;
+    }
+
+    // Measure first so the stream buffer is allocated once at its final size,
+    // then serialize straight into it (no intermediate String)
+    AsyncResponseStream* response = request->beginResponseStream("application/json", measureJson(doc));
+    response->setCode(code);
+    serializeJson(doc, *response);
+
+    // Only successful responses are validated against an ETag
+    if (etag != nullptr && code == 200) {
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", WEB_CACHE_CONTROL_VERSIONED);
+    } else {
+        response->addHeader("Cache-Control", WEB_CACHE_CONTROL_DYNAMIC);
+    }
+
+    request->send(response);
+}
+
+void WebServer::sendCachedResponse(AsyncWebServerRequest* request, ResponseCache& cache, uint32_t version,
+                                   ResponseBuildFunction build, const char* etag) {
+    AsyncResponseStream* response = request->beginResponseStream("application/json", cache.getLength());
+    if (!cache.write(version, build, this, *response, 0, &requestArena)) {
+        delete response;
+        request->send(500, "application/json", "{\"error\":\"Response too large\"}");
+        return;
+    }
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", WEB_CACHE_CONTROL_VERSIONED);
+    request->send(response);
+}
+
+void WebServer::formatETag(char (&etag)[WEB_ETAG_SIZE], const char* resource, uint32_t version,
+                           uint32_t rangeStart, uint32_t rangeEnd) const {
+    // Strong ETag: the version counters change whenever the body does, and the
+    // boot ID keeps counters that restart at 0 from matching a pre-reboot ETag
+    if (rangeStart == 0 && rangeEnd == 0) {
+        snprintf(etag, sizeof(etag), "\"%s-%08lx-%lx\"", resource,
+                 (unsigned long)bootId, (unsigned long)version);
+    } else {
+        snprintf(etag, sizeof(etag), "\"%s-%08lx-%lx-%lx-%lx\"", resource, (unsigned long)bootId,
+                 (unsigned long)version, (unsigned long)rangeStart, (unsigned long)rangeEnd);
+    }
+}
+
+bool WebServer::sendIfNotModified(AsyncWebServerRequest* request, const char* etag) {
+    AsyncWebHeader* header = request->getHeader("If-None-Match");
+    if (header == nullptr) {
+        return false;
+    }
+
+    // If-None-Match is a comma separated list of ETags (or "*"), compared weakly
+    const char* cursor = header->value().c_str();
+    size_t etagLength = strlen(etag);
+    bool match = false;
+
+    while (*cursor != '\0' && !match) {
+        while (*cursor == ' ' || *cursor == ',') {
+            cursor++;
+        }
+        if (strncmp(cursor, "W/", 2) == 0) {
+            cursor += 2;
+        }
+
+        if (*cursor == '*') {
+            match = true;
+        } else if (strncmp(cursor, etag, etagLength) == 0) {
+            char next = cursor[etagLength];
+            match = (next == '\0' || next == ',' || next == ' ');
+        }
+
+        while (*cursor != '\0' && *cursor != ',') {
+            cursor++;
+        }
+    }
+
+    if (!match) {
+        return false;
+    }
+
+    AsyncWebServerResponse* response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", WEB_CACHE_CONTROL_VERSIONED);
+    request->send(response);
+    return true;
+}
+
+void WebServer::sendParseError(AsyncWebServerRequest* request, const DeserializationError& error) {
+    if (error == DeserializationError::NoMemory) {
+        // Document did not fit in the request arena
+        sendErrorResponse(request, 413, "Request body too complex");
+        return;
+    }
+    sendErrorResponse(request, 400, "Invalid JSON: " + String(error.c_str()));
 }
 
 void WebServer::sendErrorResponse(AsyncWebServerRequest* request, int code, const String& message) {
-    JsonDocument doc;
+    // Always called from a handler, inside its arena scope
+    JsonDocument doc(&requestArena);
     doc["error"] = message;
     sendJsonResponse(request, code, doc);
 }
 
-bool WebServer::validateDosingRequest(const JsonDocument& doc, uint8_t& head, float& volume, String& error) {
+int WebServer::errorResult(JsonObject response, int code, const String& message) {
+    response["error"] = message;
+    return code;
+}
+
+bool WebServer::validateDosingRequest(JsonVariantConst doc, uint8_t& head, float& volume, String& error) {
     if (!doc["head"].is<uint8_t>()) {
         error = "Missing required field: head";
         return false;
@@ -504,7 +992,7 @@ bool WebServer::validateDosingRequest(const JsonDocument& doc, uint8_t& head, fl
     return true;
 }
 
-bool WebServer::validateCalibrationRequest(const JsonDocument& doc, uint8_t& head, float& actualVolume, String& error) {
+bool WebServer::validateCalibrationRequest(JsonVariantConst doc, uint8_t& head, float& actualVolume, String& error) {
     if (!doc["head"].is<uint8_t>()) {
         error = "Missing required field: head";
         return false;
@@ -531,16 +1019,70 @@ bool WebServer::validateCalibrationRequest(const JsonDocument& doc, uint8_t& hea
     return true;
 }
 
+bool WebServer::validateCalibrationPointsRequest(JsonVariantConst doc, uint8_t& head, CalibrationPoint* points, uint8_t& count, String& error) {
+    if (!doc["head"].is<uint8_t>()) {
+        error = "Missing required field: head";
+        return false;
+    }
+
+    head = doc["head"];
+
+    if (head >= numHeads) {
+        error = "Invalid head index: " + String(head) + " (must be 0-" + String(numHeads - 1) + ")";
+        return false;
+    }
+
+    JsonArrayConst pointsArray = doc["points"].as<JsonArrayConst>();
+    if (pointsArray.size() < 2 || pointsArray.size() > MAX_CALIBRATION_POINTS) {
+        error = "points must contain 2-" + String(MAX_CALIBRATION_POINTS) + " measurements";
+        return false;
+    }
+
+    count = 0;
+    for (JsonVariantConst point : pointsArray) {
+        if (!point["runtimeMs"].is<uint32_t>() || !point["volume"].is<float>()) {
+            error = "Each point requires runtimeMs and volume";
+            return false;
+        }
+
+        points[count].runtimeMs = point["runtimeMs"];
+        points[count].volumeMl = point["volume"];
+
+        if (points[count].volumeMl <= 0.0f) {
+            error = "Invalid measured volume: " + String(points[count].volumeMl);
+            return false;
+        }
+
+        count++;
+    }
+
+    return true;
+}
+
 void WebServer::handleGetAllSchedules(AsyncWebServerRequest* request) {
+    JsonArenaScope arenaScope(requestArena);
+
     if (scheduleManager == nullptr) {
         sendErrorResponse(request, 503, "Schedule manager not available");
         return;
     }
 
+    uint32_t version = scheduleManager->getVersion();
+    char etag[WEB_ETAG_SIZE];
+    formatETag(etag, "schedules", version);
+    if (sendIfNotModified(request, etag)) {
+        return;
+    }
+
+    sendCachedResponse(request, schedulesCache, version, buildSchedulesResponse, etag);
+}
+
+void WebServer::buildSchedulesResponse(JsonDocument& doc, void* context) {
+    WebServer* self = static_cast<WebServer*>(context);
+
     Schedule schedules[NUM_SCHEDULE_HEADS];
-    uint8_t count = scheduleManager->getAllSchedules(schedules);
+    uint8_t count = self->scheduleManager->getAllSchedules(schedules);
 
-    JsonDocument doc;
     JsonArray schedulesArray = doc["schedules"].to<JsonArray>();
 
     for (uint8_t i = 0; i < count; i++) {
@@ -559,28 +1101,25 @@ void WebServer::handleGetAllSchedules(AsyncWebServerRequest* request) {
     }
 
     doc["count"] = count;
-    sendJsonResponse(request, 200, doc);
 }
 
-void WebServer::handleGetSchedule(AsyncWebServerRequest* request) {
+void WebServer::handleGetSchedule(AsyncWebServerRequest* request, uint8_t head) {
+    JsonArenaScope arenaScope(requestArena);
+
     if (scheduleManager == nullptr) {
         sendErrorResponse(request, 503, "Schedule manager not available");
         return;
     }
 
-    // Extract head from URL path parameter
-    String path = request->url();
-    int lastSlash = path.lastIndexOf('/');
-    if (lastSlash == -1) {
-        sendErrorResponse(request, 400, "Invalid URL format");
+    if (head >= NUM_SCHEDULE_HEADS) {
+        sendErrorResponse(request, 400, "Invalid head index: " + String(head));
         return;
     }
 
-    String headStr = path.substring(lastSlash + 1);
-    uint8_t head = headStr.toInt();
-
-    if (head >= NUM_SCHEDULE_HEADS) {
-        sendErrorResponse(request, 400, "Invalid head index: " + String(head));
+    // Read before the schedule, so a change in between leaves the ETag stale
+    char etag[WEB_ETAG_SIZE];
+    formatETag(etag, "schedule", scheduleManager->getVersion());
+    if (sendIfNotModified(request, etag)) {
         return;
     }
 
@@ -590,7 +1129,7 @@ void WebServer::handleGetSchedule(AsyncWebServerRequest* request) {
         return;
     }
 
-    JsonDocument doc;
+    JsonDocument doc(&requestArena);
     doc["head"] = sched.head;
     doc["name"] = sched.name;
     doc["enabled"] = sched.enabled;
@@ -603,36 +1142,36 @@ void WebServer::handleGetSchedule(AsyncWebServerRequest* request) {
     doc["createdAt"] = sched.createdAt;
     doc["updatedAt"] = sched.updatedAt;
 
-    sendJsonResponse(request, 200, doc);
+    sendJsonResponse(request, 200, doc, etag);
 }
 
 void WebServer::handlePostSchedule(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-    if (scheduleManager == nullptr) {
-        sendErrorResponse(request, 503, "Schedule manager not available");
-        return;
-    }
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
 
-    // Only process if we have the complete body
-    if (index + len != total) {
+    // Returns true once, when the whole body has arrived and parsed
+    if (!parseJsonBody(request, data, len, index, total, doc)) {
         return;
     }
 
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, data, len);
-
-    if (error) {
-        sendErrorResponse(request, 400, "Invalid JSON: " + String(error.c_str()));
+    if (scheduleManager == nullptr) {
+        sendErrorResponse(request, 503, "Schedule manager not available");
         return;
     }
 
-    Schedule sched;
+    // Validate here (no flash access); only the save runs on the storage worker
+    StorageJob job = {};
     String validationError;
-
-    if (!validateScheduleRequest(doc, sched, validationError)) {
+    if (!validateScheduleRequest(doc, job.schedule, validationError)) {
         sendErrorResponse(request, 400, validationError);
         return;
     }
 
+    job.operation = StorageOperation::SET_SCHEDULE;
+    submitStorageJob(request, job);
+}
+
+int WebServer::executeSaveSchedule(Schedule& sched, JsonObject response) {
     // Set timestamps
     uint32_t now = millis() / 1000;
     sched.createdAt = now;
@@ -641,57 +1180,267 @@ void WebServer::handlePostSchedule(AsyncWebServerRequest* request, uint8_t* data
     // Save schedule
     bool success = scheduleManager->setSchedule(sched);
 
-    JsonDocument responseDoc;
-    responseDoc["success"] = success;
-    responseDoc["head"] = sched.head;
+    response["success"] = success;
+    response["head"] = sched.head;
 
     if (success) {
-        responseDoc["message"] = "Schedule created/updated successfully";
+        response["message"] = "Schedule created/updated successfully";
     } else {
-        responseDoc["error"] = "Failed to save schedule";
+        response["error"] = "Failed to save schedule";
     }
 
-    sendJsonResponse(request, success ? 200 : 500, responseDoc);
+    return success ? 200 : 500;
 }
 
-void WebServer::handleDeleteSchedule(AsyncWebServerRequest* request) {
+void WebServer::handleDeleteSchedule(AsyncWebServerRequest* request, uint8_t head) {
+    JsonArenaScope arenaScope(requestArena);
+
     if (scheduleManager == nullptr) {
         sendErrorResponse(request, 503, "Schedule manager not available");
         return;
     }
 
-    // Extract head from URL path parameter
-    String path = request->url();
-    int lastSlash = path.lastIndexOf('/');
-    if (lastSlash == -1) {
-        sendErrorResponse(request, 400, "Invalid URL format");
-        return;
-    }
-
-    String headStr = path.substring(lastSlash + 1);
-    uint8_t head = headStr.toInt();
-
     if (head >= NUM_SCHEDULE_HEADS) {
         sendErrorResponse(request, 400, "Invalid head index: " + String(head));
         return;
     }
 
+    StorageJob job = {};
+    job.operation = StorageOperation::DELETE_SCHEDULE;
+    job.schedule.head = head;
+    submitStorageJob(request, job);
+}
+
+int WebServer::executeDeleteSchedule(uint8_t head, JsonObject response) {
     bool success = scheduleManager->deleteSchedule(head);
 
-    JsonDocument doc;
-    doc["success"] = success;
-    doc["head"] = head;
+    response["success"] = success;
+    response["head"] = head;
 
     if (success) {
-        doc["message"] = "Schedule deleted successfully";
+        response["message"] = "Schedule deleted successfully";
     } else {
-        doc["error"] = "Failed to delete schedule";
+        response["error"] = "Failed to delete schedule";
+    }
+
+    return success ? 200 : 500;
+}
+
+void WebServer::handlePostBatch(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
+
+    // Returns true once, when the whole body has arrived and parsed
+    if (!parseJsonBody(request, data, len, index, total, doc)) {
+        return;
+    }
+
+    if (!doc["operations"].is<JsonArrayConst>()) {
+        sendErrorResponse(request, 400, "Missing required field: operations");
+        return;
+    }
+
+    JsonArrayConst operations = doc["operations"].as<JsonArrayConst>();
+    if (operations.size() == 0 || operations.size() > WEB_BATCH_MAX_OPERATIONS) {
+        sendErrorResponse(request, 400, "operations must contain 1-" + String(WEB_BATCH_MAX_OPERATIONS) + " entries");
+        return;
+    }
+
+    // One batch at a time: the storage worker still owns the previous one
+    if (batchPending.load()) {
+        sendErrorResponse(request, 503, "Batch in progress, retry later");
+        return;
+    }
+
+    // Validate and stage everything first so an invalid batch changes nothing
+    batch.transaction = ConfigTransaction();
+    uint8_t doseCount = 0;
+    bool valid = true;
+
+    JsonDocument responseDoc(&requestArena);
+    JsonArray results = responseDoc["results"].to<JsonArray>();
+
+    uint8_t opIndex = 0;
+    for (JsonVariantConst op : operations) {
+        JsonObject result = results.add<JsonObject>();
+        result["index"] = opIndex;
+        result["op"] = op["op"];
+
+        uint8_t dosesBefore = doseCount;
+        String error;
+
+        if (stageBatchOperation(op, batch.transaction, batch.doses, doseCount, error)) {
+            result["status"] = "staged";
+            strncpy(batch.ops[opIndex], op["op"].as<const char*>(), WEB_BATCH_OP_SIZE - 1);
+            batch.ops[opIndex][WEB_BATCH_OP_SIZE - 1] = '\0';
+        } else {
+            result["status"] = "invalid";
+            result["error"] = error;
+            valid = false;
+        }
+
+        batch.doseIndex[opIndex] = (doseCount > dosesBefore) ? dosesBefore : -1;
+        opIndex++;
+    }
+
+    if (!valid) {
+        responseDoc["success"] = false;
+        responseDoc["committed"] = false;
+        responseDoc["error"] = "Batch rejected, no operations were applied";
+        sendJsonResponse(request, 400, responseDoc);
+        return;
+    }
+
+    // The commit reserves flash queue room, which waits out a running dose
+    batch.opCount = opIndex;
+    batchPending.store(true);
+
+    StorageJob job = {};
+    job.operation = StorageOperation::BATCH;
+    if (!storageWorker.submit(job, request)) {
+        batchPending.store(false);
+        sendErrorResponse(request, 503, "Storage busy, retry later");
+    }
+}
+
+int WebServer::executeBatch(JsonObject response) {
+    // One journaled commit for every schedule and calibration change
+    bool committed = batch.transaction.commit(scheduleManager, dosingHeads, numHeads);
+
+    // Doses are queued only once the configuration they may depend on is committed
+    bool allSucceeded = committed;
+    JsonArray results = response["results"].to<JsonArray>();
+
+    for (uint8_t i = 0; i < batch.opCount; i++) {
+        JsonObject result = results.add<JsonObject>();
+        result["index"] = i;
+        result["op"] = batch.ops[i];
+
+        if (batch.doseIndex[i] < 0) {
+            result["status"] = committed ? "applied" : "failed";
+            continue;
+        }
+
+        if (!committed) {
+            result["status"] = "skipped";
+            allSucceeded = false;
+            continue;
+        }
+
+        DoseJob& job = batch.doses[batch.doseIndex[i]];
+        job.requestedAt = millis();
+        job.onComplete = onAdhocDoseComplete;
+        job.context = this;
+
+        DoseSubmitResult submitResult = doseWorkerPool->submit(job);
+        if (submitResult == DoseSubmitResult::ACCEPTED) {
+            result["status"] = "queued";
+        } else {
+            result["status"] = "rejected";
+            result["error"] = (submitResult == DoseSubmitResult::QUEUE_FULL)
+                ? "Dose queue full for head " + String(job.head)
+                : String("Dose worker pool not running");
+            allSucceeded = false;
+        }
+    }
+
+    response["success"] = allSucceeded;
+    response["committed"] = committed;
+    if (!committed) {
+        response["error"] = "Failed to save configuration changes";
     }
 
-    sendJsonResponse(request, success ? 200 : 500, doc);
+    // Everything the response needs has been copied out of batch
+    batchPending.store(false);
+    return committed ? 200 : 500;
 }
 
-bool WebServer::validateScheduleRequest(const JsonDocument& doc, Schedule& sched, String& error) {
+bool WebServer::stageBatchOperation(JsonVariantConst op, ConfigTransaction& transaction,
+                                    DoseJob* doses, uint8_t& doseCount, String& error) {
+    const char* type = op["op"];
+    if (type == nullptr) {
+        error = "Missing required field: op";
+        return false;
+    }
+
+    if (strcmp(type, "setSchedule") == 0) {
+        Schedule sched;
+        if (!validateScheduleRequest(op, sched, error)) {
+            return false;
+        }
+
+        uint32_t now = millis() / 1000;
+        sched.createdAt = now;
+        sched.updatedAt = now;
+
+        return transaction.setSchedule(sched);
+    }
+
+    if (strcmp(type, "deleteSchedule") == 0) {
+        if (!op["head"].is<uint8_t>() || op["head"].as<uint8_t>() >= NUM_SCHEDULE_HEADS) {
+            error = "Invalid head index (must be 0-" + String(NUM_SCHEDULE_HEADS - 1) + ")";
+            return false;
+        }
+
+        return transaction.deleteSchedule(op["head"].as<uint8_t>());
+    }
+
+    if (strcmp(type, "calibrate") == 0) {
+        uint8_t head;
+        CalibrationUpdate update;
+        bool computed;
+
+        if (op["points"].is<JsonArrayConst>()) {
+            CalibrationPoint points[MAX_CALIBRATION_POINTS];
+            uint8_t count;
+
+            if (!validateCalibrationPointsRequest(op, head, points, count, error)) {
+                return false;
+            }
+            computed = dosingHeads[head]->computeCalibration(points, count, update);
+        } else {
+            float actualVolume;
+
+            if (!validateCalibrationRequest(op, head, actualVolume, error)) {
+                return false;
+            }
+            computed = dosingHeads[head]->computeCalibration(actualVolume, update);
+        }
+
+        if (!computed) {
+            error = "Calibration result out of range";
+            return false;
+        }
+
+        return transaction.setCalibration(head, update);
+    }
+
+    if (strcmp(type, "dose") == 0) {
+        uint8_t head;
+        float volume;
+
+        if (!validateDosingRequest(op, head, volume, error)) {
+            return false;
+        }
+
+        if (doseWorkerPool == nullptr || !doseWorkerPool->isRunning()) {
+            error = "Dose worker pool not available";
+            return false;
+        }
+
+        DoseJob job = {};
+        job.head = head;
+        job.volume = volume;
+        job.source = DoseSource::ADHOC;
+        doses[doseCount++] = job;
+        return true;
+    }
+
+    error = "Unknown op: " + String(type) + " (expected setSchedule, deleteSchedule, calibrate or dose)";
+    return false;
+}
+
+bool WebServer::validateScheduleRequest(JsonVariantConst doc, Schedule& sched, String& error) {
     // Validate required fields
     if (!doc["head"].is<uint8_t>()) {
         error = "Missing required field: head";
@@ -765,11 +1514,19 @@ bool WebServer::validateScheduleRequest(const JsonDocument& doc, Schedule& sched
 }
 
 void WebServer::handleGetDashboard(AsyncWebServerRequest* request) {
+    JsonArenaScope arenaScope(requestArena);
+
     if (logManager == nullptr || scheduleManager == nullptr) {
         sendErrorResponse(request, 503, "Dosing log manager not available");
         return;
     }
 
+    StorageJob job = {};
+    job.operation = StorageOperation::DASHBOARD;
+    submitStorageJob(request, job);
+}
+
+int WebServer::executeGetDashboard(JsonObject response) {
     // Get current time
     time_t now;
     time(&now);
@@ -777,8 +1534,7 @@ void WebServer::handleGetDashboard(AsyncWebServerRequest* request) {
 
     // Check if we have valid time
     if (currentTime < 946684800) {  // Before year 2000
-        sendErrorResponse(request, 503, "Time not synchronized - NTP required");
-        return;
+        return errorResult(response, 503, "Time not synchronized - NTP required");
     }
 
     // Get all schedules
@@ -799,8 +1555,7 @@ void WebServer::handleGetDashboard(AsyncWebServerRequest* request) {
     uint8_t count = logManager->getAllDailySummaries(currentTime, schedules, summaries);
 
     // Build JSON response
-    JsonDocument doc;
-    JsonArray headsArray = doc["heads"].to<JsonArray>();
+    JsonArray headsArray = response["heads"].to<JsonArray>();
 
     for (uint8_t i = 0; i < count; i++) {
         JsonObject headObj = headsArray.add<JsonObject>();
@@ -814,57 +1569,80 @@ void WebServer::handleGetDashboard(AsyncWebServerRequest* request) {
         headObj["percentComplete"] = summaries[i].getPercentComplete();
     }
 
-    doc["timestamp"] = currentTime;
-    doc["count"] = count;
+    response["timestamp"] = currentTime;
+    response["count"] = count;
 
-    sendJsonResponse(request, 200, doc);
+    return 200;
 }
 
 void WebServer::handleGetHourlyLogs(AsyncWebServerRequest* request) {
-    if (logManager == nullptr) {
-        sendErrorResponse(request, 503, "Dosing log manager not available");
-        return;
+    JsonArenaScope arenaScope(requestArena);
+
+    // Query parameters; 0 means not provided
+    uint32_t hours = request->hasParam("hours") ? request->getParam("hours")->value().toInt() : 0;
+    uint32_t start = request->hasParam("start") ? request->getParam("start")->value().toInt() : 0;
+    uint32_t end = request->hasParam("end") ? request->getParam("end")->value().toInt() : 0;
+
+    // The ETag covers the log version and the resolved range, so polling the
+    // same window answers 304 without reading NVS
+    char etag[WEB_ETAG_SIZE];
+    uint32_t startTime;
+    uint32_t endTime;
+    bool cacheable = logManager != nullptr && resolveLogRange(hours, start, end, startTime, endTime);
+    if (cacheable) {
+        formatETag(etag, "logs", logManager->getVersion(), startTime, endTime);
+        if (sendIfNotModified(request, etag)) {
+            return;
+        }
     }
 
-    // Get current time
+    // Only the query itself runs on the storage worker
+    StorageJob job = {};
+    job.operation = StorageOperation::HOURLY_LOGS;
+    job.hours = hours;
+    job.start = start;
+    job.end = end;
+    submitStorageJob(request, job);
+}
+
+bool WebServer::resolveLogRange(uint32_t hours, uint32_t start, uint32_t end, uint32_t& startTime, uint32_t& endTime) {
     time_t now;
     time(&now);
     uint32_t currentTime = static_cast<uint32_t>(now);
 
     // Check if we have valid time
     if (currentTime < 946684800) {  // Before year 2000
-        sendErrorResponse(request, 503, "Time not synchronized - NTP required");
-        return;
+        return false;
     }
 
-    // Parse query parameters
-    uint32_t hours = 24;  // Default: last 24 hours
-    if (request->hasParam("hours")) {
-        hours = request->getParam("hours")->value().toInt();
-        if (hours == 0 || hours > 336) {  // Max 14 days (336 hours)
-            hours = 24;
-        }
+    if (hours == 0 || hours > 336) {  // Default 24 hours, max 14 days (336 hours)
+        hours = 24;
     }
 
-    // Calculate time range
-    uint32_t startTime = currentTime - (hours * 3600);
-    uint32_t endTime = currentTime;
+    // Relative range: same hour buckets as [now - hours, now], aligned to the
+    // hour so the bounds stay fixed until the next hour starts
+    uint32_t currentHour = currentTime - (currentTime % 3600);
+    startTime = (start != 0) ? start : currentHour - (hours * 3600);
+    endTime = (end != 0) ? end : currentHour + 3599;
+    return true;
+}
 
-    // Override with explicit start/end if provided
-    if (request->hasParam("start")) {
-        startTime = request->getParam("start")->value().toInt();
+int WebServer::executeGetHourlyLogs(uint32_t hours, uint32_t start, uint32_t end, JsonObject response) {
+    if (logManager == nullptr) {
+        return errorResult(response, 503, "Dosing log manager not available");
     }
-    if (request->hasParam("end")) {
-        endTime = request->getParam("end")->value().toInt();
+
+    uint32_t startTime;
+    uint32_t endTime;
+    if (!resolveLogRange(hours, start, end, startTime, endTime)) {
+        return errorResult(response, 503, "Time not synchronized - NTP required");
     }
 
     // Get hourly logs
     HourlyDoseLog logs[336];  // Max 14 days × 24 hours
     uint16_t count = logManager->getHourlyLogs(startTime, endTime, logs, 336);
 
-    // Build JSON response
-    JsonDocument doc;
-    JsonArray logsArray = doc["logs"].to<JsonArray>();
+    JsonArray logsArray = response["logs"].to<JsonArray>();
 
     for (uint16_t i = 0; i < count; i++) {
         JsonObject logObj = logsArray.add<JsonObject>();
@@ -875,41 +1653,213 @@ void WebServer::handleGetHourlyLogs(AsyncWebServerRequest* request) {
         logObj["totalVolume"] = logs[i].getTotalVolume();
     }
 
-    doc["count"] = count;
-    doc["startTime"] = startTime;
-    doc["endTime"] = endTime;
+    response["count"] = count;
+    response["startTime"] = startTime;
+    response["endTime"] = endTime;
 
-    sendJsonResponse(request, 200, doc);
+    return 200;
+}
+
+int WebServer::executeSubscribe(uint32_t clientId, JsonVariantConst params, JsonObject response) {
+    if (!params["topics"].is<JsonArrayConst>()) {
+        return errorResult(response, 400, "Missing required field: topics");
+    }
+
+    uint8_t topics = 0;
+    for (JsonVariantConst name : params["topics"].as<JsonArrayConst>()) {
+        uint8_t topic = WebSocketSessions::parseTopic(name.as<const char*>());
+        if (topic == 0) {
+            return errorResult(response, 400, "Unknown topic (expected doses, motors, config, wifi or logs)");
+        }
+        topics |= topic;
+    }
+
+    if (!wsSessions.setTopics(clientId, topics)) {
+        return errorResult(response, 404, "No session for this connection");
+    }
+
+    // A snapshot of the subscribed topics follows on the next telemetry cycle
+    response["success"] = true;
+    JsonArray subscribed = response["topics"].to<JsonArray>();
+    for (uint8_t topic = WS_TOPIC_DOSES; topic <= WS_TOPIC_LOGS; topic <<= 1) {
+        if ((topics & topic) != 0) {
+            subscribed.add(WebSocketSessions::topicName(topic));
+        }
+    }
+
+    return 200;
 }
 
 void WebServer::handleDeleteLogs(AsyncWebServerRequest* request) {
+    JsonArenaScope arenaScope(requestArena);
+
     if (logManager == nullptr) {
         sendErrorResponse(request, 503, "Dosing log manager not available");
         return;
     }
 
+    StorageJob job = {};
+    job.operation = StorageOperation::DELETE_LOGS;
+    submitStorageJob(request, job);
+}
+
+int WebServer::executeDeleteLogs(JsonObject response) {
     // Clear all logs
     bool success = logManager->clearAll();
 
-    JsonDocument doc;
-    doc["success"] = success;
+    response["success"] = success;
 
     if (success) {
-        doc["message"] = "All dosing logs cleared successfully";
-        Serial.println("[WebServer] All dosing logs cleared");
+        response["message"] = "All dosing logs cleared successfully";
+        LOG_INFO("All dosing logs cleared");
     } else {
-        doc["error"] = "Failed to clear dosing logs";
-        Serial.println("[WebServer] Failed to clear dosing logs");
+        response["error"] = "Failed to clear dosing logs";
+        LOG_ERROR("Failed to clear dosing logs");
+    }
+
+    return success ? 200 : 500;
+}
+
+void WebServer::submitStorageJob(AsyncWebServerRequest* request, StorageJob& job) {
+    if (!storageWorker.submit(job, request)) {
+        sendErrorResponse(request, 503, "Storage busy, retry later");
+    }
+}
+
+void WebServer::onStorageJob(const StorageJob& job, void* context) {
+    static_cast<WebServer*>(context)->runStorageJob(job);
+}
+
+void WebServer::runStorageJob(const StorageJob& job) {
+    JsonArenaScope arenaScope(storageArena);
+    JsonDocument doc(&storageArena);
+
+    // WebSocket replies wrap the result in the RPC envelope
+    bool rpc = job.slot == STORAGE_NO_SLOT;
+    JsonObject response;
+    if (rpc) {
+        doc["type"] = "response";
+        doc["id"] = serialized(job.rpcId);
+        response = doc["result"].to<JsonObject>();
+    } else {
+        response = doc.to<JsonObject>();
+    }
+
+    char etag[WEB_ETAG_SIZE];
+    bool cacheable = false;
+    int code = 500;
+
+    switch (job.operation) {
+        case StorageOperation::DASHBOARD:
+            code = executeGetDashboard(response);
+            break;
+
+        case StorageOperation::HOURLY_LOGS: {
+            // Version read before the logs, so the ETag is never newer than the body
+            uint32_t startTime;
+            uint32_t endTime;
+            if (!rpc && logManager != nullptr && resolveLogRange(job.hours, job.start, job.end, startTime, endTime)) {
+                formatETag(etag, "logs", logManager->getVersion(), startTime, endTime);
+                cacheable = true;
+            }
+            code = executeGetHourlyLogs(job.hours, job.start, job.end, response);
+            break;
+        }
+
+        case StorageOperation::DELETE_LOGS:
+            code = executeDeleteLogs(response);
+            break;
+
+        case StorageOperation::SET_SCHEDULE: {
+            Schedule sched = job.schedule;
+            code = executeSaveSchedule(sched, response);
+            break;
+        }
+
+        case StorageOperation::DELETE_SCHEDULE:
+            code = executeDeleteSchedule(job.schedule.head, response);
+            break;
+
+        case StorageOperation::BATCH:
+            code = executeBatch(response);
+            break;
+    }
+
+    if (rpc) {
+        doc["status"] = code;
+        sendWebSocket(job.clientId, doc);
+        return;
     }
 
-    sendJsonResponse(request, success ? 200 : 500, doc);
+    // Serialized here; AsyncTCP sends it (or drops it if the client has gone)
+    storageWorker.complete(job, code, doc, cacheable ? etag : nullptr);
+}
+
+void WebServer::handleGetMetrics(AsyncWebServerRequest* request) {
+    // Plain text straight into the response stream; no JSON document involved
+    AsyncResponseStream* response = request->beginResponseStream("text/plain; version=0.0.4", 4096);
+
+    Metrics::write(*response);
+    router.writeMetrics(*response);
+
+    Metrics::writeMetric(*response, "squaredose_ws_clients", "gauge", "Connected WebSocket clients",
+                         static_cast<uint32_t>(wsSessions.getClientCount()));
+    Metrics::writeMetric(*response, "squaredose_ws_dropped_total", "counter",
+                         "Event messages dropped for full client queues", wsSessions.getDroppedCount());
+    Metrics::writeMetric(*response, "squaredose_ws_evicted_total", "counter",
+                         "Clients closed because a critical event found their queue full",
+                         wsSessions.getEvictedCount());
+    Metrics::writeMetric(*response, "squaredose_ws_coalesced_total", "counter",
+                         "State diffs replaced by a resync snapshot", wsSessions.getCoalescedCount());
+    Metrics::writeMetric(*response, "squaredose_ws_timeouts_total", "counter",
+                         "Clients closed for not answering pings", wsSessions.getTimeoutCount());
+    Metrics::writeMetric(*response, "squaredose_ws_messages_sent_total", "counter",
+                         "Telemetry snapshots and state diffs published", telemetry.getMessagesSent());
+
+    WiFiStatus wifi;
+    wifiManager->getStatus(wifi);
+    bool stationConnected = wifi.mode == WIFIMANAGER_MODE_STA && wifi.connected;
+    Metrics::writeMetric(*response, "squaredose_wifi_connected", "gauge", "1 if connected as a station",
+                         static_cast<uint32_t>(stationConnected ? 1 : 0));
+    Metrics::writeMetric(*response, "squaredose_wifi_ap_active", "gauge", "1 while the provisioning AP is up",
+                         static_cast<uint32_t>(wifi.apActive ? 1 : 0));
+    if (stationConnected) {
+        Metrics::writeMetric(*response, "squaredose_wifi_rssi_dbm", "gauge", "Station signal strength",
+                             static_cast<int32_t>(WiFi.RSSI()));
+    }
+
+    Metrics::writeMetric(*response, "squaredose_response_cache_hits_total", "counter",
+                         "Cached response bodies served without a rebuild",
+                         statusCache.getHits() + calibrationCache.getHits() + schedulesCache.getHits());
+    Metrics::writeMetric(*response, "squaredose_response_cache_misses_total", "counter",
+                         "Cached response bodies rebuilt",
+                         statusCache.getMisses() + calibrationCache.getMisses() + schedulesCache.getMisses());
+
+    Metrics::writeMetric(*response, "squaredose_mdns_txt_updates_total", "counter",
+                         "Status hash changes announced over mDNS", mdns.getTxtUpdates());
+
+    Metrics::writeMetric(*response, "squaredose_storage_jobs_total", "counter",
+                         "NVS-backed requests run on the storage worker", storageWorker.getCompletedCount());
+    Metrics::writeMetric(*response, "squaredose_storage_rejected_total", "counter",
+                         "NVS-backed requests refused with 503 (worker queue full)", storageWorker.getRejectedCount());
+    Metrics::writeMetric(*response, "squaredose_storage_abandoned_total", "counter",
+                         "Storage worker responses dropped because the client had disconnected",
+                         storageWorker.getAbandonedCount());
+    Metrics::writeMetric(*response, "squaredose_storage_queue_depth", "gauge",
+                         "Requests waiting for the storage worker",
+                         static_cast<uint32_t>(storageWorker.getQueueDepth()));
+
+    response->addHeader("Cache-Control", WEB_CACHE_CONTROL_DYNAMIC);
+    request->send(response);
 }
 
 void WebServer::handleGetTime(AsyncWebServerRequest* request) {
+    JsonArenaScope arenaScope(requestArena);
+
     time_t now;
     time(&now);
 
-    JsonDocument doc;
+    JsonDocument doc(&requestArena);
     doc["timestamp"] = (uint32_t)now;
     doc["synced"] = (now >= 1577836800);  // After Jan 1, 2020
     doc["source"] = (now >= 1577836800) ? "NTP or Manual" : "Unsynced";
@@ -918,12 +1868,11 @@ void WebServer::handleGetTime(AsyncWebServerRequest* request) {
 }
 
 void WebServer::handlePostTime(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-    // Parse JSON from request body
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, data, len);
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
 
-    if (error) {
-        sendErrorResponse(request, 400, "Invalid JSON: " + String(error.c_str()));
+    // Parse JSON from request body (returns true once, when the whole body has arrived and parsed)
+    if (!parseJsonBody(request, data, len, index, total, doc)) {
         return;
     }
 
@@ -947,10 +1896,10 @@ void WebServer::handlePostTime(AsyncWebServerRequest* request, uint8_t* data, si
     tv.tv_usec = 0;
     settimeofday(&tv, nullptr);
 
-    Serial.printf("[WebServer] Manual time sync: %lu\n", timestamp);
+    LOG_INFO("Manual time sync: %lu", timestamp);
 
     // Return success
-    JsonDocument responseDoc;
+    JsonDocument responseDoc(&requestArena);
     responseDoc["success"] = true;
     responseDoc["timestamp"] = timestamp;
     responseDoc["message"] = "Time synchronized successfully";
@@ -958,6 +1907,61 @@ void WebServer::handlePostTime(AsyncWebServerRequest* request, uint8_t* data, si
     sendJsonResponse(request, 200, responseDoc);
 }
 
+void WebServer::handleGetPower(AsyncWebServerRequest* request) {
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
+
+    doc["profile"] = PowerManager::getProfileName(PowerManager::getProfile());
+    doc["powerManagement"] = PowerManager::isPowerManagementEnabled();
+
+    JsonArray profiles = doc["profiles"].to<JsonArray>();
+    for (uint8_t i = 0; i < static_cast<uint8_t>(PowerProfile::COUNT); i++) {
+        PowerProfile profile = static_cast<PowerProfile>(i);
+        const PowerProfileSettings& settings = PowerManager::getSettings(profile);
+
+        JsonObject entry = profiles.add<JsonObject>();
+        entry["name"] = settings.name;
+        entry["modemSleep"] = (settings.powerSave == WIFI_PS_NONE) ? "off" : (settings.powerSave == WIFI_PS_MIN_MODEM) ? "min" : "max";
+        entry["listenInterval"] = settings.listenInterval;
+        entry["minCpuMhz"] = settings.minMhz;
+        entry["maxCpuMhz"] = settings.maxMhz;
+        entry["lightSleep"] = settings.lightSleep;
+        entry["estimatedCurrentMa"] = PowerManager::getEstimatedCurrentMa(profile);
+        entry["avgHandlerUs"] = PowerManager::getAverageHandlerUs(profile);
+    }
+
+    sendJsonResponse(request, 200, doc);
+}
+
+void WebServer::handlePostPower(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    JsonArenaScope arenaScope(requestArena);
+    JsonDocument doc(&requestArena);
+
+    // Returns true once, when the whole body has arrived and parsed
+    if (!parseJsonBody(request, data, len, index, total, doc)) {
+        return;
+    }
+
+    PowerProfile profile;
+    if (!PowerManager::parseProfile(doc["profile"].as<const char*>(), profile)) {
+        sendErrorResponse(request, 400, "Invalid profile: must be performance, balanced or low-power");
+        return;
+    }
+
+    // Queues the NVS write only, so this runs on the AsyncTCP task
+    if (!PowerManager::setProfile(profile)) {
+        sendErrorResponse(request, 500, "Failed to save power profile");
+        return;
+    }
+
+    JsonDocument responseDoc(&requestArena);
+    responseDoc["success"] = true;
+    responseDoc["profile"] = PowerManager::getProfileName(profile);
+    responseDoc["powerManagement"] = PowerManager::isPowerManagementEnabled();
+
+    sendJsonResponse(request, 200, responseDoc);
+}
+
 void WebServer::onWebSocketEventStatic(AsyncWebSocket* server, AsyncWebSocketClient* client,
                                       AwsEventType type, void* arg, uint8_t* data, size_t len) {
     if (serverInstance) {
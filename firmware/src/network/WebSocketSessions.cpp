@@ -0,0 +1,328 @@
+#include "network/WebSocketSessions.h"
+#include "diagnostics/Log.h"
+
+LOG_MODULE("WebSocketSessions", LOG_LEVEL_WEBSOCKET);
+
+static const char* const TOPIC_NAMES[] = {"doses", "motors", "config", "wifi", "logs"};
+static const uint8_t TOPIC_COUNT = sizeof(TOPIC_NAMES) / sizeof(TOPIC_NAMES[0]);
+
+WebSocketSessions::WebSocketSessions()
+    : ws(nullptr), mutex(nullptr), lastMaintenanceMs(0), droppedCount(0), coalescedCount(0), evictedCount(0),
+      timeoutCount(0) {
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        sessions[i] = {};
+    }
+}
+
+WebSocketSessions::~WebSocketSessions() {
+    if (mutex != nullptr) {
+        vSemaphoreDelete(mutex);
+    }
+}
+
+bool WebSocketSessions::begin(AsyncWebSocket* socket) {
+    if (socket == nullptr) {
+        return false;
+    }
+
+    ws = socket;
+
+    if (mutex == nullptr) {
+        mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+        if (mutex == nullptr) {
+            LOG_ERROR("CRITICAL: Failed to create mutex!");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool WebSocketSessions::onConnect(AsyncWebSocketClient* client) {
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+
+    Session* slot = nullptr;
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (!sessions[i].active) {
+            slot = &sessions[i];
+            break;
+        }
+    }
+
+    if (slot != nullptr) {
+        uint32_t now = millis();
+        slot->active = true;
+        slot->clientId = client->id();
+        slot->topics = WS_TOPIC_ALL;
+        slot->needsResync = true;
+        slot->lastSeenMs = now;
+        slot->lastPingMs = now;
+    }
+
+    xSemaphoreGive(mutex);
+
+    if (slot == nullptr) {
+        LOG_WARN("Rejecting client #%u - %d clients connected", client->id(), WS_MAX_CLIENTS);
+        client->close(1013, "Too many clients");  // 1013 = Try Again Later
+        return false;
+    }
+
+    return true;
+}
+
+void WebSocketSessions::onDisconnect(uint32_t clientId) {
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    Session* session = findSession(clientId);
+    if (session != nullptr) {
+        session->active = false;
+    }
+
+    xSemaphoreGive(mutex);
+}
+
+void WebSocketSessions::onActivity(uint32_t clientId) {
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    Session* session = findSession(clientId);
+    if (session != nullptr) {
+        session->lastSeenMs = millis();
+    }
+
+    xSemaphoreGive(mutex);
+}
+
+bool WebSocketSessions::setTopics(uint32_t clientId, uint8_t topics) {
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+
+    Session* session = findSession(clientId);
+    if (session != nullptr) {
+        session->topics = topics & WS_TOPIC_ALL;
+        session->needsResync = true;  // Current state of any newly added topics
+    }
+
+    xSemaphoreGive(mutex);
+    return session != nullptr;
+}
+
+uint8_t WebSocketSessions::publish(uint8_t topic, AsyncWebSocketMessageBuffer* buffer, WsSendPolicy policy) {
+    if (buffer == nullptr || mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE) {
+        return 0;
+    }
+
+    uint8_t delivered = 0;
+
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        Session& session = sessions[i];
+        if (!session.active || (policy != WsSendPolicy::CRITICAL && (session.topics & topic) == 0)) {
+            continue;
+        }
+
+        // A pending snapshot already covers any diff
+        if (policy == WsSendPolicy::COALESCE && session.needsResync) {
+            continue;
+        }
+
+        bool full;
+        AsyncWebSocketClient* client = sendableClient(session, full);
+        if (client == nullptr) {
+            if (full && policy == WsSendPolicy::CRITICAL) {
+                // Must not be missed: the client reconnects and gets a fresh snapshot
+                LOG_WARN("Client #%u queue full for a critical message - closing", session.clientId);
+                ws->client(session.clientId)->close();
+                session.active = false;
+                evictedCount.fetch_add(1);
+            } else if (full && policy == WsSendPolicy::COALESCE) {
+                session.needsResync = true;
+                coalescedCount.fetch_add(1);
+            } else if (full) {
+                droppedCount.fetch_add(1);
+            }
+            continue;
+        }
+
+        // The buffer is reference counted, so all clients share one copy
+        client->text(buffer);
+        delivered++;
+    }
+
+    xSemaphoreGive(mutex);
+    return delivered;
+}
+
+bool WebSocketSessions::hasSubscribers(uint8_t topic) {
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+
+    bool found = false;
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS && !found; i++) {
+        found = sessions[i].active && (sessions[i].topics & topic) != 0;
+    }
+
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+bool WebSocketSessions::takeResync(uint32_t& clientId, uint8_t& topics) {
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+
+    bool found = false;
+
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        Session& session = sessions[i];
+        if (!session.active || !session.needsResync) {
+            continue;
+        }
+
+        // Wait for a slow client's queue to drain rather than adding to it
+        bool full;
+        if (sendableClient(session, full) == nullptr) {
+            continue;
+        }
+
+        session.needsResync = false;
+        clientId = session.clientId;
+        topics = session.topics;
+        found = true;
+        break;
+    }
+
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+void WebSocketSessions::maintain() {
+    uint32_t now = millis();
+    if (ws == nullptr || now - lastMaintenanceMs < WS_MAINTENANCE_INTERVAL_MS) {
+        return;
+    }
+    lastMaintenanceMs = now;
+
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        Session& session = sessions[i];
+        if (!session.active) {
+            continue;
+        }
+
+        AsyncWebSocketClient* client = ws->client(session.clientId);
+        if (client == nullptr || client->status() != WS_CONNECTED) {
+            session.active = false;
+            continue;
+        }
+
+        if (now - session.lastSeenMs > WS_CLIENT_TIMEOUT_MS) {
+            LOG_WARN("Client #%u unresponsive for %lu ms - closing", session.clientId, now - session.lastSeenMs);
+            client->close();
+            session.active = false;
+            timeoutCount.fetch_add(1);
+            continue;
+        }
+
+        // Ping only clients that have been quiet; any pong or data counts as alive
+        if (now - session.lastSeenMs >= WS_PING_INTERVAL_MS && now - session.lastPingMs >= WS_PING_INTERVAL_MS) {
+            client->ping();
+            session.lastPingMs = now;
+        }
+    }
+
+    xSemaphoreGive(mutex);
+
+    // Free clients that have disconnected (and close the oldest beyond the limit)
+    ws->cleanupClients(WS_MAX_CLIENTS);
+}
+
+uint8_t WebSocketSessions::getClientCount() {
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE) {
+        return 0;
+    }
+
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (sessions[i].active) {
+            count++;
+        }
+    }
+
+    xSemaphoreGive(mutex);
+    return count;
+}
+
+uint32_t WebSocketSessions::getDroppedCount() const {
+    return droppedCount.load();
+}
+
+uint32_t WebSocketSessions::getEvictedCount() const {
+    return evictedCount.load();
+}
+
+uint32_t WebSocketSessions::getCoalescedCount() const {
+    return coalescedCount.load();
+}
+
+uint32_t WebSocketSessions::getTimeoutCount() const {
+    return timeoutCount.load();
+}
+
+uint8_t WebSocketSessions::parseTopic(const char* name) {
+    if (name == nullptr) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < TOPIC_COUNT; i++) {
+        if (strcmp(name, TOPIC_NAMES[i]) == 0) {
+            return 1 << i;
+        }
+    }
+
+    return 0;
+}
+
+const char* WebSocketSessions::topicName(uint8_t topic) {
+    for (uint8_t i = 0; i < TOPIC_COUNT; i++) {
+        if (topic == (1 << i)) {
+            return TOPIC_NAMES[i];
+        }
+    }
+
+    return nullptr;
+}
+
+WebSocketSessions::Session* WebSocketSessions::findSession(uint32_t clientId) {
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (sessions[i].active && sessions[i].clientId == clientId) {
+            return &sessions[i];
+        }
+    }
+    return nullptr;
+}
+
+AsyncWebSocketClient* WebSocketSessions::sendableClient(const Session& session, bool& full) {
+    full = false;
+
+    AsyncWebSocketClient* client = ws->client(session.clientId);
+    if (client == nullptr || client->status() != WS_CONNECTED) {
+        return nullptr;
+    }
+
+    if (client->queueIsFull()) {
+        full = true;
+        return nullptr;
+    }
+
+    return client;
+}
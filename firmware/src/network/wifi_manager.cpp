@@ -1,14 +1,27 @@
 #include "network/wifi_manager.h"
+#include "diagnostics/Metrics.h"
+#include "diagnostics/Log.h"
+#include "storage/FlashWriter.h"
+#include "hal/PowerManager.h"
+
+LOG_MODULE("WiFiManager", LOG_LEVEL_WIFI_MANAGER);
 
 WiFiManager wifiManager;
 
 WiFiManager::WiFiManager() : stateMutex(nullptr), credentialsLoaded(false),
-                              currentMode(WIFIMANAGER_MODE_AP),
-                              staFailedTime(0), lastSTAAttemptTime(0) {
+                              linkState(LINK_AP), joinStartTime(0), connectedTime(0), attemptStartTime(0),
+                              staFailedTime(0), resumeState(LINK_CONNECTING), backoffStartTime(0), backoffMs(0),
+                              failedAttempts(0), linkCacheValid(false), cachedAttempt(false), skipCache(false),
+                              staticIPApplied(false), reachable(false), apActive(false), lastSTAAttemptTime(0), lastCheckTime(0),
+                              requestPending(false), pendingRequest(EVENT_REQUEST_AP), requestTime(0),
+                              eventQueue(nullptr), publishCount(0) {
+    memset(&linkCache, 0, sizeof(linkCache));
+    memset(snapshots, 0, sizeof(snapshots));
+    snapshots[0].mode = WIFIMANAGER_MODE_AP;
+    strcpy(snapshots[0].ipAddress, "No IP");
 }
 
 WiFiManager::~WiFiManager() {
-    preferences.end();
     if (stateMutex != nullptr) {
         vSemaphoreDelete(stateMutex);
     }
@@ -17,33 +30,55 @@ WiFiManager::~WiFiManager() {
 void WiFiManager::initMutex() {
     stateMutex = xSemaphoreCreateMutex();
     if (stateMutex == nullptr) {
-        Serial.println("[WiFiManager] CRITICAL: Failed to create mutex!");
+        LOG_ERROR("CRITICAL: Failed to create mutex!");
     }
 }
 
 bool WiFiManager::begin() {
     generateAPSSID();
 
-    loadCredentialsFromNVS();
+    if (eventQueue == nullptr) {
+        eventQueue = xQueueCreateStatic(WIFI_EVENT_QUEUE_DEPTH, sizeof(LinkEvent), eventQueueStorage,
+                                        &eventQueueBuffer);
+        if (eventQueue == nullptr) {
+            LOG_ERROR("Failed to create event queue");
+            return false;
+        }
+    }
+
+    if (xSemaphoreTake(stateMutex, portMAX_DELAY) == pdTRUE) {
+        loadCredentialsFromNVS();
+        xSemaphoreGive(stateMutex);
+    }
+    loadLinkCache();
+
+    // Reconnects are paced by the state machine, not the driver
+    WiFi.setAutoReconnect(false);
+    WiFi.onEvent(onWiFiEvent);
 
-    if (credentialsLoaded) {
-        Serial.println("[WiFiManager] Credentials found in NVS, attempting STA mode...");
-        if (switchToSTAMode()) {
-            Serial.println("[WiFiManager] Started in STA mode");
-            return true;
+    if (startJoin()) {
+        LOG_INFO("Credentials found in NVS, attempting STA mode...");
+
+        // The keep-alive task is not running yet: drive the state machine
+        // here so setup() continues with a settled mode
+        while (linkState == LINK_CONNECTING || (linkState == LINK_BACKOFF && resumeState == LINK_CONNECTING)) {
+            step();
         }
-        Serial.println("[WiFiManager] STA mode failed, falling back to AP mode");
-    } else {
-        Serial.println("[WiFiManager] No credentials found, starting in AP mode");
+
+        if (linkState == LINK_CONNECTED) {
+            LOG_INFO("Started in STA mode");
+        }
+        return true;
     }
 
-    switchToAPMode();
+    LOG_INFO("No credentials found, starting in AP mode");
+    enterAPMode();
     return true;
 }
 
 bool WiFiManager::setCredentials(const char* ssid, const char* password) {
     if (ssid == nullptr || password == nullptr) {
-        Serial.println("[WiFiManager] Invalid credentials");
+        LOG_WARN("Invalid credentials");
         return false;
     }
 
@@ -51,7 +86,7 @@ bool WiFiManager::setCredentials(const char* ssid, const char* password) {
     if (xSemaphoreTake(stateMutex, portMAX_DELAY) == pdTRUE) {
         if (!saveCredentialsToNVS(ssid, password)) {
             xSemaphoreGive(stateMutex);
-            Serial.println("[WiFiManager] Failed to save credentials to NVS");
+            LOG_ERROR("Failed to save credentials to NVS");
             return false;
         }
 
@@ -60,11 +95,11 @@ bool WiFiManager::setCredentials(const char* ssid, const char* password) {
         credentialsLoaded = true;
 
         xSemaphoreGive(stateMutex);
-        Serial.println("[WiFiManager] Credentials updated successfully");
+        LOG_INFO("Credentials updated successfully");
         return true;
     }
 
-    Serial.println("[WiFiManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return false;
 }
 
@@ -91,7 +126,7 @@ bool WiFiManager::clearCredentials() {
     if (xSemaphoreTake(stateMutex, portMAX_DELAY) == pdTRUE) {
         if (!clearCredentialsFromNVS()) {
             xSemaphoreGive(stateMutex);
-            Serial.println("[WiFiManager] Failed to clear credentials from NVS");
+            LOG_ERROR("Failed to clear credentials from NVS");
             return false;
         }
 
@@ -100,221 +135,530 @@ bool WiFiManager::clearCredentials() {
         credentialsLoaded = false;
 
         xSemaphoreGive(stateMutex);
-        Serial.println("[WiFiManager] Credentials cleared successfully");
+        LOG_INFO("Credentials cleared successfully");
         return true;
     }
 
-    Serial.println("[WiFiManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return false;
 }
 
-bool WiFiManager::switchToSTAMode() {
-    // Thread-safe: Lock before mode switch
-    if (xSemaphoreTake(stateMutex, portMAX_DELAY) == pdTRUE) {
-        if (!credentialsLoaded) {
-            xSemaphoreGive(stateMutex);
-            Serial.println("[WiFiManager] Cannot switch to STA mode: no credentials");
-            return false;
-        }
+void WiFiManager::requestSTAMode() {
+    postEvent(EVENT_REQUEST_STA, 0);
+}
 
-        Serial.println("[WiFiManager] Switching to STA mode...");
-        stopCurrentMode();
+void WiFiManager::requestAPMode() {
+    postEvent(EVENT_REQUEST_AP, 0);
+}
 
-        currentMode = WIFIMANAGER_MODE_TRANSITIONING;
+void WiFiManager::getStatus(WiFiStatus& status) const {
+    for (;;) {
+        uint32_t count = publishCount.load(std::memory_order_acquire);
+        status = snapshots[count & 1];
+        std::atomic_thread_fence(std::memory_order_acquire);
 
-        if (connectToSTA()) {
-            currentMode = WIFIMANAGER_MODE_STA;
-            staFailedTime = 0;
-            xSemaphoreGive(stateMutex);
-            Serial.println("[WiFiManager] STA mode active - IP: " + WiFi.localIP().toString());
-            return true;
+        // The writer only reuses this slot after publishing the next one
+        if (publishCount.load(std::memory_order_relaxed) == count) {
+            return;
         }
+    }
+}
 
-        Serial.println("[WiFiManager] Failed to connect to STA");
-        staFailedTime = millis();
-        xSemaphoreGive(stateMutex);
+WifiManagerMode WiFiManager::getCurrentMode() const {
+    WiFiStatus status;
+    getStatus(status);
+    return status.mode;
+}
+
+bool WiFiManager::isConnected() const {
+    WiFiStatus status;
+    getStatus(status);
+    return status.connected;
+}
+
+String WiFiManager::getLocalIP() const {
+    WiFiStatus status;
+    getStatus(status);
+    return String(status.ipAddress);
+}
+
+String WiFiManager::getAPSSID() const {
+    return apSSID;
+}
+
+uint32_t WiFiManager::getStateVersion() const {
+    return publishCount.load(std::memory_order_acquire);
+}
+
+void WiFiManager::publishStatus() {
+    WiFiStatus status;
+    memset(&status, 0, sizeof(status));  // Terminates the strings; padding too, snapshots are compared with memcmp
+
+    LinkState state = (linkState == LINK_BACKOFF) ? resumeState : linkState;
+    if (state == LINK_CONNECTING && apActive) {
+        state = LINK_AP;  // Still reachable on the AP until STA has an IP
+    }
+
+    switch (state) {
+        case LINK_AP:
+            status.mode = WIFIMANAGER_MODE_AP;
+            status.connected = WiFi.softAPgetStationNum() > 0;
+            strncpy(status.ipAddress, WiFi.softAPIP().toString().c_str(), sizeof(status.ipAddress) - 1);
+            break;
+
+        case LINK_CONNECTING:
+            status.mode = WIFIMANAGER_MODE_TRANSITIONING;
+            status.connected = false;
+            strncpy(status.ipAddress, "No IP", sizeof(status.ipAddress) - 1);
+            break;
+
+        default:
+            status.mode = WIFIMANAGER_MODE_STA;
+            status.connected = linkState == LINK_CONNECTED;
+            strncpy(status.ipAddress, status.connected ? WiFi.localIP().toString().c_str() : "No IP",
+                    sizeof(status.ipAddress) - 1);
+            break;
+    }
+
+    if (state != LINK_AP) {
+        strncpy(status.ssid, connectingSSID.c_str(), sizeof(status.ssid) - 1);
+    }
+    status.apActive = apActive;
+
+    uint32_t count = publishCount.load(std::memory_order_relaxed);
+    if (memcmp(&snapshots[count & 1], &status, sizeof(WiFiStatus)) == 0) {
+        return;
+    }
+
+    snapshots[(count + 1) & 1] = status;
+    publishCount.store(count + 1, std::memory_order_release);
+}
+
+bool WiFiManager::postEvent(EventType type, uint8_t reason) {
+    if (eventQueue == nullptr) {
         return false;
     }
 
-    return false;
+    LinkEvent event = {type, reason, millis()};
+    if (xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+        // The backstop check in handleTimers() catches up on missed link changes
+        LOG_WARN("Event queue full - event %u dropped", type);
+        return false;
+    }
+    return true;
 }
 
-bool WiFiManager::switchToAPMode() {
-    // Thread-safe: Lock before mode switch
-    if (xSemaphoreTake(stateMutex, portMAX_DELAY) == pdTRUE) {
-        Serial.println("[WiFiManager] Switching to AP mode...");
-        stopCurrentMode();
+void WiFiManager::onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            wifiManager.postEvent(EVENT_STA_GOT_IP, 0);
+            break;
 
-        currentMode = WIFIMANAGER_MODE_TRANSITIONING;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+            wifiManager.postEvent(EVENT_STA_DISCONNECTED, info.wifi_sta_disconnected.reason);
+            break;
 
-        if (startAPMode()) {
-            currentMode = WIFIMANAGER_MODE_AP;
-            xSemaphoreGive(stateMutex);
-            Serial.println("[WiFiManager] AP mode active - SSID: " + apSSID + " - IP: " + WiFi.softAPIP().toString());
-            return true;
-        }
+        case ARDUINO_EVENT_WIFI_AP_STACONNECTED:
+        case ARDUINO_EVENT_WIFI_AP_STADISCONNECTED:
+            wifiManager.postEvent(EVENT_AP_CLIENTS_CHANGED, 0);
+            break;
 
-        Serial.println("[WiFiManager] Failed to start AP mode");
-        xSemaphoreGive(stateMutex);
+        default:
+            break;
+    }
+}
+
+void WiFiManager::loadLinkCache() {
+    LinkCache cache;
+    size_t read = FlashWriter::readBytes(NVS_NAMESPACE, NVS_LINK_CACHE_KEY, &cache, sizeof(LinkCache));
+
+    linkCacheValid = read == sizeof(LinkCache) && cache.version == WIFI_LINK_CACHE_VERSION &&
+                     cache.ssid[sizeof(cache.ssid) - 1] == '\0';
+    if (linkCacheValid) {
+        linkCache = cache;
+        LOG_INFO("Cached link: %s on channel %u", linkCache.ssid, linkCache.channel);
+    }
+}
+
+void WiFiManager::updateLinkCache() {
+    static_assert(sizeof(LinkCache) <= FLASH_VALUE_SIZE, "LinkCache must fit a flash queue entry");
+
+    LinkCache cache;
+    memset(&cache, 0, sizeof(LinkCache));
+    cache.version = WIFI_LINK_CACHE_VERSION;
+
+    const uint8_t* bssid = WiFi.BSSID();
+    int32_t channel = WiFi.channel();
+    if (bssid == nullptr || channel <= 0) {
+        return;
+    }
+
+    cache.channel = static_cast<uint8_t>(channel);
+    memcpy(cache.bssid, bssid, sizeof(cache.bssid));
+    cache.ip = static_cast<uint32_t>(WiFi.localIP());
+    cache.gateway = static_cast<uint32_t>(WiFi.gatewayIP());
+    cache.subnet = static_cast<uint32_t>(WiFi.subnetMask());
+    cache.dns = static_cast<uint32_t>(WiFi.dnsIP(0));
+    strncpy(cache.ssid, connectingSSID.c_str(), sizeof(cache.ssid) - 1);
+
+    // Same AP and lease as last time: nothing to write
+    if (linkCacheValid && memcmp(&cache, &linkCache, sizeof(LinkCache)) == 0) {
+        return;
+    }
+
+    linkCache = cache;
+    linkCacheValid = true;
+    FlashWriter::putBytes(NVS_NAMESPACE, NVS_LINK_CACHE_KEY, &linkCache, sizeof(LinkCache), FlashSubsystem::WIFI);
+    LOG_INFO("Cached link updated: channel %u", linkCache.channel);
+}
+
+bool WiFiManager::isAuthFailure(uint8_t reason) {
+    return reason == WIFI_REASON_AUTH_FAIL || reason == WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT ||
+           reason == WIFI_REASON_HANDSHAKE_TIMEOUT;
+}
+
+bool WiFiManager::startJoin() {
+    String ssid;
+    String password;
+    if (!getCredentials(ssid, password)) {
         return false;
     }
 
-    return false;
+    if (linkState != LINK_AP) {
+        WiFi.disconnect();  // Rejoining (e.g. new credentials): drop the old association only
+    }
+
+    if (apActive) {
+        LOG_INFO("Switching to STA mode (AP stays up until STA is stable)...");
+        WiFi.mode(WIFI_AP_STA);
+    } else {
+        LOG_INFO("Switching to STA mode...");
+        WiFi.mode(WIFI_STA);
+    }
+
+    joinStartTime = millis();
+    failedAttempts = 0;
+    skipCache = false;
+    return beginAttempt(LINK_CONNECTING);
 }
 
-WifiManagerMode WiFiManager::getCurrentMode() {
-    // Thread-safe: Lock before reading mode
-    if (xSemaphoreTake(stateMutex, portMAX_DELAY) == pdTRUE) {
-        WifiManagerMode mode = currentMode;
-        xSemaphoreGive(stateMutex);
-        return mode;
+bool WiFiManager::beginAttempt(LinkState state) {
+    String ssid;
+    String password;
+    if (!getCredentials(ssid, password)) {
+        return false;
     }
-    return WIFIMANAGER_MODE_AP; // Safe default
+
+    cachedAttempt = linkCacheValid && !skipCache && ssid == linkCache.ssid;
+
+    if (cachedAttempt) {
+#if WIFI_STATIC_IP_FROM_CACHE
+        if (linkCache.ip != 0) {
+            WiFi.config(IPAddress(linkCache.ip), IPAddress(linkCache.gateway), IPAddress(linkCache.subnet),
+                        IPAddress(linkCache.dns));
+            staticIPApplied = true;
+        }
+#endif
+        WiFi.begin(ssid.c_str(), password.c_str(), linkCache.channel, linkCache.bssid);
+        LOG_INFO("Connecting to WiFi: %s (cached BSSID, channel %u)", ssid.c_str(), linkCache.channel);
+    } else {
+        if (staticIPApplied) {
+            // Back to DHCP: the cached lease may be what failed
+            WiFi.config(IPAddress(), IPAddress(), IPAddress());
+            staticIPApplied = false;
+        }
+        WiFi.begin(ssid.c_str(), password.c_str());
+        LOG_INFO("Connecting to WiFi: %s", ssid.c_str());
+    }
+    Metrics::recordWifiConnectAttempt(cachedAttempt);
+
+    // Set after begin(): driver events from before this attempt are stale
+    attemptStartTime = millis();
+    connectingSSID = ssid;
+    linkState = state;
+    return true;
 }
 
-bool WiFiManager::isConnected() {
-    if (currentMode == WIFIMANAGER_MODE_STA) {
-        return WiFi.status() == WL_CONNECTED;
-    } else if (currentMode == WIFIMANAGER_MODE_AP) {
-        return WiFi.softAPgetStationNum() > 0;
+void WiFiManager::enterAPMode() {
+    LOG_INFO("Switching to AP mode...");
+
+    // AP first, then drop the station, so there is always one way in
+    if (!apActive) {
+        apActive = startAPMode();
     }
-    return false;
+    if (linkState != LINK_AP) {
+        WiFi.disconnect(true);  // Station off, AP stays up
+        LOG_INFO("STA mode stopped");
+    }
+
+    linkState = LINK_AP;
+    if (apActive) {
+        LOG_INFO("AP mode active - SSID: %s - IP: %s", apSSID.c_str(), WiFi.softAPIP().toString().c_str());
+        if (!reachable) {
+            reachable = true;
+            Metrics::recordWifiReachable(millis());
+        }
+    } else {
+        LOG_ERROR("Failed to start AP mode");
+    }
+
+    lastSTAAttemptTime = millis();
 }
 
-String WiFiManager::getLocalIP() {
-    if (currentMode == WIFIMANAGER_MODE_STA && WiFi.status() == WL_CONNECTED) {
-        return WiFi.localIP().toString();
-    } else if (currentMode == WIFIMANAGER_MODE_AP) {
-        return WiFi.softAPIP().toString();
+bool WiFiManager::hasGivenUp(LinkState session) const {
+    if (session == LINK_CONNECTING) {
+        return hasElapsed(joinStartTime, WIFI_STA_TIMEOUT_MS);
     }
-    return "No IP";
+    return hasElapsed(staFailedTime, WIFI_STA_FAIL_THRESHOLD_MS);
 }
 
-String WiFiManager::getAPSSID() {
-    return apSSID;
+void WiFiManager::handleGotIP() {
+    if (linkState == LINK_CONNECTING || (linkState == LINK_BACKOFF && resumeState == LINK_CONNECTING)) {
+        uint32_t durationMs = millis() - joinStartTime;
+        LOG_INFO("STA mode active - IP: %s (%lu ms)", WiFi.localIP().toString().c_str(), durationMs);
+        Metrics::recordWifiConnect(durationMs);
+    } else if (linkState == LINK_RECONNECTING || linkState == LINK_BACKOFF) {
+        uint32_t durationMs = millis() - staFailedTime;
+        LOG_INFO("Reconnected to STA in %lu ms", durationMs);
+        Metrics::recordWifiReconnect(durationMs);
+    } else {
+        return;  // Already connected (renewed lease) or in AP mode
+    }
+
+    linkState = LINK_CONNECTED;
+    connectedTime = millis();
+    failedAttempts = 0;
+    staFailedTime = 0;
+    skipCache = false;
+
+    if (!reachable) {
+        reachable = true;
+        Metrics::recordWifiReachable(millis());
+    }
+
+    updateLinkCache();
+    PowerManager::applyStationPowerSave();
 }
 
-void WiFiManager::keepAliveTask(void* parameters) {
-    for (;;) {
-        // Thread-safe: Read current mode with mutex
-        WifiManagerMode mode;
-        if (xSemaphoreTake(wifiManager.stateMutex, portMAX_DELAY) == pdTRUE) {
-            mode = wifiManager.currentMode;
-            xSemaphoreGive(wifiManager.stateMutex);
-        } else {
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            continue;
-        }
+void WiFiManager::handleLinkLost(uint8_t reason) {
+    LOG_WARN("STA connection lost (reason %u)", reason);
+    Metrics::recordWifiDisconnect(reason);
 
-        if (mode == WIFIMANAGER_MODE_STA) {
-            if (WiFi.status() == WL_CONNECTED) {
-                Serial.println("[WiFiManager] STA connected - IP: " + WiFi.localIP().toString());
+    staFailedTime = millis();
+    failedAttempts = 0;
+    skipCache = false;
+    beginAttempt(LINK_RECONNECTING);
+}
 
-                // Thread-safe: Reset fail time
-                if (xSemaphoreTake(wifiManager.stateMutex, portMAX_DELAY) == pdTRUE) {
-                    wifiManager.staFailedTime = 0;
-                    xSemaphoreGive(wifiManager.stateMutex);
-                }
+void WiFiManager::handleAttemptFailed(uint8_t reason) {
+    LinkState session = (linkState == LINK_BACKOFF) ? resumeState : linkState;
 
-                vTaskDelay(WIFI_CHECK_INTERVAL_MS / portTICK_PERIOD_MS);
-                continue;
-            }
+    if (session == LINK_CONNECTING && isAuthFailure(reason)) {
+        // Wrong password does not get better with retries
+        LOG_ERROR("STA credentials rejected (reason %u), falling back to AP mode", reason);
+        enterAPMode();
+        return;
+    }
 
-            // Connection lost - track failure time
-            unsigned long failTime;
-            if (xSemaphoreTake(wifiManager.stateMutex, portMAX_DELAY) == pdTRUE) {
-                if (wifiManager.staFailedTime == 0) {
-                    wifiManager.staFailedTime = millis();
-                    Serial.println("[WiFiManager] STA connection lost");
-                }
-                failTime = wifiManager.staFailedTime;
-                xSemaphoreGive(wifiManager.stateMutex);
-            } else {
-                vTaskDelay(1000 / portTICK_PERIOD_MS);
-                continue;
-            }
+    if (hasGivenUp(session)) {
+        LOG_ERROR("%s, falling back to AP mode",
+                  session == LINK_CONNECTING ? "Failed to connect to STA" : "STA failed for too long");
+        enterAPMode();
+        return;
+    }
 
-            // Overflow-safe: Check if failed for too long
-            if (wifiManager.hasElapsed(failTime, WIFI_STA_FAIL_THRESHOLD_MS)) {
-                Serial.println("[WiFiManager] STA failed for too long, switching to AP mode");
-                wifiManager.switchToAPMode();
+    if (cachedAttempt) {
+        // The AP may have moved channel or been replaced: scan right away
+        LOG_INFO("Cached BSSID failed (reason %u), retrying with a full scan", reason);
+        skipCache = true;
+        beginAttempt(session);
+        return;
+    }
 
-                // Thread-safe: Update last attempt time
-                if (xSemaphoreTake(wifiManager.stateMutex, portMAX_DELAY) == pdTRUE) {
-                    wifiManager.lastSTAAttemptTime = millis();
-                    xSemaphoreGive(wifiManager.stateMutex);
-                }
-                continue;
+    if (failedAttempts < 255) {
+        failedAttempts++;
+    }
+
+    // 1st retry after WIFI_BACKOFF_INITIAL_MS, then doubling up to WIFI_BACKOFF_MAX_MS
+    uint8_t shift = (failedAttempts - 1 < 15) ? failedAttempts - 1 : 15;
+    uint32_t delayMs = static_cast<uint32_t>(WIFI_BACKOFF_INITIAL_MS) << shift;
+    backoffMs = (delayMs < WIFI_BACKOFF_MAX_MS) ? delayMs : WIFI_BACKOFF_MAX_MS;
+    backoffStartTime = millis();
+    resumeState = session;
+    linkState = LINK_BACKOFF;
+
+    LOG_INFO("Join attempt %u failed (reason %u), retrying in %lu ms", failedAttempts, reason, backoffMs);
+}
+
+void WiFiManager::handleEvent(const LinkEvent& event) {
+    switch (event.type) {
+        case EVENT_REQUEST_STA:
+        case EVENT_REQUEST_AP:
+            requestPending = true;
+            pendingRequest = event.type;
+            requestTime = event.timeMs;
+            break;
+
+        case EVENT_STA_GOT_IP:
+            handleGotIP();
+            break;
+
+        case EVENT_STA_DISCONNECTED:
+            // Events from before the current attempt (e.g. our own disconnect) are stale
+            if (static_cast<long>(event.timeMs - attemptStartTime) < 0) {
+                break;
             }
 
-            // Attempt reconnection
-            Serial.println("[WiFiManager] Attempting to reconnect to STA...");
-            if (wifiManager.connectToSTA()) {
-                // Thread-safe: Update mode and reset fail time
-                if (xSemaphoreTake(wifiManager.stateMutex, portMAX_DELAY) == pdTRUE) {
-                    wifiManager.currentMode = WIFIMANAGER_MODE_STA;
-                    wifiManager.staFailedTime = 0;
-                    xSemaphoreGive(wifiManager.stateMutex);
-                }
-                Serial.println("[WiFiManager] Reconnected to STA");
+            if (linkState == LINK_CONNECTED) {
+                handleLinkLost(event.reason);
+            } else if (linkState == LINK_CONNECTING || linkState == LINK_RECONNECTING) {
+                handleAttemptFailed(event.reason);
             }
+            break;
 
-            vTaskDelay(5000 / portTICK_PERIOD_MS);
-            continue;
+        case EVENT_AP_CLIENTS_CHANGED:
+            break;  // Client count is picked up by publishStatus()
+    }
+}
+
+void WiFiManager::handleTimers() {
+    if (requestPending && hasElapsed(requestTime, WIFI_SWITCH_DELAY_MS)) {
+        requestPending = false;
+
+        if (pendingRequest == EVENT_REQUEST_STA) {
+            LOG_INFO("Attempting to switch to STA mode...");
+            if (!startJoin()) {
+                LOG_ERROR("Cannot switch to STA mode: no credentials");
+            }
+        } else {
+            enterAPMode();
         }
+    }
+
+    bool checkDue = hasElapsed(lastCheckTime, WIFI_CHECK_INTERVAL_MS);
+    if (checkDue) {
+        lastCheckTime = millis();
+    }
 
-        if (mode == WIFIMANAGER_MODE_AP) {
-            String ssid;
-            bool hasCredentials = false;
-            unsigned long lastAttempt = 0;
-
-            // Thread-safe: Read state
-            if (xSemaphoreTake(wifiManager.stateMutex, portMAX_DELAY) == pdTRUE) {
-                ssid = wifiManager.apSSID;
-                hasCredentials = wifiManager.credentialsLoaded;
-                lastAttempt = wifiManager.lastSTAAttemptTime;
-                xSemaphoreGive(wifiManager.stateMutex);
+    switch (linkState) {
+        case LINK_CONNECTING:
+        case LINK_RECONNECTING:
+            if (WiFi.status() == WL_CONNECTED && hasElapsed(attemptStartTime, WIFI_ATTEMPT_TIMEOUT_MS)) {
+                handleGotIP();  // Got-IP event was lost
+            } else if (hasGivenUp(linkState) || hasElapsed(attemptStartTime, WIFI_ATTEMPT_TIMEOUT_MS)) {
+                handleAttemptFailed(0);
             }
+            break;
+
+        case LINK_BACKOFF:
+            if (hasGivenUp(resumeState)) {
+                handleAttemptFailed(0);
+            } else if (hasElapsed(backoffStartTime, backoffMs)) {
+                LOG_INFO("Attempting to reconnect to STA...");
+                beginAttempt(resumeState);
+            }
+            break;
 
-            Serial.print("[WiFiManager] AP mode - SSID: " + ssid);
-            Serial.println(" - Clients: " + String(WiFi.softAPgetStationNum()));
+        case LINK_CONNECTED:
+            if (apActive && hasElapsed(connectedTime, WIFI_AP_HANDOFF_MS)) {
+                stopAPMode();
+            }
+            if (!checkDue) {
+                break;
+            }
+            if (WiFi.status() != WL_CONNECTED) {
+                handleLinkLost(0);  // Disconnect event was lost
+            } else {
+                LOG_INFO("STA connected - IP: %s", WiFi.localIP().toString().c_str());
+            }
+            break;
 
-            // Overflow-safe: Check if time to retry STA
-            if (hasCredentials && wifiManager.hasElapsed(lastAttempt, WIFI_STA_RETRY_INTERVAL_MS)) {
-                Serial.println("[WiFiManager] Attempting to switch to STA mode...");
-                if (wifiManager.switchToSTAMode()) {
-                    Serial.println("[WiFiManager] Successfully switched to STA mode");
-                } else {
-                    // Thread-safe: Update last attempt time
-                    if (xSemaphoreTake(wifiManager.stateMutex, portMAX_DELAY) == pdTRUE) {
-                        wifiManager.lastSTAAttemptTime = millis();
-                        xSemaphoreGive(wifiManager.stateMutex);
-                    }
-                    Serial.println("[WiFiManager] STA connection failed, staying in AP mode");
+        case LINK_AP:
+            if (checkDue) {
+                if (!apActive) {
+                    apActive = startAPMode();  // Retry a failed AP start
                 }
+                LOG_INFO("AP mode - SSID: %s - Clients: %d", apSSID.c_str(), WiFi.softAPgetStationNum());
             }
 
-            vTaskDelay(WIFI_CHECK_INTERVAL_MS / portTICK_PERIOD_MS);
-            continue;
-        }
+            // Overflow-safe: Check if time to retry STA
+            if (hasElapsed(lastSTAAttemptTime, WIFI_STA_RETRY_INTERVAL_MS)) {
+                lastSTAAttemptTime = millis();
+                startJoin();
+            }
+            break;
+    }
+}
+
+// Milliseconds left until startTime + duration (0 if already past)
+static uint32_t msRemaining(unsigned long startTime, unsigned long duration) {
+    unsigned long elapsed = millis() - startTime;
+    return (elapsed >= duration) ? 0 : duration - elapsed;
+}
+
+uint32_t WiFiManager::msUntilNextDeadline() const {
+    uint32_t wait = msRemaining(lastCheckTime, WIFI_CHECK_INTERVAL_MS);
+
+    if (requestPending) {
+        wait = min(wait, msRemaining(requestTime, WIFI_SWITCH_DELAY_MS));
+    }
+
+    switch (linkState) {
+        case LINK_CONNECTING:
+            wait = min(wait, msRemaining(attemptStartTime, WIFI_ATTEMPT_TIMEOUT_MS));
+            wait = min(wait, msRemaining(joinStartTime, WIFI_STA_TIMEOUT_MS));
+            break;
+
+        case LINK_RECONNECTING:
+            wait = min(wait, msRemaining(attemptStartTime, WIFI_ATTEMPT_TIMEOUT_MS));
+            wait = min(wait, msRemaining(staFailedTime, WIFI_STA_FAIL_THRESHOLD_MS));
+            break;
+
+        case LINK_BACKOFF:
+            wait = min(wait, msRemaining(backoffStartTime, backoffMs));
+            break;
+
+        case LINK_AP:
+            wait = min(wait, msRemaining(lastSTAAttemptTime, WIFI_STA_RETRY_INTERVAL_MS));
+            break;
 
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        case LINK_CONNECTED:
+            if (apActive) {
+                wait = min(wait, msRemaining(connectedTime, WIFI_AP_HANDOFF_MS));
+            }
+            break;
     }
+
+    return wait;
 }
 
-bool WiFiManager::loadCredentialsFromNVS() {
-    if (!preferences.begin(NVS_NAMESPACE, true)) {
-        Serial.println("[WiFiManager] Failed to open NVS namespace");
-        return false;
+void WiFiManager::step() {
+    // Sleep until something happens or a deadline is due
+    LinkEvent event;
+    if (xQueueReceive(eventQueue, &event, msUntilNextDeadline() / portTICK_PERIOD_MS) == pdTRUE) {
+        do {
+            handleEvent(event);
+        } while (xQueueReceive(eventQueue, &event, 0) == pdTRUE);
     }
 
-    currentSSID = preferences.getString(NVS_SSID_KEY, "");
-    currentPassword = preferences.getString(NVS_PASSWORD_KEY, "");
+    handleTimers();
+    publishStatus();
+}
+
+void WiFiManager::keepAliveTask(void* parameters) {
+    LOG_INFO("Task loop started");
+
+    for (;;) {
+        wifiManager.step();
+    }
+}
 
-    preferences.end();
+bool WiFiManager::loadCredentialsFromNVS() {
+    currentSSID = FlashWriter::readString(NVS_NAMESPACE, NVS_SSID_KEY, "");
+    currentPassword = FlashWriter::readString(NVS_NAMESPACE, NVS_PASSWORD_KEY, "");
 
     if (currentSSID.length() == 0 || currentPassword.length() == 0) {
-        Serial.println("[WiFiManager] No valid credentials in NVS");
+        LOG_INFO("No valid credentials in NVS");
         credentialsLoaded = false;
         return false;
     }
@@ -324,108 +668,63 @@ bool WiFiManager::loadCredentialsFromNVS() {
 }
 
 bool WiFiManager::saveCredentialsToNVS(const char* ssid, const char* password) {
-    if (!preferences.begin(NVS_NAMESPACE, false)) {
-        Serial.println("[WiFiManager] Failed to open NVS namespace for writing");
-        return false;
-    }
-
     bool success = true;
 
-    if (preferences.putString(NVS_SSID_KEY, ssid) == 0) {
-        Serial.println("[WiFiManager] Failed to write SSID to NVS");
+    if (!FlashWriter::putString(NVS_NAMESPACE, NVS_SSID_KEY, ssid, FlashSubsystem::WIFI)) {
+        LOG_ERROR("Failed to write SSID to NVS");
         success = false;
     }
 
-    if (preferences.putString(NVS_PASSWORD_KEY, password) == 0) {
-        Serial.println("[WiFiManager] Failed to write password to NVS");
+    if (!FlashWriter::putString(NVS_NAMESPACE, NVS_PASSWORD_KEY, password, FlashSubsystem::WIFI)) {
+        LOG_ERROR("Failed to write password to NVS");
         success = false;
     }
 
-    preferences.end();
-
     return success;
 }
 
 bool WiFiManager::clearCredentialsFromNVS() {
-    if (!preferences.begin(NVS_NAMESPACE, false)) {
-        Serial.println("[WiFiManager] Failed to open NVS namespace for clearing");
-        return false;
-    }
-
     bool success = true;
 
-    if (!preferences.remove(NVS_SSID_KEY)) {
-        Serial.println("[WiFiManager] Failed to remove SSID from NVS");
+    if (!FlashWriter::remove(NVS_NAMESPACE, NVS_SSID_KEY, FlashSubsystem::WIFI)) {
+        LOG_ERROR("Failed to remove SSID from NVS");
         success = false;
     }
 
-    if (!preferences.remove(NVS_PASSWORD_KEY)) {
-        Serial.println("[WiFiManager] Failed to remove password from NVS");
+    if (!FlashWriter::remove(NVS_NAMESPACE, NVS_PASSWORD_KEY, FlashSubsystem::WIFI)) {
+        LOG_ERROR("Failed to remove password from NVS");
         success = false;
     }
 
-    preferences.end();
+    // Forget the cached AP too (the state machine ignores it without matching credentials)
+    FlashWriter::remove(NVS_NAMESPACE, NVS_LINK_CACHE_KEY, FlashSubsystem::WIFI);
 
     return success;
 }
 
-bool WiFiManager::connectToSTA() {
-    if (!credentialsLoaded) {
-        return false;
-    }
-
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(currentSSID.c_str(), currentPassword.c_str());
-
-    Serial.println("[WiFiManager] Connecting to WiFi: " + currentSSID);
-
-    unsigned long startAttemptTime = millis();
-
-    while (WiFi.status() != WL_CONNECTED &&
-           millis() - startAttemptTime < WIFI_STA_TIMEOUT_MS) {
-        // Yield to other tasks to prevent watchdog timeout
-        yield();
-        vTaskDelay(100 / portTICK_PERIOD_MS);
-    }
-
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("[WiFiManager] Failed to connect to STA");
-        return false;
-    }
-
-    Serial.println("[WiFiManager] Connected to STA - IP: " + WiFi.localIP().toString());
-    return true;
-}
-
 bool WiFiManager::startAPMode() {
-    WiFi.mode(WIFI_AP);
+    // Keep the station running if it is (or is about to be) in use
+    WiFi.mode(linkState == LINK_AP ? WIFI_AP : WIFI_AP_STA);
 
     if (!WiFi.softAPConfig(AP_IP_ADDRESS, AP_GATEWAY, AP_SUBNET)) {
-        Serial.println("[WiFiManager] Failed to configure AP IP");
+        LOG_ERROR("Failed to configure AP IP");
         return false;
     }
 
     if (!WiFi.softAP(apSSID.c_str(), AP_PASSWORD)) {
-        Serial.println("[WiFiManager] Failed to start AP");
+        LOG_ERROR("Failed to start AP");
         return false;
     }
 
-    Serial.println("[WiFiManager] AP started - SSID: " + apSSID);
-    Serial.println("[WiFiManager] AP IP: " + WiFi.softAPIP().toString());
+    LOG_INFO("AP started - SSID: %s", apSSID.c_str());
+    LOG_INFO("AP IP: %s", WiFi.softAPIP().toString().c_str());
     return true;
 }
 
-void WiFiManager::stopCurrentMode() {
-    if (currentMode == WIFIMANAGER_MODE_STA) {
-        WiFi.disconnect(true);
-        Serial.println("[WiFiManager] STA mode stopped");
-    } else if (currentMode == WIFIMANAGER_MODE_AP) {
-        WiFi.softAPdisconnect(true);
-        Serial.println("[WiFiManager] AP mode stopped");
-    }
-
-    WiFi.mode(WIFI_OFF);
-    vTaskDelay(100 / portTICK_PERIOD_MS);
+void WiFiManager::stopAPMode() {
+    WiFi.softAPdisconnect(true);  // AP off, station stays connected
+    apActive = false;
+    LOG_INFO("STA stable for %d ms, AP mode stopped", WIFI_AP_HANDOFF_MS);
 }
 
 void WiFiManager::generateAPSSID() {
@@ -435,7 +734,7 @@ void WiFiManager::generateAPSSID() {
     apSSID.toUpperCase();
 }
 
-bool WiFiManager::hasElapsed(unsigned long startTime, unsigned long duration) {
+bool WiFiManager::hasElapsed(unsigned long startTime, unsigned long duration) const {
     // Handles millis() overflow correctly
     // Works because unsigned arithmetic wraps around
     return (millis() - startTime) >= duration;
@@ -0,0 +1,191 @@
+#include "scheduling/ConfigTransaction.h"
+#include "storage/FlashWriter.h"
+#include "diagnostics/Log.h"
+
+LOG_MODULE("ConfigTransaction", LOG_LEVEL_CONFIG_TRANSACTION);
+
+ConfigTransaction::ConfigTransaction() {
+    memset(&journal, 0, sizeof(Journal));
+    journal.version = CONFIG_JOURNAL_VERSION;
+}
+
+ConfigTransaction::Record& ConfigTransaction::stage(RecordKind kind, uint8_t head) {
+    for (uint8_t i = 0; i < journal.count; i++) {
+        if (journal.records[i].kind == kind && journal.records[i].head == head) {
+            return journal.records[i];
+        }
+    }
+
+    // At most one record per head and kind, so records[] never overflows
+    Record& record = journal.records[journal.count++];
+    record.kind = kind;
+    record.head = head;
+    return record;
+}
+
+bool ConfigTransaction::setSchedule(const Schedule& sched) {
+    if (sched.head >= NUM_SCHEDULE_HEADS) {
+        return false;
+    }
+
+    Record& record = stage(SCHEDULE, sched.head);
+    record.schedule.remove = false;
+    record.schedule.schedule = sched;
+    return true;
+}
+
+bool ConfigTransaction::deleteSchedule(uint8_t head) {
+    if (head >= NUM_SCHEDULE_HEADS) {
+        return false;
+    }
+
+    stage(SCHEDULE, head).schedule.remove = true;
+    return true;
+}
+
+bool ConfigTransaction::setCalibration(uint8_t head, const CalibrationUpdate& update) {
+    if (head >= NUM_MOTORS) {
+        return false;
+    }
+
+    stage(CALIBRATION, head).calibration = update;
+    return true;
+}
+
+bool ConfigTransaction::isEmpty() const {
+    return journal.count == 0;
+}
+
+bool ConfigTransaction::commit(ScheduleManager* scheduleManager, DosingHead** dosingHeads, uint8_t numHeads) {
+    if (isEmpty()) {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < journal.count; i++) {
+        if ((journal.records[i].kind == SCHEDULE && scheduleManager == nullptr) ||
+            (journal.records[i].kind == CALIBRATION && dosingHeads == nullptr)) {
+            return false;
+        }
+    }
+
+    // Room for every write before the first one: with commits held during a
+    // dose the queue does not drain, and a half-queued set would fail partway.
+    // One write per record, plus the journal and its removal.
+    bool journaled = journal.count > 1;
+    FlashReservation reservation(journaled ? journal.count + 1 : 1, journaled ? 1 : 0);
+    if (!reservation.isReserved()) {
+        LOG_ERROR("Flash queue full - nothing committed");
+        return false;
+    }
+
+    // One NVS blob write is atomic by itself
+    if (!journaled) {
+        return apply(journal, scheduleManager, dosingHeads, numHeads);
+    }
+
+    // Commit point: once the journal blob is written the whole set will be applied.
+    // The flash writer commits in queue order; the barriers keep the journal
+    // ahead of the changes and its removal behind them.
+    if (!writeJournal(journal)) {
+        LOG_ERROR("Failed to write journal");
+        return false;
+    }
+    FlashWriter::barrier();
+
+    bool success = apply(journal, scheduleManager, dosingHeads, numHeads);
+
+    if (success) {
+        FlashWriter::barrier();
+        clearJournal();
+    } else {
+        // Keep the journal so the next boot retries the remaining writes
+        LOG_ERROR("Apply failed - journal kept for recovery");
+    }
+
+    return success;
+}
+
+bool ConfigTransaction::recover(ScheduleManager* scheduleManager, DosingHead** dosingHeads, uint8_t numHeads) {
+    Journal pending;
+    if (!readJournal(pending)) {
+        // A journal from another firmware version cannot be replayed
+        if (FlashWriter::hasKey(CONFIG_JOURNAL_NVS_NAMESPACE, CONFIG_JOURNAL_NVS_KEY)) {
+            LOG_WARN("Discarding unreadable journal");
+            clearJournal();
+        }
+        return true;
+    }
+
+    LOG_INFO("Replaying interrupted commit (%d changes)", pending.count);
+
+    if (!apply(pending, scheduleManager, dosingHeads, numHeads)) {
+        LOG_ERROR("Replay failed - journal kept");
+        return false;
+    }
+
+    FlashWriter::barrier();
+    clearJournal();
+    return true;
+}
+
+bool ConfigTransaction::apply(const Journal& journal, ScheduleManager* scheduleManager,
+                              DosingHead** dosingHeads, uint8_t numHeads) {
+    bool success = true;
+
+    // Schedules go to the schedule manager in one call, indexed by head
+    ScheduleChange schedules[NUM_SCHEDULE_HEADS];
+    uint8_t scheduleMask = 0;
+
+    for (uint8_t i = 0; i < journal.count; i++) {
+        const Record& record = journal.records[i];
+        if (record.kind == SCHEDULE && record.head < NUM_SCHEDULE_HEADS) {
+            schedules[record.head] = record.schedule;
+            scheduleMask |= (1 << record.head);
+        }
+    }
+
+    // Replaying is idempotent: every change is a full overwrite or a delete
+    if (scheduleMask != 0) {
+        success &= (scheduleManager != nullptr) && scheduleManager->applyChanges(schedules, scheduleMask);
+    }
+
+    for (uint8_t i = 0; i < journal.count; i++) {
+        const Record& record = journal.records[i];
+        if (record.kind != CALIBRATION) {
+            continue;
+        }
+
+        if (dosingHeads == nullptr || record.head >= numHeads) {
+            success = false;
+            continue;
+        }
+
+        success &= dosingHeads[record.head]->applyCalibration(record.calibration);
+    }
+
+    return success;
+}
+
+size_t ConfigTransaction::journalSize(uint8_t count) {
+    return sizeof(Journal) - (NUM_SCHEDULE_HEADS + NUM_MOTORS - count) * sizeof(Record);
+}
+
+bool ConfigTransaction::writeJournal(const Journal& journal) {
+    static_assert(sizeof(Journal) <= FLASH_LARGE_VALUE_SIZE, "Journal must fit a large flash queue entry");
+
+    // Only the staged records are written
+    return FlashWriter::putBytes(CONFIG_JOURNAL_NVS_NAMESPACE, CONFIG_JOURNAL_NVS_KEY, &journal,
+                                 journalSize(journal.count), FlashSubsystem::JOURNAL);
+}
+
+bool ConfigTransaction::readJournal(Journal& journal) {
+    size_t read = FlashWriter::readBytes(CONFIG_JOURNAL_NVS_NAMESPACE, CONFIG_JOURNAL_NVS_KEY, &journal, sizeof(Journal));
+
+    return read >= journalSize(0) && journal.version == CONFIG_JOURNAL_VERSION &&
+           journal.count <= NUM_SCHEDULE_HEADS + NUM_MOTORS && read == journalSize(journal.count);
+}
+
+void ConfigTransaction::clearJournal() {
+    // A change the writer drops keeps the journal, so the next boot replays it
+    FlashWriter::removeIfCommitted(CONFIG_JOURNAL_NVS_NAMESPACE, CONFIG_JOURNAL_NVS_KEY, FlashSubsystem::JOURNAL);
+}
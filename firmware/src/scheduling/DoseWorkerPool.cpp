@@ -0,0 +1,225 @@
+#include "scheduling/DoseWorkerPool.h"
+#include "diagnostics/Metrics.h"
+#include "diagnostics/Log.h"
+#include "storage/FlashWriter.h"
+
+LOG_MODULE("DoseWorkerPool", LOG_LEVEL_DOSE_WORKER_POOL);
+
+DoseWorkerPool::DoseWorkerPool()
+    : dosingHeads(nullptr), numHeads(0), initialized(false), running(false), epoch(0), version(0) {
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        workers[i].pool = this;
+        workers[i].head = i;
+        workers[i].task = nullptr;
+        workers[i].adhocQueue = nullptr;
+        workers[i].scheduledQueue = nullptr;
+        workers[i].busy.store(false);
+    }
+}
+
+bool DoseWorkerPool::begin(DosingHead** heads, uint8_t num) {
+    if (initialized) {
+        return true;
+    }
+
+    if (heads == nullptr || num == 0 || num > NUM_MOTORS) {
+        LOG_WARN("Invalid parameters");
+        return false;
+    }
+
+    dosingHeads = heads;
+    numHeads = num;
+
+    for (uint8_t i = 0; i < numHeads; i++) {
+        workers[i].adhocQueue = xQueueCreateStatic(DOSE_ADHOC_QUEUE_DEPTH, sizeof(DoseJob),
+                                                   adhocQueueStorage[i], &adhocQueueBuffers[i]);
+        workers[i].scheduledQueue = xQueueCreateStatic(DOSE_SCHEDULED_QUEUE_DEPTH, sizeof(DoseJob),
+                                                       scheduledQueueStorage[i], &scheduledQueueBuffers[i]);
+
+        if (workers[i].adhocQueue == nullptr || workers[i].scheduledQueue == nullptr) {
+            LOG_ERROR("Failed to create queues for head %d", i);
+            return false;
+        }
+    }
+
+    initialized = true;
+    LOG_INFO("Initialized");
+    return true;
+}
+
+bool DoseWorkerPool::start() {
+    if (running) {
+        LOG_INFO("Already running");
+        return true;
+    }
+
+    if (!initialized) {
+        LOG_WARN("Not initialized - call begin() first");
+        return false;
+    }
+
+    for (uint8_t i = 0; i < numHeads; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "DoseWorker%d", i);
+
+        workers[i].task = xTaskCreateStatic(
+            workerTaskFunction,         // Task function
+            name,                       // Task name
+            DOSE_WORKER_STACK_SIZE,     // Stack size (bytes)
+            &workers[i],                // Parameters (this worker)
+            DOSE_WORKER_PRIORITY,       // Priority
+            workerStacks[i],            // Static stack
+            &workerTaskBuffers[i]       // Static TCB
+        );
+
+        if (workers[i].task == nullptr) {
+            LOG_ERROR("Failed to create worker for head %d", i);
+            return false;
+        }
+        Metrics::registerTask(workers[i].task);
+    }
+
+    running = true;
+    LOG_INFO("Started %d workers", numHeads);
+    return true;
+}
+
+DoseSubmitResult DoseWorkerPool::submit(const DoseJob& job) {
+    if (!running) {
+        return DoseSubmitResult::NOT_RUNNING;
+    }
+
+    if (job.head >= numHeads) {
+        return DoseSubmitResult::INVALID_HEAD;
+    }
+
+    Worker& worker = workers[job.head];
+    QueueHandle_t queue = (job.source == DoseSource::ADHOC) ? worker.adhocQueue : worker.scheduledQueue;
+
+    DoseJob queued = job;
+    queued.epoch = epoch.load();
+
+    // Never block the caller (AsyncTCP or SchedulerTask) - report backpressure instead
+    if (xQueueSend(queue, &queued, 0) != pdTRUE) {
+        return DoseSubmitResult::QUEUE_FULL;
+    }
+
+    version.fetch_add(1);
+    xTaskNotifyGive(worker.task);
+    return DoseSubmitResult::ACCEPTED;
+}
+
+uint16_t DoseWorkerPool::cancelAll() {
+    if (!initialized) {
+        return 0;
+    }
+
+    // Bump the epoch first: a worker that has not started its motor yet drops
+    // its job, and one that starts it anyway stops again (DosingHead::runMotor)
+    epoch.fetch_add(1);
+
+    uint16_t cancelled = 0;
+    DoseJob job;
+
+    for (uint8_t i = 0; i < numHeads; i++) {
+        while (xQueueReceive(workers[i].adhocQueue, &job, 0) == pdTRUE) {
+            completeCancelled(job);
+            cancelled++;
+        }
+        while (xQueueReceive(workers[i].scheduledQueue, &job, 0) == pdTRUE) {
+            completeCancelled(job);
+            cancelled++;
+        }
+    }
+
+    version.fetch_add(1);
+
+    if (cancelled > 0) {
+        LOG_INFO("Cancelled %d pending doses", cancelled);
+    }
+
+    return cancelled;
+}
+
+uint8_t DoseWorkerPool::getQueueDepth(uint8_t head) const {
+    if (!initialized || head >= numHeads) {
+        return 0;
+    }
+
+    return uxQueueMessagesWaiting(workers[head].adhocQueue) +
+           uxQueueMessagesWaiting(workers[head].scheduledQueue);
+}
+
+bool DoseWorkerPool::isBusy(uint8_t head) const {
+    if (head >= numHeads) {
+        return false;
+    }
+    return workers[head].busy.load();
+}
+
+bool DoseWorkerPool::isRunning() const {
+    return running;
+}
+
+uint32_t DoseWorkerPool::getVersion() const {
+    return version.load();
+}
+
+void DoseWorkerPool::workerTaskFunction(void* parameters) {
+    Worker* worker = static_cast<Worker*>(parameters);
+    if (worker != nullptr && worker->pool != nullptr) {
+        worker->pool->runWorker(*worker);
+    }
+    vTaskDelete(NULL);
+}
+
+void DoseWorkerPool::runWorker(Worker& worker) {
+    LOG_INFO("Worker for head %d started", worker.head);
+
+    DoseJob job;
+
+    for (;;) {
+        // Each submit() gives one notification; take them all and drain the queues
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (receiveNext(worker, job)) {
+            if (job.epoch != epoch.load()) {
+                // Submitted before an emergency stop
+                completeCancelled(job);
+                continue;
+            }
+
+            worker.busy.store(true);
+            version.fetch_add(1);
+            FlashWriter::holdCommits();  // Keep flash erases from stalling the run timing
+            DosingResult result = dosingHeads[worker.head]->dispense(job.volume, &epoch, job.epoch);
+            FlashWriter::releaseCommits();
+            worker.busy.store(false);
+            version.fetch_add(1);
+
+            Metrics::recordDose(worker.head, job.source == DoseSource::ADHOC, result.success,
+                                result.estimatedVolume);
+
+            if (job.onComplete != nullptr) {
+                job.onComplete(job, result, job.context);
+            }
+        }
+    }
+}
+
+bool DoseWorkerPool::receiveNext(Worker& worker, DoseJob& job) {
+    // Ad-hoc requests always run before scheduled ones
+    if (xQueueReceive(worker.adhocQueue, &job, 0) == pdTRUE) {
+        return true;
+    }
+    return xQueueReceive(worker.scheduledQueue, &job, 0) == pdTRUE;
+}
+
+void DoseWorkerPool::completeCancelled(const DoseJob& job) {
+    if (job.onComplete == nullptr) {
+        return;
+    }
+
+    DosingResult result = {false, 0, job.volume, 0.0f, "Cancelled by emergency stop", true, 0};
+    job.onComplete(job, result, job.context);
+}
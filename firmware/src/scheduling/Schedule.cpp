@@ -1,4 +1,7 @@
 #include "scheduling/Schedule.h"
+#include "diagnostics/Log.h"
+
+LOG_MODULE("Schedule", LOG_LEVEL_SCHEDULE_STORE);
 
 bool Schedule::isValid() const {
     // Check head index
@@ -58,7 +61,7 @@ String Schedule::toString() const {
 bool Schedule::calculateFromDailyTarget() {
     // Validate inputs
     if (dosesPerDay == 0 || dailyTargetVolume <= 0.0f) {
-        Serial.println("[Schedule] Invalid dailyTarget or dosesPerDay");
+        LOG_WARN("Invalid dailyTarget or dosesPerDay");
         return false;
     }
 
@@ -68,8 +71,7 @@ bool Schedule::calculateFromDailyTarget() {
     // Calculate interval in seconds (24 hours = 86400 seconds)
     intervalSeconds = 86400 / dosesPerDay;
 
-    Serial.printf("[Schedule] Calculated: %.2f mL/day, %d doses → %.2f mL/dose every %lu seconds\n",
-                 dailyTargetVolume, dosesPerDay, volume, intervalSeconds);
+    LOG_DEBUG("Calculated: %.2f mL/day, %d doses → %.2f mL/dose every %lu seconds", dailyTargetVolume, dosesPerDay, volume, intervalSeconds);
 
     return true;
 }
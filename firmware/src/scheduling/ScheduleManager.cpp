@@ -1,10 +1,15 @@
 #include "scheduling/ScheduleManager.h"
 #include "logs/DosingLogManager.h"
+#include "diagnostics/Log.h"
 
-ScheduleManager::ScheduleManager() : mutex(nullptr), initialized(false), logManager(nullptr) {
+LOG_MODULE("ScheduleManager", LOG_LEVEL_SCHEDULE_MANAGER);
+
+ScheduleManager::ScheduleManager()
+    : mutex(nullptr), initialized(false), logManager(nullptr), workerPool(nullptr), version(0) {
     // Initialize cache validity flags to false
     for (uint8_t i = 0; i < NUM_SCHEDULE_HEADS; i++) {
         cacheValid[i] = false;
+        dosePending[i] = false;
     }
 }
 
@@ -17,7 +22,7 @@ ScheduleManager::~ScheduleManager() {
 void ScheduleManager::initMutex() {
     mutex = xSemaphoreCreateMutex();
     if (mutex == nullptr) {
-        Serial.println("[ScheduleManager] CRITICAL: Failed to create mutex!");
+        LOG_ERROR("CRITICAL: Failed to create mutex!");
     }
 }
 
@@ -27,13 +32,13 @@ bool ScheduleManager::begin() {
     }
 
     if (mutex == nullptr) {
-        Serial.println("[ScheduleManager] Error: Mutex not initialized. Call initMutex() first.");
+        LOG_ERROR("Error: Mutex not initialized. Call initMutex() first.");
         return false;
     }
 
     // Initialize the storage layer
     if (!store.begin()) {
-        Serial.println("[ScheduleManager] Failed to initialize ScheduleStore");
+        LOG_ERROR("Failed to initialize ScheduleStore");
         return false;
     }
 
@@ -41,18 +46,18 @@ bool ScheduleManager::begin() {
     reloadCache();
 
     initialized = true;
-    Serial.println("[ScheduleManager] Initialized successfully");
+    LOG_INFO("Initialized successfully");
     return true;
 }
 
 bool ScheduleManager::setSchedule(const Schedule& sched) {
     if (!initialized) {
-        Serial.println("[ScheduleManager] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     if (sched.head >= NUM_SCHEDULE_HEADS) {
-        Serial.printf("[ScheduleManager] Invalid head index: %d\n", sched.head);
+        LOG_WARN("Invalid head index: %d", sched.head);
         return false;
     }
 
@@ -65,27 +70,28 @@ bool ScheduleManager::setSchedule(const Schedule& sched) {
             // Update cache
             scheduleCache[sched.head] = sched;
             cacheValid[sched.head] = true;
-            Serial.printf("[ScheduleManager] Schedule saved for head %d\n", sched.head);
+            version.fetch_add(1);
+            LOG_INFO("Schedule saved for head %d", sched.head);
         } else {
-            Serial.printf("[ScheduleManager] Failed to save schedule for head %d\n", sched.head);
+            LOG_ERROR("Failed to save schedule for head %d", sched.head);
         }
 
         xSemaphoreGive(mutex);
         return success;
     }
 
-    Serial.println("[ScheduleManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return false;
 }
 
 bool ScheduleManager::getSchedule(uint8_t head, Schedule& sched) {
     if (!initialized) {
-        Serial.println("[ScheduleManager] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     if (head >= NUM_SCHEDULE_HEADS) {
-        Serial.printf("[ScheduleManager] Invalid head index: %d\n", head);
+        LOG_WARN("Invalid head index: %d", head);
         return false;
     }
 
@@ -102,18 +108,18 @@ bool ScheduleManager::getSchedule(uint8_t head, Schedule& sched) {
         return success;
     }
 
-    Serial.println("[ScheduleManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return false;
 }
 
 bool ScheduleManager::deleteSchedule(uint8_t head) {
     if (!initialized) {
-        Serial.println("[ScheduleManager] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     if (head >= NUM_SCHEDULE_HEADS) {
-        Serial.printf("[ScheduleManager] Invalid head index: %d\n", head);
+        LOG_WARN("Invalid head index: %d", head);
         return false;
     }
 
@@ -125,22 +131,60 @@ bool ScheduleManager::deleteSchedule(uint8_t head) {
         if (success) {
             // Invalidate cache entry
             cacheValid[head] = false;
-            Serial.printf("[ScheduleManager] Schedule deleted for head %d\n", head);
+            version.fetch_add(1);
+            LOG_INFO("Schedule deleted for head %d", head);
+        } else {
+            LOG_ERROR("Failed to delete schedule for head %d", head);
+        }
+
+        xSemaphoreGive(mutex);
+        return success;
+    }
+
+    LOG_ERROR("Failed to acquire mutex");
+    return false;
+}
+
+bool ScheduleManager::applyChanges(const ScheduleChange* changes, uint8_t headMask) {
+    if (!initialized || changes == nullptr) {
+        LOG_WARN("Not initialized or null changes");
+        return false;
+    }
+
+    // Thread-safe: Lock before modifying schedules
+    if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
+        bool success = store.applyChanges(changes, headMask);
+
+        if (success) {
+            // Update cache
+            for (uint8_t head = 0; head < NUM_SCHEDULE_HEADS; head++) {
+                if ((headMask & (1 << head)) == 0) {
+                    continue;
+                }
+                if (changes[head].remove) {
+                    cacheValid[head] = false;
+                } else {
+                    scheduleCache[head] = changes[head].schedule;
+                    cacheValid[head] = true;
+                }
+            }
         } else {
-            Serial.printf("[ScheduleManager] Failed to delete schedule for head %d\n", head);
+            // Partial write: resync the cache with whatever reached flash
+            reloadCache();
         }
 
+        version.fetch_add(1);
         xSemaphoreGive(mutex);
         return success;
     }
 
-    Serial.println("[ScheduleManager] Failed to acquire mutex");
+    LOG_ERROR("Failed to acquire mutex");
     return false;
 }
 
 uint8_t ScheduleManager::getAllSchedules(Schedule* schedules) {
     if (!initialized || schedules == nullptr) {
-        Serial.println("[ScheduleManager] Not initialized or null schedules array");
+        LOG_WARN("Not initialized or null schedules array");
         return 0;
     }
 
@@ -157,7 +201,7 @@ uint8_t ScheduleManager::getAllSchedules(Schedule* schedules) {
 
         xSemaphoreGive(mutex);
     } else {
-        Serial.println("[ScheduleManager] Failed to acquire mutex");
+        LOG_ERROR("Failed to acquire mutex");
     }
 
     return count;
@@ -171,10 +215,17 @@ void ScheduleManager::checkAndExecute(uint32_t currentTime, DosingHead** dosingH
     // Thread-safe: Lock before checking schedules
     if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
         for (uint8_t head = 0; head < NUM_SCHEDULE_HEADS; head++) {
-            if (cacheValid[head] && scheduleCache[head].enabled) {
+            if (cacheValid[head] && scheduleCache[head].enabled && !dosePending[head]) {
                 Schedule sched = scheduleCache[head]; // Make a COPY
 
-                if (sched.shouldExecute(currentTime)) {
+                if (!sched.shouldExecute(currentTime)) {
+                    continue;
+                }
+
+                if (workerPool != nullptr) {
+                    // Non-blocking: the head's worker runs the dose
+                    submitSchedule(sched, currentTime);
+                } else {
                     // CRITICAL: Release mutex before blocking operation!
                     xSemaphoreGive(mutex);
 
@@ -205,9 +256,9 @@ void ScheduleManager::updateLastExecution(uint8_t head, uint32_t executionTime)
 
             // Save updated schedule to NVS
             store.saveSchedule(scheduleCache[head]);
+            version.fetch_add(1);
 
-            Serial.printf("[ScheduleManager] Updated last execution for head %d: time=%lu, count=%lu\n",
-                         head, executionTime, scheduleCache[head].executionCount);
+            LOG_DEBUG("Updated last execution for head %d: time=%lu, count=%lu", head, executionTime, scheduleCache[head].executionCount);
         }
 
         xSemaphoreGive(mutex);
@@ -215,60 +266,118 @@ void ScheduleManager::updateLastExecution(uint8_t head, uint32_t executionTime)
 }
 
 void ScheduleManager::reloadCache() {
-    Serial.println("[ScheduleManager] Reloading schedule cache from NVS...");
+    LOG_INFO("Reloading schedule cache from NVS...");
 
     for (uint8_t head = 0; head < NUM_SCHEDULE_HEADS; head++) {
         Schedule sched;
         if (store.loadSchedule(head, sched)) {
             scheduleCache[head] = sched;
             cacheValid[head] = true;
-            Serial.printf("[ScheduleManager] Loaded schedule for head %d into cache\n", head);
+            LOG_DEBUG("Loaded schedule for head %d into cache", head);
         } else {
             cacheValid[head] = false;
         }
     }
 
-    Serial.println("[ScheduleManager] Cache reload complete");
+    version.fetch_add(1);
+    LOG_INFO("Cache reload complete");
 }
 
 void ScheduleManager::executeSchedule(Schedule& sched, DosingHead** dosingHeads, uint32_t currentTime) {
     if (sched.head >= NUM_SCHEDULE_HEADS) {
-        Serial.printf("[ScheduleManager] Invalid head index in schedule: %d\n", sched.head);
+        LOG_WARN("Invalid head index in schedule: %d", sched.head);
         return;
     }
 
     DosingHead* head = dosingHeads[sched.head];
     if (head == nullptr) {
-        Serial.printf("[ScheduleManager] Null dosing head pointer for head %d\n", sched.head);
+        LOG_ERROR("Null dosing head pointer for head %d", sched.head);
         return;
     }
 
-    Serial.printf("[ScheduleManager] Starting scheduled dose: Head %d, Volume %.2f mL\n",
-                 sched.head, sched.volume);
+    LOG_INFO("Starting scheduled dose: Head %d, Volume %.2f mL", sched.head, sched.volume);
 
     // Execute the dose (blocking operation)
     DosingResult result = head->dispense(sched.volume);
 
+    completeSchedule(sched.head, result, currentTime);
+}
+
+void ScheduleManager::submitSchedule(const Schedule& sched, uint32_t currentTime) {
+    DoseJob job = {};
+    job.head = sched.head;
+    job.volume = sched.volume;
+    job.source = DoseSource::SCHEDULED;
+    job.requestedAt = currentTime;
+    job.onComplete = onScheduledDoseComplete;
+    job.context = this;
+
+    DoseSubmitResult submitResult = workerPool->submit(job);
+
+    if (submitResult == DoseSubmitResult::ACCEPTED) {
+        dosePending[sched.head] = true;
+        LOG_INFO("Queued scheduled dose: Head %d, Volume %.2f mL", sched.head, sched.volume);
+    } else {
+        // Retried on the next scheduler tick
+        LOG_ERROR("Could not queue scheduled dose for head %d (result %d)", sched.head, static_cast<int>(submitResult));
+    }
+}
+
+void ScheduleManager::completeSchedule(uint8_t head, const DosingResult& result, uint32_t currentTime) {
     if (result.success) {
-        Serial.printf("[ScheduleManager] Scheduled dose complete: Head %d, Volume %.2f mL, Runtime %lu ms\n",
-                     sched.head, result.estimatedVolume, result.actualRuntime);
+        LOG_INFO("Scheduled dose complete: Head %d, Volume %.2f mL, Runtime %lu ms", head, result.estimatedVolume, result.actualRuntime);
 
         // Log scheduled dose if log manager is configured
         if (logManager != nullptr) {
-            logManager->logScheduledDose(sched.head, result.estimatedVolume, currentTime);
+            logManager->logScheduledDose(head, result.estimatedVolume, currentTime);
         }
 
         // Update last execution time with the SAME time used for checking
-        updateLastExecution(sched.head, currentTime);
+        updateLastExecution(head, currentTime);
+    } else if (result.cancelled) {
+        LOG_INFO("Scheduled dose cancelled: Head %d, Partial %.2f mL, Runtime %lu ms", head, result.estimatedVolume, result.actualRuntime);
+
+        // Record what was actually pumped before the stop
+        if (logManager != nullptr && result.estimatedVolume > 0.0f) {
+            logManager->logScheduledDose(head, result.estimatedVolume, currentTime);
+        }
+
+        // Treat the slot as consumed so a stop is not immediately followed by a retry
+        updateLastExecution(head, currentTime);
     } else {
-        Serial.printf("[ScheduleManager] Scheduled dose failed: Head %d, Error: %s\n",
-                     sched.head, result.errorMessage.c_str());
+        LOG_ERROR("Scheduled dose failed: Head %d, Error: %s", head, result.errorMessage.c_str());
     }
 }
 
+void ScheduleManager::onScheduledDoseComplete(const DoseJob& job, const DosingResult& result, void* context) {
+    ScheduleManager* manager = static_cast<ScheduleManager*>(context);
+    if (manager == nullptr || job.head >= NUM_SCHEDULE_HEADS) {
+        return;
+    }
+
+    manager->completeSchedule(job.head, result, job.requestedAt);
+
+    // Allow the schedule to fire again
+    if (xSemaphoreTake(manager->mutex, portMAX_DELAY) == pdTRUE) {
+        manager->dosePending[job.head] = false;
+        xSemaphoreGive(manager->mutex);
+    }
+}
+
+void ScheduleManager::setWorkerPool(DoseWorkerPool* pool) {
+    workerPool = pool;
+    if (workerPool != nullptr) {
+        LOG_INFO("Dose worker pool configured");
+    }
+}
+
+uint32_t ScheduleManager::getVersion() const {
+    return version.load();
+}
+
 void ScheduleManager::setLogManager(DosingLogManager* logMgr) {
     logManager = logMgr;
     if (logManager != nullptr) {
-        Serial.println("[ScheduleManager] Log manager configured");
+        LOG_INFO("Log manager configured");
     }
 }
@@ -1,12 +1,12 @@
 #include "scheduling/ScheduleStore.h"
+#include "storage/FlashWriter.h"
+#include "diagnostics/Log.h"
 
-ScheduleStore::ScheduleStore() : initialized(false) {
-}
+LOG_MODULE("ScheduleStore", LOG_LEVEL_SCHEDULE_STORE);
 
-ScheduleStore::~ScheduleStore() {
-    if (initialized) {
-        preferences.end();
-    }
+static_assert(sizeof(Schedule) <= FLASH_VALUE_SIZE, "Schedule must fit a flash queue entry");
+
+ScheduleStore::ScheduleStore() : initialized(false) {
 }
 
 bool ScheduleStore::begin() {
@@ -15,7 +15,7 @@ bool ScheduleStore::begin() {
     }
 
     initialized = true;
-    Serial.println("[ScheduleStore] Initialized");
+    LOG_INFO("Initialized");
     return true;
 }
 
@@ -25,115 +25,131 @@ String ScheduleStore::getScheduleKey(uint8_t head) {
 
 bool ScheduleStore::saveSchedule(const Schedule& sched) {
     if (!initialized) {
-        Serial.println("[ScheduleStore] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     if (sched.head >= NUM_SCHEDULE_HEADS) {
-        Serial.printf("[ScheduleStore] Invalid head index: %d\n", sched.head);
+        LOG_WARN("Invalid head index: %d", sched.head);
         return false;
     }
 
     // Validate schedule before saving
     ScheduleValidationResult validation = validateSchedule(sched);
     if (!validation.valid) {
-        Serial.printf("[ScheduleStore] Validation failed: %s\n", validation.errorMessage.c_str());
-        return false;
-    }
-
-    // Open NVS for writing
-    if (!preferences.begin(SCHEDULE_NVS_NAMESPACE, false)) {
-        Serial.println("[ScheduleStore] Failed to open NVS for writing");
+        LOG_ERROR("Validation failed: %s", validation.errorMessage.c_str());
         return false;
     }
 
     String key = getScheduleKey(sched.head);
 
-    // Write schedule as blob
-    size_t written = preferences.putBytes(key.c_str(), &sched, sizeof(Schedule));
-
-    preferences.end();
-
-    if (written != sizeof(Schedule)) {
-        Serial.printf("[ScheduleStore] Failed to write schedule for head %d\n", sched.head);
+    // Queue schedule as blob (committed by the flash writer)
+    if (!FlashWriter::putBytes(SCHEDULE_NVS_NAMESPACE, key.c_str(), &sched, sizeof(Schedule),
+                               FlashSubsystem::SCHEDULES)) {
+        LOG_ERROR("Failed to write schedule for head %d", sched.head);
         return false;
     }
 
-    Serial.printf("[ScheduleStore] Saved schedule for head %d: %s\n",
-                  sched.head, sched.toString().c_str());
+    LOG_DEBUG("Saved schedule for head %d: %s", sched.head, sched.toString().c_str());
     return true;
 }
 
 bool ScheduleStore::loadSchedule(uint8_t head, Schedule& sched) {
     if (!initialized) {
-        Serial.println("[ScheduleStore] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     if (head >= NUM_SCHEDULE_HEADS) {
-        Serial.printf("[ScheduleStore] Invalid head index: %d\n", head);
-        return false;
-    }
-
-    // Open NVS for reading
-    if (!preferences.begin(SCHEDULE_NVS_NAMESPACE, true)) {
-        Serial.println("[ScheduleStore] Failed to open NVS for reading");
+        LOG_WARN("Invalid head index: %d", head);
         return false;
     }
 
     String key = getScheduleKey(head);
 
-    // Read schedule as blob
-    size_t read = preferences.getBytes(key.c_str(), &sched, sizeof(Schedule));
-
-    preferences.end();
+    // Read schedule as blob (a queued write is returned before it reaches flash)
+    size_t read = FlashWriter::readBytes(SCHEDULE_NVS_NAMESPACE, key.c_str(), &sched, sizeof(Schedule));
 
     if (read != sizeof(Schedule)) {
         // No schedule found for this head
         return false;
     }
 
-    Serial.printf("[ScheduleStore] Loaded schedule for head %d: %s\n",
-                  head, sched.toString().c_str());
+    LOG_DEBUG("Loaded schedule for head %d: %s", head, sched.toString().c_str());
     return true;
 }
 
 bool ScheduleStore::deleteSchedule(uint8_t head) {
     if (!initialized) {
-        Serial.println("[ScheduleStore] Not initialized");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     if (head >= NUM_SCHEDULE_HEADS) {
-        Serial.printf("[ScheduleStore] Invalid head index: %d\n", head);
-        return false;
-    }
-
-    // Open NVS for writing
-    if (!preferences.begin(SCHEDULE_NVS_NAMESPACE, false)) {
-        Serial.println("[ScheduleStore] Failed to open NVS for writing");
+        LOG_WARN("Invalid head index: %d", head);
         return false;
     }
 
     String key = getScheduleKey(head);
 
     // Remove the schedule entry
-    bool success = preferences.remove(key.c_str());
-
-    preferences.end();
+    bool success = FlashWriter::remove(SCHEDULE_NVS_NAMESPACE, key.c_str(), FlashSubsystem::SCHEDULES);
 
     if (success) {
-        Serial.printf("[ScheduleStore] Deleted schedule for head %d\n", head);
+        LOG_INFO("Deleted schedule for head %d", head);
     } else {
-        Serial.printf("[ScheduleStore] Failed to delete schedule for head %d\n", head);
+        LOG_ERROR("Failed to delete schedule for head %d", head);
     }
 
     return success;
 }
 
+bool ScheduleStore::applyChanges(const ScheduleChange* changes, uint8_t headMask) {
+    if (!initialized || changes == nullptr) {
+        LOG_WARN("Not initialized or null changes");
+        return false;
+    }
+
+    // Validate everything before touching flash
+    for (uint8_t head = 0; head < NUM_SCHEDULE_HEADS; head++) {
+        if ((headMask & (1 << head)) == 0 || changes[head].remove) {
+            continue;
+        }
+
+        ScheduleValidationResult validation = validateSchedule(changes[head].schedule);
+        if (changes[head].schedule.head != head || !validation.valid) {
+            LOG_ERROR("Validation failed for head %d: %s", head, validation.errorMessage.c_str());
+            return false;
+        }
+    }
+
+    bool success = true;
+
+    for (uint8_t head = 0; head < NUM_SCHEDULE_HEADS; head++) {
+        if ((headMask & (1 << head)) == 0) {
+            continue;
+        }
+
+        String key = getScheduleKey(head);
+
+        if (changes[head].remove) {
+            // Deleting an absent schedule is not an error here
+            if (FlashWriter::hasKey(SCHEDULE_NVS_NAMESPACE, key.c_str())) {
+                success &= FlashWriter::remove(SCHEDULE_NVS_NAMESPACE, key.c_str(), FlashSubsystem::SCHEDULES);
+            }
+        } else {
+            success &= FlashWriter::putBytes(SCHEDULE_NVS_NAMESPACE, key.c_str(), &changes[head].schedule,
+                                             sizeof(Schedule), FlashSubsystem::SCHEDULES);
+        }
+    }
+
+    LOG_INFO("Applied schedule changes (mask 0x%02X): %s", headMask, success ? "ok" : "FAILED");
+    return success;
+}
+
 uint8_t ScheduleStore::loadAllSchedules(Schedule* schedules) {
     if (!initialized || schedules == nullptr) {
-        Serial.println("[ScheduleStore] Not initialized or null schedules array");
+        LOG_WARN("Not initialized or null schedules array");
         return 0;
     }
 
@@ -147,31 +163,23 @@ uint8_t ScheduleStore::loadAllSchedules(Schedule* schedules) {
         }
     }
 
-    Serial.printf("[ScheduleStore] Loaded %d active schedules\n", count);
+    LOG_INFO("Loaded %d active schedules", count);
     return count;
 }
 
 bool ScheduleStore::clearAll() {
     if (!initialized) {
-        Serial.println("[ScheduleStore] Not initialized");
-        return false;
-    }
-
-    // Open NVS for writing
-    if (!preferences.begin(SCHEDULE_NVS_NAMESPACE, false)) {
-        Serial.println("[ScheduleStore] Failed to open NVS for writing");
+        LOG_WARN("Not initialized");
         return false;
     }
 
     // Clear entire namespace
-    bool success = preferences.clear();
-
-    preferences.end();
+    bool success = FlashWriter::clear(SCHEDULE_NVS_NAMESPACE, FlashSubsystem::SCHEDULES);
 
     if (success) {
-        Serial.println("[ScheduleStore] Cleared all schedules");
+        LOG_INFO("Cleared all schedules");
     } else {
-        Serial.println("[ScheduleStore] Failed to clear schedules");
+        LOG_ERROR("Failed to clear schedules");
     }
 
     return success;
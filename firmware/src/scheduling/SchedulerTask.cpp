@@ -1,8 +1,13 @@
 #include "scheduling/SchedulerTask.h"
+#include "logs/DosingLogManager.h"
+#include "diagnostics/Metrics.h"
+#include "diagnostics/Log.h"
+
+LOG_MODULE("SchedulerTask", LOG_LEVEL_SCHEDULER_TASK);
 
 SchedulerTask::SchedulerTask()
     : scheduleManager(nullptr), dosingHeads(nullptr), numHeads(0),
-      taskHandle(nullptr), running(false) {
+      taskHandle(nullptr), running(false), logManager(nullptr), lastPruneHour(0) {
 }
 
 SchedulerTask::~SchedulerTask() {
@@ -11,7 +16,7 @@ SchedulerTask::~SchedulerTask() {
 
 bool SchedulerTask::begin(ScheduleManager* manager, DosingHead** heads, uint8_t numHeads) {
     if (manager == nullptr || heads == nullptr || numHeads == 0) {
-        Serial.println("[SchedulerTask] Invalid parameters");
+        LOG_WARN("Invalid parameters");
         return false;
     }
 
@@ -19,18 +24,22 @@ bool SchedulerTask::begin(ScheduleManager* manager, DosingHead** heads, uint8_t
     dosingHeads = heads;
     this->numHeads = numHeads;
 
-    Serial.println("[SchedulerTask] Initialized");
+    LOG_INFO("Initialized");
     return true;
 }
 
+void SchedulerTask::setLogManager(DosingLogManager* manager) {
+    logManager = manager;
+}
+
 bool SchedulerTask::start() {
     if (running) {
-        Serial.println("[SchedulerTask] Already running");
+        LOG_INFO("Already running");
         return true;
     }
 
     if (scheduleManager == nullptr || dosingHeads == nullptr) {
-        Serial.println("[SchedulerTask] Not initialized - call begin() first");
+        LOG_WARN("Not initialized - call begin() first");
         return false;
     }
 
@@ -45,12 +54,13 @@ bool SchedulerTask::start() {
     );
 
     if (result != pdPASS) {
-        Serial.println("[SchedulerTask] Failed to create task");
+        LOG_ERROR("Failed to create task");
         return false;
     }
+    Metrics::registerTask(taskHandle);
 
     running = true;
-    Serial.println("[SchedulerTask] Started");
+    LOG_INFO("Started");
     return true;
 }
 
@@ -62,10 +72,11 @@ void SchedulerTask::stop() {
     running = false;
     vTaskDelay(100 / portTICK_PERIOD_MS); // Give task time to exit
 
+    Metrics::unregisterTask(taskHandle);
     vTaskDelete(taskHandle);
     taskHandle = nullptr;
 
-    Serial.println("[SchedulerTask] Stopped");
+    LOG_INFO("Stopped");
 }
 
 bool SchedulerTask::isRunning() const {
@@ -80,7 +91,7 @@ void SchedulerTask::taskFunction(void* parameters) {
 }
 
 void SchedulerTask::run() {
-    Serial.println("[SchedulerTask] Task loop started");
+    LOG_INFO("Task loop started");
 
     while (running) {
         // Get current time (Unix epoch if available, otherwise millis/1000)
@@ -90,11 +101,17 @@ void SchedulerTask::run() {
         // INTERVAL schedules work with millis(), ONCE/DAILY need real time
         scheduleManager->checkAndExecute(currentTime, dosingHeads);
 
+        // Drop logs past retention once an hour (a no-op until NTP has synced)
+        if (logManager != nullptr && currentTime / 3600 != lastPruneHour) {
+            lastPruneHour = currentTime / 3600;
+            logManager->pruneOldLogs(currentTime);
+        }
+
         // Wait 1 second before next check
         vTaskDelay(SCHEDULER_CHECK_INTERVAL_MS / portTICK_PERIOD_MS);
     }
 
-    Serial.println("[SchedulerTask] Task loop exited");
+    LOG_INFO("Task loop exited");
 }
 
 uint32_t SchedulerTask::getCurrentTime() {
@@ -0,0 +1,740 @@
+#include "storage/FlashWriter.h"
+#include "diagnostics/Log.h"
+#include <Preferences.h>
+#include <esp_timer.h>
+
+LOG_MODULE("FlashWriter", LOG_LEVEL_FLASH_WRITER);
+
+static_assert(FLASH_LARGE_SLOTS < FLASH_QUEUE_SLOTS, "FLASH_LARGE_SLOTS must leave room for small entries");
+static_assert(FLASH_QUEUE_SLOTS <= 255, "Queue depth is reported as uint8_t");
+
+// Static storage is zero-initialized: every entry starts FREE
+FlashWriter::Entry FlashWriter::entries[FLASH_QUEUE_SLOTS];
+uint8_t FlashWriter::smallValues[FLASH_QUEUE_SLOTS - FLASH_LARGE_SLOTS][FLASH_VALUE_SIZE];
+uint8_t FlashWriter::largeValues[FLASH_LARGE_SLOTS][FLASH_LARGE_VALUE_SIZE];
+uint32_t FlashWriter::nextOrder;
+uint32_t FlashWriter::epoch;
+uint32_t FlashWriter::writeSequence;
+SemaphoreHandle_t FlashWriter::mutex;
+StaticSemaphore_t FlashWriter::mutexBuffer;
+std::atomic<TaskHandle_t> FlashWriter::writerTask;
+StackType_t FlashWriter::taskStack[FLASH_WRITER_STACK_SIZE];
+StaticTask_t FlashWriter::taskBuffer;
+std::atomic<uint32_t> FlashWriter::holdCount;
+TaskHandle_t FlashWriter::reservationOwner;
+uint8_t FlashWriter::reservedEntries;
+uint8_t FlashWriter::reservedLargeEntries;
+std::atomic<uint8_t> FlashWriter::depth;
+std::atomic<uint8_t> FlashWriter::maxDepth;
+std::atomic<uint32_t> FlashWriter::commits;
+std::atomic<uint32_t> FlashWriter::coalesced;
+std::atomic<uint32_t> FlashWriter::failures;
+std::atomic<uint32_t> FlashWriter::retries;
+std::atomic<uint32_t> FlashWriter::rejected;
+std::atomic<uint32_t> FlashWriter::commitTimeUs;
+std::atomic<uint32_t> FlashWriter::maxCommitTimeUs;
+std::atomic<uint32_t> FlashWriter::latencyMs;
+std::atomic<uint32_t> FlashWriter::maxLatencyMs;
+
+bool FlashWriter::begin() {
+    if (writerTask.load() != nullptr) {
+        return true;
+    }
+
+    if (mutex == nullptr) {
+        mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+        if (mutex == nullptr) {
+            LOG_ERROR("CRITICAL: Failed to create mutex!");
+            return false;
+        }
+        init();
+    }
+
+    TaskHandle_t task = xTaskCreateStatic(
+        taskFunction,             // Task function
+        "FlashWriter",            // Task name
+        FLASH_WRITER_STACK_SIZE,  // Stack size (bytes)
+        nullptr,                  // Parameters
+        FLASH_WRITER_PRIORITY,    // Priority
+        taskStack,                // Static stack
+        &taskBuffer               // Static TCB
+    );
+
+    if (task == nullptr) {
+        LOG_ERROR("Failed to create task");
+        return false;
+    }
+    Metrics::registerTask(task);
+
+    writerTask.store(task);
+    return true;
+}
+
+void FlashWriter::init() {
+    // The first FLASH_LARGE_SLOTS entries take the large values
+    for (uint8_t i = 0; i < FLASH_QUEUE_SLOTS; i++) {
+        if (i < FLASH_LARGE_SLOTS) {
+            entries[i].value = largeValues[i];
+            entries[i].capacity = FLASH_LARGE_VALUE_SIZE;
+        } else {
+            entries[i].value = smallValues[i - FLASH_LARGE_SLOTS];
+            entries[i].capacity = FLASH_VALUE_SIZE;
+        }
+    }
+}
+
+bool FlashWriter::putBytes(const char* ns, const char* key, const void* data, size_t size, FlashSubsystem subsystem) {
+    return enqueue(BLOB, ns, key, data, size, subsystem);
+}
+
+bool FlashWriter::putUShort(const char* ns, const char* key, uint16_t value, FlashSubsystem subsystem) {
+    return enqueue(USHORT, ns, key, &value, sizeof(value), subsystem);
+}
+
+bool FlashWriter::putString(const char* ns, const char* key, const char* value, FlashSubsystem subsystem) {
+    if (value == nullptr) {
+        return false;
+    }
+    return enqueue(STRING, ns, key, value, strlen(value) + 1, subsystem);
+}
+
+bool FlashWriter::remove(const char* ns, const char* key, FlashSubsystem subsystem) {
+    return enqueue(REMOVE, ns, key, nullptr, 0, subsystem);
+}
+
+bool FlashWriter::removeIfCommitted(const char* ns, const char* key, FlashSubsystem subsystem) {
+    return enqueue(REMOVE, ns, key, nullptr, 0, subsystem, true);
+}
+
+bool FlashWriter::clear(const char* ns, FlashSubsystem subsystem) {
+    return enqueue(CLEAR, ns, "", nullptr, 0, subsystem);
+}
+
+bool FlashWriter::removeKeys(const char* ns, const char* keys, size_t size, FlashSubsystem subsystem) {
+    if (keys == nullptr || size == 0 || keys[size - 1] != '\0') {
+        return false;
+    }
+    return enqueue(REMOVE_KEYS, ns, "", keys, size, subsystem);
+}
+
+bool FlashWriter::reserve(uint8_t count, uint8_t largeCount) {
+    if (mutex == nullptr) {
+        LOG_WARN("Not initialized - call begin() first");
+        return false;
+    }
+
+    if (count > FLASH_QUEUE_SLOTS - FLASH_LARGE_SLOTS || largeCount > FLASH_LARGE_SLOTS) {
+        LOG_ERROR("Cannot reserve %d + %d entries", count, largeCount);
+        return false;
+    }
+
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    uint32_t startMs = millis();
+    uint32_t waitStartMs = startMs;
+
+    for (;;) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        if (reservationOwner == nullptr) {
+            uint8_t freeEntries = 0;
+            uint8_t freeLargeEntries = 0;
+            for (uint8_t i = 0; i < FLASH_QUEUE_SLOTS; i++) {
+                if (entries[i].state == FREE) {
+                    if (i < FLASH_LARGE_SLOTS) {
+                        freeLargeEntries++;
+                    } else {
+                        freeEntries++;
+                    }
+                }
+            }
+
+            if (freeEntries >= count && freeLargeEntries >= largeCount) {
+                reservationOwner = self;
+                reservedEntries = count;
+                reservedLargeEntries = largeCount;
+                xSemaphoreGive(mutex);
+                return true;
+            }
+        }
+        xSemaphoreGive(mutex);
+
+        // Nothing leaves the queue while commits are held, so the wait only
+        // starts counting once the motor has stopped
+        uint32_t nowMs = millis();
+        if (holdCount.load() > 0) {
+            waitStartMs = nowMs;
+        }
+        if (nowMs - waitStartMs >= FLASH_QUEUE_FULL_WAIT_MS ||
+            nowMs - startMs >= FLASH_MAX_HOLD_MS + FLASH_QUEUE_FULL_WAIT_MS) {
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            LOG_ERROR("Queue full - cannot reserve %d + %d entries", count, largeCount);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void FlashWriter::unreserve() {
+    if (mutex == nullptr) {
+        return;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (reservationOwner == xTaskGetCurrentTaskHandle()) {
+        reservationOwner = nullptr;
+        reservedEntries = 0;
+        reservedLargeEntries = 0;
+    }
+    xSemaphoreGive(mutex);
+}
+
+void FlashWriter::barrier() {
+    if (mutex == nullptr) {
+        return;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    epoch++;
+    xSemaphoreGive(mutex);
+}
+
+bool FlashWriter::enqueue(EntryType type, const char* ns, const char* key, const void* data, size_t size,
+                          FlashSubsystem subsystem, bool conditional) {
+    if (mutex == nullptr) {
+        LOG_WARN("Not initialized - call begin() first");
+        return false;
+    }
+
+    if (ns == nullptr || key == nullptr || strlen(ns) >= FLASH_NAME_SIZE || strlen(key) >= FLASH_NAME_SIZE ||
+        size > FLASH_LARGE_VALUE_SIZE) {
+        LOG_ERROR("Invalid write %s/%s (%u bytes)", ns, key, (unsigned)size);
+        return false;
+    }
+
+    uint32_t startMs = millis();
+
+    for (;;) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+
+        if (type == REMOVE_KEYS) {
+            epoch++;  // Nothing merges across a multi-key removal, in either direction
+        }
+
+        // Pending writes this one supersedes: the same key, or for a clear every
+        // key of the namespace. Entries from before a barrier are never touched.
+        Entry* entry = nullptr;
+        for (uint8_t i = 0; i < FLASH_QUEUE_SLOTS; i++) {
+            Entry& candidate = entries[i];
+            if (candidate.state != PENDING || candidate.epoch != epoch || strcmp(candidate.ns, ns) != 0) {
+                continue;
+            }
+
+            bool sameKey = (type == CLEAR) ? true : (candidate.type != CLEAR && strcmp(candidate.key, key) == 0);
+            if (!sameKey) {
+                continue;
+            }
+
+            if (entry == nullptr && candidate.capacity >= size && (type != CLEAR || candidate.type == CLEAR)) {
+                entry = &candidate;  // Reuse in place, keeping its queue position
+            } else {
+                candidate.state = FREE;
+                depth.fetch_sub(1, std::memory_order_relaxed);
+            }
+            coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (entry == nullptr) {
+            bool reserved = reservationOwner != nullptr && reservationOwner == xTaskGetCurrentTaskHandle();
+            entry = allocate(size, reserved);
+            if (entry != nullptr) {
+                entry->state = PENDING;
+                entry->attempts = 0;
+                entry->order = nextOrder++;
+                entry->epoch = epoch;
+                entry->since = ++writeSequence;
+                entry->queuedUs = static_cast<uint32_t>(esp_timer_get_time());
+                strcpy(entry->ns, ns);
+                strcpy(entry->key, key);
+
+                uint8_t current = depth.fetch_add(1, std::memory_order_relaxed) + 1;
+                if (current > maxDepth.load(std::memory_order_relaxed)) {
+                    maxDepth.store(current, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        if (entry != nullptr) {
+            entry->type = type;
+            entry->subsystem = subsystem;
+            entry->conditional = conditional;
+            entry->size = static_cast<uint16_t>(size);
+            if (size > 0) {
+                memcpy(entry->value, data, size);
+            }
+            if (type == REMOVE_KEYS) {
+                epoch++;
+            }
+            xSemaphoreGive(mutex);
+
+            TaskHandle_t task = writerTask.load(std::memory_order_relaxed);
+            if (task != nullptr) {
+                xTaskNotifyGive(task);
+            }
+            return true;
+        }
+
+        xSemaphoreGive(mutex);
+
+        // Every slot is waiting for the writer: give it a moment to catch up
+        if (millis() - startMs >= FLASH_QUEUE_FULL_WAIT_MS) {
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            LOG_ERROR("Queue full - write to %s/%s dropped", ns, key);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+FlashWriter::Entry* FlashWriter::allocate(size_t size, bool reserved) {
+    // Reserved entries are only handed to the reserving task, which uses them up
+    uint8_t keep = reserved ? 0 : reservedEntries;
+    uint8_t keepLarge = reserved ? 0 : reservedLargeEntries;
+
+    // Prefer small entries so the large ones stay free for the journal
+    if (size <= FLASH_VALUE_SIZE) {
+        Entry* entry = findFree(FLASH_LARGE_SLOTS, FLASH_QUEUE_SLOTS, keep);
+        if (entry != nullptr) {
+            if (reserved && reservedEntries > 0) {
+                reservedEntries--;
+            }
+            return entry;
+        }
+    }
+
+    Entry* entry = findFree(0, FLASH_LARGE_SLOTS, keepLarge);
+    if (entry != nullptr && reserved && reservedLargeEntries > 0) {
+        reservedLargeEntries--;
+    }
+    return entry;
+}
+
+FlashWriter::Entry* FlashWriter::findFree(uint8_t first, uint8_t last, uint8_t keep) {
+    Entry* entry = nullptr;
+    uint8_t freeCount = 0;
+
+    for (uint8_t i = first; i < last; i++) {
+        if (entries[i].state == FREE) {
+            if (entry == nullptr) {
+                entry = &entries[i];
+            }
+            freeCount++;
+        }
+    }
+
+    return (freeCount > keep) ? entry : nullptr;
+}
+
+FlashWriter::Entry* FlashWriter::findLatest(const char* ns, const char* key) {
+    Entry* latest = nullptr;
+
+    for (uint8_t i = 0; i < FLASH_QUEUE_SLOTS; i++) {
+        Entry& candidate = entries[i];
+        if (candidate.state == FREE || strcmp(candidate.ns, ns) != 0) {
+            continue;
+        }
+
+        if (!coversKey(candidate, key)) {
+            continue;
+        }
+
+        // Queue order is commit order, so the highest position decides the value
+        if (latest == nullptr || static_cast<int32_t>(candidate.order - latest->order) > 0) {
+            latest = &candidate;
+        }
+    }
+
+    return latest;
+}
+
+bool FlashWriter::coversKey(const Entry& entry, const char* key) {
+    if (entry.type == CLEAR) {
+        return true;
+    }
+    if (entry.type != REMOVE_KEYS) {
+        return strcmp(entry.key, key) == 0;
+    }
+
+    const char* listed = reinterpret_cast<const char*>(entry.value);
+    const char* end = listed + entry.size;
+    for (; listed < end; listed += strlen(listed) + 1) {
+        if (strcmp(listed, key) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FlashWriter::flush(uint32_t timeoutMs) {
+    if (mutex == nullptr || writerTask.load() == nullptr || xTaskGetCurrentTaskHandle() == writerTask.load()) {
+        return false;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t target = writeSequence;
+    xSemaphoreGive(mutex);
+
+    uint32_t startMs = millis();
+
+    for (;;) {
+        // Done when nothing that became pending up to target is still queued
+        bool waiting = false;
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        for (uint8_t i = 0; i < FLASH_QUEUE_SLOTS && !waiting; i++) {
+            waiting = entries[i].state != FREE && static_cast<int32_t>(entries[i].since - target) <= 0;
+        }
+        xSemaphoreGive(mutex);
+
+        if (!waiting) {
+            return true;
+        }
+        if (millis() - startMs >= timeoutMs) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+size_t FlashWriter::readBytes(const char* ns, const char* key, void* data, size_t size) {
+    if (mutex != nullptr) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        Entry* entry = findLatest(ns, key);
+        if (entry != nullptr) {
+            size_t read = 0;
+            if (entry->type == BLOB && entry->size <= size) {
+                memcpy(data, entry->value, entry->size);
+                read = entry->size;
+            }
+            xSemaphoreGive(mutex);
+            return read;
+        }
+        xSemaphoreGive(mutex);
+    }
+
+    // Nothing pending: flash holds the current value
+    Preferences prefs;
+    if (!prefs.begin(ns, true)) {
+        return 0;  // Namespace does not exist until its first write
+    }
+
+    size_t read = prefs.isKey(key) ? prefs.getBytes(key, data, size) : 0;
+    prefs.end();
+    return read;
+}
+
+uint16_t FlashWriter::readUShort(const char* ns, const char* key, uint16_t defaultValue) {
+    if (mutex != nullptr) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        Entry* entry = findLatest(ns, key);
+        if (entry != nullptr) {
+            uint16_t value = defaultValue;
+            if (entry->type == USHORT) {
+                memcpy(&value, entry->value, sizeof(value));
+            }
+            xSemaphoreGive(mutex);
+            return value;
+        }
+        xSemaphoreGive(mutex);
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(ns, true)) {
+        return defaultValue;
+    }
+
+    uint16_t value = prefs.isKey(key) ? prefs.getUShort(key, defaultValue) : defaultValue;
+    prefs.end();
+    return value;
+}
+
+String FlashWriter::readString(const char* ns, const char* key, const char* defaultValue) {
+    if (mutex != nullptr) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        Entry* entry = findLatest(ns, key);
+        if (entry != nullptr) {
+            String value = (entry->type == STRING) ? String(reinterpret_cast<const char*>(entry->value)) :
+                                                     String(defaultValue);
+            xSemaphoreGive(mutex);
+            return value;
+        }
+        xSemaphoreGive(mutex);
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(ns, true)) {
+        return String(defaultValue);
+    }
+
+    String value = prefs.isKey(key) ? prefs.getString(key, defaultValue) : String(defaultValue);
+    prefs.end();
+    return value;
+}
+
+bool FlashWriter::hasKey(const char* ns, const char* key) {
+    if (mutex != nullptr) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        Entry* entry = findLatest(ns, key);
+        if (entry != nullptr) {
+            bool exists = entry->type != REMOVE && entry->type != CLEAR && entry->type != REMOVE_KEYS;
+            xSemaphoreGive(mutex);
+            return exists;
+        }
+        xSemaphoreGive(mutex);
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(ns, true)) {
+        return false;
+    }
+
+    bool exists = prefs.isKey(key);
+    prefs.end();
+    return exists;
+}
+
+uint16_t FlashWriter::countKeys(const char* ns, const char* keys, size_t size) {
+    Preferences prefs;
+    bool stored = prefs.begin(ns, true);  // Namespace does not exist until its first write
+
+    // The mutex stays held across the lookups (NVS reads, no erase) so a
+    // commit in between cannot make a key count twice or not at all
+    if (mutex != nullptr) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+    }
+
+    uint16_t count = 0;
+    const char* end = keys + size;
+    for (const char* key = keys; key < end; key += strlen(key) + 1) {
+        Entry* entry = (mutex != nullptr) ? findLatest(ns, key) : nullptr;
+        bool exists = (entry != nullptr) ? (entry->type != REMOVE && entry->type != CLEAR && entry->type != REMOVE_KEYS) :
+                                           (stored && prefs.isKey(key));
+        if (exists) {
+            count++;
+        }
+    }
+
+    if (mutex != nullptr) {
+        xSemaphoreGive(mutex);
+    }
+    if (stored) {
+        prefs.end();
+    }
+    return count;
+}
+
+void FlashWriter::holdCommits() {
+    holdCount.fetch_add(1);
+}
+
+void FlashWriter::releaseCommits() {
+    holdCount.fetch_sub(1);
+
+    TaskHandle_t task = writerTask.load(std::memory_order_relaxed);
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
+}
+
+bool FlashWriter::commit(const Entry& entry, const uint8_t* value) {
+    Preferences prefs;
+    if (!prefs.begin(entry.ns, false)) {
+        return false;
+    }
+
+    bool success = true;
+    bool wrote = true;
+
+    switch (entry.type) {
+        case BLOB:
+            success = prefs.putBytes(entry.key, value, entry.size) == entry.size;
+            break;
+
+        case USHORT: {
+            uint16_t number;
+            memcpy(&number, value, sizeof(number));
+            success = prefs.putUShort(entry.key, number) == sizeof(number);
+            break;
+        }
+
+        case STRING:
+            success = prefs.putString(entry.key, reinterpret_cast<const char*>(value)) == static_cast<size_t>(entry.size - 1);
+            break;
+
+        case REMOVE:
+            // Removing an absent key is not an error (and costs no erase)
+            wrote = prefs.isKey(entry.key);
+            success = !wrote || prefs.remove(entry.key);
+            break;
+
+        case CLEAR:
+            success = prefs.clear();
+            break;
+
+        case REMOVE_KEYS: {
+            // Counted per key actually erased
+            wrote = false;
+            const char* end = reinterpret_cast<const char*>(value) + entry.size;
+            for (const char* key = reinterpret_cast<const char*>(value); key < end; key += strlen(key) + 1) {
+                if (prefs.isKey(key)) {
+                    success &= prefs.remove(key);
+                    Metrics::recordFlashWrite(entry.subsystem);
+                }
+            }
+            break;
+        }
+    }
+
+    prefs.end();
+
+    if (wrote) {
+        Metrics::recordFlashWrite(entry.subsystem);
+    }
+    return success;
+}
+
+void FlashWriter::taskFunction(void* parameters) {
+    uint32_t heldSinceMs = 0;
+    bool held = false;
+    uint32_t waitMs = 1000;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+        waitMs = 1000;
+
+        for (;;) {
+            // Leave the flash cache alone while a motor runs, within limits
+            if (holdCount.load() > 0) {
+                if (!held) {
+                    held = true;
+                    heldSinceMs = millis();
+                }
+                if (millis() - heldSinceMs < FLASH_MAX_HOLD_MS) {
+                    break;  // Woken again by releaseCommits() or the 1 s timeout
+                }
+            } else {
+                held = false;
+            }
+
+            // Oldest pending entry
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            Entry* entry = nullptr;
+            for (uint8_t i = 0; i < FLASH_QUEUE_SLOTS; i++) {
+                if (entries[i].state == PENDING &&
+                    (entry == nullptr || static_cast<int32_t>(entries[i].order - entry->order) < 0)) {
+                    entry = &entries[i];
+                }
+            }
+            uint32_t nowMs = millis();
+            if (entry != nullptr && entry->attempts > 0 && static_cast<int32_t>(entry->retryAtMs - nowMs) > 0) {
+                // Failed before: everything behind it waits too, so commit order is kept
+                waitMs = entry->retryAtMs - nowMs;
+                xSemaphoreGive(mutex);
+                break;
+            }
+            if (entry != nullptr) {
+                // A committing entry is never modified, so it is read below without the mutex
+                entry->state = COMMITTING;
+            }
+            xSemaphoreGive(mutex);
+
+            if (entry == nullptr) {
+                break;
+            }
+
+            uint32_t startUs = static_cast<uint32_t>(esp_timer_get_time());
+            bool success = commit(*entry, entry->value);
+            uint32_t endUs = static_cast<uint32_t>(esp_timer_get_time());
+
+            uint32_t durationUs = endUs - startUs;
+            uint32_t latency = (endUs - entry->queuedUs) / 1000;
+
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            if (!success && entry->attempts + 1 < FLASH_COMMIT_ATTEMPTS) {
+                // Keep it queued (writes to its key still coalesce into it) and back off
+                uint32_t delayMs = static_cast<uint32_t>(FLASH_RETRY_DELAY_MS) << entry->attempts;
+                entry->attempts++;
+                entry->retryAtMs = millis() + delayMs;
+                entry->state = PENDING;
+                retries.fetch_add(1, std::memory_order_relaxed);
+                LOG_WARN("Commit failed: %s/%s - retry in %lu ms", entry->ns, entry->key, (unsigned long)delayMs);
+                xSemaphoreGive(mutex);
+                continue;
+            }
+            if (!success) {
+                failures.fetch_add(1, std::memory_order_relaxed);
+                LOG_ERROR("Commit failed after %d attempts - dropped %s/%s", FLASH_COMMIT_ATTEMPTS, entry->ns, entry->key);
+                dropConditional();
+            }
+            entry->state = FREE;
+            xSemaphoreGive(mutex);
+            depth.fetch_sub(1, std::memory_order_relaxed);
+
+            commits.fetch_add(1, std::memory_order_relaxed);
+            commitTimeUs.fetch_add(durationUs, std::memory_order_relaxed);
+            latencyMs.fetch_add(latency, std::memory_order_relaxed);
+            if (durationUs > maxCommitTimeUs.load(std::memory_order_relaxed)) {
+                maxCommitTimeUs.store(durationUs, std::memory_order_relaxed);
+            }
+            if (latency > maxLatencyMs.load(std::memory_order_relaxed)) {
+                maxLatencyMs.store(latency, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void FlashWriter::dropConditional() {
+    // The failed entry was the oldest pending one, so every other pending entry was queued after it
+    for (uint8_t i = 0; i < FLASH_QUEUE_SLOTS; i++) {
+        Entry& candidate = entries[i];
+        if (candidate.state == PENDING && candidate.conditional) {
+            LOG_WARN("Removal of %s/%s dropped with it", candidate.ns, candidate.key);
+            candidate.state = FREE;
+            depth.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void FlashWriter::writeMetrics(Print& out) {
+    Metrics::writeMetric(out, "squaredose_flash_queue_depth", "gauge", "Flash writes waiting to be committed",
+                         static_cast<uint32_t>(depth.load(std::memory_order_relaxed)));
+    Metrics::writeMetric(out, "squaredose_flash_queue_depth_max", "gauge", "Highest flash queue depth since boot",
+                         static_cast<uint32_t>(maxDepth.load(std::memory_order_relaxed)));
+    Metrics::writeMetric(out, "squaredose_flash_commits_total", "counter", "Flash queue entries committed",
+                         commits.load(std::memory_order_relaxed));
+    Metrics::writeMetric(out, "squaredose_flash_coalesced_total", "counter",
+                         "Pending flash writes replaced by a newer write of the same key",
+                         coalesced.load(std::memory_order_relaxed));
+    Metrics::writeMetric(out, "squaredose_flash_commit_failures_total", "counter",
+                         "Flash writes dropped after every commit attempt failed",
+                         failures.load(std::memory_order_relaxed));
+    Metrics::writeMetric(out, "squaredose_flash_commit_retries_total", "counter",
+                         "Failed flash commits queued again for a retry",
+                         retries.load(std::memory_order_relaxed));
+    Metrics::writeMetric(out, "squaredose_flash_queue_full_total", "counter",
+                         "Flash writes and reservations refused because the queue stayed full",
+                         rejected.load(std::memory_order_relaxed));
+
+    uint32_t count = commits.load(std::memory_order_relaxed);
+
+    Metrics::writeHeader(out, "squaredose_flash_commit_duration_seconds", "summary", "Time spent writing to NVS");
+    out.printf("squaredose_flash_commit_duration_seconds_sum %.6f\n",
+               commitTimeUs.load(std::memory_order_relaxed) / 1000000.0);
+    out.printf("squaredose_flash_commit_duration_seconds_count %lu\n", (unsigned long)count);
+    Metrics::writeHeader(out, "squaredose_flash_commit_duration_max_seconds", "gauge", "Longest single commit");
+    out.printf("squaredose_flash_commit_duration_max_seconds %.6f\n",
+               maxCommitTimeUs.load(std::memory_order_relaxed) / 1000000.0);
+
+    Metrics::writeHeader(out, "squaredose_flash_write_latency_seconds", "summary", "Time from queueing to committed");
+    out.printf("squaredose_flash_write_latency_seconds_sum %.3f\n", latencyMs.load(std::memory_order_relaxed) / 1000.0);
+    out.printf("squaredose_flash_write_latency_seconds_count %lu\n", (unsigned long)count);
+    Metrics::writeHeader(out, "squaredose_flash_write_latency_max_seconds", "gauge", "Longest queued-to-committed time");
+    out.printf("squaredose_flash_write_latency_max_seconds %.3f\n", maxLatencyMs.load(std::memory_order_relaxed) / 1000.0);
+}
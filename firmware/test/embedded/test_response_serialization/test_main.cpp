@@ -0,0 +1,117 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <unity.h>
+
+// Heap cost of sending a full /api/logs/hourly body (336 rows) through the
+// old path (serializeJson into a String, copied into an AsyncBasicResponse)
+// and the current one (measureJson, then serializeJson straight into a
+// pre-sized AsyncResponseStream). Prints peak heap use, the largest free
+// block left afterwards and the time taken for each.
+
+static const uint16_t LOG_ROWS = 336;
+static const uint8_t MAX_BALLAST_BLOCKS = 32;
+
+struct HeapSample {
+    uint32_t peakUsed;       // Bytes in use at the lowest free heap point
+    uint32_t largestBlock;   // Largest free block after the response is gone
+    uint32_t durationUs;
+};
+
+static void buildHourlyLogs(JsonDocument& doc) {
+    JsonArray logs = doc["logs"].to<JsonArray>();
+    for (uint16_t i = 0; i < LOG_ROWS; i++) {
+        JsonObject log = logs.add<JsonObject>();
+        log["hourTimestamp"] = 1768617600UL + (i / 4) * 3600UL;
+        log["head"] = i % 4;
+        log["scheduledVolume"] = 1.25f + i;
+        log["adhocVolume"] = 0.5f;
+        log["totalVolume"] = 1.75f + i;
+    }
+    doc["count"] = LOG_ROWS;
+}
+
+/**
+ * Run fn and sample the heap. Ballast first brings free heap below the
+ * lowest point since boot, so ESP.getMinFreeHeap() then records fn's own
+ * peak, including short-lived reallocations a before/after reading misses.
+ */
+template <typename Function>
+static HeapSample measure(Function fn) {
+    void* ballast[MAX_BALLAST_BLOCKS] = {};
+    uint32_t target = ESP.getFreeHeap() - ESP.getMinFreeHeap() + 1024;
+    for (uint8_t i = 0; i < MAX_BALLAST_BLOCKS && target > 0; i++) {
+        uint32_t size = ESP.getMaxAllocHeap() / 2;
+        if (size > target) {
+            size = target;
+        }
+        ballast[i] = malloc(size);
+        if (ballast[i] == nullptr) {
+            break;
+        }
+        target -= size;
+    }
+
+    uint32_t freeBefore = ESP.getFreeHeap();
+    uint32_t start = micros();
+    fn();
+    uint32_t duration = micros() - start;
+
+    HeapSample sample;
+    sample.peakUsed = freeBefore - ESP.getMinFreeHeap();
+    sample.durationUs = duration;
+
+    for (uint8_t i = 0; i < MAX_BALLAST_BLOCKS; i++) {
+        free(ballast[i]);
+    }
+    sample.largestBlock = ESP.getMaxAllocHeap();
+    return sample;
+}
+
+static void printSample(const char* path, const HeapSample& sample) {
+    char line[128];
+    snprintf(line, sizeof(line), "%s: peak %lu bytes, largest free block after %lu bytes, %lu us", path,
+             (unsigned long)sample.peakUsed, (unsigned long)sample.largestBlock, (unsigned long)sample.durationUs);
+    TEST_MESSAGE(line);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_stream_path_peaks_below_string_path() {
+    JsonDocument doc;
+    buildHourlyLogs(doc);
+    TEST_ASSERT_FALSE(doc.overflowed());
+
+    HeapSample before = measure([&doc]() {
+        String json;
+        serializeJson(doc, json);
+        AsyncWebServerResponse* response = new AsyncBasicResponse(200, "application/json", json);
+        delete response;
+    });
+
+    HeapSample after = measure([&doc]() {
+        AsyncResponseStream* response = new AsyncResponseStream("application/json", measureJson(doc));
+        serializeJson(doc, *response);
+        delete response;
+    });
+
+    printSample("String + copy (before)", before);
+    printSample("measureJson + stream (after)", after);
+
+    // The stream holds the body once; the String path holds it twice at its peak
+    TEST_ASSERT_LESS_THAN_UINT32(before.peakUsed, after.peakUsed);
+}
+
+void setup() {
+    delay(2000);  // Let the serial monitor attach
+    UNITY_BEGIN();
+    RUN_TEST(test_stream_path_peaks_below_string_path);
+    UNITY_END();
+}
+
+void loop() {
+}
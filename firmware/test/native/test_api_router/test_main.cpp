@@ -0,0 +1,185 @@
+#include <unity.h>
+#include "network/ApiRouter.h"
+#include "hal/PowerManager.h"
+#include "diagnostics/Log.h"
+
+// Registers REST-style patterns and feeds request paths through canHandle()
+// and handleRequest(), covering pattern compilation, exact segment matching
+// and the decimal parsing of {name:u8|u16|u32} parameters.
+
+static ApiRouter* router;
+static int matchedRoute;   // Id of the route whose handler ran, -1 if none
+static RouteParams matchedParams;
+
+void LogRecord::add(const char*) {
+}
+
+void Log::push(const LogRecord&) {
+}
+
+void PowerManager::acquire(PowerLock) {
+}
+
+void PowerManager::release(PowerLock) {
+}
+
+void PowerManager::recordHandlerTime(uint32_t, bool) {
+}
+
+static RouteRequestHandler handlerFor(int id) {
+    return [id](AsyncWebServerRequest*, const RouteParams& params) {
+        matchedRoute = id;
+        matchedParams = params;
+    };
+}
+
+/**
+ * Dispatch a request the way the server does; returns the id of the route that ran
+ */
+static int dispatch(WebRequestMethodComposite method, const char* url) {
+    AsyncWebServerRequest request(method, url);
+    matchedRoute = -1;
+    matchedParams.count = 0;
+
+    if (!router->canHandle(&request)) {
+        return -1;
+    }
+    router->handleRequest(&request);
+    TEST_ASSERT_TRUE(matchedRoute >= 0);
+    return matchedRoute;
+}
+
+void setUp() {
+    router = new ApiRouter();
+}
+
+void tearDown() {
+    delete router;
+}
+
+void test_invalid_patterns_are_rejected() {
+    TEST_ASSERT_FALSE(router->on(HTTP_GET, "api/status", handlerFor(0)));
+    TEST_ASSERT_FALSE(router->on(HTTP_GET, "/", handlerFor(0)));
+    TEST_ASSERT_FALSE(router->on(HTTP_GET, "/api/status/", handlerFor(0)));
+    TEST_ASSERT_FALSE(router->on(HTTP_GET, "/api//status", handlerFor(0)));
+    TEST_ASSERT_FALSE(router->on(HTTP_GET, "/api/{head:i8}", handlerFor(0)));
+    TEST_ASSERT_FALSE(router->on(HTTP_GET, "/api/{head}", handlerFor(0)));
+    TEST_ASSERT_FALSE(router->on(HTTP_GET, "/api/{head:u8", handlerFor(0)));
+    TEST_ASSERT_FALSE(router->on(HTTP_GET, "/a/b/c/d/e/f/g", handlerFor(0)));
+    TEST_ASSERT_FALSE(router->on(HTTP_GET, "/{a:u8}/{b:u8}/{c:u8}/{d:u8}", handlerFor(0)));
+    TEST_ASSERT_EQUAL_UINT8(0, router->getRouteCount());
+
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/a/b/c/d/e/f", handlerFor(0)));
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/{a:u8}/{b:u16}/{c:u32}", handlerFor(1)));
+    TEST_ASSERT_EQUAL_UINT8(2, router->getRouteCount());
+}
+
+void test_matching_is_exact_not_prefix() {
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/api/schedules", handlerFor(0)));
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/api/schedules/{head:u8}", handlerFor(1)));
+
+    TEST_ASSERT_EQUAL_INT(0, dispatch(HTTP_GET, "/api/schedules"));
+    TEST_ASSERT_EQUAL_INT(1, dispatch(HTTP_GET, "/api/schedules/2"));
+    TEST_ASSERT_EQUAL_UINT8(1, matchedParams.count);
+    TEST_ASSERT_EQUAL_UINT32(2, matchedParams.values[0]);
+
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/schedule"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/schedulesx"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/schedules/2/extra"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "api/schedules"));
+}
+
+void test_registration_order_does_not_matter() {
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/api/schedules/{head:u8}", handlerFor(1)));
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/api/schedules", handlerFor(0)));
+
+    TEST_ASSERT_EQUAL_INT(0, dispatch(HTTP_GET, "/api/schedules"));
+    TEST_ASSERT_EQUAL_INT(1, dispatch(HTTP_GET, "/api/schedules/3"));
+}
+
+void test_method_selects_the_route() {
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/api/time", handlerFor(0)));
+    TEST_ASSERT_TRUE(router->on(HTTP_POST | HTTP_PUT, "/api/time", handlerFor(1)));
+
+    TEST_ASSERT_EQUAL_INT(0, dispatch(HTTP_GET, "/api/time"));
+    TEST_ASSERT_EQUAL_INT(1, dispatch(HTTP_POST, "/api/time"));
+    TEST_ASSERT_EQUAL_INT(1, dispatch(HTTP_PUT, "/api/time"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_DELETE, "/api/time"));
+}
+
+void test_trailing_slash_does_not_match() {
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/api/schedules", handlerFor(0)));
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/api/schedules/{head:u8}", handlerFor(1)));
+
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/schedules/"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/schedules/2/"));
+}
+
+void test_empty_segments_do_not_match() {
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/api/schedules/{head:u8}", handlerFor(1)));
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/api/heads/{head:u8}/calibration", handlerFor(2)));
+
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api//schedules/1"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "//api/schedules/1"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/heads//calibration"));
+    TEST_ASSERT_EQUAL_INT(2, dispatch(HTTP_GET, "/api/heads/0/calibration"));
+    TEST_ASSERT_EQUAL_UINT32(0, matchedParams.values[0]);
+}
+
+void test_parameter_must_fit_its_type() {
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/u8/{v:u8}", handlerFor(0)));
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/u16/{v:u16}", handlerFor(1)));
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/u32/{v:u32}", handlerFor(2)));
+    TEST_ASSERT_TRUE(router->on(HTTP_DELETE, "/api/schedules/{head:u8}", handlerFor(3)));
+
+    TEST_ASSERT_EQUAL_INT(0, dispatch(HTTP_GET, "/u8/255"));
+    TEST_ASSERT_EQUAL_UINT32(255, matchedParams.values[0]);
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/u8/256"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_DELETE, "/api/schedules/256"));
+
+    TEST_ASSERT_EQUAL_INT(1, dispatch(HTTP_GET, "/u16/65535"));
+    TEST_ASSERT_EQUAL_UINT32(65535, matchedParams.values[0]);
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/u16/65536"));
+
+    TEST_ASSERT_EQUAL_INT(2, dispatch(HTTP_GET, "/u32/4294967295"));
+    TEST_ASSERT_EQUAL_UINT32(4294967295u, matchedParams.values[0]);
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/u32/4294967296"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/u32/99999999999"));
+}
+
+void test_parameter_must_be_plain_decimal() {
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/api/schedules/{head:u8}", handlerFor(0)));
+
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/schedules/+1"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/schedules/-1"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/schedules/ 1"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/schedules/0x1"));
+    TEST_ASSERT_EQUAL_INT(-1, dispatch(HTTP_GET, "/api/schedules/1a"));
+    TEST_ASSERT_EQUAL_INT(0, dispatch(HTTP_GET, "/api/schedules/007"));
+    TEST_ASSERT_EQUAL_UINT32(7, matchedParams.values[0]);
+}
+
+void test_parameters_are_passed_in_pattern_order() {
+    TEST_ASSERT_TRUE(router->on(HTTP_GET, "/{a:u8}/x/{b:u16}/{c:u32}", handlerFor(0)));
+
+    TEST_ASSERT_EQUAL_INT(0, dispatch(HTTP_GET, "/1/x/300/70000"));
+    TEST_ASSERT_EQUAL_UINT8(3, matchedParams.count);
+    TEST_ASSERT_EQUAL_UINT32(1, matchedParams.values[0]);
+    TEST_ASSERT_EQUAL_UINT32(300, matchedParams.values[1]);
+    TEST_ASSERT_EQUAL_UINT32(70000, matchedParams.values[2]);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_invalid_patterns_are_rejected);
+    RUN_TEST(test_matching_is_exact_not_prefix);
+    RUN_TEST(test_registration_order_does_not_matter);
+    RUN_TEST(test_method_selects_the_route);
+    RUN_TEST(test_trailing_slash_does_not_match);
+    RUN_TEST(test_empty_segments_do_not_match);
+    RUN_TEST(test_parameter_must_fit_its_type);
+    RUN_TEST(test_parameter_must_be_plain_decimal);
+    RUN_TEST(test_parameters_are_passed_in_pattern_order);
+    return UNITY_END();
+}
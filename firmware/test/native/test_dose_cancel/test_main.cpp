@@ -0,0 +1,161 @@
+#include <unity.h>
+#include <atomic>
+#include "scheduling/DoseWorkerPool.h"
+#include "hal/PowerManager.h"
+#include "diagnostics/Log.h"
+#include "diagnostics/Metrics.h"
+
+// Runs the real dose workers, dosing heads and motor driver on host threads and
+// fires the emergency stop of POST /api/emergency-stop against them, including
+// a stop that lands after a worker took its job but before its motor started.
+
+static const float DOSE_ML = 2.0f;          // 2 s at the default 1 mL/s
+static const uint32_t STOPPED_WITHIN_MS = 500;
+
+static MotorDriver motorDriver;
+static DosingHead* heads[NUM_MOTORS];
+static DoseWorkerPool pool;
+
+// Set to make the next dose's power lock run the emergency stop, i.e. just
+// after the worker's epoch check and before the head marks itself dispensing
+static std::atomic<bool> stopOnPowerLock(false);
+
+void LogRecord::add(const char*) {
+}
+
+void Log::push(const LogRecord&) {
+}
+
+void Metrics::registerTask(TaskHandle_t) {
+}
+
+void Metrics::recordFlashWrite(FlashSubsystem) {
+}
+
+void Metrics::recordDose(uint8_t, bool, bool, float) {
+}
+
+void Metrics::writeHeader(Print&, const char*, const char*, const char*) {
+}
+
+void Metrics::writeMetric(Print&, const char*, const char*, const char*, uint32_t) {
+}
+
+static void emergencyStop() {
+    pool.cancelAll();
+    motorDriver.emergencyStopAll();
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        heads[i]->cancelDispensing();
+    }
+}
+
+void PowerManager::acquire(PowerLock lock) {
+    if (lock == PowerLock::DOSE && stopOnPowerLock.exchange(false)) {
+        emergencyStop();
+    }
+}
+
+void PowerManager::release(PowerLock) {
+}
+
+struct Completion {
+    std::atomic<bool> done;
+    DosingResult result;
+};
+
+static void onComplete(const DoseJob&, const DosingResult& result, void* context) {
+    Completion* completion = static_cast<Completion*>(context);
+    completion->result = result;
+    completion->done.store(true);
+}
+
+static void submitDose(Completion& completion) {
+    completion.done.store(false);
+    DoseJob job = {0, DOSE_ML, DoseSource::ADHOC, static_cast<uint32_t>(millis()), onComplete, &completion, 0};
+    TEST_ASSERT_TRUE(pool.submit(job) == DoseSubmitResult::ACCEPTED);
+}
+
+static bool waitFor(const std::atomic<bool>& flag, uint32_t timeoutMs) {
+    uint32_t startMs = millis();
+    while (!flag.load()) {
+        if (millis() - startMs > timeoutMs) {
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+static void assertCancelledWithin(Completion& completion, uint32_t startMs) {
+    TEST_ASSERT_TRUE(waitFor(completion.done, 5000));
+    TEST_ASSERT_LESS_THAN_UINT32(STOPPED_WITHIN_MS, millis() - startMs);
+    TEST_ASSERT_TRUE(completion.result.cancelled);
+    TEST_ASSERT_FALSE(completion.result.success);
+    TEST_ASSERT_FALSE(motorDriver.isMotorRunning(0));
+}
+
+void setUp() {
+    stopOnPowerLock.store(false);
+}
+
+void tearDown() {
+}
+
+void test_stop_before_the_motor_starts_cancels_the_taken_job() {
+    Completion completion;
+    stopOnPowerLock.store(true);
+
+    uint32_t startMs = millis();
+    submitDose(completion);
+    assertCancelledWithin(completion, startMs);
+    TEST_ASSERT_FALSE(stopOnPowerLock.load());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, completion.result.estimatedVolume);
+}
+
+void test_stop_while_dispensing_cancels_the_running_dose() {
+    Completion completion;
+    submitDose(completion);
+
+    uint32_t startMs = millis();
+    while (!heads[0]->isDispensing()) {
+        TEST_ASSERT_LESS_THAN_UINT32(STOPPED_WITHIN_MS, millis() - startMs);
+        delay(1);
+    }
+    delay(50);
+
+    startMs = millis();
+    emergencyStop();
+    assertCancelledWithin(completion, startMs);
+    TEST_ASSERT_TRUE(completion.result.estimatedVolume < DOSE_ML);
+}
+
+void test_dose_after_a_stop_runs_to_completion() {
+    Completion completion;
+    stopOnPowerLock.store(true);
+    submitDose(completion);
+    TEST_ASSERT_TRUE(waitFor(completion.done, 5000));
+    TEST_ASSERT_TRUE(completion.result.cancelled);
+
+    uint32_t startMs = millis();
+    submitDose(completion);
+    TEST_ASSERT_TRUE(waitFor(completion.done, 5000));
+    TEST_ASSERT_TRUE(completion.result.success);
+    TEST_ASSERT_FALSE(completion.result.cancelled);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(static_cast<uint32_t>(DOSE_ML * 1000), millis() - startMs);
+}
+
+int main(int argc, char** argv) {
+    motorDriver.begin();
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        heads[i] = new DosingHead(i, &motorDriver);
+        heads[i]->begin();
+    }
+    pool.begin(heads, NUM_MOTORS);
+    pool.start();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_stop_before_the_motor_starts_cancels_the_taken_job);
+    RUN_TEST(test_stop_while_dispensing_cancels_the_running_dose);
+    RUN_TEST(test_dose_after_a_stop_runs_to_completion);
+    return UNITY_END();
+}
@@ -0,0 +1,292 @@
+#include <unity.h>
+#include <map>
+#include <string>
+#include <thread>
+#include "storage/FlashWriter.h"
+#include "diagnostics/Log.h"
+#include <Preferences.h>
+
+// Runs the real FlashWriter task against the in-memory Preferences shim.
+// Covers a full /api/batch commit (journal, 4 schedules, 4 calibrations,
+// journal removal) queued while a dose holds commits, including a queue
+// already full of dose-time writes, commits that fail and are retried or
+// dropped (keeping the journal), and log pruning's batched key removal.
+
+static const uint8_t BATCH_HEADS = 4;
+static const size_t JOURNAL_SIZE = 676;  // Journal with 8 records on the ESP32
+static const size_t SCHEDULE_SIZE = 72;
+static const size_t CALIBRATION_SIZE = 80;
+
+// Log and metrics sinks: messages are dropped, metric values are kept by name
+static std::map<std::string, uint32_t> metrics;
+
+void LogRecord::add(const char*) {
+}
+
+void Log::push(const LogRecord&) {
+}
+
+void Metrics::registerTask(TaskHandle_t) {
+}
+
+void Metrics::recordFlashWrite(FlashSubsystem) {
+}
+
+void Metrics::writeHeader(Print&, const char*, const char*, const char*) {
+}
+
+void Metrics::writeMetric(Print&, const char* name, const char*, const char*, uint32_t value) {
+    metrics[name] = value;
+}
+
+class NullPrint : public Print {
+public:
+    size_t write(uint8_t) override { return 1; }
+};
+
+static uint32_t readMetric(const char* name) {
+    NullPrint out;
+    FlashWriter::writeMetrics(out);
+    return metrics[name];
+}
+
+static bool isStored(const char* ns, const char* key) {
+    ShimNvs& nvs = shimNvs();
+    std::lock_guard<std::mutex> lock(nvs.mutex);
+    return nvs.namespaces.count(ns) > 0 && nvs.namespaces[ns].count(key) > 0;
+}
+
+static uint32_t storedWrites() {
+    ShimNvs& nvs = shimNvs();
+    std::lock_guard<std::mutex> lock(nvs.mutex);
+    return nvs.writes;
+}
+
+static void failNextWrites(uint32_t count) {
+    ShimNvs& nvs = shimNvs();
+    std::lock_guard<std::mutex> lock(nvs.mutex);
+    nvs.failWrites = count;
+}
+
+static std::string key(const char* prefix, int index) {
+    return prefix + std::to_string(index);
+}
+
+/**
+ * Queue what a dose writes: one hourly log entry per key
+ */
+static void queueDoseLogs(int count) {
+    uint8_t log[32] = {};
+    for (int i = 0; i < count; i++) {
+        TEST_ASSERT_TRUE(FlashWriter::putBytes("dosinglogs", key("h", i).c_str(), log, sizeof(log), FlashSubsystem::LOGS));
+    }
+}
+
+/**
+ * The writes ConfigTransaction::commit() queues for 4 schedules and 4 calibrations
+ * @return true if every write was queued
+ */
+static bool commitBatch() {
+    FlashReservation reservation(2 * BATCH_HEADS + 1, 1);
+    if (!reservation.isReserved()) {
+        return false;
+    }
+
+    uint8_t journal[JOURNAL_SIZE] = {1};
+    uint8_t schedule[SCHEDULE_SIZE] = {};
+    uint8_t calibration[CALIBRATION_SIZE] = {};
+    bool success = FlashWriter::putBytes("cfgjournal", "pending", journal, sizeof(journal), FlashSubsystem::JOURNAL);
+    FlashWriter::barrier();
+
+    for (int head = 0; head < BATCH_HEADS; head++) {
+        success &= FlashWriter::putBytes("schedules", key("head", head).c_str(), schedule, sizeof(schedule),
+                                         FlashSubsystem::SCHEDULES);
+    }
+    for (int head = 0; head < BATCH_HEADS; head++) {
+        success &= FlashWriter::putBytes(key("head", head).c_str(), "calBlob", calibration, sizeof(calibration),
+                                         FlashSubsystem::CALIBRATION);
+    }
+
+    FlashWriter::barrier();
+    success &= FlashWriter::removeIfCommitted("cfgjournal", "pending", FlashSubsystem::JOURNAL);
+    return success;
+}
+
+static void assertBatchStored() {
+    for (int head = 0; head < BATCH_HEADS; head++) {
+        TEST_ASSERT_TRUE(isStored("schedules", key("head", head).c_str()));
+        TEST_ASSERT_TRUE(isStored(key("head", head).c_str(), "calBlob"));
+    }
+    TEST_ASSERT_FALSE(isStored("cfgjournal", "pending"));
+}
+
+void setUp() {
+    shimNvs().reset();
+}
+
+void tearDown() {
+    TEST_ASSERT_TRUE(FlashWriter::flush(5000));
+}
+
+void test_batch_is_queued_while_a_dose_holds_commits() {
+    FlashWriter::holdCommits();
+    queueDoseLogs(12);
+
+    // The storage worker commits while the dose is still running
+    bool committed = false;
+    std::thread worker([&committed]() { committed = commitBatch(); });
+    worker.join();
+
+    TEST_ASSERT_TRUE(committed);
+    TEST_ASSERT_EQUAL_UINT32(0, storedWrites());
+
+    FlashWriter::releaseCommits();
+    TEST_ASSERT_TRUE(FlashWriter::flush(2000));
+    assertBatchStored();
+    TEST_ASSERT_TRUE(isStored("dosinglogs", "h11"));
+}
+
+void test_batch_waits_for_the_dose_when_the_queue_is_full() {
+    FlashWriter::holdCommits();
+    queueDoseLogs(FLASH_QUEUE_SLOTS - FLASH_LARGE_SLOTS);
+
+    // The dose ends well after FLASH_QUEUE_FULL_WAIT_MS
+    const uint32_t doseMs = FLASH_QUEUE_FULL_WAIT_MS * 3;
+    std::thread dose([doseMs]() {
+        delay(doseMs);
+        FlashWriter::releaseCommits();
+    });
+
+    uint32_t startMs = millis();
+    bool committed = commitBatch();
+    uint32_t elapsedMs = millis() - startMs;
+    dose.join();
+
+    TEST_ASSERT_TRUE(committed);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(doseMs, elapsedMs);
+
+    TEST_ASSERT_TRUE(FlashWriter::flush(2000));
+    assertBatchStored();
+}
+
+void test_reserved_entries_are_kept_for_the_owner() {
+    FlashWriter::holdCommits();
+    TEST_ASSERT_TRUE(FlashWriter::reserve(2, 0));
+
+    // Another task fills everything else, spilling into the large entries
+    uint32_t rejectedBefore = readMetric("squaredose_flash_queue_full_total");
+    int queued = 0;
+    std::thread other([&queued]() {
+        uint8_t log[32] = {};
+        while (FlashWriter::putBytes("dosinglogs", key("h", queued).c_str(), log, sizeof(log), FlashSubsystem::LOGS)) {
+            queued++;
+        }
+    });
+    other.join();
+    TEST_ASSERT_EQUAL(FLASH_QUEUE_SLOTS - 2, queued);
+    TEST_ASSERT_EQUAL_UINT32(rejectedBefore + 1, readMetric("squaredose_flash_queue_full_total"));
+
+    uint8_t schedule[SCHEDULE_SIZE] = {};
+    TEST_ASSERT_TRUE(FlashWriter::putBytes("schedules", "head0", schedule, sizeof(schedule), FlashSubsystem::SCHEDULES));
+    TEST_ASSERT_TRUE(FlashWriter::putBytes("schedules", "head1", schedule, sizeof(schedule), FlashSubsystem::SCHEDULES));
+    TEST_ASSERT_FALSE(FlashWriter::putBytes("schedules", "head2", schedule, sizeof(schedule), FlashSubsystem::SCHEDULES));
+
+    FlashWriter::unreserve();
+    FlashWriter::releaseCommits();
+}
+
+void test_failed_commit_is_retried_in_order() {
+    uint32_t retriesBefore = readMetric("squaredose_flash_commit_retries_total");
+    uint32_t failuresBefore = readMetric("squaredose_flash_commit_failures_total");
+    uint8_t value[16] = {};
+
+    failNextWrites(2);
+    TEST_ASSERT_TRUE(FlashWriter::putBytes("cfgjournal", "pending", value, sizeof(value), FlashSubsystem::JOURNAL));
+    FlashWriter::barrier();
+    TEST_ASSERT_TRUE(FlashWriter::putBytes("schedules", "head0", value, sizeof(value), FlashSubsystem::SCHEDULES));
+
+    // Nothing behind the failed entry overtakes it while it waits for a retry
+    delay(FLASH_RETRY_DELAY_MS / 2);
+    TEST_ASSERT_FALSE(isStored("schedules", "head0"));
+
+    TEST_ASSERT_TRUE(FlashWriter::flush(2000));
+    TEST_ASSERT_TRUE(isStored("cfgjournal", "pending"));
+    TEST_ASSERT_TRUE(isStored("schedules", "head0"));
+    TEST_ASSERT_EQUAL_UINT32(retriesBefore + 2, readMetric("squaredose_flash_commit_retries_total"));
+    TEST_ASSERT_EQUAL_UINT32(failuresBefore, readMetric("squaredose_flash_commit_failures_total"));
+}
+
+void test_commit_is_dropped_after_every_attempt_fails() {
+    uint32_t failuresBefore = readMetric("squaredose_flash_commit_failures_total");
+    uint8_t value[16] = {};
+
+    failNextWrites(FLASH_COMMIT_ATTEMPTS);
+    TEST_ASSERT_TRUE(FlashWriter::putBytes("schedules", "head0", value, sizeof(value), FlashSubsystem::SCHEDULES));
+    TEST_ASSERT_TRUE(FlashWriter::flush(FLASH_RETRY_DELAY_MS << FLASH_COMMIT_ATTEMPTS));
+
+    TEST_ASSERT_FALSE(isStored("schedules", "head0"));
+    TEST_ASSERT_EQUAL_UINT32(failuresBefore + 1, readMetric("squaredose_flash_commit_failures_total"));
+}
+
+void test_journal_is_kept_when_a_write_it_covers_is_dropped() {
+    uint8_t value[16] = {};
+    TEST_ASSERT_TRUE(FlashWriter::putBytes("cfgjournal", "pending", value, sizeof(value), FlashSubsystem::JOURNAL));
+    TEST_ASSERT_TRUE(FlashWriter::flush(2000));
+
+    failNextWrites(FLASH_COMMIT_ATTEMPTS);
+    TEST_ASSERT_TRUE(FlashWriter::putBytes("schedules", "head0", value, sizeof(value), FlashSubsystem::SCHEDULES));
+    FlashWriter::barrier();
+    TEST_ASSERT_TRUE(FlashWriter::removeIfCommitted("cfgjournal", "pending", FlashSubsystem::JOURNAL));
+    TEST_ASSERT_TRUE(FlashWriter::putBytes("schedules", "head1", value, sizeof(value), FlashSubsystem::SCHEDULES));
+    TEST_ASSERT_TRUE(FlashWriter::flush(FLASH_RETRY_DELAY_MS << FLASH_COMMIT_ATTEMPTS));
+
+    TEST_ASSERT_FALSE(isStored("schedules", "head0"));
+    TEST_ASSERT_TRUE(isStored("cfgjournal", "pending"));
+    TEST_ASSERT_TRUE(FlashWriter::hasKey("cfgjournal", "pending"));
+
+    // Plain writes behind the dropped one still commit
+    TEST_ASSERT_TRUE(isStored("schedules", "head1"));
+}
+
+void test_key_list_is_removed_as_one_entry() {
+    queueDoseLogs(3);
+    TEST_ASSERT_TRUE(FlashWriter::flush(2000));
+
+    // h0-h2 are in flash, h3 is pending, h4 was never written
+    uint8_t log[32] = {};
+    FlashWriter::holdCommits();
+    TEST_ASSERT_TRUE(FlashWriter::putBytes("dosinglogs", "h3", log, sizeof(log), FlashSubsystem::LOGS));
+
+    const char keys[] = "h0\0h1\0h2\0h3\0h4";
+    TEST_ASSERT_EQUAL(4, FlashWriter::countKeys("dosinglogs", keys, sizeof(keys)));
+
+    uint32_t commitsBefore = readMetric("squaredose_flash_commits_total");
+    TEST_ASSERT_TRUE(FlashWriter::removeKeys("dosinglogs", keys, sizeof(keys), FlashSubsystem::LOGS));
+    TEST_ASSERT_EQUAL(0, FlashWriter::countKeys("dosinglogs", keys, sizeof(keys)));
+    TEST_ASSERT_FALSE(FlashWriter::hasKey("dosinglogs", "h3"));
+
+    // A write after the removal is not merged into the write before it
+    TEST_ASSERT_TRUE(FlashWriter::putBytes("dosinglogs", "h3", log, sizeof(log), FlashSubsystem::LOGS));
+    TEST_ASSERT_TRUE(FlashWriter::hasKey("dosinglogs", "h3"));
+
+    FlashWriter::releaseCommits();
+    TEST_ASSERT_TRUE(FlashWriter::flush(2000));
+    TEST_ASSERT_FALSE(isStored("dosinglogs", "h0"));
+    TEST_ASSERT_FALSE(isStored("dosinglogs", "h2"));
+    TEST_ASSERT_TRUE(isStored("dosinglogs", "h3"));
+    TEST_ASSERT_EQUAL_UINT32(commitsBefore + 3, readMetric("squaredose_flash_commits_total"));
+}
+
+int main(int argc, char** argv) {
+    FlashWriter::begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_batch_is_queued_while_a_dose_holds_commits);
+    RUN_TEST(test_batch_waits_for_the_dose_when_the_queue_is_full);
+    RUN_TEST(test_reserved_entries_are_kept_for_the_owner);
+    RUN_TEST(test_failed_commit_is_retried_in_order);
+    RUN_TEST(test_commit_is_dropped_after_every_attempt_fails);
+    RUN_TEST(test_journal_is_kept_when_a_write_it_covers_is_dropped);
+    RUN_TEST(test_key_list_is_removed_as_one_entry);
+    return UNITY_END();
+}
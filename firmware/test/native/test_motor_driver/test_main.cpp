@@ -0,0 +1,171 @@
+#include <unity.h>
+#include <random>
+#include <thread>
+#include <vector>
+#include "hal/MotorDriver.h"
+
+// Races start/stop/brake/emergency stop from several host threads against
+// MotorDriver's spinlocks, then checks that pins and state still agree.
+
+static const int WORKER_THREADS = 4;
+static const int OPERATIONS_PER_THREAD = 20000;
+
+static const uint8_t motorPins[NUM_MOTORS][3] = {
+    {MOTOR1_IN1_PIN, MOTOR1_IN2_PIN, MOTOR1_PWM_PIN},
+    {MOTOR2_IN1_PIN, MOTOR2_IN2_PIN, MOTOR2_PWM_PIN},
+    {MOTOR3_IN1_PIN, MOTOR3_IN2_PIN, MOTOR3_PWM_PIN},
+    {MOTOR4_IN1_PIN, MOTOR4_IN2_PIN, MOTOR4_PWM_PIN},
+};
+
+static MotorDriver* driver;
+
+void setUp() {
+    shimGpioOutput().store(0);
+    driver = new MotorDriver();
+    driver->begin();
+}
+
+void tearDown() {
+    delete driver;
+}
+
+static bool isRunningDirection(MotorDirection direction) {
+    return direction == MotorDirection::FORWARD || direction == MotorDirection::REVERSE;
+}
+
+static void assertPinsMatchState(uint8_t motor) {
+    MotorState state = driver->getMotorState(motor);
+    int in1 = digitalRead(motorPins[motor][0]);
+    int in2 = digitalRead(motorPins[motor][1]);
+    int pwm = digitalRead(motorPins[motor][2]);
+
+    switch (state.direction) {
+        case MotorDirection::FORWARD:
+            TEST_ASSERT_TRUE(in1 == HIGH && in2 == LOW && pwm == HIGH);
+            break;
+        case MotorDirection::REVERSE:
+            TEST_ASSERT_TRUE(in1 == LOW && in2 == HIGH && pwm == HIGH);
+            break;
+        case MotorDirection::BRAKE:
+            TEST_ASSERT_TRUE(in1 == HIGH && in2 == HIGH && pwm == HIGH);
+            break;
+        case MotorDirection::STOP:
+            TEST_ASSERT_TRUE(in1 == LOW && in2 == LOW && pwm == LOW);
+            break;
+    }
+    TEST_ASSERT_EQUAL(isRunningDirection(state.direction), state.isRunning);
+}
+
+static void runRandomOperations(unsigned seed, bool withEmergencyStops) {
+    std::mt19937 rng(seed);
+    for (int n = 0; n < OPERATIONS_PER_THREAD; n++) {
+        uint8_t motor = rng() % NUM_MOTORS;
+        uint8_t mask = 1 + rng() % ((1 << NUM_MOTORS) - 1);
+        MotorDirection direction = (rng() & 1) ? MotorDirection::FORWARD : MotorDirection::REVERSE;
+
+        switch (rng() % (withEmergencyStops ? 6 : 5)) {
+            case 0: driver->startMotor(motor, direction); break;
+            case 1: driver->stopMotor(motor); break;
+            case 2: driver->brakeMotor(motor); break;
+            case 3: driver->startMotors(mask, direction); break;
+            case 4: driver->stopMotors(mask); break;
+            case 5: driver->emergencyStopAll(); break;
+        }
+    }
+}
+
+/**
+ * Snapshot reader racing the writers: a state must never be half-written
+ * (running with a stopped direction or the other way round)
+ */
+static void readSnapshots(const std::atomic<bool>& done, std::atomic<uint32_t>& tornReads) {
+    while (!done.load()) {
+        for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+            MotorState state = driver->getMotorState(i);
+            if (state.isRunning != isRunningDirection(state.direction)) {
+                tornReads.fetch_add(1);
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+static void runStress(bool withEmergencyStops) {
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> tornReads(0);
+    std::thread reader(readSnapshots, std::cref(done), std::ref(tornReads));
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < WORKER_THREADS; t++) {
+        workers.emplace_back(runRandomOperations, 1000 + t, withEmergencyStops);
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+
+    done.store(true);
+    reader.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, tornReads.load());
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        assertPinsMatchState(i);
+    }
+}
+
+void test_concurrent_start_stop_keeps_pins_and_state_in_sync() {
+    runStress(false);
+}
+
+void test_concurrent_emergency_stop_keeps_pins_and_state_in_sync() {
+    runStress(true);
+
+    // A running motor needs STBY high: an emergency stop never leaves one behind
+    bool anyRunning = false;
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        anyRunning = anyRunning || driver->isMotorRunning(i);
+    }
+    TEST_ASSERT_EQUAL(driver->isStandbyEnabled(), digitalRead(MOTOR_STBY_PIN) == HIGH);
+    if (anyRunning) {
+        TEST_ASSERT_TRUE(driver->isStandbyEnabled());
+    }
+}
+
+void test_emergency_stop_during_starts_brakes_everything() {
+    std::atomic<bool> done(false);
+    std::vector<std::thread> starters;
+    for (int t = 0; t < WORKER_THREADS; t++) {
+        starters.emplace_back([t, &done]() {
+            uint8_t motor = t % NUM_MOTORS;
+            while (!done.load()) {
+                driver->startMotor(motor, MotorDirection::FORWARD);
+                driver->stopMotor(motor);
+            }
+        });
+    }
+
+    // Once starters have quit, the last emergency stop must leave every motor braked
+    for (int n = 0; n < 1000; n++) {
+        driver->emergencyStopAll();
+    }
+    done.store(true);
+    for (size_t t = 0; t < starters.size(); t++) {
+        starters[t].join();
+    }
+    driver->emergencyStopAll();
+
+    for (uint8_t i = 0; i < NUM_MOTORS; i++) {
+        TEST_ASSERT_FALSE(driver->isMotorRunning(i));
+        TEST_ASSERT_TRUE(driver->getMotorState(i).direction == MotorDirection::BRAKE);
+        assertPinsMatchState(i);
+    }
+    TEST_ASSERT_FALSE(driver->isStandbyEnabled());
+    TEST_ASSERT_EQUAL(LOW, digitalRead(MOTOR_STBY_PIN));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_concurrent_start_stop_keeps_pins_and_state_in_sync);
+    RUN_TEST(test_concurrent_emergency_stop_keeps_pins_and_state_in_sync);
+    RUN_TEST(test_emergency_stop_during_starts_brakes_everything);
+    return UNITY_END();
+}
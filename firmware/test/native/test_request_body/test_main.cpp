@@ -0,0 +1,226 @@
+#include <unity.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "network/RequestBodyPool.h"
+
+// Feeds RequestBodyPool::parseJsonBody() bodies split at every byte boundary
+// and in every chunk size, the way AsyncWebServerRequest hands over TCP
+// segments, and checks each split gives the same answer as the whole body.
+
+static RequestBodyPool* pool;
+
+void setUp() {
+    pool = new RequestBodyPool();
+}
+
+void tearDown() {
+    delete pool;
+}
+
+struct FeedOutcome {
+    JsonBodyResult answer;  // First result that is not INCOMPLETE/IGNORED
+    int answers;            // How many chunks produced an answer (must be 1)
+    std::string parsed;     // Serialized document when PARSED
+};
+
+static bool isAnswer(JsonBodyResult result) {
+    return result != JsonBodyResult::INCOMPLETE && result != JsonBodyResult::IGNORED;
+}
+
+/**
+ * Feed a body as the given chunks (lengths summing to the body length)
+ */
+static FeedOutcome feed(const std::string& body, const std::vector<size_t>& chunks) {
+    FeedOutcome outcome = {JsonBodyResult::INCOMPLETE, 0, ""};
+    void* slot = nullptr;
+    JsonDocument doc;
+    size_t index = 0;
+
+    for (size_t c = 0; c < chunks.size(); c++) {
+        DeserializationError error;
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(body.data()) + index;
+        JsonBodyResult result = pool->parseJsonBody(slot, data, chunks[c], index, body.size(), doc, error);
+        index += chunks[c];
+
+        if (isAnswer(result)) {
+            outcome.answers++;
+            if (outcome.answers == 1) {
+                outcome.answer = result;
+            }
+        }
+        if (result == JsonBodyResult::PARSED) {
+            serializeJson(doc, outcome.parsed);
+        }
+        if (result == JsonBodyResult::INVALID_JSON) {
+            TEST_ASSERT_TRUE(static_cast<bool>(error));
+        }
+    }
+
+    // No pooled buffer may stay attached once the body is finished
+    TEST_ASSERT_NULL(slot);
+    return outcome;
+}
+
+static FeedOutcome feedWhole(const std::string& body) {
+    return feed(body, std::vector<size_t>(1, body.size()));
+}
+
+/**
+ * Every two-chunk split, then every uniform chunk size, must match the whole body
+ */
+static void checkEverySplit(const std::string& body, JsonBodyResult expected) {
+    FeedOutcome whole = feedWhole(body);
+    TEST_ASSERT_EQUAL(static_cast<int>(expected), static_cast<int>(whole.answer));
+    TEST_ASSERT_EQUAL(1, whole.answers);
+
+    for (size_t split = 1; split < body.size(); split++) {
+        std::vector<size_t> chunks;
+        chunks.push_back(split);
+        chunks.push_back(body.size() - split);
+
+        FeedOutcome outcome = feed(body, chunks);
+        TEST_ASSERT_EQUAL_MESSAGE(static_cast<int>(expected), static_cast<int>(outcome.answer), "two-chunk split");
+        TEST_ASSERT_EQUAL(1, outcome.answers);
+        TEST_ASSERT_TRUE(outcome.parsed == whole.parsed);
+    }
+
+    for (size_t size = 1; size < body.size(); size++) {
+        std::vector<size_t> chunks;
+        for (size_t offset = 0; offset < body.size(); offset += size) {
+            chunks.push_back(std::min(size, body.size() - offset));
+        }
+
+        FeedOutcome outcome = feed(body, chunks);
+        TEST_ASSERT_EQUAL_MESSAGE(static_cast<int>(expected), static_cast<int>(outcome.answer), "uniform chunks");
+        TEST_ASSERT_EQUAL(1, outcome.answers);
+        TEST_ASSERT_TRUE(outcome.parsed == whole.parsed);
+    }
+}
+
+/**
+ * A body shaped like POST /api/batch, close to the size limit
+ */
+static std::string batchBody() {
+    std::string body = "{\"operations\":[";
+    for (int i = 0; body.size() < WEB_MAX_REQUEST_BODY_SIZE - 200; i++) {
+        if (i > 0) {
+            body += ",";
+        }
+        body += "{\"op\":\"setSchedule\",\"head\":" + std::to_string(i % 4) +
+                ",\"enabled\":true,\"dailyTargetVolume\":12.5,\"dosesPerDay\":" + std::to_string(1 + i % 24) + "}";
+    }
+    body += "]}";
+    return body;
+}
+
+void test_small_body_parses_at_every_split() {
+    checkEverySplit("{\"head\":0,\"volume\":1.5}", JsonBodyResult::PARSED);
+}
+
+void test_batch_body_parses_at_every_split() {
+    checkEverySplit(batchBody(), JsonBodyResult::PARSED);
+}
+
+void test_body_at_size_limit_parses_at_every_split() {
+    std::string body = "{\"pad\":\"";
+    body.append(WEB_MAX_REQUEST_BODY_SIZE - body.size() - 2, 'x');
+    body += "\"}";
+    TEST_ASSERT_EQUAL(WEB_MAX_REQUEST_BODY_SIZE, body.size());
+    checkEverySplit(body, JsonBodyResult::PARSED);
+}
+
+void test_empty_body_is_rejected() {
+    FeedOutcome outcome = feedWhole("");
+    TEST_ASSERT_EQUAL(static_cast<int>(JsonBodyResult::INVALID_JSON), static_cast<int>(outcome.answer));
+    TEST_ASSERT_EQUAL(1, outcome.answers);
+}
+
+void test_whitespace_body_is_rejected_at_every_split() {
+    checkEverySplit("  \r\n ", JsonBodyResult::INVALID_JSON);
+}
+
+void test_oversized_body_is_rejected_once_at_every_split() {
+    std::string body = "{\"pad\":\"";
+    body.append(WEB_MAX_REQUEST_BODY_SIZE, 'x');
+    body += "\"}";
+    checkEverySplit(body, JsonBodyResult::TOO_LARGE);
+}
+
+void test_malformed_body_is_rejected_at_every_split() {
+    checkEverySplit("{\"head\":0,\"volume\":}", JsonBodyResult::INVALID_JSON);
+}
+
+void test_truncated_body_is_rejected_at_every_split() {
+    checkEverySplit("{\"head\":0,\"volume\":1.5", JsonBodyResult::INVALID_JSON);
+}
+
+void test_gap_in_chunks_is_rejected_and_releases_buffer() {
+    const std::string body = "{\"head\":0,\"volume\":1.5}";
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(body.data());
+    void* slot = nullptr;
+    JsonDocument doc;
+    DeserializationError error;
+
+    TEST_ASSERT_EQUAL(static_cast<int>(JsonBodyResult::INCOMPLETE),
+                      static_cast<int>(pool->parseJsonBody(slot, data, 5, 0, body.size(), doc, error)));
+    TEST_ASSERT_NOT_NULL(slot);
+
+    // Skips bytes 5-9
+    TEST_ASSERT_EQUAL(static_cast<int>(JsonBodyResult::OUT_OF_ORDER),
+                      static_cast<int>(pool->parseJsonBody(slot, data + 10, 5, 10, body.size(), doc, error)));
+    TEST_ASSERT_NULL(slot);
+
+    // The rest of the stream is ignored, not answered again
+    TEST_ASSERT_EQUAL(static_cast<int>(JsonBodyResult::IGNORED),
+                      static_cast<int>(pool->parseJsonBody(slot, data + 15, body.size() - 15, 15, body.size(), doc, error)));
+}
+
+void test_exhausted_pool_rejects_new_body_once() {
+    const std::string body = "{\"head\":0,\"volume\":1.5}";
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(body.data());
+    void* slots[WEB_BODY_BUFFER_COUNT + 1] = {};
+    JsonDocument doc;
+    DeserializationError error;
+
+    // Hold every buffer with a half-received body
+    for (uint8_t i = 0; i < WEB_BODY_BUFFER_COUNT; i++) {
+        TEST_ASSERT_EQUAL(static_cast<int>(JsonBodyResult::INCOMPLETE),
+                          static_cast<int>(pool->parseJsonBody(slots[i], data, 4, 0, body.size(), doc, error)));
+    }
+
+    void*& extra = slots[WEB_BODY_BUFFER_COUNT];
+    TEST_ASSERT_EQUAL(static_cast<int>(JsonBodyResult::NO_BUFFER),
+                      static_cast<int>(pool->parseJsonBody(extra, data, 4, 0, body.size(), doc, error)));
+    TEST_ASSERT_EQUAL(static_cast<int>(JsonBodyResult::IGNORED),
+                      static_cast<int>(pool->parseJsonBody(extra, data + 4, body.size() - 4, 4, body.size(), doc, error)));
+    TEST_ASSERT_EQUAL_UINT32(1, pool->getExhaustedCount());
+
+    // Finishing one body frees its buffer for the next
+    TEST_ASSERT_EQUAL(static_cast<int>(JsonBodyResult::PARSED),
+                      static_cast<int>(pool->parseJsonBody(slots[0], data + 4, body.size() - 4, 4, body.size(), doc, error)));
+    TEST_ASSERT_NULL(slots[0]);
+    TEST_ASSERT_EQUAL(static_cast<int>(JsonBodyResult::INCOMPLETE),
+                      static_cast<int>(pool->parseJsonBody(extra, data, 4, 0, body.size(), doc, error)));
+
+    // Disconnects release what is left
+    for (uint8_t i = 0; i <= WEB_BODY_BUFFER_COUNT; i++) {
+        pool->release(slots[i]);
+        TEST_ASSERT_NULL(slots[i]);
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_small_body_parses_at_every_split);
+    RUN_TEST(test_batch_body_parses_at_every_split);
+    RUN_TEST(test_body_at_size_limit_parses_at_every_split);
+    RUN_TEST(test_empty_body_is_rejected);
+    RUN_TEST(test_whitespace_body_is_rejected_at_every_split);
+    RUN_TEST(test_oversized_body_is_rejected_once_at_every_split);
+    RUN_TEST(test_malformed_body_is_rejected_at_every_split);
+    RUN_TEST(test_truncated_body_is_rejected_at_every_split);
+    RUN_TEST(test_gap_in_chunks_is_rejected_and_releases_buffer);
+    RUN_TEST(test_exhausted_pool_rejects_new_body_once);
+    return UNITY_END();
+}
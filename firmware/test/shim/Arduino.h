@@ -0,0 +1,125 @@
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core the native tests compile
+// against. GPIO writes land in a simulated output register (bit n = GPIO n)
+// that soc/gpio_struct.h writes too, so tests can check pin levels.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "freertos/FreeRTOS.h"
+
+#define IRAM_ATTR
+
+#define LOW 0
+#define HIGH 1
+#define OUTPUT 0x03
+
+inline uint64_t shimMicros() {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline unsigned long millis() {
+    return static_cast<unsigned long>(shimMicros() / 1000);
+}
+
+inline unsigned long micros() {
+    return static_cast<unsigned long>(shimMicros());
+}
+
+inline void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline std::atomic<uint64_t>& shimGpioOutput() {
+    static std::atomic<uint64_t> output(0);
+    return output;
+}
+
+inline void pinMode(uint8_t, uint8_t) {
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+    if (level) {
+        shimGpioOutput().fetch_or(1ULL << pin);
+    } else {
+        shimGpioOutput().fetch_and(~(1ULL << pin));
+    }
+}
+
+inline int digitalRead(uint8_t pin) {
+    return (shimGpioOutput().load() >> pin) & 1;
+}
+
+class String {
+public:
+    String(const char* text = "") : value(text != nullptr ? text : "") {}
+    explicit String(int number) : value(std::to_string(number)) {}
+    explicit String(unsigned int number) : value(std::to_string(number)) {}
+    explicit String(unsigned long number) : value(std::to_string(number)) {}
+    explicit String(float number) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.2f", number);
+        value = text;
+    }
+
+    const char* c_str() const { return value.c_str(); }
+    size_t length() const { return value.size(); }
+    bool operator==(const char* other) const { return value == other; }
+
+    String& operator+=(const String& other) {
+        value += other.value;
+        return *this;
+    }
+
+    friend String operator+(String left, const String& right) { return left += right; }
+    friend String operator+(const char* left, const String& right) { return String(left) += right; }
+
+private:
+    std::string value;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+
+    size_t write(const char* text, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            write(static_cast<uint8_t>(text[i]));
+        }
+        return length;
+    }
+
+    size_t print(const char* text) { return write(text, strlen(text)); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length < 0) {
+            return 0;
+        }
+        return write(buffer, (static_cast<size_t>(length) < sizeof(buffer)) ? length : sizeof(buffer) - 1);
+    }
+};
+
+class EspClass {
+public:
+    uint32_t getCycleCount() { return static_cast<uint32_t>(shimMicros() * getCpuFreqMHz()); }
+    uint32_t getCpuFreqMHz() { return 240; }
+};
+
+static EspClass ESP __attribute__((unused));
+
+#endif // SHIM_ARDUINO_H
@@ -0,0 +1,47 @@
+#ifndef SHIM_ESP_ASYNC_WEB_SERVER_H
+#define SHIM_ESP_ASYNC_WEB_SERVER_H
+
+// Host stand-in for the parts of ESPAsyncWebServer that ApiRouter uses: a
+// request with a method, URL and content length, and the handler interface
+
+#include <Arduino.h>
+
+typedef enum {
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServerRequest {
+public:
+    AsyncWebServerRequest(WebRequestMethodComposite method, const char* url, size_t contentLength = 0)
+        : requestMethod(method), requestUrl(url), length(contentLength) {}
+
+    WebRequestMethodComposite method() const { return requestMethod; }
+    const String& url() const { return requestUrl; }
+    size_t contentLength() const { return length; }
+    void addInterestingHeader(const String&) {}
+
+private:
+    WebRequestMethodComposite requestMethod;
+    String requestUrl;
+    size_t length;
+};
+
+class AsyncWebHandler {
+public:
+    virtual ~AsyncWebHandler() {}
+    virtual bool canHandle(AsyncWebServerRequest*) { return false; }
+    virtual void handleRequest(AsyncWebServerRequest*) {}
+    virtual void handleBody(AsyncWebServerRequest*, uint8_t*, size_t, size_t, size_t) {}
+    virtual bool isRequestHandlerTrivial() { return true; }
+};
+
+#endif // SHIM_ESP_ASYNC_WEB_SERVER_H
@@ -0,0 +1,160 @@
+#ifndef SHIM_PREFERENCES_H
+#define SHIM_PREFERENCES_H
+
+// Host stand-in for the Arduino NVS Preferences library. Values live in a
+// process-wide map; tests can inspect it, count writes and make the next
+// writes fail, the way a full or worn NVS partition does.
+
+#include <Arduino.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+struct ShimNvs {
+    std::mutex mutex;
+    std::map<std::string, std::map<std::string, std::vector<uint8_t>>> namespaces;
+    uint32_t writes;      // Successful puts, removes and clears
+    uint32_t failWrites;  // Writes still to fail
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        namespaces.clear();
+        writes = 0;
+        failWrites = 0;
+    }
+};
+
+inline ShimNvs& shimNvs() {
+    static ShimNvs nvs;
+    return nvs;
+}
+
+class Preferences {
+public:
+    Preferences() : readOnly(true), open(false) {}
+
+    bool begin(const char* name, bool readOnlyMode) {
+        ShimNvs& nvs = shimNvs();
+        std::lock_guard<std::mutex> lock(nvs.mutex);
+        // A read-only open fails until the namespace has been written once
+        if (readOnlyMode && nvs.namespaces.count(name) == 0) {
+            return false;
+        }
+        ns = name;
+        readOnly = readOnlyMode;
+        open = true;
+        return true;
+    }
+
+    void end() { open = false; }
+
+    bool isKey(const char* key) {
+        ShimNvs& nvs = shimNvs();
+        std::lock_guard<std::mutex> lock(nvs.mutex);
+        return open && nvs.namespaces.count(ns) > 0 && nvs.namespaces[ns].count(key) > 0;
+    }
+
+    size_t putBytes(const char* key, const void* value, size_t length) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(value);
+        return store(key, std::vector<uint8_t>(bytes, bytes + length)) ? length : 0;
+    }
+
+    size_t putUShort(const char* key, uint16_t value) { return putBytes(key, &value, sizeof(value)); }
+
+    size_t putString(const char* key, const char* value) {
+        return store(key, std::vector<uint8_t>(value, value + strlen(value) + 1)) ? strlen(value) : 0;
+    }
+
+    size_t getBytes(const char* key, void* buffer, size_t maxLength) {
+        std::vector<uint8_t> value;
+        if (!load(key, value) || value.size() > maxLength) {
+            return 0;
+        }
+        memcpy(buffer, value.data(), value.size());
+        return value.size();
+    }
+
+    uint16_t getUShort(const char* key, uint16_t defaultValue) {
+        uint16_t value = defaultValue;
+        return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+    }
+
+    float getFloat(const char* key, float defaultValue) {
+        float value = defaultValue;
+        return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+    }
+
+    bool getBool(const char* key, bool defaultValue) {
+        uint8_t value = defaultValue;
+        return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value != 0 : defaultValue;
+    }
+
+    uint32_t getULong(const char* key, uint32_t defaultValue) {
+        uint32_t value = defaultValue;
+        return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+    }
+
+    String getString(const char* key, const char* defaultValue) {
+        std::vector<uint8_t> value;
+        return load(key, value) ? String(reinterpret_cast<const char*>(value.data())) : String(defaultValue);
+    }
+
+    bool remove(const char* key) {
+        ShimNvs& nvs = shimNvs();
+        std::lock_guard<std::mutex> lock(nvs.mutex);
+        if (!writable(nvs)) {
+            return false;
+        }
+        return nvs.namespaces[ns].erase(key) > 0;
+    }
+
+    bool clear() {
+        ShimNvs& nvs = shimNvs();
+        std::lock_guard<std::mutex> lock(nvs.mutex);
+        if (!writable(nvs)) {
+            return false;
+        }
+        nvs.namespaces[ns].clear();
+        return true;
+    }
+
+private:
+    std::string ns;
+    bool readOnly;
+    bool open;
+
+    // Mutex must be held; counts the write or uses up an injected failure
+    bool writable(ShimNvs& nvs) {
+        if (!open || readOnly) {
+            return false;
+        }
+        if (nvs.failWrites > 0) {
+            nvs.failWrites--;
+            return false;
+        }
+        nvs.writes++;
+        return true;
+    }
+
+    bool store(const char* key, const std::vector<uint8_t>& value) {
+        ShimNvs& nvs = shimNvs();
+        std::lock_guard<std::mutex> lock(nvs.mutex);
+        if (!writable(nvs)) {
+            return false;
+        }
+        nvs.namespaces[ns][key] = value;
+        return true;
+    }
+
+    bool load(const char* key, std::vector<uint8_t>& value) {
+        ShimNvs& nvs = shimNvs();
+        std::lock_guard<std::mutex> lock(nvs.mutex);
+        if (!open || nvs.namespaces.count(ns) == 0 || nvs.namespaces[ns].count(key) == 0) {
+            return false;
+        }
+        value = nvs.namespaces[ns][key];
+        return true;
+    }
+};
+
+#endif // SHIM_PREFERENCES_H
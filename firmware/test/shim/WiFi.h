@@ -0,0 +1,15 @@
+#ifndef SHIM_WIFI_H
+#define SHIM_WIFI_H
+
+// Host stand-in for WiFi.h: config headers only reference its names in macros,
+// and PowerManager.h only needs the modem sleep type
+
+#include <Arduino.h>
+
+typedef enum {
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+#endif // SHIM_WIFI_H
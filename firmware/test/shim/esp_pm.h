@@ -0,0 +1,8 @@
+#ifndef SHIM_ESP_PM_H
+#define SHIM_ESP_PM_H
+
+// Host stand-in for the ESP-IDF power management lock type
+
+typedef struct esp_pm_lock* esp_pm_lock_handle_t;
+
+#endif // SHIM_ESP_PM_H
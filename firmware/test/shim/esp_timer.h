@@ -0,0 +1,12 @@
+#ifndef SHIM_ESP_TIMER_H
+#define SHIM_ESP_TIMER_H
+
+// Host stand-in for the ESP-IDF microsecond timer
+
+#include <Arduino.h>
+
+inline int64_t esp_timer_get_time() {
+    return static_cast<int64_t>(shimMicros());
+}
+
+#endif // SHIM_ESP_TIMER_H
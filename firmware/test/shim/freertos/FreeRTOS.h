@@ -0,0 +1,40 @@
+#ifndef SHIM_FREERTOS_H
+#define SHIM_FREERTOS_H
+
+// Host stand-in for the FreeRTOS port primitives and types used by the native
+// tests. Critical sections are real spinlocks, so code under test can race on
+// host threads.
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms))
+
+struct portMUX_TYPE {
+    std::atomic_flag locked;
+};
+
+inline void portMUX_INITIALIZE(portMUX_TYPE* mux) {
+    mux->locked.clear();
+}
+
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) {
+    while (mux->locked.test_and_set(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+    mux->locked.clear(std::memory_order_release);
+}
+
+#endif // SHIM_FREERTOS_H
@@ -0,0 +1,67 @@
+#ifndef SHIM_FREERTOS_SEMPHR_H
+#define SHIM_FREERTOS_SEMPHR_H
+
+// Host stand-in for statically allocated FreeRTOS mutexes (not recursive) and
+// binary semaphores. A binary semaphore may be given from any thread.
+
+#include "freertos/FreeRTOS.h"
+#include <condition_variable>
+#include <mutex>
+
+struct StaticSemaphore_t {
+    std::timed_mutex mutex;
+    bool binary;
+    std::mutex signalMutex;
+    std::condition_variable signalled;
+    bool available;
+};
+
+typedef StaticSemaphore_t* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer) {
+    buffer->binary = false;
+    return buffer;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buffer) {
+    buffer->binary = true;
+    buffer->available = false;  // Created empty, as on FreeRTOS
+    return buffer;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    if (semaphore->binary) {
+        std::unique_lock<std::mutex> lock(semaphore->signalMutex);
+        if (ticks == portMAX_DELAY) {
+            semaphore->signalled.wait(lock, [semaphore]() { return semaphore->available; });
+        } else if (!semaphore->signalled.wait_for(lock, std::chrono::milliseconds(ticks),
+                                                  [semaphore]() { return semaphore->available; })) {
+            return pdFALSE;
+        }
+        semaphore->available = false;
+        return pdTRUE;
+    }
+
+    if (ticks == portMAX_DELAY) {
+        semaphore->mutex.lock();
+        return pdTRUE;
+    }
+    return semaphore->mutex.try_lock_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    if (semaphore->binary) {
+        std::lock_guard<std::mutex> lock(semaphore->signalMutex);
+        if (semaphore->available) {
+            return pdFALSE;
+        }
+        semaphore->available = true;
+        semaphore->signalled.notify_one();
+        return pdTRUE;
+    }
+
+    semaphore->mutex.unlock();
+    return pdTRUE;
+}
+
+#endif // SHIM_FREERTOS_SEMPHR_H
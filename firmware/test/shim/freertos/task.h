@@ -0,0 +1,80 @@
+#ifndef SHIM_FREERTOS_TASK_H
+#define SHIM_FREERTOS_TASK_H
+
+// Host stand-in for FreeRTOS tasks: a task is a detached host thread, and
+// direct-to-task notifications are a counter behind a condition variable.
+// Ticks are milliseconds (configTICK_RATE_HZ 1000, as on the ESP32).
+
+#include "freertos/FreeRTOS.h"
+#include <condition_variable>
+#include <mutex>
+
+struct ShimNotification {
+    std::mutex mutex;
+    std::condition_variable notified;
+    uint32_t count;
+};
+
+// Never freed: a detached task thread may still be waiting on it at exit
+struct StaticTask_t {
+    ShimNotification* notification;
+};
+
+typedef StaticTask_t* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+inline TaskHandle_t& shimCurrentTask() {
+    // Threads that are not shim tasks still get a handle of their own
+    static thread_local StaticTask_t self = {new ShimNotification()};
+    static thread_local TaskHandle_t current = &self;
+    return current;
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return shimCurrentTask();
+}
+
+inline TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char*, uint32_t, void* parameters, UBaseType_t,
+                                      StackType_t*, StaticTask_t* task) {
+    task->notification = new ShimNotification();
+    task->notification->count = 0;
+    std::thread([function, parameters, task]() {
+        shimCurrentTask() = task;
+        function(parameters);
+    }).detach();
+    return task;
+}
+
+inline void xTaskNotifyGive(TaskHandle_t task) {
+    ShimNotification* notification = task->notification;
+    std::lock_guard<std::mutex> lock(notification->mutex);
+    notification->count++;
+    notification->notified.notify_one();
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    ShimNotification* notification = shimCurrentTask()->notification;
+    std::unique_lock<std::mutex> lock(notification->mutex);
+    if (ticks == portMAX_DELAY) {
+        notification->notified.wait(lock, [notification]() { return notification->count > 0; });
+    } else {
+        notification->notified.wait_for(lock, std::chrono::milliseconds(ticks),
+                                        [notification]() { return notification->count > 0; });
+    }
+
+    uint32_t count = notification->count;
+    if (count > 0) {
+        notification->count = clearOnExit ? 0 : count - 1;
+    }
+    return count;
+}
+
+inline void vTaskDelete(TaskHandle_t) {
+    // The task function returning ends its thread
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+#endif // SHIM_FREERTOS_TASK_H
@@ -0,0 +1,39 @@
+#ifndef SHIM_GPIO_STRUCT_H
+#define SHIM_GPIO_STRUCT_H
+
+// Host stand-in for the ESP32-S3 GPIO set/clear registers. Writes update the
+// simulated output register from Arduino.h atomically, like W1TS/W1TC do, and
+// yield so host threads interleave inside multi-register updates.
+
+#include <Arduino.h>
+
+struct ShimGpioWrite {
+    bool set;       // W1TS (true) or W1TC (false)
+    uint8_t shift;  // 0 for GPIO 0-31, 32 for GPIO 32-48
+
+    void operator=(uint32_t bits) {
+        uint64_t mask = static_cast<uint64_t>(bits) << shift;
+        if (set) {
+            shimGpioOutput().fetch_or(mask);
+        } else {
+            shimGpioOutput().fetch_and(~mask);
+        }
+        // Give other threads a chance to run between register writes
+        std::this_thread::yield();
+    }
+};
+
+struct ShimGpioHighWrite {
+    ShimGpioWrite val;
+};
+
+struct ShimGpioDev {
+    ShimGpioWrite out_w1ts;
+    ShimGpioWrite out_w1tc;
+    ShimGpioHighWrite out1_w1ts;
+    ShimGpioHighWrite out1_w1tc;
+};
+
+static ShimGpioDev GPIO = {{true, 0}, {false, 0}, {{true, 32}}, {{false, 32}}};
+
+#endif // SHIM_GPIO_STRUCT_H